@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../include/StatParser.h"
+#include "../include/StatGenerator.h"
+#include "../include/Logger.h"
+
+static const size_t CPU_COUNTS[] = {8, 128, 4096};
+static const double BENCH_SECONDS_PER_CASE = 1.0;
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+//The Analyzer's parsing path before StatParser: strlen plus a three character scan to count the cpu lines, then
+//strtok and a ten field sscanf per line.
+static size_t legacy_parse(char input[], CpuData rows[]) {
+    size_t cpu_count = 0;
+    size_t parse_length = strlen(input);
+    for (size_t i = 2; i < parse_length; i++) {
+        if (input[i - 2] == 'c' && input[i - 1] == 'p' && input[i] == 'u') {
+            cpu_count++;
+        }
+    }
+
+    char *token = strtok(input, "\n");
+    for (size_t i = 0; i < cpu_count && token != NULL; i++) {
+        unsigned long long int user, nice, system, idle, io_wait, irq, soft_irq, steal, guest, guest_nice;
+        sscanf(token, "%*s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle,
+               &io_wait, &irq, &soft_irq, &steal, &guest, &guest_nice);
+        user -= guest;
+        nice -= guest_nice;
+        rows[i] = (CpuData) {
+                .idle_time = idle + io_wait,
+                .total_time = user + nice + system + irq + soft_irq + idle + io_wait + steal + guest + guest_nice
+        };
+        token = strtok(NULL, "\n");
+    }
+    return cpu_count;
+}
+
+//Both paths parse from a fresh copy of the snapshot, strtok is destructive.
+static double bench_case(const char snapshot[], const size_t length, char scratch[], CpuData rows[],
+                         const size_t capacity, const int legacy, size_t *const iterations) {
+    unsigned long long int checksum = 0;
+    size_t count = 0;
+    double start = monotonic_seconds();
+    double now = start;
+    while (now - start < BENCH_SECONDS_PER_CASE) {
+        for (size_t i = 0; i < 16; i++) {
+            memcpy(scratch, snapshot, length + 1);
+            size_t parsed = legacy ? legacy_parse(scratch, rows) : stat_parser_parse(scratch, length, rows, capacity);
+            checksum += rows[parsed - 1].total_time;
+            count++;
+        }
+        now = monotonic_seconds();
+    }
+
+    if (checksum == 0) {
+        printf("unexpected checksum\n");
+    }
+    *iterations = count;
+    return (now - start) / (double) count;
+}
+
+int main(void) {
+    printf("{\"benchmark\": \"StatParser\", \"results\": [\n");
+    for (size_t c = 0; c < sizeof(CPU_COUNTS) / sizeof(CPU_COUNTS[0]); c++) {
+        size_t cpu_count = CPU_COUNTS[c];
+        StatGenerator *generator = stat_generator_create(cpu_count, 1);
+        stat_generator_advance(generator, 100);
+
+        char probe[1];
+        size_t capacity = stat_generator_render(generator, probe, sizeof(probe)) + 1;
+        char *snapshot = malloc(capacity);
+        char *scratch = malloc(capacity);
+        CpuData *rows = malloc(sizeof(CpuData) * (cpu_count + 1));
+        if (snapshot == NULL || scratch == NULL || rows == NULL) {
+            return 1;
+        }
+        size_t length = stat_generator_render(generator, snapshot, capacity);
+
+        size_t legacy_iterations, parser_iterations;
+        double legacy = bench_case(snapshot, length, scratch, rows, cpu_count + 1, 1, &legacy_iterations);
+        double parser = bench_case(snapshot, length, scratch, rows, cpu_count + 1, 0, &parser_iterations);
+
+        printf("  {\"cpus\": %zu, \"bytes\": %zu, \"legacy_ns\": %.0f, \"parser_ns\": %.0f, \"speedup\": %.2f}%s\n",
+               cpu_count, length, legacy * 1e9, parser * 1e9, legacy / parser,
+               c + 1 < sizeof(CPU_COUNTS) / sizeof(CPU_COUNTS[0]) ? "," : "");
+
+        free(rows);
+        free(scratch);
+        free(snapshot);
+        stat_generator_destroy(generator);
+    }
+    printf("]}\n");
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,356 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/Analyzer.h"
+#include "../include/BufferPool.h"
+#include "../include/CpuIndexMap.h"
+#include "../include/FrameBroadcast.h"
+#include "../include/OutputSink.h"
+#include "../include/Queue.h"
+#include "../include/Reader.h"
+#include "../include/ReaderSource.h"
+#include "../include/SampleFrame.h"
+#include "../include/Scheduler.h"
+#include "../include/StatGenerator.h"
+#include "../include/StatParser.h"
+#include "../include/TerminalRenderer.h"
+#include "../include/Watchdog.h"
+#include "../include/Logger.h"
+
+#define PIPELINE_QUEUE_CAPACITY 10
+
+static const size_t CPU_COUNTS[] = {1, 8, 128, 1024, 4096};
+static const double BENCH_SECONDS_PER_STAGE = 0.25;
+static const size_t BENCH_MAXIMUM_SAMPLES = 200000;
+//Ticks the generator advances between snapshots, like a busy machine sampled every 100 ms.
+static const unsigned int BENCH_TICKS_PER_SNAPSHOT = 10;
+static const size_t PIPELINE_SNAPSHOTS = 100;
+static const struct timespec PIPELINE_INTERVAL = {.tv_sec = 0, .tv_nsec = 10000000};
+static const struct timespec PIPELINE_WAIT_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0};
+static const size_t PIPELINE_BUFFER_POOL_SIZE = PIPELINE_QUEUE_CAPACITY + 2;
+static const size_t PIPELINE_BUFFER_CAPACITY = 4096;
+
+typedef struct LatencyResult {
+    size_t count;
+    double per_second;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} LatencyResult;
+
+typedef struct StageContext {
+    const char *snapshot;
+    size_t snapshot_length;
+    ReaderSource *source;
+    Buffer *buffer;
+    CpuData *rows;
+    CpuData *previous_rows;
+    size_t row_capacity;
+    size_t row_count;
+    CpuIndexMap *cpu_index_map;
+    //Filled by the diff stage, allocated once like the Analyzer's frames.
+    SampleFrame *diff_frame;
+    //Drawn in turns, so every call has changed cells to send.
+    const SampleFrame *frames[2];
+    size_t frame_index;
+    TerminalRenderer *renderer;
+    OutputSink *sink;
+} StageContext;
+
+static int compare_samples(const void *left, const void *right) {
+    uint64_t a = *(const uint64_t *) left;
+    uint64_t b = *(const uint64_t *) right;
+    return (a > b) - (a < b);
+}
+
+static LatencyResult latency_result(uint64_t samples[], const size_t count, const double seconds) {
+    qsort(samples, count, sizeof(uint64_t), compare_samples);
+    return (LatencyResult) {
+            .count = count,
+            .per_second = (double) count / seconds,
+            .p50_ns = samples[(count - 1) * 50 / 100],
+            .p90_ns = samples[(count - 1) * 90 / 100],
+            .p99_ns = samples[(count - 1) * 99 / 100],
+            .max_ns = samples[count - 1]
+    };
+}
+
+static void print_latency(const char name[], const LatencyResult *result, const char suffix[]) {
+    printf("      \"%s\": {\"count\": %zu, \"per_second\": %.0f, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+           "\"p99_ns\": %llu, \"max_ns\": %llu}%s\n", name, result->count, result->per_second,
+           (unsigned long long) result->p50_ns, (unsigned long long) result->p90_ns,
+           (unsigned long long) result->p99_ns, (unsigned long long) result->max_ns, suffix);
+}
+
+static void stage_read(StageContext *const context) {
+    if (context->source->read(context->source->context, context->buffer) != READER_SOURCE_STATUS_OK) {
+        fprintf(stderr, "unexpected read failure\n");
+    }
+}
+
+static void stage_parse(StageContext *const context) {
+    context->row_count = stat_parser_parse(context->snapshot, context->snapshot_length, context->rows,
+                                           context->row_capacity);
+}
+
+//The Analyzer's per snapshot work without its queues: slot lookup, counter diff and the frame it fills.
+static void stage_diff(StageContext *const context) {
+    const size_t *row_slots = cpu_index_map_update(context->cpu_index_map, context->rows, context->row_count);
+    SampleFrame *frame = context->diff_frame;
+    if (row_slots == NULL || cpu_index_map_get_key_count(context->cpu_index_map) - 1 > frame->cpu_count) {
+        fprintf(stderr, "unexpected diff failure\n");
+        return;
+    }
+
+    for (size_t i = 0; i < context->row_count; i++) {
+        size_t key = cpu_index_map_key(context->rows[i].cpu_id);
+        frame->utilization[key] = sample_frame_basis_points(
+                context->rows[i].idle_time - context->previous_rows[i].idle_time,
+                context->rows[i].total_time - context->previous_rows[i].total_time);
+    }
+}
+
+static void stage_render(StageContext *const context) {
+    terminal_renderer_draw(context->renderer, context->frames[context->frame_index++ % 2]);
+}
+
+//Streams include their share of the batched writes, the exposition only its formatting.
+static void stage_format(StageContext *const context) {
+    context->sink->write(context->sink->context, context->frames[context->frame_index++ % 2]);
+}
+
+static LatencyResult run_stage(void (*stage)(StageContext *), StageContext *const context, uint64_t samples[]) {
+    size_t count = 0;
+    uint64_t start = scheduler_monotonic_now_ns();
+    uint64_t end = start + (uint64_t) (BENCH_SECONDS_PER_STAGE * 1e9);
+    uint64_t now = start;
+    while (now < end && count < BENCH_MAXIMUM_SAMPLES) {
+        stage(context);
+        uint64_t after = scheduler_monotonic_now_ns();
+        samples[count++] = after - now;
+        now = after;
+    }
+    return latency_result(samples, count, (double) (now - start) / 1e9);
+}
+
+//Runs the threaded Reader and Analyzer over a replayed archive and renders every frame like the Printer. Latency
+//is measured from the Reader's timestamp, taken before the read, to the end of the render.
+static LatencyResult run_pipeline(const char archive_path[], const enum READER_SOURCE_PACING pacing,
+                                  TerminalRenderer *const renderer, uint64_t samples[]) {
+    Queue *reader_analyzer_queue = queue_create_with_mode(PIPELINE_QUEUE_CAPACITY, QUEUE_MODE_SPSC);
+    FrameBroadcast *broadcast = frame_broadcast_create(PIPELINE_QUEUE_CAPACITY);
+    BufferPool *pool = buffer_pool_create(PIPELINE_BUFFER_POOL_SIZE, PIPELINE_BUFFER_CAPACITY);
+    Watchdog *watchdog = watchdog_create(2);
+    ReaderSource source;
+    if (reader_analyzer_queue == NULL || broadcast == NULL || pool == NULL || watchdog == NULL ||
+        !reader_source_create_replay(archive_path, pacing, &source)) {
+        fprintf(stderr, "unexpected pipeline setup failure\n");
+        exit(1);
+    }
+
+    size_t subscriber = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK);
+    uint64_t start = scheduler_monotonic_now_ns();
+    Reader *reader = reader_create_with_source(reader_analyzer_queue, pool, watchdog, source, NULL,
+                                               PIPELINE_INTERVAL);
+    Analyzer *analyzer = analyzer_create(reader_analyzer_queue, broadcast, watchdog, NULL, NULL);
+
+    size_t count = 0;
+    while (true) {
+        SampleFrame *frame;
+        if (frame_broadcast_acquire_batch(broadcast, subscriber, &frame, 1) == 0) {
+            if (!frame_broadcast_wait_until_available(broadcast, subscriber, PIPELINE_WAIT_TIMEOUT)) {
+                break;
+            }
+            continue;
+        }
+
+        terminal_renderer_draw(renderer, frame);
+        samples[count++] = scheduler_monotonic_now_ns() - frame->timestamp_ns;
+        frame_broadcast_release(broadcast, subscriber);
+    }
+    double seconds = (double) (scheduler_monotonic_now_ns() - start) / 1e9;
+
+    reader_await_and_destroy(reader);
+    analyzer_await_and_destroy(analyzer);
+    watchdog_request_stop_synchronized(watchdog);
+    watchdog_await_and_destroy(watchdog);
+    buffer_pool_destroy(pool);
+    queue_destroy(reader_analyzer_queue);
+    frame_broadcast_unsubscribe(broadcast, subscriber);
+    frame_broadcast_destroy(broadcast);
+
+    if (count == 0) {
+        fprintf(stderr, "unexpected empty pipeline run\n");
+        exit(1);
+    }
+    return latency_result(samples, count, seconds);
+}
+
+static char *render_snapshot(const StatGenerator *generator, size_t *const length) {
+    char probe[1];
+    size_t capacity = stat_generator_render(generator, probe, sizeof(probe)) + 1;
+    char *snapshot = malloc(capacity);
+    if (snapshot == NULL) {
+        fprintf(stderr, "unexpected allocation failure\n");
+        exit(1);
+    }
+    *length = stat_generator_render(generator, snapshot, capacity);
+    return snapshot;
+}
+
+static void write_file(const char path[], const char content[], const size_t length, const char mode[]) {
+    FILE *file = fopen(path, mode);
+    if (file == NULL || fwrite(content, 1, length, file) != length) {
+        fprintf(stderr, "unexpected write failure\n");
+        exit(1);
+    }
+    fclose(file);
+}
+
+static void bench_cpu_count(const size_t cpu_count, const int output_fd, uint64_t samples[], const bool last) {
+    StatGenerator *generator = stat_generator_create(cpu_count, 1);
+    stat_generator_advance(generator, 100);
+    size_t previous_length;
+    char *previous_snapshot = render_snapshot(generator, &previous_length);
+    stat_generator_advance(generator, BENCH_TICKS_PER_SNAPSHOT);
+    size_t length;
+    char *snapshot = render_snapshot(generator, &length);
+
+    char snapshot_path[] = "/tmp/TietoBenchSnapshotXXXXXX";
+    char archive_path[] = "/tmp/TietoBenchArchiveXXXXXX";
+    int snapshot_fd = mkstemp(snapshot_path);
+    int archive_fd = mkstemp(archive_path);
+    if (snapshot_fd < 0 || archive_fd < 0) {
+        fprintf(stderr, "unexpected mkstemp failure\n");
+        exit(1);
+    }
+    close(snapshot_fd);
+    close(archive_fd);
+    write_file(snapshot_path, snapshot, length, "w");
+    for (size_t i = 0; i < PIPELINE_SNAPSHOTS; i++) {
+        size_t archive_length;
+        char *archive_snapshot = render_snapshot(generator, &archive_length);
+        write_file(archive_path, archive_snapshot, archive_length, "a");
+        free(archive_snapshot);
+        stat_generator_advance(generator, BENCH_TICKS_PER_SNAPSHOT);
+    }
+
+    BufferPool *pool = buffer_pool_create(1, PIPELINE_BUFFER_CAPACITY);
+    ReaderSource source;
+    StageContext context = {
+            .snapshot = snapshot,
+            .snapshot_length = length,
+            .source = &source,
+            .buffer = pool != NULL ? buffer_pool_try_acquire(pool) : NULL,
+            .rows = malloc(sizeof(CpuData) * (cpu_count + 1)),
+            .previous_rows = malloc(sizeof(CpuData) * (cpu_count + 1)),
+            .row_capacity = cpu_count + 1,
+            .cpu_index_map = cpu_index_map_create(),
+            .diff_frame = sample_frame_create(cpu_count),
+            .frame_index = 0,
+            .renderer = terminal_renderer_create(output_fd)
+    };
+    if (context.buffer == NULL || context.rows == NULL || context.previous_rows == NULL ||
+        context.cpu_index_map == NULL || context.diff_frame == NULL || context.renderer == NULL ||
+        !reader_source_create_file(snapshot_path, &source)) {
+        fprintf(stderr, "unexpected setup failure\n");
+        exit(1);
+    }
+    stat_parser_parse(previous_snapshot, previous_length, context.previous_rows, context.row_capacity);
+
+    LatencyResult read = run_stage(stage_read, &context, samples);
+    LatencyResult parse = run_stage(stage_parse, &context, samples);
+    LatencyResult diff = run_stage(stage_diff, &context, samples);
+
+    //One CPU in eight changes between the two frames, the rest is idle, like a mostly quiet large machine.
+    SampleFrame *frames[2] = {sample_frame_create(cpu_count), sample_frame_create(cpu_count)};
+    for (size_t i = 0; i <= cpu_count; i++) {
+        frames[0]->utilization[i] = i % 8 == 0 ? (uint16_t) (i * 37 % (SAMPLE_FRAME_FULL_LOAD + 1)) : 0;
+        frames[1]->utilization[i] = i % 8 == 0 ? (uint16_t) (i * 53 % (SAMPLE_FRAME_FULL_LOAD + 1)) : 0;
+    }
+    context.frames[0] = frames[0];
+    context.frames[1] = frames[1];
+    terminal_renderer_draw(context.renderer, frames[0]);
+    uint64_t full_bytes = terminal_renderer_get_bytes_written(context.renderer);
+    LatencyResult render = run_stage(stage_render, &context, samples);
+    uint64_t render_bytes = (terminal_renderer_get_bytes_written(context.renderer) - full_bytes) / render.count;
+
+    char exposition_path[] = "/tmp/TietoBenchExpositionXXXXXX";
+    int exposition_fd = mkstemp(exposition_path);
+    OutputSink sinks[3];
+    if (exposition_fd < 0 || !output_sink_create_json_lines("/dev/null", &sinks[0]) ||
+        !output_sink_create_csv("/dev/null", &sinks[1]) || !output_sink_create_prometheus(exposition_path, &sinks[2])) {
+        fprintf(stderr, "unexpected sink failure\n");
+        exit(1);
+    }
+    close(exposition_fd);
+    LatencyResult formats[3];
+    for (size_t i = 0; i < 3; i++) {
+        context.sink = &sinks[i];
+        formats[i] = run_stage(stage_format, &context, samples);
+        sinks[i].destroy(sinks[i].context);
+    }
+    unlink(exposition_path);
+
+    LatencyResult paced = run_pipeline(archive_path, READER_SOURCE_PACING_REAL_TIME, context.renderer, samples);
+    LatencyResult unpaced = run_pipeline(archive_path, READER_SOURCE_PACING_NONE, context.renderer, samples);
+
+    printf("  {\"cpus\": %zu, \"bytes\": %zu, \"stages\": {\n", cpu_count, length);
+    print_latency("read", &read, ",");
+    print_latency("parse", &parse, ",");
+    print_latency("diff", &diff, ",");
+    print_latency("render", &render, ",");
+    print_latency("format_jsonl", &formats[0], ",");
+    print_latency("format_csv", &formats[1], ",");
+    print_latency("format_prometheus", &formats[2], ",");
+    printf("      \"render_full_bytes\": %llu, \"render_changed_bytes\": %llu\n", (unsigned long long) full_bytes,
+           (unsigned long long) render_bytes);
+    printf("    }, \"pipeline\": {\n");
+    printf("      \"interval_ns\": %ld,\n", PIPELINE_INTERVAL.tv_nsec);
+    print_latency("paced", &paced, ",");
+    print_latency("unpaced", &unpaced, "");
+    printf("  }}%s\n", last ? "" : ",");
+
+    sample_frame_destroy(frames[0]);
+    sample_frame_destroy(frames[1]);
+    terminal_renderer_destroy(context.renderer);
+    sample_frame_destroy(context.diff_frame);
+    source.destroy(source.context);
+    cpu_index_map_destroy(context.cpu_index_map);
+    free(context.previous_rows);
+    free(context.rows);
+    buffer_pool_release(context.buffer);
+    buffer_pool_destroy(pool);
+    unlink(snapshot_path);
+    unlink(archive_path);
+    free(snapshot);
+    free(previous_snapshot);
+    stat_generator_destroy(generator);
+}
+
+//Results are JSON on stdout, one entry per CPU count. Stage numbers are single threaded and per call, pipeline
+//numbers come from the threaded stages: paced runs at the interval and shows the latency of a fresh sample,
+//unpaced replays as fast as the stages go and shows their throughput.
+int main(void) {
+    int output_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    uint64_t *samples = malloc(sizeof(uint64_t) * BENCH_MAXIMUM_SAMPLES);
+    if (output_fd < 0 || samples == NULL) {
+        return 1;
+    }
+
+    printf("{\"benchmark\": \"Tieto\", \"results\": [\n");
+    size_t case_count = sizeof(CPU_COUNTS) / sizeof(CPU_COUNTS[0]);
+    for (size_t c = 0; c < case_count; c++) {
+        bench_cpu_count(CPU_COUNTS[c], output_fd, samples, c + 1 == case_count);
+    }
+    printf("]}\n");
+
+    free(samples);
+    close(output_fd);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -1,15 +1,23 @@
 #ifndef TIETO_ANALYZER_H
 #define TIETO_ANALYZER_H
 
+#include "FrameBroadcast.h"
+#include "FrameSnapshot.h"
 #include "Queue.h"
+#include "Recorder.h"
+#include "RollingWindows.h"
 #include "Watchdog.h"
 
 typedef struct Analyzer Analyzer;
 
-Analyzer *analyzer_create(Queue *reader_analyzer_queue, Queue *analyzer_printer_queue, Watchdog *watchdog);
+Analyzer *analyzer_create(Queue *reader_analyzer_queue, FrameBroadcast *broadcast, Watchdog *watchdog,
+                          Recorder *recorder, FrameSnapshot *snapshot);
 
 void analyzer_await_and_destroy(Analyzer *analyzer);
 
 void analyzer_request_stop_synchronized(Analyzer *analyzer);
 
+bool analyzer_get_window_stats(Analyzer *analyzer, size_t index, enum ROLLING_WINDOW_SPAN span,
+                               RollingWindowStats *stats);
+
 #endif //TIETO_ANALYZER_H
@@ -0,0 +1,42 @@
+#ifndef TIETO_BUFFERPOOL_H
+#define TIETO_BUFFERPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct BufferPool BufferPool;
+
+typedef struct Buffer {
+    BufferPool *pool;
+    size_t capacity;
+    size_t length;
+    //CLOCK_MONOTONIC time the contents were sampled at, set by the producer.
+    uint64_t timestamp_ns;
+    char *data;
+    //Optional binary payload sampled together with the text, e.g. ProcessSample records.
+    size_t records_capacity;
+    size_t records_length;
+    char *records;
+} Buffer;
+
+BufferPool *buffer_pool_create(size_t buffers, size_t buffer_capacity);
+
+void buffer_pool_destroy(BufferPool *pool);
+
+Buffer *buffer_pool_try_acquire(BufferPool *pool);
+
+bool buffer_pool_wait_to_acquire(BufferPool *pool, struct timespec timeout);
+
+void buffer_pool_close(BufferPool *pool);
+
+void buffer_pool_release(Buffer *buffer);
+
+bool buffer_reserve(Buffer *buffer, size_t capacity);
+
+bool buffer_reserve_records(Buffer *buffer, size_t capacity);
+
+size_t buffer_pool_get_allocation_count(const BufferPool *pool);
+
+#endif //TIETO_BUFFERPOOL_H
@@ -0,0 +1,6 @@
+#ifndef TIETO_CACHELINE_H
+#define TIETO_CACHELINE_H
+
+#define CACHE_LINE_SIZE 64
+
+#endif //TIETO_CACHELINE_H
@@ -0,0 +1,30 @@
+#ifndef TIETO_CPUINDEXMAP_H
+#define TIETO_CPUINDEXMAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "StatParser.h"
+
+#define CPU_INDEX_MAP_NO_SLOT SIZE_MAX
+
+typedef struct CpuIndexMap CpuIndexMap;
+
+CpuIndexMap *cpu_index_map_create(void);
+
+void cpu_index_map_destroy(CpuIndexMap *map);
+
+const size_t *cpu_index_map_update(CpuIndexMap *map, const CpuData rows[], size_t row_count);
+
+size_t cpu_index_map_get_generation(const CpuIndexMap *map);
+
+size_t cpu_index_map_get_slot_count(const CpuIndexMap *map);
+
+size_t cpu_index_map_get_slot_key(const CpuIndexMap *map, size_t slot);
+
+bool cpu_index_map_is_online(const CpuIndexMap *map, size_t slot);
+
+size_t cpu_index_map_get_key_count(const CpuIndexMap *map);
+
+size_t cpu_index_map_key(size_t cpu_id);
+
+#endif //TIETO_CPUINDEXMAP_H
@@ -0,0 +1,50 @@
+#ifndef TIETO_FRAMEBROADCAST_H
+#define TIETO_FRAMEBROADCAST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "SampleFrame.h"
+
+#define FRAME_BROADCAST_MAX_SUBSCRIBERS 8
+#define FRAME_BROADCAST_INVALID_SUBSCRIBER SIZE_MAX
+
+//BLOCK subscribers get every frame, the producer waits while one of them is a full ring behind. DROP_OLDEST
+//subscribers never hold the producer back with frames they did not take yet, those are skipped instead.
+enum FRAME_BROADCAST_POLICY {
+    FRAME_BROADCAST_POLICY_BLOCK = 0, FRAME_BROADCAST_POLICY_DROP_OLDEST
+};
+
+typedef struct FrameBroadcast FrameBroadcast;
+
+FrameBroadcast *frame_broadcast_create(size_t capacity);
+
+void frame_broadcast_destroy(FrameBroadcast *broadcast);
+
+void frame_broadcast_close(FrameBroadcast *broadcast);
+
+bool frame_broadcast_is_closed(const FrameBroadcast *broadcast);
+
+size_t frame_broadcast_subscribe(FrameBroadcast *broadcast, enum FRAME_BROADCAST_POLICY policy);
+
+void frame_broadcast_unsubscribe(FrameBroadcast *broadcast, size_t subscriber);
+
+void frame_broadcast_close_subscriber(FrameBroadcast *broadcast, size_t subscriber);
+
+bool frame_broadcast_try_publish(FrameBroadcast *broadcast, SampleFrame *frame);
+
+bool frame_broadcast_wait_until_publishable(FrameBroadcast *broadcast, struct timespec timeout);
+
+size_t frame_broadcast_acquire_batch(FrameBroadcast *broadcast, size_t subscriber, SampleFrame *frames[],
+                                     size_t max_count);
+
+void frame_broadcast_release(FrameBroadcast *broadcast, size_t subscriber);
+
+bool frame_broadcast_wait_until_available(FrameBroadcast *broadcast, size_t subscriber, struct timespec timeout);
+
+uint64_t frame_broadcast_get_dropped_count(FrameBroadcast *broadcast, size_t subscriber);
+
+size_t frame_broadcast_get_subscriber_count(FrameBroadcast *broadcast);
+
+#endif //TIETO_FRAMEBROADCAST_H
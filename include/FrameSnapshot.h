@@ -0,0 +1,35 @@
+#ifndef TIETO_FRAMESNAPSHOT_H
+#define TIETO_FRAMESNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "SampleFrame.h"
+
+typedef struct FrameSnapshot FrameSnapshot;
+
+//version is the number of frames published, reads the consistent copies handed out and retries the copies that had
+//to be repeated because they raced with the writer.
+typedef struct FrameSnapshotStats {
+    uint64_t version;
+    uint64_t reads;
+    uint64_t retries;
+} FrameSnapshotStats;
+
+FrameSnapshot *frame_snapshot_create(size_t cpu_capacity);
+
+void frame_snapshot_destroy(FrameSnapshot *snapshot);
+
+void frame_snapshot_publish(FrameSnapshot *snapshot, const SampleFrame *frame);
+
+bool frame_snapshot_read(FrameSnapshot *snapshot, SampleFrame *copy);
+
+bool frame_snapshot_read_versioned(FrameSnapshot *snapshot, SampleFrame *copy, uint64_t *version);
+
+uint64_t frame_snapshot_get_version(FrameSnapshot *snapshot);
+
+void frame_snapshot_get_stats(FrameSnapshot *snapshot, FrameSnapshotStats *stats);
+
+size_t frame_snapshot_get_cpu_capacity(const FrameSnapshot *snapshot);
+
+#endif //TIETO_FRAMESNAPSHOT_H
@@ -1,18 +1,52 @@
 #ifndef TIETO_LOGGER_H
 #define TIETO_LOGGER_H
 
+#include <stdint.h>
+
+//Build time threshold of the LOGGER_<LEVEL> macros, 0 keeps DEBUG and up, 1 INFO and up and so on. Calls below it
+//are removed by the compiler, arguments included.
+#ifndef LOGGER_COMPILE_LEVEL
+#define LOGGER_COMPILE_LEVEL 0
+#endif
+
 typedef struct Logger Logger;
 
 enum LOGGER_LEVEL {
     LOGGER_LEVEL_DEBUG = 0, LOGGER_LEVEL_INFO = 1, LOGGER_LEVEL_WARN = 2, LOGGER_LEVEL_ERROR = 3
 };
 
+//SYNC writes and flushes every message in the calling thread. ASYNC queues messages for a background thread and
+//writes only ERROR messages right away.
+enum LOGGER_MODE {
+    LOGGER_MODE_SYNC = 0, LOGGER_MODE_ASYNC
+};
+
 Logger *logger_create(const char path[]);
 
+Logger *logger_create_with_mode(const char path[], enum LOGGER_MODE mode);
+
 void logger_destroy(Logger *logger);
 
 Logger *logger_get_global(void);
 
 void logger_log(Logger *logger, enum LOGGER_LEVEL level, const char message[]);
 
+void logger_logf(Logger *logger, enum LOGGER_LEVEL level, const char format[], ...)
+__attribute__((format(printf, 3, 4)));
+
+uint64_t logger_get_dropped_count(const Logger *logger);
+
+//The condition is a constant, so a disabled call is still type checked but compiles to nothing.
+#define LOGGER_LOG_COMPILED(level, ...) \
+    do { \
+        if ((int) (level) >= LOGGER_COMPILE_LEVEL) { \
+            logger_logf(logger_get_global(), (level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOGGER_DEBUG(...) LOGGER_LOG_COMPILED(LOGGER_LEVEL_DEBUG, __VA_ARGS__)
+#define LOGGER_INFO(...) LOGGER_LOG_COMPILED(LOGGER_LEVEL_INFO, __VA_ARGS__)
+#define LOGGER_WARN(...) LOGGER_LOG_COMPILED(LOGGER_LEVEL_WARN, __VA_ARGS__)
+#define LOGGER_ERROR(...) LOGGER_LOG_COMPILED(LOGGER_LEVEL_ERROR, __VA_ARGS__)
+
 #endif //TIETO_LOGGER_H
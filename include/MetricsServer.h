@@ -0,0 +1,18 @@
+#ifndef TIETO_METRICSSERVER_H
+#define TIETO_METRICSSERVER_H
+
+#include <stdint.h>
+#include "FrameSnapshot.h"
+#include "Watchdog.h"
+
+typedef struct MetricsServer MetricsServer;
+
+MetricsServer *metrics_server_create(const char address[], FrameSnapshot *snapshot, Watchdog *watchdog);
+
+void metrics_server_await_and_destroy(MetricsServer *server);
+
+void metrics_server_request_stop_synchronized(MetricsServer *server);
+
+uint64_t metrics_server_get_scrape_count(const MetricsServer *server);
+
+#endif //TIETO_METRICSSERVER_H
@@ -0,0 +1,38 @@
+#ifndef TIETO_OUTPUTSINK_H
+#define TIETO_OUTPUTSINK_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "SampleFrame.h"
+
+//EVERY_FRAME sinks get each frame the Printer takes off the queue, LATEST_FRAME sinks only the newest one of a batch
+//since they replace what they showed before.
+enum OUTPUT_SINK_DELIVERY {
+    OUTPUT_SINK_DELIVERY_EVERY_FRAME = 0, OUTPUT_SINK_DELIVERY_LATEST_FRAME
+};
+
+//Where the Printer sends frames. write formats a frame and may keep it buffered, flush pushes out what is buffered,
+//both are only called from the printer thread. destroy flushes and releases context.
+typedef struct OutputSink {
+    bool (*write)(void *context, const SampleFrame *frame);
+    bool (*flush)(void *context);
+    void (*destroy)(void *context);
+    void *context;
+    enum OUTPUT_SINK_DELIVERY delivery;
+} OutputSink;
+
+bool output_sink_create_terminal(int fd, OutputSink *sink);
+
+bool output_sink_create_json_lines(const char path[], OutputSink *sink);
+
+bool output_sink_create_csv(const char path[], OutputSink *sink);
+
+bool output_sink_create_prometheus(const char path[], OutputSink *sink);
+
+bool output_sink_create_from_spec(const char spec[], OutputSink *sink);
+
+size_t output_sink_prometheus_capacity(const SampleFrame *frame);
+
+size_t output_sink_format_prometheus(const SampleFrame *frame, char output[]);
+
+#endif //TIETO_OUTPUTSINK_H
@@ -1,12 +1,16 @@
 #ifndef TIETO_PRINTER_H
 #define TIETO_PRINTER_H
 
-#include "Queue.h"
+#include "FrameBroadcast.h"
+#include "OutputSink.h"
 #include "Watchdog.h"
 
+#define PRINTER_MAX_SINKS 8
+
 typedef struct Printer Printer;
 
-Printer *printer_create(Queue *analyzer_printer_queue, Watchdog *watchdog);
+Printer *printer_create(FrameBroadcast *broadcast, Watchdog *watchdog, const OutputSink sinks[],
+                        size_t sink_count);
 
 void printer_await_and_destroy(Printer *printer);
 
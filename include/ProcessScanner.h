@@ -0,0 +1,26 @@
+#ifndef TIETO_PROCESSSCANNER_H
+#define TIETO_PROCESSSCANNER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PROCESS_SCANNER_COMMAND_LENGTH 16
+
+//CPU time a process used since the previous scan, in clock ticks, user and system time together.
+typedef struct ProcessSample {
+    int32_t pid;
+    uint32_t ticks;
+    char command[PROCESS_SCANNER_COMMAND_LENGTH];
+} ProcessSample;
+
+typedef struct ProcessScanner ProcessScanner;
+
+ProcessScanner *process_scanner_create(const char proc_path[]);
+
+void process_scanner_destroy(ProcessScanner *scanner);
+
+const ProcessSample *process_scanner_scan(ProcessScanner *scanner, size_t *sample_count);
+
+size_t process_scanner_get_process_count(const ProcessScanner *scanner);
+
+#endif //TIETO_PROCESSSCANNER_H
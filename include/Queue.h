@@ -3,13 +3,30 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
 
 typedef struct Queue Queue;
 
+enum QUEUE_MODE {
+    QUEUE_MODE_LOCKED = 0, QUEUE_MODE_SPSC = 1
+};
+
 Queue *queue_create(size_t capacity);
 
+Queue *queue_create_with_mode(size_t capacity, enum QUEUE_MODE mode);
+
 void queue_destroy(Queue *queue);
 
+void queue_close(Queue *queue);
+
+size_t queue_add_producer(Queue *queue);
+
+void queue_release_producer(Queue *queue);
+
+bool queue_is_closed(const Queue *queue);
+
+enum QUEUE_MODE queue_get_mode(const Queue *queue);
+
 bool queue_is_empty(const Queue *queue);
 
 bool queue_is_full(const Queue *queue);
@@ -18,6 +35,18 @@ void queue_insert(Queue *queue, void *object);
 
 void *queue_extract(Queue *queue);
 
+bool queue_try_push(Queue *queue, void *object);
+
+void *queue_try_pop(Queue *queue);
+
+size_t queue_insert_batch(Queue *queue, void *const objects[], size_t count);
+
+size_t queue_extract_batch(Queue *queue, void *objects[], size_t max_count);
+
+bool queue_wait_until_not_full(Queue *queue, struct timespec timeout);
+
+bool queue_wait_until_not_empty(Queue *queue, struct timespec timeout);
+
 void queue_lock(Queue *queue);
 
 void queue_unlock(Queue *queue);
@@ -2,15 +2,29 @@
 #define TIETO_READER_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 #include "Queue.h"
+#include "BufferPool.h"
+#include "ProcessScanner.h"
+#include "ReaderSource.h"
 #include "Watchdog.h"
 
 typedef struct Reader Reader;
 
-Reader *reader_create(Queue *reader_analyzer_queue, Watchdog *watchdog);
+Reader *reader_create(Queue *reader_analyzer_queue, BufferPool *buffer_pool, Watchdog *watchdog, const char path[],
+                      ProcessScanner *process_scanner, struct timespec update_interval);
+
+Reader *reader_create_with_source(Queue *reader_analyzer_queue, BufferPool *buffer_pool, Watchdog *watchdog,
+                                  ReaderSource source, ProcessScanner *process_scanner,
+                                  struct timespec update_interval);
 
 void reader_await_and_destroy(Reader *reader);
 
 void reader_request_stop_synchronized(Reader *reader);
 
+uint64_t reader_get_missed_deadlines(const Reader *reader);
+
+bool reader_is_finished(const Reader *reader);
+
 #endif //TIETO_READER_H
@@ -0,0 +1,30 @@
+#ifndef TIETO_READERSOURCE_H
+#define TIETO_READERSOURCE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "BufferPool.h"
+
+enum READER_SOURCE_STATUS {
+    READER_SOURCE_STATUS_OK = 0, READER_SOURCE_STATUS_END, READER_SOURCE_STATUS_ERROR
+};
+
+//REAL_TIME sources are read once per Reader interval, NONE sources are read again as soon as the queue has room.
+enum READER_SOURCE_PACING {
+    READER_SOURCE_PACING_REAL_TIME = 0, READER_SOURCE_PACING_NONE
+};
+
+//Where the Reader takes its /proc/stat snapshots from. read fills buffer->data with one NUL terminated snapshot
+//and sets buffer->length, it is only called from the reader thread. destroy releases context.
+typedef struct ReaderSource {
+    enum READER_SOURCE_STATUS (*read)(void *context, Buffer *buffer);
+    void (*destroy)(void *context);
+    void *context;
+    enum READER_SOURCE_PACING pacing;
+} ReaderSource;
+
+bool reader_source_create_file(const char path[], ReaderSource *source);
+
+bool reader_source_create_replay(const char path[], enum READER_SOURCE_PACING pacing, ReaderSource *source);
+
+#endif //TIETO_READERSOURCE_H
@@ -0,0 +1,48 @@
+#ifndef TIETO_RECORDER_H
+#define TIETO_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "StatParser.h"
+
+#define RECORDER_MAGIC "TIETOREC"
+#define RECORDER_VERSION 2
+//Counters of a CPU that was offline or missing in the snapshot.
+#define RECORDER_OFFLINE UINT64_MAX
+
+//File layout, native byte order: one RecorderHeader, then record_count records of record_size bytes. A record is
+//a RecorderRecord followed by cpu_count + 1 RecorderCounters, entry 0 is the aggregate, entry n + 1 is CPU n.
+typedef struct RecorderHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cpu_count;
+    uint32_t column_count;
+    uint32_t reserved;
+    uint64_t interval_ns;
+    uint64_t record_size;
+    uint64_t record_count;
+} RecorderHeader;
+
+//Every column of the cpu line as read, indexed by enum STAT_PARSER_COLUMN. Totals are left to the analysis.
+typedef struct RecorderCounters {
+    uint64_t columns[STAT_PARSER_COLUMN_COUNT];
+} RecorderCounters;
+
+typedef struct RecorderRecord {
+    uint64_t timestamp_ns;
+    RecorderCounters counters[];
+} RecorderRecord;
+
+typedef struct Recorder Recorder;
+
+Recorder *recorder_create(const char path[], size_t cpu_count, struct timespec interval);
+
+void recorder_destroy(Recorder *recorder);
+
+bool recorder_append(Recorder *recorder, uint64_t timestamp_ns, const CpuData rows[], size_t row_count);
+
+uint64_t recorder_get_record_count(const Recorder *recorder);
+
+#endif //TIETO_RECORDER_H
@@ -0,0 +1,41 @@
+#ifndef TIETO_ROLLINGWINDOWS_H
+#define TIETO_ROLLINGWINDOWS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum ROLLING_WINDOW_SPAN {
+    ROLLING_WINDOW_SPAN_10_SECONDS = 0, ROLLING_WINDOW_SPAN_1_MINUTE, ROLLING_WINDOW_SPAN_5_MINUTES,
+    ROLLING_WINDOW_SPAN_COUNT
+};
+
+//Basis points like SampleFrame. Percentiles come from a histogram with 1% buckets, the rest is exact over the
+//samples of the window. Windows longer than 10 seconds move in whole blocks of rolling_windows_block_ns.
+typedef struct RollingWindowStats {
+    uint32_t sample_count;
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t p95;
+    uint16_t p99;
+} RollingWindowStats;
+
+typedef struct RollingWindows RollingWindows;
+
+RollingWindows *rolling_windows_create(void);
+
+void rolling_windows_destroy(RollingWindows *windows);
+
+bool rolling_windows_add(RollingWindows *windows, uint64_t timestamp_ns, const uint16_t values[], size_t count);
+
+bool rolling_windows_get(const RollingWindows *windows, size_t series, enum ROLLING_WINDOW_SPAN span,
+                         RollingWindowStats *stats);
+
+size_t rolling_windows_get_series_count(const RollingWindows *windows);
+
+uint64_t rolling_windows_span_ns(enum ROLLING_WINDOW_SPAN span);
+
+uint64_t rolling_windows_block_ns(void);
+
+#endif //TIETO_ROLLINGWINDOWS_H
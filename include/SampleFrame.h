@@ -0,0 +1,42 @@
+#ifndef TIETO_SAMPLEFRAME_H
+#define TIETO_SAMPLEFRAME_H
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "CacheLine.h"
+#include "ProcessScanner.h"
+#include "RollingWindows.h"
+
+#define SAMPLE_FRAME_FULL_LOAD 10000
+#define SAMPLE_FRAME_OFFLINE UINT16_MAX
+#define SAMPLE_FRAME_TOP_PROCESSES 10
+
+//Utilization in basis points of a single CPU, a multithreaded process can exceed SAMPLE_FRAME_FULL_LOAD.
+typedef struct SampleFrameProcess {
+    int32_t pid;
+    uint32_t utilization;
+    char command[PROCESS_SCANNER_COMMAND_LENGTH];
+} SampleFrameProcess;
+
+//Utilization is stored in basis points (1/100 of a percent). Entry 0 is the aggregate of all CPUs, entry n + 1 is
+//CPU n, offline CPUs hold SAMPLE_FRAME_OFFLINE. The entries start on their own cache line after the header.
+//The busiest processes come first in processes, process_count is 0 unless process tracking is enabled.
+//windows holds the rolling statistics of the aggregate up to and including this frame.
+typedef struct SampleFrame {
+    uint64_t timestamp_ns;
+    uint64_t sequence;
+    uint32_t cpu_count;
+    uint32_t process_count;
+    SampleFrameProcess processes[SAMPLE_FRAME_TOP_PROCESSES];
+    RollingWindowStats windows[ROLLING_WINDOW_SPAN_COUNT];
+    alignas(CACHE_LINE_SIZE) uint16_t utilization[];
+} SampleFrame;
+
+SampleFrame *sample_frame_create(size_t cpu_count);
+
+void sample_frame_destroy(SampleFrame *frame);
+
+uint16_t sample_frame_basis_points(unsigned long long int idle_time, unsigned long long int total_time);
+
+#endif //TIETO_SAMPLEFRAME_H
@@ -0,0 +1,24 @@
+#ifndef TIETO_SCHEDULER_H
+#define TIETO_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct Scheduler Scheduler;
+
+Scheduler *scheduler_create(struct timespec interval);
+
+void scheduler_destroy(Scheduler *scheduler);
+
+bool scheduler_wait_next(Scheduler *scheduler);
+
+uint64_t scheduler_get_deadline(const Scheduler *scheduler);
+
+void scheduler_cancel(Scheduler *scheduler);
+
+uint64_t scheduler_get_missed_deadlines(const Scheduler *scheduler);
+
+uint64_t scheduler_monotonic_now_ns(void);
+
+#endif //TIETO_SCHEDULER_H
@@ -0,0 +1,58 @@
+#ifndef TIETO_STAGE_H
+#define TIETO_STAGE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Queue.h"
+#include "Watchdog.h"
+
+#define STAGE_BATCH_SIZE 16
+#define STAGE_MAX_OUTPUTS 8
+
+//CONTINUE asks for the next batch. FINISHED means the stage produced everything it will, e.g. a replay ran out,
+//STOPPED that it ended early on an error, a stop request or a closed output.
+enum STAGE_STATUS {
+    STAGE_STATUS_CONTINUE = 0, STAGE_STATUS_FINISHED, STAGE_STATUS_STOPPED
+};
+
+typedef struct Stage Stage;
+
+//process gets up to STAGE_BATCH_SIZE items taken off the input and owns them from then on. A stage without an input
+//is called once per iteration with none and paces itself. Results go on with stage_emit or stage_emit_batch.
+//discard frees an item that could not be emitted to output, it may be NULL when items are freed elsewhere.
+//wake is called on stop requests, also from the watchdog, to interrupt waits the stage does on its own, it may be
+//NULL. end runs once the stage left its loop for whatever reason, before its outputs are released, so a stage can
+//close channels other than queues behind it, it may be NULL. All of them run on the stage thread except wake.
+typedef struct StageOperations {
+    enum STAGE_STATUS (*process)(Stage *stage, void *context, void *items[], size_t count);
+
+    void (*discard)(void *context, size_t output, void *item);
+
+    void (*wake)(void *context);
+
+    void (*end)(void *context);
+} StageOperations;
+
+Stage *stage_create(const char name[], StageOperations operations, void *context, Queue *input,
+                    Queue *const outputs[], size_t output_count, Watchdog *watchdog, struct timespec budget);
+
+bool stage_start(Stage *stage);
+
+void stage_await_and_destroy(Stage *stage);
+
+void stage_request_stop_synchronized(Stage *stage);
+
+bool stage_should_stop_synchronized(const Stage *stage);
+
+bool stage_is_finished(const Stage *stage);
+
+struct timespec stage_get_wait_timeout(const Stage *stage);
+
+void stage_heartbeat(Stage *stage);
+
+bool stage_emit(Stage *stage, size_t output, void *item);
+
+bool stage_emit_batch(Stage *stage, size_t output, void *items[], size_t count);
+
+#endif //TIETO_STAGE_H
@@ -0,0 +1,16 @@
+#ifndef TIETO_STATGENERATOR_H
+#define TIETO_STATGENERATOR_H
+
+#include <stdlib.h>
+
+typedef struct StatGenerator StatGenerator;
+
+StatGenerator *stat_generator_create(size_t cpu_count, unsigned int seed);
+
+void stat_generator_destroy(StatGenerator *generator);
+
+void stat_generator_advance(StatGenerator *generator, unsigned int ticks);
+
+size_t stat_generator_render(const StatGenerator *generator, char buffer[], size_t capacity);
+
+#endif //TIETO_STATGENERATOR_H
@@ -0,0 +1,28 @@
+#ifndef TIETO_STATPARSER_H
+#define TIETO_STATPARSER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define STAT_PARSER_AGGREGATE_ID SIZE_MAX
+
+//Columns of a cpu line in /proc/stat order. Columns an older kernel does not report are 0.
+enum STAT_PARSER_COLUMN {
+    STAT_PARSER_COLUMN_USER = 0, STAT_PARSER_COLUMN_NICE, STAT_PARSER_COLUMN_SYSTEM, STAT_PARSER_COLUMN_IDLE,
+    STAT_PARSER_COLUMN_IOWAIT, STAT_PARSER_COLUMN_IRQ, STAT_PARSER_COLUMN_SOFTIRQ, STAT_PARSER_COLUMN_STEAL,
+    STAT_PARSER_COLUMN_GUEST, STAT_PARSER_COLUMN_GUEST_NICE, STAT_PARSER_COLUMN_COUNT
+};
+
+//total_time and idle_time are derived from the raw columns, which are kept for recording.
+typedef struct CpuData {
+    size_t cpu_id;
+    unsigned long long int total_time;
+    unsigned long long int idle_time;
+    unsigned long long int columns[STAT_PARSER_COLUMN_COUNT];
+} CpuData;
+
+size_t stat_parser_parse(const char input[], size_t length, CpuData rows[], size_t capacity);
+
+unsigned long long int stat_parser_parse_number(const char **cursor, const char *end);
+
+#endif //TIETO_STATPARSER_H
@@ -0,0 +1,18 @@
+#ifndef TIETO_TERMINALRENDERER_H
+#define TIETO_TERMINALRENDERER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SampleFrame.h"
+
+typedef struct TerminalRenderer TerminalRenderer;
+
+TerminalRenderer *terminal_renderer_create(int fd);
+
+void terminal_renderer_destroy(TerminalRenderer *renderer);
+
+bool terminal_renderer_draw(TerminalRenderer *renderer, const SampleFrame *frame);
+
+uint64_t terminal_renderer_get_bytes_written(const TerminalRenderer *renderer);
+
+#endif //TIETO_TERMINALRENDERER_H
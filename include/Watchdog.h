@@ -3,6 +3,10 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define WATCHDOG_INVALID_INDEX SIZE_MAX
 
 typedef struct Watchdog Watchdog;
 
@@ -12,7 +16,9 @@ void watchdog_await_and_destroy(Watchdog *watchdog);
 
 void watchdog_request_stop_synchronized(Watchdog *watchdog);
 
-size_t watchdog_register_watch(Watchdog *watchdog, void (*function)(void *), void *object);
+size_t watchdog_register_watch(Watchdog *watchdog, void (*function)(void *), void *object, struct timespec budget);
+
+void watchdog_unregister_watch(Watchdog *watchdog, size_t index);
 
 void watchdog_update(Watchdog *watchdog, size_t index);
 
@@ -22,4 +28,6 @@ void watchdog_pause_watching(Watchdog *watchdog);
 
 bool watchdog_was_triggered(Watchdog *watchdog);
 
+size_t watchdog_get_registered_count(Watchdog *watchdog);
+
 #endif //TIETO_WATCHDOG_H
@@ -1,40 +1,66 @@
 #include "../include/Analyzer.h"
-#include "../include/LongDoubleArray.h"
+#include "../include/SampleFrame.h"
+#include "../include/BufferPool.h"
+#include "../include/StatParser.h"
+#include "../include/CpuIndexMap.h"
+#include "../include/FrameSnapshot.h"
+#include "../include/Recorder.h"
+#include "../include/RollingWindows.h"
 #include "../include/Logger.h"
+#include "../include/Stage.h"
 #include <pthread.h>
 #include <stdio.h>
-#include <malloc.h>
 #include <string.h>
+#include <time.h>
+#include <malloc.h>
 
-static const time_t ANALYZER_QUEUE_WAIT_TIMEOUT = 1;
+//Updates come after every queue wait and every batch, a batch of 16 snapshots takes far less than a second.
+static const struct timespec ANALYZER_WATCHDOG_BUDGET = {.tv_sec = 2, .tv_nsec = 0};
 
 struct Analyzer {
-    Queue *reader_analyzer_queue;
-    Queue *analyzer_printer_queue;
-    Watchdog *watchdog;
-    size_t watchdog_index;
-    pthread_t thread;
-    pthread_mutex_t mutex;
-    bool should_stop;
+    FrameBroadcast *broadcast;
+    Recorder *recorder;
+    FrameSnapshot *snapshot;
+    Stage *stage;
+    //Owned by the analyzer thread. Rows are indexed by position in the snapshot, previous counters by the dense
+    //slot the CpuIndexMap assigned to the CPU id of the row.
+    CpuData *rows;
+    size_t row_capacity;
+    CpuIndexMap *cpu_index_map;
+    size_t cpu_index_map_generation;
+    CpuData *previous_cpu_data;
+    bool *has_previous_cpu_data;
+    uint16_t *previous_utilization;
+    size_t slot_capacity;
+    uint64_t frame_sequence;
+    //Written by the analyzer thread, read by any consumer through analyzer_get_window_stats.
+    RollingWindows *rolling_windows;
+    pthread_mutex_t rolling_windows_mutex;
 };
 
-typedef struct CpuData {
-    unsigned long long int total_time;
-    unsigned long long int idle_time;
-} CpuData;
+static size_t analyzer_parse_input(Analyzer *analyzer, const Buffer *input);
+
+static bool analyzer_reserve_slots(Analyzer *analyzer, size_t slot_count);
 
-static void analyzer_request_stop_synchronized_void(void *analyzer);
+static size_t analyzer_select_top_processes(const Buffer *input, ProcessSample top[]);
 
-static bool analyzer_should_stop_synchronized(Analyzer *analyzer);
+static void analyzer_fill_processes(SampleFrame *frame, const ProcessSample top[], size_t top_count,
+                                    unsigned long long int aggregate_time_diff, size_t cpu_count);
 
-static size_t analyze_cpu_count(const char input[]);
+static void analyzer_update_windows(Analyzer *analyzer, SampleFrame *frame, uint64_t timestamp_ns);
 
-static void analyze_line(const char line[], CpuData *cpu_data);
+static SampleFrame *analyzer_process_input(Analyzer *analyzer, Buffer *input);
 
-static void *analyzer_thread(void *args);
+static enum STAGE_STATUS analyzer_process(Stage *stage, void *context, void *items[], size_t count);
 
-Analyzer *analyzer_create(Queue *const reader_analyzer_queue, Queue *const analyzer_printer_queue, Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_create: Entry.");
+static void analyzer_close_broadcast(void *context);
+
+//Frames go to every subscriber of broadcast, which is closed once the analyzer ends. recorder may be NULL, otherwise
+//every parsed snapshot is appended to it. snapshot may be NULL, otherwise the newest frame of every batch is
+//published to it before the frames are broadcast. None of them is owned by the analyzer.
+Analyzer *analyzer_create(Queue *const reader_analyzer_queue, FrameBroadcast *const broadcast, Watchdog *const watchdog,
+                          Recorder *const recorder, FrameSnapshot *const snapshot) {
+    LOGGER_DEBUG("analyzer_create: Entry.");
 
     if (reader_analyzer_queue == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -42,15 +68,15 @@ Analyzer *analyzer_create(Queue *const reader_analyzer_queue, Queue *const analy
         return NULL;
     }
 
-    if (analyzer_printer_queue == NULL) {
+    if (broadcast == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received analyzer_create call with analyzer_printer_queue = NULL.");
+                   "Received analyzer_create call with broadcast = NULL.");
         return NULL;
     }
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received printer_create call with watchdog = NULL.");
+                   "Received analyzer_create call with watchdog = NULL.");
         return NULL;
     }
 
@@ -61,27 +87,61 @@ Analyzer *analyzer_create(Queue *const reader_analyzer_queue, Queue *const analy
     }
 
     *analyzer = (Analyzer) {
-            .reader_analyzer_queue = reader_analyzer_queue,
-            .analyzer_printer_queue = analyzer_printer_queue,
-            .watchdog = watchdog,
-            .watchdog_index = watchdog_register_watch(watchdog, &analyzer_request_stop_synchronized_void, analyzer),
-            .mutex = PTHREAD_MUTEX_INITIALIZER,
-            .should_stop = false
+            .broadcast = broadcast,
+            .recorder = recorder,
+            .snapshot = snapshot,
+            .stage = NULL,
+            .rows = NULL,
+            .row_capacity = 0,
+            .cpu_index_map = cpu_index_map_create(),
+            .cpu_index_map_generation = 0,
+            .previous_cpu_data = NULL,
+            .has_previous_cpu_data = NULL,
+            .previous_utilization = NULL,
+            .slot_capacity = 0,
+            .frame_sequence = 0,
+            .rolling_windows = rolling_windows_create(),
+            .rolling_windows_mutex = PTHREAD_MUTEX_INITIALIZER
     };
 
-    if (pthread_create(&analyzer->thread, NULL, analyzer_thread, (void *) analyzer) != 0) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in analyzer_create.");
-        pthread_mutex_destroy(&analyzer->mutex);
+    if (analyzer->cpu_index_map == NULL || analyzer->rolling_windows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received NULL from cpu_index_map_create or rolling_windows_create in analyzer_create.");
+        if (analyzer->cpu_index_map != NULL) {
+            cpu_index_map_destroy(analyzer->cpu_index_map);
+        }
+        if (analyzer->rolling_windows != NULL) {
+            rolling_windows_destroy(analyzer->rolling_windows);
+        }
+        free(analyzer);
+        return NULL;
+    }
+
+    analyzer->stage = stage_create("analyzer",
+                                   (StageOperations) {
+                                           .process = &analyzer_process,
+                                           .discard = NULL,
+                                           .wake = &analyzer_close_broadcast,
+                                           .end = &analyzer_close_broadcast
+                                   },
+                                   analyzer, reader_analyzer_queue, NULL, 0, watchdog, ANALYZER_WATCHDOG_BUDGET);
+    if (analyzer->stage != NULL && !stage_start(analyzer->stage)) {
+        stage_await_and_destroy(analyzer->stage);
+        analyzer->stage = NULL;
+    }
+    if (analyzer->stage == NULL) {
+        cpu_index_map_destroy(analyzer->cpu_index_map);
+        rolling_windows_destroy(analyzer->rolling_windows);
         free(analyzer);
         return NULL;
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_create: Success.");
+    LOGGER_DEBUG("analyzer_create: Success.");
     return analyzer;
 }
 
 void analyzer_await_and_destroy(Analyzer *const analyzer) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_await_and_destroy: Entry.");
+    LOGGER_DEBUG("analyzer_await_and_destroy: Entry.");
 
     if (analyzer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -89,15 +149,21 @@ void analyzer_await_and_destroy(Analyzer *const analyzer) {
         return;
     }
 
-    pthread_join(analyzer->thread, NULL);
-    pthread_mutex_destroy(&analyzer->mutex);
+    stage_await_and_destroy(analyzer->stage);
+    free(analyzer->rows);
+    cpu_index_map_destroy(analyzer->cpu_index_map);
+    free(analyzer->previous_cpu_data);
+    free(analyzer->has_previous_cpu_data);
+    free(analyzer->previous_utilization);
+    rolling_windows_destroy(analyzer->rolling_windows);
+    pthread_mutex_destroy(&analyzer->rolling_windows_mutex);
     free(analyzer);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_await_and_destroy: Success.");
+    LOGGER_DEBUG("analyzer_await_and_destroy: Success.");
 }
 
 void analyzer_request_stop_synchronized(Analyzer *const analyzer) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_request_stop_synchronized: Entry.");
+    LOGGER_DEBUG("analyzer_request_stop_synchronized: Entry.");
 
     if (analyzer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -105,166 +171,263 @@ void analyzer_request_stop_synchronized(Analyzer *const analyzer) {
         return;
     }
 
-    pthread_mutex_lock(&analyzer->mutex);
-    analyzer->should_stop = true;
-    pthread_mutex_unlock(&analyzer->mutex);
-
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_request_stop_synchronized: Success.");
-}
+    stage_request_stop_synchronized(analyzer->stage);
 
-static void analyzer_request_stop_synchronized_void(void *const analyzer) {
-    analyzer_request_stop_synchronized((Analyzer *) analyzer);
+    LOGGER_DEBUG("analyzer_request_stop_synchronized: Success.");
 }
 
-static bool analyzer_should_stop_synchronized(Analyzer *const analyzer) {
+//Series 0 is the aggregate, series n + 1 is CPU n, like the utilization entries of a SampleFrame.
+bool analyzer_get_window_stats(Analyzer *const analyzer, const size_t index, const enum ROLLING_WINDOW_SPAN span,
+                               RollingWindowStats *const stats) {
     if (analyzer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received analyzer_should_stop_synchronized call with analyzer = NULL.");
+                   "Received analyzer_get_window_stats call with analyzer = NULL.");
         return false;
     }
 
-    bool return_value;
-    pthread_mutex_lock(&analyzer->mutex);
-    return_value = analyzer->should_stop;
-    pthread_mutex_unlock(&analyzer->mutex);
-
-    return return_value;
+    pthread_mutex_lock(&analyzer->rolling_windows_mutex);
+    bool result = index < rolling_windows_get_series_count(analyzer->rolling_windows) &&
+                  rolling_windows_get(analyzer->rolling_windows, index, span, stats);
+    pthread_mutex_unlock(&analyzer->rolling_windows_mutex);
+    return result;
 }
 
-static size_t analyze_cpu_count(const char input[const]) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyze_cpu_count: Entry.");
+static size_t analyzer_parse_input(Analyzer *const analyzer, const Buffer *const input) {
+    size_t row_count = stat_parser_parse(input->data, input->length, analyzer->rows, analyzer->row_capacity);
+    if (row_count > analyzer->row_capacity) {
+        CpuData *rows = realloc(analyzer->rows, sizeof(CpuData) * row_count);
+        if (rows == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in analyzer_parse_input.");
+            return 0;
+        }
+        analyzer->rows = rows;
+        analyzer->row_capacity = row_count;
 
-    if (input == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received analyze_cpu_count call with input = NULL.");
-        return 0;
+        stat_parser_parse(input->data, input->length, analyzer->rows, analyzer->row_capacity);
     }
+    return row_count;
+}
 
-    size_t cpu_count = 0;
-
-    size_t parse_length = strlen(input);
-    for (size_t i = 2; i < parse_length; i++) {
-        if (input[i - 2] == 'c' && input[i - 1] == 'p' && input[i] == 'u') {
-            cpu_count++;
-        }
+static bool analyzer_reserve_slots(Analyzer *const analyzer, const size_t slot_count) {
+    if (slot_count <= analyzer->slot_capacity) {
+        return true;
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyze_cpu_count: Success.");
-    return cpu_count;
-}
+    CpuData *previous_cpu_data = realloc(analyzer->previous_cpu_data, sizeof(CpuData) * slot_count);
+    if (previous_cpu_data == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in analyzer_reserve_slots.");
+        return false;
+    }
+    analyzer->previous_cpu_data = previous_cpu_data;
 
-static void analyze_line(const char line[const], CpuData *const cpu_data) {
-    if (cpu_data == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received cpu_data call with cpu_data = NULL.");
-        return;
+    bool *has_previous_cpu_data = realloc(analyzer->has_previous_cpu_data, sizeof(bool) * slot_count);
+    if (has_previous_cpu_data == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in analyzer_reserve_slots.");
+        return false;
     }
+    for (size_t slot = analyzer->slot_capacity; slot < slot_count; slot++) {
+        has_previous_cpu_data[slot] = false;
+    }
+    analyzer->has_previous_cpu_data = has_previous_cpu_data;
 
-    if (line == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received cpu_data call with line = NULL.");
-        *cpu_data = (CpuData) {
-                .idle_time = 0,
-                .total_time = 0,
-        };
-        return;
+    uint16_t *previous_utilization = realloc(analyzer->previous_utilization, sizeof(uint16_t) * slot_count);
+    if (previous_utilization == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in analyzer_reserve_slots.");
+        return false;
+    }
+    for (size_t slot = analyzer->slot_capacity; slot < slot_count; slot++) {
+        previous_utilization[slot] = SAMPLE_FRAME_OFFLINE;
     }
+    analyzer->previous_utilization = previous_utilization;
+    analyzer->slot_capacity = slot_count;
+    return true;
+}
 
-    unsigned long long int user, nice, system, idle, io_wait, irq, soft_irq, steal, guest, guest_nice;
-    sscanf(line, "%*s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle, &io_wait, &irq,
-           &soft_irq, &steal, &guest, &guest_nice);
+static SampleFrame *analyzer_process_input(Analyzer *const analyzer, Buffer *const input) {
+    size_t row_count = analyzer_parse_input(analyzer, input);
+    uint64_t timestamp_ns = input->timestamp_ns;
+    ProcessSample top[SAMPLE_FRAME_TOP_PROCESSES];
+    size_t top_count = analyzer_select_top_processes(input, top);
+    buffer_pool_release(input);
+    if (row_count == 0) {
+        return NULL;
+    }
 
-    user -= guest;
-    nice -= guest_nice;
+    if (analyzer->recorder != NULL) {
+        recorder_append(analyzer->recorder, timestamp_ns, analyzer->rows, row_count);
+    }
 
-    *cpu_data = (CpuData) {
-            .idle_time = idle + io_wait,
-            .total_time = user + nice + system + irq + soft_irq + idle + io_wait + steal + guest + guest_nice
-    };
-}
+    const size_t *row_slots = cpu_index_map_update(analyzer->cpu_index_map, analyzer->rows, row_count);
+    if (row_slots == NULL || !analyzer_reserve_slots(analyzer, cpu_index_map_get_slot_count(analyzer->cpu_index_map))) {
+        return NULL;
+    }
 
-static void *analyzer_thread(void *args) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_thread: Entry.");
-
-    Analyzer *analyzer = (Analyzer *) args;
-    size_t cpu_count = 0;
-
-    CpuData *previous_cpu_data = NULL;
-    while (!analyzer_should_stop_synchronized(analyzer)) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_thread: Iteration.");
-        watchdog_update(analyzer->watchdog, analyzer->watchdog_index);
-
-        queue_lock(analyzer->reader_analyzer_queue);
-        while (queue_is_empty(analyzer->reader_analyzer_queue)) {
-            queue_wait_to_extract_with_timeout(analyzer->reader_analyzer_queue, ANALYZER_QUEUE_WAIT_TIMEOUT);
-            if (analyzer_should_stop_synchronized(analyzer)) {
-                queue_unlock(analyzer->reader_analyzer_queue);
-                free(previous_cpu_data);
-                logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_thread: Ending.");
-                return NULL;
+    //A CPU that went offline has to be diffed against fresh counters once it is back, not against the stale ones.
+    size_t generation = cpu_index_map_get_generation(analyzer->cpu_index_map);
+    if (generation != analyzer->cpu_index_map_generation) {
+        if (analyzer->cpu_index_map_generation != 0) {
+            LOGGER_INFO("CPU set changed. Updating CPU index map.");
+        }
+        for (size_t slot = 0; slot < cpu_index_map_get_slot_count(analyzer->cpu_index_map); slot++) {
+            if (!cpu_index_map_is_online(analyzer->cpu_index_map, slot)) {
+                analyzer->has_previous_cpu_data[slot] = false;
+                analyzer->previous_utilization[slot] = SAMPLE_FRAME_OFFLINE;
             }
         }
+        analyzer->cpu_index_map_generation = generation;
+    }
 
-        char *input = queue_extract(analyzer->reader_analyzer_queue);
-        queue_notify_insert(analyzer->reader_analyzer_queue);
-        queue_unlock(analyzer->reader_analyzer_queue);
+    //Offline CPUs and CPUs without a baseline keep SAMPLE_FRAME_OFFLINE.
+    SampleFrame *frame = sample_frame_create(cpu_index_map_get_key_count(analyzer->cpu_index_map) - 1);
+    if (frame == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i <= frame->cpu_count; i++) {
+        frame->utilization[i] = SAMPLE_FRAME_OFFLINE;
+    }
 
-        if (cpu_count == 0) {
-            cpu_count = analyze_cpu_count(input);
+    bool produced = false;
+    unsigned long long int aggregate_time_diff = 0;
+    size_t online_cpu_count = 0;
+    for (size_t i = 0; i < row_count; i++) {
+        size_t slot = row_slots[i];
+        if (slot == CPU_INDEX_MAP_NO_SLOT) {
+            continue;
         }
 
-        CpuData *cpu_data = malloc(sizeof(CpuData) * cpu_count);
-        if (cpu_data == NULL) {
-            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in analyzer_thread.");
-            return NULL;
+        const CpuData *cpu_data = &analyzer->rows[i];
+        const CpuData *previous_cpu_data = &analyzer->previous_cpu_data[slot];
+        size_t key = cpu_index_map_get_slot_key(analyzer->cpu_index_map, slot);
+        if (key != 0) {
+            online_cpu_count++;
         }
-
-        char *token = strtok(input, "\n");
-        for (size_t i = 0; i < cpu_count; i++) {
-            analyze_line(token, &cpu_data[i]);
-            token = strtok(NULL, "\n");
+        if (analyzer->has_previous_cpu_data[slot]) {
+            unsigned long long int total_time_diff = cpu_data->total_time - previous_cpu_data->total_time;
+            if (key == 0) {
+                aggregate_time_diff = total_time_diff;
+            }
+            unsigned long long int idle_time_diff = cpu_data->idle_time - previous_cpu_data->idle_time;
+            //Sampling faster than the kernel tick leaves some counters unchanged. Such a CPU repeats its last
+            //value and keeps its baseline, so the next diff spans the whole gap.
+            if (total_time_diff == 0) {
+                frame->utilization[key] = analyzer->previous_utilization[slot];
+                produced = true;
+                continue;
+            }
+            frame->utilization[key] = sample_frame_basis_points(idle_time_diff, total_time_diff);
+            analyzer->previous_utilization[slot] = frame->utilization[key];
+            produced = true;
+        } else {
+            //Counters that do not move before the first diff accounted no time, the CPU is idle, not offline.
+            analyzer->previous_utilization[slot] = 0;
         }
-        free(input);
 
-        if (previous_cpu_data == NULL) {
-            previous_cpu_data = cpu_data;
+        analyzer->previous_cpu_data[slot] = *cpu_data;
+        analyzer->has_previous_cpu_data[slot] = true;
+    }
+
+    if (!produced) {
+        sample_frame_destroy(frame);
+        return NULL;
+    }
+
+    analyzer_fill_processes(frame, top, top_count, aggregate_time_diff, online_cpu_count);
+    analyzer_update_windows(analyzer, frame, timestamp_ns);
+    frame->timestamp_ns = timestamp_ns;
+    frame->sequence = analyzer->frame_sequence++;
+    return frame;
+}
+
+//Keeps the busiest processes of the sample sorted by ticks, busiest first. The list is short, so a sorted insert
+//beats a heap.
+static size_t analyzer_select_top_processes(const Buffer *const input, ProcessSample top[const]) {
+    const ProcessSample *samples = (const ProcessSample *) input->records;
+    size_t sample_count = input->records_length / sizeof(ProcessSample);
+
+    size_t top_count = 0;
+    for (size_t i = 0; i < sample_count; i++) {
+        if (top_count == SAMPLE_FRAME_TOP_PROCESSES && samples[i].ticks <= top[top_count - 1].ticks) {
             continue;
         }
 
-        bool error = false;
-        LongDoubleArray *array = long_double_array_create(cpu_count);
-        for (size_t i = 0; i < cpu_count; i++) {
-            unsigned long long int total_time_diff = cpu_data[i].total_time - previous_cpu_data[i].total_time;
-            unsigned long long int idle_time_diff = cpu_data[i].idle_time - previous_cpu_data[i].idle_time;
-            if (total_time_diff == 0) {
-                logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                           "Calculated total_time_diff = 0. Try increasing READER_UPDATE_INTERVAL.");
-                error = true;
-            }
-            long double percentage = (total_time_diff - idle_time_diff) * 100 / ((long double) total_time_diff);
-            array->buffer[i] = percentage;
+        size_t position = top_count < SAMPLE_FRAME_TOP_PROCESSES ? top_count++ : top_count - 1;
+        while (position > 0 && top[position - 1].ticks < samples[i].ticks) {
+            top[position] = top[position - 1];
+            position--;
+        }
+        top[position] = samples[i];
+    }
+    return top_count;
+}
+
+//Process ticks are relative to a single CPU, like top. The aggregate line counts ticks of every online CPU, so it
+//is divided by their number to get the elapsed ticks per CPU.
+static void analyzer_fill_processes(SampleFrame *const frame, const ProcessSample top[const], const size_t top_count,
+                                    const unsigned long long int aggregate_time_diff, const size_t cpu_count) {
+    if (aggregate_time_diff == 0 || cpu_count == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < top_count; i++) {
+        unsigned long long int utilization =
+                ((unsigned long long int) top[i].ticks * SAMPLE_FRAME_FULL_LOAD * cpu_count + aggregate_time_diff / 2) /
+                aggregate_time_diff;
+        frame->processes[i] = (SampleFrameProcess) {
+                .pid = top[i].pid,
+                .utilization = utilization > UINT32_MAX ? UINT32_MAX : (uint32_t) utilization
+        };
+        memcpy(frame->processes[i].command, top[i].command, PROCESS_SCANNER_COMMAND_LENGTH);
+    }
+    frame->process_count = (uint32_t) top_count;
+}
+
+static void analyzer_update_windows(Analyzer *const analyzer, SampleFrame *const frame, const uint64_t timestamp_ns) {
+    pthread_mutex_lock(&analyzer->rolling_windows_mutex);
+    rolling_windows_add(analyzer->rolling_windows, timestamp_ns, frame->utilization, frame->cpu_count + 1);
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        rolling_windows_get(analyzer->rolling_windows, 0, (enum ROLLING_WINDOW_SPAN) span, &frame->windows[span]);
+    }
+    pthread_mutex_unlock(&analyzer->rolling_windows_mutex);
+}
+
+//The newest frame of the batch is published to the snapshot before the batch is broadcast, the snapshot never lags
+//the Printers.
+static enum STAGE_STATUS analyzer_process(Stage *const stage, void *const context, void *items[const],
+                                          const size_t count) {
+    Analyzer *analyzer = (Analyzer *) context;
+
+    SampleFrame *outputs[STAGE_BATCH_SIZE];
+    size_t output_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        SampleFrame *frame = analyzer_process_input(analyzer, items[i]);
+        if (frame != NULL) {
+            outputs[output_count++] = frame;
         }
+    }
+
+    if (analyzer->snapshot != NULL && output_count > 0) {
+        frame_snapshot_publish(analyzer->snapshot, outputs[output_count - 1]);
+    }
 
-        if (!error) {
-            queue_lock(analyzer->analyzer_printer_queue);
-            while (queue_is_full(analyzer->analyzer_printer_queue)) {
-                queue_wait_to_insert_with_timeout(analyzer->analyzer_printer_queue, ANALYZER_QUEUE_WAIT_TIMEOUT);
-                if (analyzer_should_stop_synchronized(analyzer)) {
-                    queue_unlock(analyzer->analyzer_printer_queue);
-                    free(cpu_data);
-                    free(previous_cpu_data);
-                    long_double_array_destroy(array);
-                    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_thread: Ending.");
-                    return NULL;
-                }
+    size_t published = 0;
+    while (published < output_count) {
+        if (frame_broadcast_try_publish(analyzer->broadcast, outputs[published])) {
+            published++;
+            continue;
+        }
+        bool closed = !frame_broadcast_wait_until_publishable(analyzer->broadcast, stage_get_wait_timeout(stage));
+        stage_heartbeat(stage);
+        if (closed || stage_should_stop_synchronized(stage)) {
+            for (size_t i = published; i < output_count; i++) {
+                sample_frame_destroy(outputs[i]);
             }
-            queue_insert(analyzer->analyzer_printer_queue, array);
-            queue_notify_extract(analyzer->analyzer_printer_queue);
-            queue_unlock(analyzer->analyzer_printer_queue);
+            return STAGE_STATUS_STOPPED;
         }
-
-        free(previous_cpu_data);
-        previous_cpu_data = cpu_data;
     }
+    return STAGE_STATUS_CONTINUE;
+}
 
-    free(previous_cpu_data);
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "analyzer_thread: Ending.");
-    return NULL;
+//Subscribers take what was broadcast so far and end after it. On a stop request it also ends a wait to publish.
+static void analyzer_close_broadcast(void *const context) {
+    frame_broadcast_close(((Analyzer *) context)->broadcast);
 }
@@ -0,0 +1,207 @@
+#include <stdatomic.h>
+#include "../include/BufferPool.h"
+#include "../include/Queue.h"
+#include "../include/Logger.h"
+
+struct BufferPool {
+    size_t buffers;
+    //Return channel. Buffers travel back from the consumer to the producer through it, so the pool behaves as
+    //a single producer single consumer queue in steady state.
+    Queue *free_queue;
+    atomic_size_t allocation_count;
+    Buffer buffers_array[];
+};
+
+BufferPool *buffer_pool_create(const size_t buffers, const size_t buffer_capacity) {
+    LOGGER_DEBUG("buffer_pool_create: Entry.");
+
+    if (buffers <= 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_create call with buffers <= 0.");
+        return NULL;
+    }
+
+    if (buffer_capacity <= 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_create call with buffer_capacity <= 0.");
+        return NULL;
+    }
+
+    BufferPool *pool = malloc(sizeof(BufferPool) + sizeof(Buffer) * buffers);
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in buffer_pool_create.");
+        return NULL;
+    }
+
+    *pool = (BufferPool) {
+            .buffers = buffers,
+            .free_queue = queue_create_with_mode(buffers, QUEUE_MODE_SPSC)
+    };
+    atomic_init(&pool->allocation_count, 0);
+
+    if (pool->free_queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from queue_create call in buffer_pool_create.");
+        free(pool);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buffers; i++) {
+        pool->buffers_array[i] = (Buffer) {
+                .pool = pool,
+                .capacity = buffer_capacity,
+                .length = 0,
+                .timestamp_ns = 0,
+                .data = malloc(sizeof(char) * buffer_capacity),
+                .records_capacity = 0,
+                .records_length = 0,
+                .records = NULL
+        };
+
+        if (pool->buffers_array[i].data == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in buffer_pool_create.");
+            for (size_t j = 0; j < i; j++) {
+                free(pool->buffers_array[j].data);
+            }
+            queue_destroy(pool->free_queue);
+            free(pool);
+            return NULL;
+        }
+
+        atomic_fetch_add_explicit(&pool->allocation_count, 1, memory_order_relaxed);
+        queue_insert(pool->free_queue, &pool->buffers_array[i]);
+    }
+
+    LOGGER_DEBUG("buffer_pool_create: Success.");
+    return pool;
+}
+
+void buffer_pool_destroy(BufferPool *const pool) {
+    LOGGER_DEBUG("buffer_pool_destroy: Entry.");
+
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_destroy call with pool = NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < pool->buffers; i++) {
+        free(pool->buffers_array[i].data);
+        free(pool->buffers_array[i].records);
+    }
+    queue_destroy(pool->free_queue);
+    free(pool);
+
+    LOGGER_DEBUG("buffer_pool_destroy: Success.");
+}
+
+Buffer *buffer_pool_try_acquire(BufferPool *const pool) {
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_try_acquire call with pool = NULL.");
+        return NULL;
+    }
+
+    Buffer *buffer = queue_try_pop(pool->free_queue);
+    if (buffer != NULL) {
+        buffer->length = 0;
+        buffer->records_length = 0;
+    }
+    return buffer;
+}
+
+//Returns false once the pool is closed.
+bool buffer_pool_wait_to_acquire(BufferPool *const pool, const struct timespec timeout) {
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_wait_to_acquire call with pool = NULL.");
+        return false;
+    }
+
+    return queue_wait_until_not_empty(pool->free_queue, timeout);
+}
+
+//Wakes a thread blocked in buffer_pool_wait_to_acquire. Releasing buffers keeps working.
+void buffer_pool_close(BufferPool *const pool) {
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_close call with pool = NULL.");
+        return;
+    }
+
+    queue_close(pool->free_queue);
+}
+
+void buffer_pool_release(Buffer *const buffer) {
+    if (buffer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_release call with buffer = NULL.");
+        return;
+    }
+
+    if (!queue_try_push(buffer->pool->free_queue, buffer)) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received buffer_pool_release call with a buffer that is already released.");
+    }
+}
+
+bool buffer_reserve(Buffer *const buffer, const size_t capacity) {
+    if (buffer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_reserve call with buffer = NULL.");
+        return false;
+    }
+
+    if (capacity <= buffer->capacity) {
+        return true;
+    }
+
+    //Contents are not preserved, callers reserve before filling the buffer.
+    char *data = malloc(sizeof(char) * capacity);
+    if (data == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in buffer_reserve.");
+        return false;
+    }
+
+    free(buffer->data);
+    buffer->data = data;
+    buffer->capacity = capacity;
+    buffer->length = 0;
+    atomic_fetch_add_explicit(&buffer->pool->allocation_count, 1, memory_order_relaxed);
+    return true;
+}
+
+bool buffer_reserve_records(Buffer *const buffer, const size_t capacity) {
+    if (buffer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_reserve_records call with buffer = NULL.");
+        return false;
+    }
+
+    if (capacity <= buffer->records_capacity) {
+        return true;
+    }
+
+    //Same policy as the text, the records are rewritten right after the reservation.
+    char *records = malloc(sizeof(char) * capacity);
+    if (records == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in buffer_reserve_records.");
+        return false;
+    }
+
+    free(buffer->records);
+    buffer->records = records;
+    buffer->records_capacity = capacity;
+    buffer->records_length = 0;
+    atomic_fetch_add_explicit(&buffer->pool->allocation_count, 1, memory_order_relaxed);
+    return true;
+}
+
+size_t buffer_pool_get_allocation_count(const BufferPool *const pool) {
+    if (pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received buffer_pool_get_allocation_count call with pool = NULL.");
+        return 0;
+    }
+
+    return atomic_load_explicit(&pool->allocation_count, memory_order_relaxed);
+}
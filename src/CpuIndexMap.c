@@ -0,0 +1,260 @@
+#include "../include/CpuIndexMap.h"
+#include "../include/Logger.h"
+
+//Keys are CPU ids shifted by one so that the aggregate line owns key 0. Ids above the limit are ignored, they can
+//only come from a corrupted snapshot and would otherwise size the key table.
+static const size_t CPU_INDEX_MAP_MAX_KEY = 65536;
+
+struct CpuIndexMap {
+    size_t *key_to_slot;
+    size_t key_capacity;
+    size_t key_count;
+
+    size_t *slot_keys;
+    bool *slot_online;
+    size_t slot_count;
+    size_t slot_capacity;
+
+    //Row layout of the previous sample. While it repeats, the cached slots are returned as they are.
+    size_t *row_keys;
+    size_t *row_slots;
+    size_t row_count;
+    size_t row_capacity;
+
+    size_t generation;
+};
+
+static bool cpu_index_map_reserve_rows(CpuIndexMap *map, size_t row_count);
+
+static size_t cpu_index_map_find_or_add_slot(CpuIndexMap *map, size_t key);
+
+static void cpu_index_map_rebuild(CpuIndexMap *map, const CpuData rows[], size_t row_count);
+
+CpuIndexMap *cpu_index_map_create(void) {
+    CpuIndexMap *map = malloc(sizeof(CpuIndexMap));
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in cpu_index_map_create.");
+        return NULL;
+    }
+
+    *map = (CpuIndexMap) {
+            .key_to_slot = NULL,
+            .key_capacity = 0,
+            .key_count = 0,
+            .slot_keys = NULL,
+            .slot_online = NULL,
+            .slot_count = 0,
+            .slot_capacity = 0,
+            .row_keys = NULL,
+            .row_slots = NULL,
+            .row_count = 0,
+            .row_capacity = 0,
+            .generation = 0
+    };
+
+    return map;
+}
+
+void cpu_index_map_destroy(CpuIndexMap *const map) {
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_destroy call with map = NULL.");
+        return;
+    }
+
+    free(map->key_to_slot);
+    free(map->slot_keys);
+    free(map->slot_online);
+    free(map->row_keys);
+    free(map->row_slots);
+    free(map);
+}
+
+//Returns the slot of every row, valid until the next update. Slots are dense and stable: a CPU keeps its slot
+//while it is offline and gets it back when it returns.
+const size_t *cpu_index_map_update(CpuIndexMap *const map, const CpuData rows[const], const size_t row_count) {
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_update call with map = NULL.");
+        return NULL;
+    }
+
+    if (rows == NULL && row_count > 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_update call with rows = NULL.");
+        return NULL;
+    }
+
+    if (row_count == map->row_count) {
+        size_t i = 0;
+        while (i < row_count && map->row_keys[i] == cpu_index_map_key(rows[i].cpu_id)) {
+            i++;
+        }
+        if (i == row_count) {
+            return map->row_slots;
+        }
+    }
+
+    if (!cpu_index_map_reserve_rows(map, row_count)) {
+        return NULL;
+    }
+
+    cpu_index_map_rebuild(map, rows, row_count);
+    return map->row_slots;
+}
+
+size_t cpu_index_map_get_generation(const CpuIndexMap *const map) {
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_get_generation call with map = NULL.");
+        return 0;
+    }
+
+    return map->generation;
+}
+
+size_t cpu_index_map_get_slot_count(const CpuIndexMap *const map) {
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_get_slot_count call with map = NULL.");
+        return 0;
+    }
+
+    return map->slot_count;
+}
+
+size_t cpu_index_map_get_slot_key(const CpuIndexMap *const map, const size_t slot) {
+    if (map == NULL || slot >= map->slot_count) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_get_slot_key call with an invalid slot.");
+        return 0;
+    }
+
+    return map->slot_keys[slot];
+}
+
+bool cpu_index_map_is_online(const CpuIndexMap *const map, const size_t slot) {
+    if (map == NULL || slot >= map->slot_count) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_is_online call with an invalid slot.");
+        return false;
+    }
+
+    return map->slot_online[slot];
+}
+
+size_t cpu_index_map_get_key_count(const CpuIndexMap *const map) {
+    if (map == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received cpu_index_map_get_key_count call with map = NULL.");
+        return 0;
+    }
+
+    return map->key_count;
+}
+
+size_t cpu_index_map_key(const size_t cpu_id) {
+    return cpu_id == STAT_PARSER_AGGREGATE_ID ? 0 : cpu_id + 1;
+}
+
+static bool cpu_index_map_reserve_rows(CpuIndexMap *const map, const size_t row_count) {
+    if (row_count <= map->row_capacity) {
+        return true;
+    }
+
+    size_t *row_keys = realloc(map->row_keys, sizeof(size_t) * row_count);
+    if (row_keys == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in cpu_index_map_update.");
+        return false;
+    }
+    map->row_keys = row_keys;
+
+    size_t *row_slots = realloc(map->row_slots, sizeof(size_t) * row_count);
+    if (row_slots == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in cpu_index_map_update.");
+        return false;
+    }
+    map->row_slots = row_slots;
+    map->row_capacity = row_count;
+    return true;
+}
+
+static size_t cpu_index_map_find_or_add_slot(CpuIndexMap *const map, const size_t key) {
+    if (key >= CPU_INDEX_MAP_MAX_KEY) {
+        return CPU_INDEX_MAP_NO_SLOT;
+    }
+
+    if (key >= map->key_capacity) {
+        size_t key_capacity = map->key_capacity > 0 ? map->key_capacity : 64;
+        while (key_capacity <= key) {
+            key_capacity *= 2;
+        }
+
+        size_t *key_to_slot = realloc(map->key_to_slot, sizeof(size_t) * key_capacity);
+        if (key_to_slot == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in cpu_index_map_find_or_add_slot.");
+            return CPU_INDEX_MAP_NO_SLOT;
+        }
+        for (size_t i = map->key_capacity; i < key_capacity; i++) {
+            key_to_slot[i] = CPU_INDEX_MAP_NO_SLOT;
+        }
+        map->key_to_slot = key_to_slot;
+        map->key_capacity = key_capacity;
+    }
+
+    if (map->key_to_slot[key] != CPU_INDEX_MAP_NO_SLOT) {
+        return map->key_to_slot[key];
+    }
+
+    if (map->slot_count == map->slot_capacity) {
+        size_t slot_capacity = map->slot_capacity > 0 ? map->slot_capacity * 2 : 64;
+
+        size_t *slot_keys = realloc(map->slot_keys, sizeof(size_t) * slot_capacity);
+        if (slot_keys == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in cpu_index_map_find_or_add_slot.");
+            return CPU_INDEX_MAP_NO_SLOT;
+        }
+        map->slot_keys = slot_keys;
+
+        bool *slot_online = realloc(map->slot_online, sizeof(bool) * slot_capacity);
+        if (slot_online == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in cpu_index_map_find_or_add_slot.");
+            return CPU_INDEX_MAP_NO_SLOT;
+        }
+        map->slot_online = slot_online;
+        map->slot_capacity = slot_capacity;
+    }
+
+    size_t slot = map->slot_count++;
+    map->slot_keys[slot] = key;
+    map->slot_online[slot] = false;
+    map->key_to_slot[key] = slot;
+    if (key >= map->key_count) {
+        map->key_count = key + 1;
+    }
+    return slot;
+}
+
+//Only runs when the set or order of CPUs differs from the previous sample. Existing slots are kept, new CPUs are
+//appended and every slot without a row is marked offline.
+static void cpu_index_map_rebuild(CpuIndexMap *const map, const CpuData rows[const], const size_t row_count) {
+    for (size_t slot = 0; slot < map->slot_count; slot++) {
+        map->slot_online[slot] = false;
+    }
+
+    for (size_t i = 0; i < row_count; i++) {
+        size_t key = cpu_index_map_key(rows[i].cpu_id);
+        size_t slot = cpu_index_map_find_or_add_slot(map, key);
+        if (slot != CPU_INDEX_MAP_NO_SLOT) {
+            map->slot_online[slot] = true;
+        }
+        map->row_keys[i] = key;
+        map->row_slots[i] = slot;
+    }
+
+    map->row_count = row_count;
+    map->generation++;
+}
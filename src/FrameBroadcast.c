@@ -0,0 +1,457 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "../include/FrameBroadcast.h"
+#include "../include/Logger.h"
+
+//A frame and the number of subscribers that still have to take and release it, or skip it.
+typedef struct FrameBroadcastSlot {
+    SampleFrame *frame;
+    size_t references;
+} FrameBroadcastSlot;
+
+//Frames before next are taken, the ones before released are given back as well. A closed subscriber takes nothing
+//more and is not counted in frames published after it closed.
+typedef struct FrameBroadcastSubscriber {
+    bool active;
+    bool closed;
+    enum FRAME_BROADCAST_POLICY policy;
+    uint64_t next;
+    uint64_t released;
+    uint64_t dropped;
+} FrameBroadcastSubscriber;
+
+//One producer hands every frame to all subscribers without copying it. Frame sequence s lives in slot
+//s % capacity, head is the sequence of the next frame. Each subscriber reads at its own cursor and a frame is
+//destroyed once the last subscriber released or skipped it, so its slot can take a new one.
+struct FrameBroadcast {
+    size_t capacity;
+    uint64_t head;
+    pthread_mutex_t mutex;
+    pthread_cond_t can_publish;
+    pthread_cond_t can_acquire;
+    atomic_bool closed;
+    FrameBroadcastSubscriber subscribers[FRAME_BROADCAST_MAX_SUBSCRIBERS];
+    FrameBroadcastSlot slots[];
+};
+
+static struct timespec frame_broadcast_deadline_after(struct timespec timeout);
+
+static bool frame_broadcast_init_condition(pthread_cond_t *condition);
+
+static FrameBroadcastSubscriber *frame_broadcast_get_subscriber(FrameBroadcast *broadcast, size_t subscriber);
+
+static void frame_broadcast_unreference(FrameBroadcast *broadcast, uint64_t from, uint64_t to);
+
+static bool frame_broadcast_make_room(FrameBroadcast *broadcast);
+
+FrameBroadcast *frame_broadcast_create(const size_t capacity) {
+    if (capacity == 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_create call with capacity = 0.");
+        return NULL;
+    }
+
+    FrameBroadcast *broadcast = malloc(sizeof(FrameBroadcast) + sizeof(FrameBroadcastSlot) * capacity);
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received NULL from malloc call in frame_broadcast_create.");
+        return NULL;
+    }
+
+    *broadcast = (FrameBroadcast) {
+            .capacity = capacity,
+            .head = 0,
+            .mutex = PTHREAD_MUTEX_INITIALIZER
+    };
+    atomic_init(&broadcast->closed, false);
+    for (size_t i = 0; i < capacity; i++) {
+        broadcast->slots[i] = (FrameBroadcastSlot) {.frame = NULL, .references = 0};
+    }
+
+    if (!frame_broadcast_init_condition(&broadcast->can_publish)) {
+        free(broadcast);
+        return NULL;
+    }
+    if (!frame_broadcast_init_condition(&broadcast->can_acquire)) {
+        pthread_cond_destroy(&broadcast->can_publish);
+        free(broadcast);
+        return NULL;
+    }
+
+    return broadcast;
+}
+
+//Frames still in the ring are destroyed, subscribers must not hold any by now.
+void frame_broadcast_destroy(FrameBroadcast *const broadcast) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_destroy call with broadcast = NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < broadcast->capacity; i++) {
+        if (broadcast->slots[i].frame != NULL) {
+            sample_frame_destroy(broadcast->slots[i].frame);
+        }
+    }
+    pthread_mutex_destroy(&broadcast->mutex);
+    pthread_cond_destroy(&broadcast->can_acquire);
+    pthread_cond_destroy(&broadcast->can_publish);
+    free(broadcast);
+}
+
+//Called by the producer after its last frame. Subscribers still take what is in the ring before their waits fail.
+void frame_broadcast_close(FrameBroadcast *const broadcast) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_close call with broadcast = NULL.");
+        return;
+    }
+
+    atomic_store(&broadcast->closed, true);
+    pthread_mutex_lock(&broadcast->mutex);
+    pthread_cond_broadcast(&broadcast->can_publish);
+    pthread_cond_broadcast(&broadcast->can_acquire);
+    pthread_mutex_unlock(&broadcast->mutex);
+}
+
+bool frame_broadcast_is_closed(const FrameBroadcast *const broadcast) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_is_closed call with broadcast = NULL.");
+        return true;
+    }
+
+    return atomic_load(&broadcast->closed);
+}
+
+//The subscriber gets frames published from now on. Returns FRAME_BROADCAST_INVALID_SUBSCRIBER when all
+//FRAME_BROADCAST_MAX_SUBSCRIBERS are taken.
+size_t frame_broadcast_subscribe(FrameBroadcast *const broadcast, const enum FRAME_BROADCAST_POLICY policy) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_subscribe call with broadcast = NULL.");
+        return FRAME_BROADCAST_INVALID_SUBSCRIBER;
+    }
+
+    if (policy != FRAME_BROADCAST_POLICY_BLOCK && policy != FRAME_BROADCAST_POLICY_DROP_OLDEST) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_subscribe call with unknown policy.");
+        return FRAME_BROADCAST_INVALID_SUBSCRIBER;
+    }
+
+    size_t subscriber = FRAME_BROADCAST_INVALID_SUBSCRIBER;
+    pthread_mutex_lock(&broadcast->mutex);
+    for (size_t i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (!broadcast->subscribers[i].active) {
+            broadcast->subscribers[i] = (FrameBroadcastSubscriber) {
+                    .active = true,
+                    .closed = false,
+                    .policy = policy,
+                    .next = broadcast->head,
+                    .released = broadcast->head,
+                    .dropped = 0
+            };
+            subscriber = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+
+    if (subscriber == FRAME_BROADCAST_INVALID_SUBSCRIBER) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "No free subscriber in frame_broadcast_subscribe.");
+    }
+    return subscriber;
+}
+
+//Gives back every frame the subscriber holds or did not take yet.
+void frame_broadcast_unsubscribe(FrameBroadcast *const broadcast, const size_t subscriber) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_unsubscribe call with broadcast = NULL.");
+        return;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_unsubscribe call with an unknown subscriber.");
+        return;
+    }
+
+    frame_broadcast_unreference(broadcast, entry->released, entry->closed ? entry->next : broadcast->head);
+    entry->active = false;
+    pthread_cond_signal(&broadcast->can_publish);
+    pthread_mutex_unlock(&broadcast->mutex);
+}
+
+//Wakes the subscriber wherever it waits and lets its waits fail from now on, so it stops without draining. Frames
+//it did not take are given back right away, the ones it holds once it releases them.
+void frame_broadcast_close_subscriber(FrameBroadcast *const broadcast, const size_t subscriber) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_close_subscriber call with broadcast = NULL.");
+        return;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_close_subscriber call with an unknown subscriber.");
+        return;
+    }
+
+    if (!entry->closed) {
+        frame_broadcast_unreference(broadcast, entry->next, broadcast->head);
+        entry->closed = true;
+    }
+    pthread_cond_signal(&broadcast->can_publish);
+    pthread_cond_broadcast(&broadcast->can_acquire);
+    pthread_mutex_unlock(&broadcast->mutex);
+}
+
+//Hands frame to every subscriber, or destroys it right away when there is none. Returns false and leaves frame
+//with the caller when the broadcast is closed or a subscriber still needs the slot it would take.
+bool frame_broadcast_try_publish(FrameBroadcast *const broadcast, SampleFrame *const frame) {
+    if (broadcast == NULL || frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_try_publish call with broadcast = NULL or frame = NULL.");
+        return false;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    if (atomic_load(&broadcast->closed) || !frame_broadcast_make_room(broadcast)) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        return false;
+    }
+
+    size_t references = 0;
+    for (size_t i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (broadcast->subscribers[i].active && !broadcast->subscribers[i].closed) {
+            references++;
+        }
+    }
+
+    if (references == 0) {
+        sample_frame_destroy(frame);
+    } else {
+        broadcast->slots[broadcast->head % broadcast->capacity] = (FrameBroadcastSlot) {
+                .frame = frame,
+                .references = references
+        };
+    }
+    broadcast->head++;
+    pthread_cond_broadcast(&broadcast->can_acquire);
+    pthread_mutex_unlock(&broadcast->mutex);
+    return true;
+}
+
+//Returns false once the broadcast is closed, true otherwise. A true result does not guarantee room, the caller
+//retries.
+bool frame_broadcast_wait_until_publishable(FrameBroadcast *const broadcast, const struct timespec timeout) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_wait_until_publishable call with broadcast = NULL.");
+        return false;
+    }
+
+    struct timespec deadline = frame_broadcast_deadline_after(timeout);
+    pthread_mutex_lock(&broadcast->mutex);
+    if (!atomic_load(&broadcast->closed) && !frame_broadcast_make_room(broadcast)) {
+        pthread_cond_timedwait(&broadcast->can_publish, &broadcast->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+    return !atomic_load(&broadcast->closed);
+}
+
+//Takes up to max_count frames in publishing order. They stay valid and must not be changed until
+//frame_broadcast_release, other subscribers read the same frames.
+size_t frame_broadcast_acquire_batch(FrameBroadcast *const broadcast, const size_t subscriber,
+                                     SampleFrame *frames[const], const size_t max_count) {
+    if (broadcast == NULL || frames == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_acquire_batch call with broadcast = NULL or frames = NULL.");
+        return 0;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    if (entry == NULL || entry->closed) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        return 0;
+    }
+
+    size_t count = 0;
+    while (count < max_count && entry->next < broadcast->head) {
+        frames[count++] = broadcast->slots[entry->next % broadcast->capacity].frame;
+        entry->next++;
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+    return count;
+}
+
+//Gives back every frame the subscriber took so far. The last subscriber to release a frame destroys it.
+void frame_broadcast_release(FrameBroadcast *const broadcast, const size_t subscriber) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_release call with broadcast = NULL.");
+        return;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_release call with an unknown subscriber.");
+        return;
+    }
+
+    if (entry->released < entry->next) {
+        frame_broadcast_unreference(broadcast, entry->released, entry->next);
+        entry->released = entry->next;
+        pthread_cond_signal(&broadcast->can_publish);
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+}
+
+//Returns false once the subscriber is closed, or once the broadcast is closed and the subscriber took every frame.
+//A true result does not guarantee a frame, the caller retries.
+bool frame_broadcast_wait_until_available(FrameBroadcast *const broadcast, const size_t subscriber,
+                                          const struct timespec timeout) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_wait_until_available call with broadcast = NULL.");
+        return false;
+    }
+
+    struct timespec deadline = frame_broadcast_deadline_after(timeout);
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&broadcast->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_wait_until_available call with an unknown subscriber.");
+        return false;
+    }
+
+    if (!entry->closed && entry->next == broadcast->head && !atomic_load(&broadcast->closed)) {
+        pthread_cond_timedwait(&broadcast->can_acquire, &broadcast->mutex, &deadline);
+    }
+    bool available = !entry->closed && (entry->next < broadcast->head || !atomic_load(&broadcast->closed));
+    pthread_mutex_unlock(&broadcast->mutex);
+    return available;
+}
+
+//Frames a DROP_OLDEST subscriber skipped because it fell a full ring behind.
+uint64_t frame_broadcast_get_dropped_count(FrameBroadcast *const broadcast, const size_t subscriber) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_get_dropped_count call with broadcast = NULL.");
+        return 0;
+    }
+
+    pthread_mutex_lock(&broadcast->mutex);
+    FrameBroadcastSubscriber *entry = frame_broadcast_get_subscriber(broadcast, subscriber);
+    uint64_t dropped = entry != NULL ? entry->dropped : 0;
+    pthread_mutex_unlock(&broadcast->mutex);
+    return dropped;
+}
+
+size_t frame_broadcast_get_subscriber_count(FrameBroadcast *const broadcast) {
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_broadcast_get_subscriber_count call with broadcast = NULL.");
+        return 0;
+    }
+
+    size_t count = 0;
+    pthread_mutex_lock(&broadcast->mutex);
+    for (size_t i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        if (broadcast->subscribers[i].active) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&broadcast->mutex);
+    return count;
+}
+
+//Condition variables wait on CLOCK_MONOTONIC, so a stepped wall clock neither stretches nor cuts short a timeout.
+static struct timespec frame_broadcast_deadline_after(const struct timespec timeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ts.tv_sec += timeout.tv_sec;
+    ts.tv_nsec += timeout.tv_nsec;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+static bool frame_broadcast_init_condition(pthread_cond_t *const condition) {
+    pthread_condattr_t attributes;
+    if (pthread_condattr_init(&attributes) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received error from pthread_condattr_init in frame_broadcast_create.");
+        return false;
+    }
+
+    bool success = pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) == 0 &&
+                   pthread_cond_init(condition, &attributes) == 0;
+    pthread_condattr_destroy(&attributes);
+    if (!success) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received error from pthread_cond_init in frame_broadcast_create.");
+    }
+    return success;
+}
+
+//Requires the mutex. NULL for a subscriber that is not active.
+static FrameBroadcastSubscriber *frame_broadcast_get_subscriber(FrameBroadcast *const broadcast,
+                                                                const size_t subscriber) {
+    if (subscriber >= FRAME_BROADCAST_MAX_SUBSCRIBERS || !broadcast->subscribers[subscriber].active) {
+        return NULL;
+    }
+    return &broadcast->subscribers[subscriber];
+}
+
+//Requires the mutex. Drops one reference from each frame in [from, to) and destroys those nobody references.
+static void frame_broadcast_unreference(FrameBroadcast *const broadcast, const uint64_t from, const uint64_t to) {
+    for (uint64_t sequence = from; sequence < to; sequence++) {
+        FrameBroadcastSlot *slot = &broadcast->slots[sequence % broadcast->capacity];
+        if (--slot->references == 0) {
+            sample_frame_destroy(slot->frame);
+            slot->frame = NULL;
+        }
+    }
+}
+
+//Requires the mutex. Frees the slot of the next frame if it is still taken by the frame a full ring back, which
+//DROP_OLDEST subscribers skip if they did not take it yet. Frames older than that were destroyed before, so that
+//frame is the only one such a subscriber can be behind on. Returns false while others still need it.
+static bool frame_broadcast_make_room(FrameBroadcast *const broadcast) {
+    FrameBroadcastSlot *slot = &broadcast->slots[broadcast->head % broadcast->capacity];
+    if (slot->frame == NULL) {
+        return true;
+    }
+
+    uint64_t oldest = broadcast->head - broadcast->capacity;
+    for (size_t i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        FrameBroadcastSubscriber *entry = &broadcast->subscribers[i];
+        if (entry->active && !entry->closed && entry->policy == FRAME_BROADCAST_POLICY_DROP_OLDEST &&
+            entry->next == oldest) {
+            entry->next++;
+            entry->released++;
+            entry->dropped++;
+            frame_broadcast_unreference(broadcast, oldest, oldest + 1);
+        }
+    }
+    return slot->frame == NULL;
+}
@@ -0,0 +1,182 @@
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include "../include/FrameSnapshot.h"
+#include "../include/CacheLine.h"
+#include "../include/Logger.h"
+
+//One of two frames behind its own sequence lock. The writer makes sequence odd, copies the frame in and makes it
+//even again; readers copy the frame out and retry if sequence was odd or moved meanwhile.
+typedef struct FrameSnapshotBuffer {
+    alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t sequence;
+} FrameSnapshotBuffer;
+
+//The newest frame, double buffered. Publish number version goes to buffer version % 2 and version is only raised
+//once that copy is complete, so readers copy the other buffer from the one being written. A reader only retries
+//when the writer came around to its buffer again while it was copying. The writer never waits for readers, readers
+//never take a lock and their statistics live on a line of their own. Version 0 means nothing was published yet.
+struct FrameSnapshot {
+    alignas(CACHE_LINE_SIZE) size_t cpu_capacity;
+    SampleFrame *frames[2];
+    alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t version;
+    FrameSnapshotBuffer buffers[2];
+    alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t read_count;
+    atomic_uint_fast64_t retry_count;
+};
+
+static size_t frame_snapshot_header_size(void);
+
+//CPUs beyond cpu_capacity are left out of published frames.
+FrameSnapshot *frame_snapshot_create(const size_t cpu_capacity) {
+    FrameSnapshot *snapshot = aligned_alloc(CACHE_LINE_SIZE, sizeof(FrameSnapshot));
+    if (snapshot == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from aligned_alloc call in frame_snapshot_create.");
+        return NULL;
+    }
+
+    SampleFrame *first = sample_frame_create(cpu_capacity);
+    SampleFrame *second = sample_frame_create(cpu_capacity);
+    if (first == NULL || second == NULL) {
+        sample_frame_destroy(first);
+        sample_frame_destroy(second);
+        free(snapshot);
+        return NULL;
+    }
+
+    *snapshot = (FrameSnapshot) {
+            .cpu_capacity = cpu_capacity,
+            .frames = {first, second}
+    };
+    atomic_init(&snapshot->version, 0);
+    atomic_init(&snapshot->buffers[0].sequence, 0);
+    atomic_init(&snapshot->buffers[1].sequence, 0);
+    atomic_init(&snapshot->read_count, 0);
+    atomic_init(&snapshot->retry_count, 0);
+    return snapshot;
+}
+
+void frame_snapshot_destroy(FrameSnapshot *const snapshot) {
+    if (snapshot == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received frame_snapshot_destroy call with snapshot = NULL.");
+        return;
+    }
+
+    sample_frame_destroy(snapshot->frames[0]);
+    sample_frame_destroy(snapshot->frames[1]);
+    free(snapshot);
+}
+
+//Only one thread may publish, readers can be any number of threads.
+void frame_snapshot_publish(FrameSnapshot *const snapshot, const SampleFrame *const frame) {
+    if (snapshot == NULL || frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_snapshot_publish call with snapshot = NULL or frame = NULL.");
+        return;
+    }
+
+    size_t cpu_count = frame->cpu_count < snapshot->cpu_capacity ? frame->cpu_count : snapshot->cpu_capacity;
+    uint_fast64_t version = atomic_load_explicit(&snapshot->version, memory_order_relaxed) + 1;
+    FrameSnapshotBuffer *buffer = &snapshot->buffers[version % 2];
+    SampleFrame *target = snapshot->frames[version % 2];
+    uint_fast64_t sequence = atomic_load_explicit(&buffer->sequence, memory_order_relaxed);
+    atomic_store_explicit(&buffer->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(target, frame, frame_snapshot_header_size());
+    memcpy(target->utilization, frame->utilization, sizeof(uint16_t) * (cpu_count + 1));
+    target->cpu_count = (uint32_t) cpu_count;
+
+    atomic_store_explicit(&buffer->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&snapshot->version, version, memory_order_release);
+}
+
+//Copies the newest frame into copy, which must have room for frame_snapshot_get_cpu_capacity CPUs. Returns false
+//if nothing was published yet.
+bool frame_snapshot_read(FrameSnapshot *const snapshot, SampleFrame *const copy) {
+    uint64_t version;
+    return frame_snapshot_read_versioned(snapshot, copy, &version);
+}
+
+//Like frame_snapshot_read, version is set to the publish number of the copied frame. A copy that raced with the
+//writer may be torn, it is only trusted after the sequence of its buffer is seen unchanged, and cpu_count is clamped
+//before it sizes anything. The writer may have come around to the buffer again between the version load and the
+//sequence load, so the version is taken from the sequence: buffer b holds publish 2 * writes - b.
+bool frame_snapshot_read_versioned(FrameSnapshot *const snapshot, SampleFrame *const copy, uint64_t *const version) {
+    if (snapshot == NULL || copy == NULL || version == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_snapshot_read_versioned call with snapshot = NULL, copy = NULL or version = NULL.");
+        return false;
+    }
+
+    for (;;) {
+        uint_fast64_t current = atomic_load_explicit(&snapshot->version, memory_order_acquire);
+        if (current == 0) {
+            return false;
+        }
+
+        FrameSnapshotBuffer *buffer = &snapshot->buffers[current % 2];
+        const SampleFrame *source = snapshot->frames[current % 2];
+        uint_fast64_t before = atomic_load_explicit(&buffer->sequence, memory_order_acquire);
+        if (before % 2 == 1) {
+            //The writer is in the middle of a copy and may have been preempted there, spinning would not help it.
+            atomic_fetch_add_explicit(&snapshot->retry_count, 1, memory_order_relaxed);
+            sched_yield();
+            continue;
+        }
+
+        memcpy(copy, source, frame_snapshot_header_size());
+        size_t cpu_count = copy->cpu_count < snapshot->cpu_capacity ? copy->cpu_count : snapshot->cpu_capacity;
+        memcpy(copy->utilization, source->utilization, sizeof(uint16_t) * (cpu_count + 1));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&buffer->sequence, memory_order_relaxed) == before) {
+            copy->cpu_count = (uint32_t) cpu_count;
+            *version = before - current % 2;
+            atomic_fetch_add_explicit(&snapshot->read_count, 1, memory_order_relaxed);
+            return true;
+        }
+        atomic_fetch_add_explicit(&snapshot->retry_count, 1, memory_order_relaxed);
+    }
+}
+
+//Number of frames published so far, a single load. Pollers compare it to the version of their last copy and skip
+//the read while nothing changed.
+uint64_t frame_snapshot_get_version(FrameSnapshot *const snapshot) {
+    if (snapshot == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_snapshot_get_version call with snapshot = NULL.");
+        return 0;
+    }
+
+    return atomic_load_explicit(&snapshot->version, memory_order_acquire);
+}
+
+void frame_snapshot_get_stats(FrameSnapshot *const snapshot, FrameSnapshotStats *const stats) {
+    if (snapshot == NULL || stats == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_snapshot_get_stats call with snapshot = NULL or stats = NULL.");
+        return;
+    }
+
+    *stats = (FrameSnapshotStats) {
+            .version = atomic_load_explicit(&snapshot->version, memory_order_relaxed),
+            .reads = atomic_load_explicit(&snapshot->read_count, memory_order_relaxed),
+            .retries = atomic_load_explicit(&snapshot->retry_count, memory_order_relaxed)
+    };
+}
+
+size_t frame_snapshot_get_cpu_capacity(const FrameSnapshot *const snapshot) {
+    if (snapshot == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received frame_snapshot_get_cpu_capacity call with snapshot = NULL.");
+        return 0;
+    }
+
+    return snapshot->cpu_capacity;
+}
+
+static size_t frame_snapshot_header_size(void) {
+    return offsetof(SampleFrame, utilization);
+}
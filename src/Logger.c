@@ -1,37 +1,134 @@
 #include <pthread.h>
+#include <stdarg.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include "../include/CacheLine.h"
 #include "../include/Logger.h"
 
+#define LOGGER_RECORD_MESSAGE_LENGTH 224
+#define LOGGER_TIME_STRING_LENGTH 32
+
 static pthread_mutex_t global_logger_mutex = PTHREAD_MUTEX_INITIALIZER;
 static Logger *global_logger = NULL;
 static const char *enum_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
 static const enum LOGGER_LEVEL LOGGER_MINIMUM_LOGGING_LEVEL = LOGGER_LEVEL_DEBUG;
+static const enum LOGGER_MODE LOGGER_GLOBAL_MODE = LOGGER_MODE_ASYNC;
+//Power of two, at the flush interval below it absorbs bursts of about 200000 messages per second.
+static const size_t LOGGER_RING_CAPACITY = 4096;
+static const struct timespec LOGGER_FLUSH_INTERVAL = {.tv_sec = 0, .tv_nsec = 20000000};
+
+//When a line was logged. second comes from the coarse wall clock, only good enough to name the second, and selects
+//the cached date. monotonic_ns gives the microseconds since the logger was created, which order lines across threads.
+typedef struct LoggerTimestamp {
+    time_t second;
+    uint64_t monotonic_ns;
+} LoggerTimestamp;
+
+//A slot of the ring. sequence tells its state: equal to the position a producer may claim it at, one more once the
+//message is written, one ring capacity more once the flusher has consumed it.
+typedef struct LoggerRecord {
+    atomic_size_t sequence;
+    enum LOGGER_LEVEL level;
+    LoggerTimestamp timestamp;
+    char message[LOGGER_RECORD_MESSAGE_LENGTH];
+} LoggerRecord;
 
+//In ASYNC mode producers claim a slot of the bounded MPSC ring with a compare and swap on tail and never block: a
+//full ring drops the message and counts it. The flusher thread formats whatever is ready every flush interval and
+//writes it with one fflush. ERROR messages are written synchronously, after draining the ring, so the lines
+//before an error are on disk when it is. Consuming happens under mutex, which makes the flusher and an ERROR
+//writer take turns as the single consumer. The formatted date is kept for the second it names, so writing a line
+//only formats it when the second changes.
 struct Logger {
     FILE *log_file;
     pthread_mutex_t mutex;
+    enum LOGGER_MODE mode;
+    uint64_t start_ns;
+    time_t cached_second;
+    char cached_time_string[LOGGER_TIME_STRING_LENGTH];
+    LoggerRecord *records;
+    size_t head;
+    uint64_t reported_dropped_count;
+    pthread_t flusher;
+    atomic_bool should_stop;
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+    alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t dropped_count;
 };
 
+static LoggerTimestamp logger_now(void);
+
+static void logger_write_line(Logger *logger, enum LOGGER_LEVEL level, LoggerTimestamp timestamp,
+                              const char message[]);
+
+static void logger_write_synchronized(Logger *logger, enum LOGGER_LEVEL level, const char message[]);
+
+static LoggerRecord *logger_claim(Logger *logger, enum LOGGER_LEVEL level, size_t *position);
+
+static void logger_commit(LoggerRecord *record, size_t position);
+
+static size_t logger_drain(Logger *logger);
+
+static void *logger_flusher_thread(void *args);
+
 Logger *logger_create(const char path[const]) {
+    return logger_create_with_mode(path, LOGGER_MODE_SYNC);
+}
+
+Logger *logger_create_with_mode(const char path[const], const enum LOGGER_MODE mode) {
     FILE *log_file = fopen(path, "w");
     if (log_file == NULL) {
         perror("logger_create fopen error");
         return NULL;
     }
 
-    Logger *logger = malloc(sizeof(Logger));
+    Logger *logger = aligned_alloc(CACHE_LINE_SIZE, sizeof(Logger));
     if (logger == NULL) {
         perror("logger_create malloc error");
+        fclose(log_file);
         return NULL;
     }
 
     *logger = (Logger) {
             .log_file = log_file,
-            .mutex = PTHREAD_MUTEX_INITIALIZER
+            .mutex = PTHREAD_MUTEX_INITIALIZER,
+            .mode = mode,
+            .start_ns = logger_now().monotonic_ns,
+            .cached_second = -1,
+            .cached_time_string = "",
+            .records = NULL,
+            .head = 0,
+            .reported_dropped_count = 0
     };
+    atomic_init(&logger->should_stop, false);
+    atomic_init(&logger->tail, 0);
+    atomic_init(&logger->dropped_count, 0);
+
+    if (mode == LOGGER_MODE_ASYNC) {
+        logger->records = malloc(sizeof(LoggerRecord) * LOGGER_RING_CAPACITY);
+        if (logger->records == NULL) {
+            perror("logger_create malloc error");
+            fclose(log_file);
+            free(logger);
+            return NULL;
+        }
+        for (size_t i = 0; i < LOGGER_RING_CAPACITY; i++) {
+            atomic_init(&logger->records[i].sequence, i);
+        }
+
+        if (pthread_create(&logger->flusher, NULL, logger_flusher_thread, logger) != 0) {
+            perror("logger_create pthread_create error");
+            free(logger->records);
+            fclose(log_file);
+            free(logger);
+            return NULL;
+        }
+    }
 
     return logger;
 }
@@ -40,7 +137,7 @@ Logger *logger_get_global(void) {
     if (global_logger == NULL) {
         pthread_mutex_lock(&global_logger_mutex);
         if (global_logger == NULL) {
-            global_logger = logger_create("./global.log");
+            global_logger = logger_create_with_mode("./global.log", LOGGER_GLOBAL_MODE);
         }
         pthread_mutex_unlock(&global_logger_mutex);
     }
@@ -63,24 +160,68 @@ void logger_log(Logger *const logger, const enum LOGGER_LEVEL level, const char
         return;
     }
 
-    char buffer[50];
-    time_t current_time = time(NULL);
-    char *time_string = ctime_r(&current_time, buffer);
+    if (logger->mode == LOGGER_MODE_ASYNC && level != LOGGER_LEVEL_ERROR) {
+        size_t position;
+        LoggerRecord *record = logger_claim(logger, level, &position);
+        if (record != NULL) {
+            size_t length = strnlen(message, LOGGER_RECORD_MESSAGE_LENGTH - 1);
+            memcpy(record->message, message, length);
+            record->message[length] = '\0';
+            logger_commit(record, position);
+        }
+        return;
+    }
+
+    logger_write_synchronized(logger, level, message);
+}
 
-    if (time_string == NULL) {
-        perror("time_string is NULL");
+//Formats only once the level is known to be enabled, in ASYNC mode straight into the ring. Messages longer than
+//a ring record are cut, in both modes.
+void logger_logf(Logger *const logger, const enum LOGGER_LEVEL level, const char format[const], ...) {
+    if (logger == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received logger_logf call with logger = NULL.");
+        return;
+    }
+    if (format == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received logger_logf call with format = NULL.");
         return;
     }
 
-    char *end_line = memchr(time_string, '\n', strlen(time_string));
-    *end_line = '\0';
+    if (level < LOGGER_MINIMUM_LOGGING_LEVEL) {
+        return;
+    }
 
-    pthread_mutex_lock(&logger->mutex);
-    fprintf(logger->log_file, "[%s] [%s] %s\n", enum_names[level], time_string, message);
-    fflush(logger->log_file);
-    pthread_mutex_unlock(&logger->mutex);
+    va_list arguments;
+    va_start(arguments, format);
+    if (logger->mode == LOGGER_MODE_ASYNC && level != LOGGER_LEVEL_ERROR) {
+        size_t position;
+        LoggerRecord *record = logger_claim(logger, level, &position);
+        if (record != NULL) {
+            vsnprintf(record->message, LOGGER_RECORD_MESSAGE_LENGTH, format, arguments);
+            logger_commit(record, position);
+        }
+    } else {
+        char message[LOGGER_RECORD_MESSAGE_LENGTH];
+        vsnprintf(message, sizeof(message), format, arguments);
+        logger_write_synchronized(logger, level, message);
+    }
+    va_end(arguments);
+}
+
+//Messages lost because the ring was full, always 0 in SYNC mode.
+uint64_t logger_get_dropped_count(const Logger *const logger) {
+    if (logger == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received logger_get_dropped_count call with logger = NULL.");
+        return 0;
+    }
+
+    return atomic_load_explicit(&logger->dropped_count, memory_order_relaxed);
 }
 
+//Everything logged before is written out. Messages logged while it runs may be lost.
 void logger_destroy(Logger *const logger) {
     if (logger == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -88,7 +229,132 @@ void logger_destroy(Logger *const logger) {
         return;
     }
 
+    if (logger->mode == LOGGER_MODE_ASYNC) {
+        atomic_store(&logger->should_stop, true);
+        pthread_join(logger->flusher, NULL);
+        free(logger->records);
+    }
+
     fclose(logger->log_file);
     free(logger);
 }
 
+//Both clocks are read through the vDSO, the coarse one only returns the time of the last tick.
+static LoggerTimestamp logger_now(void) {
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME_COARSE, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    return (LoggerTimestamp) {
+            .second = realtime.tv_sec,
+            .monotonic_ns = (uint64_t) monotonic.tv_sec * 1000000000u + (uint64_t) monotonic.tv_nsec
+    };
+}
+
+//Only called with mutex held. Lines look like "[INFO] [Sun Oct 18 12:00:00 2026] [12.345678] message", the second
+//field being seconds since the logger was created.
+static void logger_write_line(Logger *const logger, const enum LOGGER_LEVEL level, const LoggerTimestamp timestamp,
+                              const char message[const]) {
+    if (timestamp.second != logger->cached_second) {
+        struct tm local_time;
+        if (localtime_r(&timestamp.second, &local_time) == NULL ||
+            strftime(logger->cached_time_string, sizeof(logger->cached_time_string), "%a %b %e %H:%M:%S %Y",
+                     &local_time) == 0) {
+            perror("logger_write_line strftime error");
+            return;
+        }
+        logger->cached_second = timestamp.second;
+    }
+
+    uint64_t offset_us = (timestamp.monotonic_ns - logger->start_ns) / 1000;
+    fprintf(logger->log_file, "[%s] [%s] [%llu.%06u] %s\n", enum_names[level], logger->cached_time_string,
+            (unsigned long long int) (offset_us / 1000000), (unsigned int) (offset_us % 1000000), message);
+}
+
+static void logger_write_synchronized(Logger *const logger, const enum LOGGER_LEVEL level, const char message[const]) {
+    pthread_mutex_lock(&logger->mutex);
+    if (logger->mode == LOGGER_MODE_ASYNC) {
+        logger_drain(logger);
+    }
+    logger_write_line(logger, level, logger_now(), message);
+    fflush(logger->log_file);
+    pthread_mutex_unlock(&logger->mutex);
+}
+
+//Vyukov style bounded queue, producer side. The claimed record is stamped, the caller fills in the message and
+//commits it. Returns NULL, and counts the message as dropped, when the ring is full.
+static LoggerRecord *logger_claim(Logger *const logger, const enum LOGGER_LEVEL level, size_t *const position) {
+    size_t tail = atomic_load_explicit(&logger->tail, memory_order_relaxed);
+    LoggerRecord *record;
+    for (;;) {
+        record = &logger->records[tail & (LOGGER_RING_CAPACITY - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) tail;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger->tail, &tail, tail + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            atomic_fetch_add_explicit(&logger->dropped_count, 1, memory_order_relaxed);
+            return NULL;
+        } else {
+            tail = atomic_load_explicit(&logger->tail, memory_order_relaxed);
+        }
+    }
+
+    record->level = level;
+    record->timestamp = logger_now();
+    *position = tail;
+    return record;
+}
+
+static void logger_commit(LoggerRecord *const record, const size_t position) {
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+//Consumer side, only called with mutex held. Stops at the first slot still being written, it is taken next time.
+static size_t logger_drain(Logger *const logger) {
+    size_t count = 0;
+    for (;;) {
+        LoggerRecord *record = &logger->records[logger->head & (LOGGER_RING_CAPACITY - 1)];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != logger->head + 1) {
+            break;
+        }
+        logger_write_line(logger, record->level, record->timestamp, record->message);
+        atomic_store_explicit(&record->sequence, logger->head + LOGGER_RING_CAPACITY, memory_order_release);
+        logger->head++;
+        count++;
+    }
+
+    uint64_t dropped_count = atomic_load_explicit(&logger->dropped_count, memory_order_relaxed);
+    if (dropped_count != logger->reported_dropped_count) {
+        char message[96];
+        snprintf(message, sizeof(message), "Log ring full, dropped %llu messages so far.",
+                 (unsigned long long int) dropped_count);
+        logger_write_line(logger, LOGGER_LEVEL_WARN, logger_now(), message);
+        logger->reported_dropped_count = dropped_count;
+        count++;
+    }
+    return count;
+}
+
+static void *logger_flusher_thread(void *args) {
+    Logger *logger = (Logger *) args;
+
+    bool stopping = false;
+    while (!stopping) {
+        //Read before draining, so the last pass after a stop request still sees every earlier message.
+        stopping = atomic_load_explicit(&logger->should_stop, memory_order_acquire);
+
+        pthread_mutex_lock(&logger->mutex);
+        if (logger_drain(logger) > 0) {
+            fflush(logger->log_file);
+        }
+        pthread_mutex_unlock(&logger->mutex);
+
+        if (!stopping) {
+            nanosleep(&LOGGER_FLUSH_INTERVAL, NULL);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,493 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../include/MetricsServer.h"
+#include "../include/OutputSink.h"
+#include "../include/Logger.h"
+
+static const int METRICS_SERVER_POLL_TIMEOUT_MS = 1000;
+//A client gets this long from accept to the last byte of the response, however it spreads its reads and writes, a
+//slower one is dropped.
+static const uint64_t METRICS_SERVER_CLIENT_BUDGET_NS = 1000000000ULL;
+static const uint64_t METRICS_SERVER_NS_PER_SECOND = 1000000000ULL;
+static const uint64_t METRICS_SERVER_NS_PER_MS = 1000000ULL;
+//Updates come before every poll, also those for a client, so they are at most one poll timeout apart.
+static const struct timespec METRICS_SERVER_WATCHDOG_BUDGET = {.tv_sec = 3, .tv_nsec = 0};
+static const int METRICS_SERVER_BACKLOG = 16;
+static const char METRICS_SERVER_UNIX_PREFIX[] = "unix:";
+static const char METRICS_SERVER_PATH[] = "/metrics";
+static const char METRICS_SERVER_CONTENT_TYPE[] = "text/plain; version=0.0.4; charset=utf-8";
+
+#define METRICS_SERVER_REQUEST_CAPACITY 4096
+#define METRICS_SERVER_HEADER_CAPACITY 256
+
+//Serves the newest published frame over HTTP/1.1 in the Prometheus text format, one connection at a time and
+//closed after the response. Scrapes only read the FrameSnapshot, they never touch the queues or wait for the
+//Analyzer. The frame copy and the response buffer are reused across scrapes, and the response is only formatted
+//again once the snapshot version moved.
+struct MetricsServer {
+    FrameSnapshot *snapshot;
+    Watchdog *watchdog;
+    size_t watchdog_index;
+    int listen_fd;
+    int wake_fds[2];
+    char *unix_path;
+    SampleFrame *frame;
+    char *response;
+    size_t response_capacity;
+    size_t response_length;
+    uint64_t response_version;
+    //CLOCK_MONOTONIC time the current client is dropped at.
+    uint64_t client_deadline_ns;
+    pthread_t thread;
+    atomic_bool should_stop;
+    atomic_uint_fast64_t scrape_count;
+};
+
+static void metrics_server_request_stop_synchronized_void(void *server);
+
+static bool metrics_server_should_stop_synchronized(MetricsServer *server);
+
+static int metrics_server_listen(MetricsServer *server, const char address[]);
+
+static void metrics_server_handle(MetricsServer *server, int client);
+
+static bool metrics_server_read_request(MetricsServer *server, int client, char request[], size_t capacity);
+
+static void metrics_server_respond(MetricsServer *server, int client, const char status[], const char extra_headers[],
+                                   const char body[], size_t body_length);
+
+static bool metrics_server_send_all(MetricsServer *server, int client, const char data[], size_t length, int flags);
+
+static bool metrics_server_wait_client(MetricsServer *server, int client, short events);
+
+static uint64_t metrics_server_now_ns(void);
+
+static void metrics_server_release(MetricsServer *server);
+
+static void *metrics_server_thread(void *args);
+
+//Address is "unix:<path>" for a Unix socket or a TCP port, which is bound to the loopback interface only.
+MetricsServer *metrics_server_create(const char address[const], FrameSnapshot *const snapshot,
+                                     Watchdog *const watchdog) {
+    LOGGER_DEBUG("metrics_server_create: Entry.");
+
+    if (address == NULL || snapshot == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_create call with address = NULL or snapshot = NULL.");
+        return NULL;
+    }
+
+    if (watchdog == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_create call with watchdog = NULL.");
+        return NULL;
+    }
+
+    MetricsServer *server = malloc(sizeof(MetricsServer));
+    if (server == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in metrics_server_create.");
+        return NULL;
+    }
+
+    *server = (MetricsServer) {
+            .snapshot = snapshot,
+            .watchdog = watchdog,
+            .listen_fd = -1,
+            .wake_fds = {-1, -1},
+            .unix_path = NULL,
+            .frame = sample_frame_create(frame_snapshot_get_cpu_capacity(snapshot)),
+            .response = NULL,
+            .response_capacity = 0,
+            .response_length = 0,
+            .response_version = 0,
+            .client_deadline_ns = 0
+    };
+    atomic_init(&server->should_stop, false);
+    atomic_init(&server->scrape_count, 0);
+
+    //Only the write end must not block, a stop request should never wait for the server thread.
+    if (server->frame == NULL || pipe(server->wake_fds) != 0 || fcntl(server->wake_fds[1], F_SETFL, O_NONBLOCK) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Could not allocate the frame or the wake pipe in metrics_server_create.");
+        metrics_server_release(server);
+        return NULL;
+    }
+
+    server->listen_fd = metrics_server_listen(server, address);
+    if (server->listen_fd < 0) {
+        metrics_server_release(server);
+        return NULL;
+    }
+
+    server->watchdog_index = watchdog_register_watch(watchdog, &metrics_server_request_stop_synchronized_void, server,
+                                                     METRICS_SERVER_WATCHDOG_BUDGET);
+    if (server->watchdog_index == WATCHDOG_INVALID_INDEX) {
+        metrics_server_release(server);
+        return NULL;
+    }
+
+    if (pthread_create(&server->thread, NULL, metrics_server_thread, (void *) server) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in metrics_server_create.");
+        watchdog_unregister_watch(watchdog, server->watchdog_index);
+        metrics_server_release(server);
+        return NULL;
+    }
+
+    LOGGER_DEBUG("metrics_server_create: Success.");
+    return server;
+}
+
+void metrics_server_await_and_destroy(MetricsServer *const server) {
+    LOGGER_DEBUG("metrics_server_await_and_destroy: Entry.");
+
+    if (server == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_await_and_destroy call with server = NULL.");
+        return;
+    }
+
+    pthread_join(server->thread, NULL);
+    watchdog_unregister_watch(server->watchdog, server->watchdog_index);
+    metrics_server_release(server);
+
+    LOGGER_DEBUG("metrics_server_await_and_destroy: Success.");
+}
+
+void metrics_server_request_stop_synchronized(MetricsServer *const server) {
+    LOGGER_DEBUG("metrics_server_request_stop_synchronized: Entry.");
+
+    if (server == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_request_stop_synchronized call with server = NULL.");
+        return;
+    }
+
+    //The byte wakes the poll right away. A full pipe already holds a wake up, so a failed write is fine.
+    atomic_store(&server->should_stop, true);
+    char wake = 0;
+    ssize_t written = write(server->wake_fds[1], &wake, 1);
+    (void) written;
+
+    LOGGER_DEBUG("metrics_server_request_stop_synchronized: Success.");
+}
+
+uint64_t metrics_server_get_scrape_count(const MetricsServer *const server) {
+    if (server == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_get_scrape_count call with server = NULL.");
+        return 0;
+    }
+
+    return atomic_load_explicit(&server->scrape_count, memory_order_relaxed);
+}
+
+static void metrics_server_request_stop_synchronized_void(void *const server) {
+    metrics_server_request_stop_synchronized((MetricsServer *) server);
+}
+
+static bool metrics_server_should_stop_synchronized(MetricsServer *const server) {
+    if (server == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received metrics_server_should_stop_synchronized call with server = NULL.");
+        return true;
+    }
+
+    return atomic_load_explicit(&server->should_stop, memory_order_acquire);
+}
+
+//A stale socket file left by a previous run is replaced, any other file at the path is not.
+static int metrics_server_listen(MetricsServer *const server, const char address[const]) {
+    size_t prefix_length = sizeof(METRICS_SERVER_UNIX_PREFIX) - 1;
+    int fd;
+    if (strncmp(address, METRICS_SERVER_UNIX_PREFIX, prefix_length) == 0) {
+        const char *path = address + prefix_length;
+        struct sockaddr_un socket_address = {.sun_family = AF_UNIX};
+        size_t path_length = strlen(path);
+        if (path_length == 0 || path_length >= sizeof(socket_address.sun_path)) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                       "Received metrics_server_listen call with an empty or too long socket path.");
+            return -1;
+        }
+        memcpy(socket_address.sun_path, path, path_length + 1);
+
+        struct stat path_stat;
+        if (lstat(path, &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+            unlink(path);
+        }
+
+        server->unix_path = malloc(path_length + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (server->unix_path == NULL || fd < 0 ||
+            bind(fd, (const struct sockaddr *) &socket_address, sizeof(socket_address)) != 0) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not bind the Unix socket in metrics_server_listen.");
+            free(server->unix_path);
+            server->unix_path = NULL;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        memcpy(server->unix_path, path, path_length + 1);
+    } else {
+        char *end;
+        long port = strtol(address, &end, 10);
+        if (end == address || *end != '\0' || port <= 0 || port > UINT16_MAX) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received metrics_server_listen call with an invalid port.");
+            return -1;
+        }
+
+        struct sockaddr_in socket_address = {
+                .sin_family = AF_INET,
+                .sin_port = htons((uint16_t) port),
+                .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)}
+        };
+        int reuse = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(fd, (const struct sockaddr *) &socket_address, sizeof(socket_address)) != 0) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not bind the TCP port in metrics_server_listen.");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+    }
+
+    if (listen(fd, METRICS_SERVER_BACKLOG) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from listen in metrics_server_listen.");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void metrics_server_handle(MetricsServer *const server, const int client) {
+    server->client_deadline_ns = metrics_server_now_ns() + METRICS_SERVER_CLIENT_BUDGET_NS;
+
+    char request[METRICS_SERVER_REQUEST_CAPACITY];
+    if (!metrics_server_read_request(server, client, request, sizeof(request))) {
+        //A client out of time or a stopping server gets no answer, the connection is just closed.
+        if (metrics_server_should_stop_synchronized(server) || metrics_server_now_ns() >= server->client_deadline_ns) {
+            return;
+        }
+        static const char body[] = "Bad request.\n";
+        metrics_server_respond(server, client, "400 Bad Request", "", body, sizeof(body) - 1);
+        return;
+    }
+
+    //Only the request line matters: "<method> <target> HTTP/1.x".
+    bool head = strncmp(request, "HEAD ", 5) == 0;
+    if (!head && strncmp(request, "GET ", 4) != 0) {
+        static const char body[] = "Only GET and HEAD are supported.\n";
+        metrics_server_respond(server, client, "405 Method Not Allowed", "Allow: GET, HEAD\r\n", body, sizeof(body) - 1);
+        return;
+    }
+    const char *target = request + (head ? 5 : 4);
+    size_t path_length = sizeof(METRICS_SERVER_PATH) - 1;
+    if (strncmp(target, METRICS_SERVER_PATH, path_length) != 0 ||
+        (target[path_length] != ' ' && target[path_length] != '?')) {
+        static const char body[] = "Metrics are served at /metrics.\n";
+        metrics_server_respond(server, client, "404 Not Found", "", head ? NULL : body, sizeof(body) - 1);
+        return;
+    }
+
+    uint64_t version = frame_snapshot_get_version(server->snapshot);
+    if (version != 0 && version == server->response_version) {
+        metrics_server_respond(server, client, "200 OK", "", head ? NULL : server->response, server->response_length);
+        atomic_fetch_add_explicit(&server->scrape_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    if (!frame_snapshot_read_versioned(server->snapshot, server->frame, &version)) {
+        static const char body[] = "No sample yet.\n";
+        metrics_server_respond(server, client, "503 Service Unavailable", "", head ? NULL : body, sizeof(body) - 1);
+        return;
+    }
+
+    size_t capacity = output_sink_prometheus_capacity(server->frame);
+    if (capacity > server->response_capacity) {
+        char *response = realloc(server->response, capacity);
+        if (response == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in metrics_server_handle.");
+            static const char body[] = "Out of memory.\n";
+            metrics_server_respond(server, client, "500 Internal Server Error", "", body, sizeof(body) - 1);
+            return;
+        }
+        server->response = response;
+        server->response_capacity = capacity;
+    }
+
+    server->response_length = output_sink_format_prometheus(server->frame, server->response);
+    server->response_version = version;
+    metrics_server_respond(server, client, "200 OK", "", head ? NULL : server->response, server->response_length);
+    atomic_fetch_add_explicit(&server->scrape_count, 1, memory_order_relaxed);
+}
+
+//Reads up to the blank line that ends the headers. The rest is not needed, but closing with unread request bytes
+//would make the kernel reset the connection and the client could lose the response.
+static bool metrics_server_read_request(MetricsServer *const server, const int client, char request[const],
+                                        const size_t capacity) {
+    size_t length = 0;
+    while (length + 1 < capacity) {
+        ssize_t bytes = recv(client, request + length, capacity - 1 - length, MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!metrics_server_wait_client(server, client, POLLIN)) {
+                return false;
+            }
+            continue;
+        }
+        if (bytes <= 0) {
+            return false;
+        }
+        length += (size_t) bytes;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//A NULL body answers a HEAD request: the headers describe the body, which is not sent.
+static void metrics_server_respond(MetricsServer *const server, const int client, const char status[const],
+                                   const char extra_headers[const], const char body[const], const size_t body_length) {
+    char header[METRICS_SERVER_HEADER_CAPACITY];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%sConnection: close\r\n\r\n",
+                                 status, METRICS_SERVER_CONTENT_TYPE, body_length, extra_headers);
+    if (header_length < 0 || (size_t) header_length >= sizeof(header)) {
+        return;
+    }
+
+    if (body == NULL) {
+        metrics_server_send_all(server, client, header, (size_t) header_length, MSG_NOSIGNAL);
+        return;
+    }
+    if (metrics_server_send_all(server, client, header, (size_t) header_length, MSG_NOSIGNAL | MSG_MORE)) {
+        metrics_server_send_all(server, client, body, body_length, MSG_NOSIGNAL);
+    }
+}
+
+//MSG_NOSIGNAL keeps a client that hung up from raising SIGPIPE in the whole process.
+static bool metrics_server_send_all(MetricsServer *const server, const int client, const char data[const],
+                                    const size_t length, const int flags) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t bytes = send(client, data + sent, length - sent, flags | MSG_DONTWAIT);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && metrics_server_wait_client(server, client, POLLOUT)) {
+                continue;
+            }
+            return false;
+        }
+        sent += (size_t) bytes;
+    }
+    return true;
+}
+
+//Socket calls never block, waits happen here, bounded by the client's deadline and cut short by a stop request.
+//Every wait updates the watchdog first, so a client trickling its bytes keeps the server alive only up to its deadline.
+static bool metrics_server_wait_client(MetricsServer *const server, const int client, const short events) {
+    struct pollfd descriptors[2] = {
+            {.fd = client, .events = events},
+            {.fd = server->wake_fds[0], .events = POLLIN}
+    };
+
+    while (!metrics_server_should_stop_synchronized(server)) {
+        watchdog_update(server->watchdog, server->watchdog_index);
+
+        uint64_t now_ns = metrics_server_now_ns();
+        if (now_ns >= server->client_deadline_ns) {
+            LOGGER_DEBUG("metrics_server_wait_client: Dropping a client past its deadline.");
+            return false;
+        }
+        uint64_t remaining_ms = (server->client_deadline_ns - now_ns + METRICS_SERVER_NS_PER_MS - 1) /
+                                METRICS_SERVER_NS_PER_MS;
+
+        int ready = poll(descriptors, 2, (int) remaining_ms);
+        if (ready < 0 && errno != EINTR) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from poll in metrics_server_wait_client.");
+            return false;
+        }
+        if (ready > 0 && descriptors[0].revents != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t metrics_server_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * METRICS_SERVER_NS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
+
+static void metrics_server_release(MetricsServer *const server) {
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+    }
+    if (server->unix_path != NULL) {
+        unlink(server->unix_path);
+        free(server->unix_path);
+    }
+    if (server->wake_fds[0] >= 0) {
+        close(server->wake_fds[0]);
+        close(server->wake_fds[1]);
+    }
+    if (server->frame != NULL) {
+        sample_frame_destroy(server->frame);
+    }
+    free(server->response);
+    free(server);
+}
+
+static void *metrics_server_thread(void *args) {
+    LOGGER_DEBUG("metrics_server_thread: Entry.");
+
+    MetricsServer *server = (MetricsServer *) args;
+    struct pollfd descriptors[2] = {
+            {.fd = server->listen_fd, .events = POLLIN},
+            {.fd = server->wake_fds[0], .events = POLLIN}
+    };
+
+    while (!metrics_server_should_stop_synchronized(server)) {
+        LOGGER_DEBUG("metrics_server_thread: Iteration.");
+        watchdog_update(server->watchdog, server->watchdog_index);
+
+        int ready = poll(descriptors, 2, METRICS_SERVER_POLL_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from poll in metrics_server_thread.");
+            break;
+        }
+        if (ready <= 0 || (descriptors[0].revents & POLLIN) == 0 || metrics_server_should_stop_synchronized(server)) {
+            continue;
+        }
+
+        int client = accept(server->listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        metrics_server_handle(server, client);
+        close(client);
+    }
+
+    LOGGER_DEBUG("metrics_server_thread: Ending.");
+    return NULL;
+}
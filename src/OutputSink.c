@@ -0,0 +1,593 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/OutputSink.h"
+#include "../include/TerminalRenderer.h"
+#include "../include/Logger.h"
+
+//Buffered frames are written once this much piled up, otherwise when the Printer flushes after a batch.
+static const size_t OUTPUT_SINK_BATCH_BYTES = 64 * 1024;
+//Upper bounds of the formatted parts of a frame. The buffer is reserved for the whole frame up front, so the
+//formatting itself never checks the space left.
+static const size_t OUTPUT_SINK_FRAME_LENGTH = 4096;
+static const size_t OUTPUT_SINK_CPU_LENGTH = 64;
+static const size_t OUTPUT_SINK_PROCESS_LENGTH = 256;
+static const char OUTPUT_SINK_STDOUT_PATH[] = "-";
+static const char OUTPUT_SINK_TEMPORARY_SUFFIX[] = ".tmp";
+static const char *const OUTPUT_SINK_WINDOW_NAMES[ROLLING_WINDOW_SPAN_COUNT] = {"10s", "1m", "5m"};
+static const char *const OUTPUT_SINK_STATISTIC_NAMES[] = {"min", "mean", "max", "p95", "p99"};
+
+enum OUTPUT_STREAM_FORMAT {
+    OUTPUT_STREAM_FORMAT_JSON_LINES = 0, OUTPUT_STREAM_FORMAT_CSV, OUTPUT_STREAM_FORMAT_PROMETHEUS
+};
+
+//A text format written to a descriptor. Frames are formatted into output, which only grows when a frame needs more
+//room than any before it. A Prometheus file is never appended to, every exposition is written next to it and
+//renamed over it, so a collector reading it never sees half of one.
+typedef struct OutputStream {
+    enum OUTPUT_STREAM_FORMAT format;
+    int fd;
+    bool owns_fd;
+    char *path;
+    char *temporary_path;
+    char *output;
+    size_t output_capacity;
+    size_t output_length;
+    int64_t realtime_offset_ns;
+    uint32_t header_cpu_count;
+    bool header_written;
+} OutputStream;
+
+static bool output_terminal_write(void *renderer, const SampleFrame *frame);
+
+static bool output_terminal_flush(void *renderer);
+
+static void output_terminal_destroy(void *renderer);
+
+static bool output_stream_create(const char path[], enum OUTPUT_STREAM_FORMAT format, OutputSink *sink);
+
+static bool output_stream_write(void *stream, const SampleFrame *frame);
+
+static bool output_stream_flush(void *stream);
+
+static void output_stream_destroy(void *stream);
+
+static bool output_stream_reserve(OutputStream *stream, const SampleFrame *frame);
+
+static void output_stream_format_json(OutputStream *stream, const SampleFrame *frame);
+
+static void output_stream_format_csv(OutputStream *stream, const SampleFrame *frame);
+
+static void output_stream_format_prometheus(OutputStream *stream, const SampleFrame *frame);
+
+static uint64_t output_stream_timestamp_ms(const OutputStream *stream, const SampleFrame *frame);
+
+static void output_stream_append(OutputStream *stream, const char text[], size_t length);
+
+static void output_stream_append_text(OutputStream *stream, const char text[]);
+
+static void output_stream_append_unsigned(OutputStream *stream, uint64_t value);
+
+static void output_stream_append_fixed(OutputStream *stream, uint64_t value, unsigned int decimals);
+
+static void output_stream_append_json_string(OutputStream *stream, const char text[], size_t length);
+
+static void output_stream_append_label_value(OutputStream *stream, const char text[], size_t length);
+
+static bool output_stream_write_all(int fd, const char data[], size_t length);
+
+//Draws frames with a TerminalRenderer, only the newest frame of a batch is drawn.
+bool output_sink_create_terminal(const int fd, OutputSink *const sink) {
+    if (sink == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received output_sink_create_terminal call with sink = NULL.");
+        return false;
+    }
+
+    TerminalRenderer *renderer = terminal_renderer_create(fd);
+    if (renderer == NULL) {
+        return false;
+    }
+
+    *sink = (OutputSink) {
+            .write = &output_terminal_write,
+            .flush = &output_terminal_flush,
+            .destroy = &output_terminal_destroy,
+            .context = renderer,
+            .delivery = OUTPUT_SINK_DELIVERY_LATEST_FRAME
+    };
+    return true;
+}
+
+//One JSON object per frame and line. Utilization is in percent, offline CPUs are null.
+bool output_sink_create_json_lines(const char path[const], OutputSink *const sink) {
+    if (path == NULL || sink == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_create_json_lines call with path = NULL or sink = NULL.");
+        return false;
+    }
+
+    return output_stream_create(path, OUTPUT_STREAM_FORMAT_JSON_LINES, sink);
+}
+
+//One row per frame with the total and every CPU in percent, offline CPUs are left empty. The header is repeated
+//whenever the number of CPUs changes.
+bool output_sink_create_csv(const char path[const], OutputSink *const sink) {
+    if (path == NULL || sink == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_create_csv call with path = NULL or sink = NULL.");
+        return false;
+    }
+
+    return output_stream_create(path, OUTPUT_STREAM_FORMAT_CSV, sink);
+}
+
+//The newest frame in the Prometheus text exposition format, e.g. for the node_exporter textfile collector.
+//Utilization is a ratio, offline CPUs are left out.
+bool output_sink_create_prometheus(const char path[const], OutputSink *const sink) {
+    if (path == NULL || sink == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_create_prometheus call with path = NULL or sink = NULL.");
+        return false;
+    }
+
+    return output_stream_create(path, OUTPUT_STREAM_FORMAT_PROMETHEUS, sink);
+}
+
+//Spec is "terminal" or "<format>:<path>" with format jsonl, csv or prometheus. A path of "-" is stdout.
+bool output_sink_create_from_spec(const char spec[const], OutputSink *const sink) {
+    if (spec == NULL || sink == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_create_from_spec call with spec = NULL or sink = NULL.");
+        return false;
+    }
+
+    if (strcmp(spec, "terminal") == 0) {
+        return output_sink_create_terminal(STDOUT_FILENO, sink);
+    }
+
+    const char *separator = strchr(spec, ':');
+    if (separator != NULL && separator[1] != '\0') {
+        size_t name_length = (size_t) (separator - spec);
+        if (name_length == 5 && strncmp(spec, "jsonl", name_length) == 0) {
+            return output_sink_create_json_lines(separator + 1, sink);
+        }
+        if (name_length == 3 && strncmp(spec, "csv", name_length) == 0) {
+            return output_sink_create_csv(separator + 1, sink);
+        }
+        if (name_length == 10 && strncmp(spec, "prometheus", name_length) == 0) {
+            return output_sink_create_prometheus(separator + 1, sink);
+        }
+    }
+
+    logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received output_sink_create_from_spec call with an unknown spec.");
+    return false;
+}
+
+//Upper bound of what output_sink_format_prometheus writes for frame.
+size_t output_sink_prometheus_capacity(const SampleFrame *const frame) {
+    if (frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_prometheus_capacity call with frame = NULL.");
+        return 0;
+    }
+
+    return OUTPUT_SINK_FRAME_LENGTH + frame->cpu_count * OUTPUT_SINK_CPU_LENGTH +
+           frame->process_count * OUTPUT_SINK_PROCESS_LENGTH;
+}
+
+//Formats frame like the Prometheus sink into output, which has room for output_sink_prometheus_capacity bytes.
+//Returns the length written, output is not NUL terminated.
+size_t output_sink_format_prometheus(const SampleFrame *const frame, char output[const]) {
+    if (frame == NULL || output == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received output_sink_format_prometheus call with frame = NULL or output = NULL.");
+        return 0;
+    }
+
+    OutputStream stream = {
+            .format = OUTPUT_STREAM_FORMAT_PROMETHEUS,
+            .output = output,
+            .output_capacity = output_sink_prometheus_capacity(frame),
+            .output_length = 0
+    };
+    output_stream_format_prometheus(&stream, frame);
+    return stream.output_length;
+}
+
+static bool output_terminal_write(void *const renderer, const SampleFrame *const frame) {
+    return terminal_renderer_draw((TerminalRenderer *) renderer, frame);
+}
+
+static bool output_terminal_flush(void *const renderer) {
+    (void) renderer;
+    return true;
+}
+
+static void output_terminal_destroy(void *const renderer) {
+    terminal_renderer_destroy((TerminalRenderer *) renderer);
+}
+
+static bool output_stream_create(const char path[const], const enum OUTPUT_STREAM_FORMAT format,
+                                 OutputSink *const sink) {
+    OutputStream *stream = malloc(sizeof(OutputStream));
+    if (stream == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in output_stream_create.");
+        return false;
+    }
+
+    //Frames carry monotonic timestamps, collectors expect wall clock ones.
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    *stream = (OutputStream) {
+            .format = format,
+            .fd = -1,
+            .owns_fd = false,
+            .path = NULL,
+            .temporary_path = NULL,
+            .output = NULL,
+            .output_capacity = 0,
+            .output_length = 0,
+            .realtime_offset_ns = ((int64_t) realtime.tv_sec - (int64_t) monotonic.tv_sec) * 1000000000 +
+                                  ((int64_t) realtime.tv_nsec - (int64_t) monotonic.tv_nsec),
+            .header_cpu_count = 0,
+            .header_written = false
+    };
+
+    if (strcmp(path, OUTPUT_SINK_STDOUT_PATH) == 0) {
+        stream->fd = STDOUT_FILENO;
+    } else if (format == OUTPUT_STREAM_FORMAT_PROMETHEUS) {
+        size_t path_length = strlen(path);
+        stream->path = malloc(path_length + 1);
+        stream->temporary_path = malloc(path_length + sizeof(OUTPUT_SINK_TEMPORARY_SUFFIX));
+        if (stream->path == NULL || stream->temporary_path == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in output_stream_create.");
+            free(stream->path);
+            free(stream->temporary_path);
+            free(stream);
+            return false;
+        }
+        memcpy(stream->path, path, path_length + 1);
+        memcpy(stream->temporary_path, path, path_length);
+        memcpy(stream->temporary_path + path_length, OUTPUT_SINK_TEMPORARY_SUFFIX, sizeof(OUTPUT_SINK_TEMPORARY_SUFFIX));
+    } else {
+        stream->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        stream->owns_fd = true;
+        if (stream->fd < 0) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not open the output file in output_stream_create.");
+            free(stream);
+            return false;
+        }
+    }
+
+    *sink = (OutputSink) {
+            .write = &output_stream_write,
+            .flush = &output_stream_flush,
+            .destroy = &output_stream_destroy,
+            .context = stream,
+            .delivery = format == OUTPUT_STREAM_FORMAT_PROMETHEUS ? OUTPUT_SINK_DELIVERY_LATEST_FRAME
+                                                                  : OUTPUT_SINK_DELIVERY_EVERY_FRAME
+    };
+    return true;
+}
+
+static bool output_stream_write(void *const stream_pointer, const SampleFrame *const frame) {
+    OutputStream *stream = (OutputStream *) stream_pointer;
+    if (frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received output_stream_write call with frame = NULL.");
+        return false;
+    }
+
+    //An exposition describes the current state only, a newer one replaces whatever was not flushed yet.
+    if (stream->format == OUTPUT_STREAM_FORMAT_PROMETHEUS) {
+        stream->output_length = 0;
+    }
+    if (!output_stream_reserve(stream, frame)) {
+        return false;
+    }
+
+    switch (stream->format) {
+        case OUTPUT_STREAM_FORMAT_JSON_LINES:
+            output_stream_format_json(stream, frame);
+            break;
+        case OUTPUT_STREAM_FORMAT_CSV:
+            output_stream_format_csv(stream, frame);
+            break;
+        case OUTPUT_STREAM_FORMAT_PROMETHEUS:
+            output_stream_format_prometheus(stream, frame);
+            return true;
+    }
+
+    if (stream->output_length >= OUTPUT_SINK_BATCH_BYTES) {
+        return output_stream_flush(stream);
+    }
+    return true;
+}
+
+//Whatever could not be written is dropped, the output must not grow without bound behind a stuck reader.
+static bool output_stream_flush(void *const stream_pointer) {
+    OutputStream *stream = (OutputStream *) stream_pointer;
+    if (stream->output_length == 0) {
+        return true;
+    }
+
+    bool written;
+    if (stream->path == NULL) {
+        written = output_stream_write_all(stream->fd, stream->output, stream->output_length);
+    } else {
+        int fd = open(stream->temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        written = fd >= 0 && output_stream_write_all(fd, stream->output, stream->output_length);
+        if (fd >= 0 && close(fd) != 0) {
+            written = false;
+        }
+        written = written && rename(stream->temporary_path, stream->path) == 0;
+    }
+    stream->output_length = 0;
+
+    if (!written) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not write the output in output_stream_flush.");
+    }
+    return written;
+}
+
+static void output_stream_destroy(void *const stream_pointer) {
+    OutputStream *stream = (OutputStream *) stream_pointer;
+    output_stream_flush(stream);
+    if (stream->owns_fd) {
+        close(stream->fd);
+    }
+    free(stream->output);
+    free(stream->path);
+    free(stream->temporary_path);
+    free(stream);
+}
+
+static bool output_stream_reserve(OutputStream *const stream, const SampleFrame *const frame) {
+    size_t capacity = stream->output_length + output_sink_prometheus_capacity(frame);
+    if (capacity <= stream->output_capacity) {
+        return true;
+    }
+
+    //Rounded up to whole batches, so a steady stream of frames settles on one allocation.
+    capacity = (capacity + OUTPUT_SINK_BATCH_BYTES - 1) / OUTPUT_SINK_BATCH_BYTES * OUTPUT_SINK_BATCH_BYTES;
+    char *output = realloc(stream->output, capacity);
+    if (output == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from realloc call in output_stream_reserve.");
+        return false;
+    }
+    stream->output = output;
+    stream->output_capacity = capacity;
+    return true;
+}
+
+static void output_stream_format_json(OutputStream *const stream, const SampleFrame *const frame) {
+    output_stream_append_text(stream, "{\"timestamp_ms\":");
+    output_stream_append_unsigned(stream, output_stream_timestamp_ms(stream, frame));
+    output_stream_append_text(stream, ",\"sequence\":");
+    output_stream_append_unsigned(stream, frame->sequence);
+    output_stream_append_text(stream, ",\"total\":");
+    output_stream_append_fixed(stream, frame->utilization[0], 2);
+
+    output_stream_append_text(stream, ",\"cpus\":[");
+    for (size_t cpu = 0; cpu < frame->cpu_count; cpu++) {
+        if (cpu > 0) {
+            output_stream_append(stream, ",", 1);
+        }
+        uint16_t basis_points = frame->utilization[cpu + 1];
+        if (basis_points == SAMPLE_FRAME_OFFLINE) {
+            output_stream_append_text(stream, "null");
+        } else {
+            output_stream_append_fixed(stream, basis_points, 2);
+        }
+    }
+
+    output_stream_append_text(stream, "],\"windows\":{");
+    bool first = true;
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        const RollingWindowStats *stats = &frame->windows[span];
+        if (stats->sample_count == 0) {
+            continue;
+        }
+        const uint16_t values[] = {stats->min, stats->mean, stats->max, stats->p95, stats->p99};
+        output_stream_append_text(stream, first ? "\"" : ",\"");
+        output_stream_append_text(stream, OUTPUT_SINK_WINDOW_NAMES[span]);
+        output_stream_append_text(stream, "\":{\"samples\":");
+        output_stream_append_unsigned(stream, stats->sample_count);
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            output_stream_append_text(stream, ",\"");
+            output_stream_append_text(stream, OUTPUT_SINK_STATISTIC_NAMES[i]);
+            output_stream_append_text(stream, "\":");
+            output_stream_append_fixed(stream, values[i], 2);
+        }
+        output_stream_append(stream, "}", 1);
+        first = false;
+    }
+
+    output_stream_append_text(stream, "},\"processes\":[");
+    for (size_t i = 0; i < frame->process_count; i++) {
+        const SampleFrameProcess *process = &frame->processes[i];
+        output_stream_append_text(stream, i > 0 ? ",{\"pid\":" : "{\"pid\":");
+        output_stream_append_unsigned(stream, (uint32_t) process->pid);
+        output_stream_append_text(stream, ",\"cpu\":");
+        output_stream_append_fixed(stream, process->utilization, 2);
+        output_stream_append_text(stream, ",\"command\":");
+        output_stream_append_json_string(stream, process->command,
+                                         strnlen(process->command, PROCESS_SCANNER_COMMAND_LENGTH));
+        output_stream_append(stream, "}", 1);
+    }
+    output_stream_append_text(stream, "]}\n");
+}
+
+static void output_stream_format_csv(OutputStream *const stream, const SampleFrame *const frame) {
+    if (!stream->header_written || stream->header_cpu_count != frame->cpu_count) {
+        output_stream_append_text(stream, "timestamp_ms,sequence,total");
+        for (size_t cpu = 0; cpu < frame->cpu_count; cpu++) {
+            output_stream_append_text(stream, ",cpu");
+            output_stream_append_unsigned(stream, cpu);
+        }
+        output_stream_append(stream, "\n", 1);
+        stream->header_written = true;
+        stream->header_cpu_count = frame->cpu_count;
+    }
+
+    output_stream_append_unsigned(stream, output_stream_timestamp_ms(stream, frame));
+    output_stream_append(stream, ",", 1);
+    output_stream_append_unsigned(stream, frame->sequence);
+    output_stream_append(stream, ",", 1);
+    output_stream_append_fixed(stream, frame->utilization[0], 2);
+    for (size_t cpu = 0; cpu < frame->cpu_count; cpu++) {
+        output_stream_append(stream, ",", 1);
+        uint16_t basis_points = frame->utilization[cpu + 1];
+        if (basis_points != SAMPLE_FRAME_OFFLINE) {
+            output_stream_append_fixed(stream, basis_points, 2);
+        }
+    }
+    output_stream_append(stream, "\n", 1);
+}
+
+//Basis points are ratios with four decimals, 10000 is one fully busy CPU.
+static void output_stream_format_prometheus(OutputStream *const stream, const SampleFrame *const frame) {
+    output_stream_append_text(stream, "# HELP tieto_cpu_utilization_ratio Share of the last interval the CPU was busy.\n"
+                                      "# TYPE tieto_cpu_utilization_ratio gauge\n"
+                                      "tieto_cpu_utilization_ratio{cpu=\"all\"} ");
+    output_stream_append_fixed(stream, frame->utilization[0], 4);
+    output_stream_append(stream, "\n", 1);
+    for (size_t cpu = 0; cpu < frame->cpu_count; cpu++) {
+        uint16_t basis_points = frame->utilization[cpu + 1];
+        if (basis_points == SAMPLE_FRAME_OFFLINE) {
+            continue;
+        }
+        output_stream_append_text(stream, "tieto_cpu_utilization_ratio{cpu=\"");
+        output_stream_append_unsigned(stream, cpu);
+        output_stream_append_text(stream, "\"} ");
+        output_stream_append_fixed(stream, basis_points, 4);
+        output_stream_append(stream, "\n", 1);
+    }
+
+    output_stream_append_text(stream, "# HELP tieto_cpu_utilization_window_ratio Rolling statistics of the total "
+                                      "utilization.\n"
+                                      "# TYPE tieto_cpu_utilization_window_ratio gauge\n");
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        const RollingWindowStats *stats = &frame->windows[span];
+        if (stats->sample_count == 0) {
+            continue;
+        }
+        const uint16_t values[] = {stats->min, stats->mean, stats->max, stats->p95, stats->p99};
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            output_stream_append_text(stream, "tieto_cpu_utilization_window_ratio{window=\"");
+            output_stream_append_text(stream, OUTPUT_SINK_WINDOW_NAMES[span]);
+            output_stream_append_text(stream, "\",statistic=\"");
+            output_stream_append_text(stream, OUTPUT_SINK_STATISTIC_NAMES[i]);
+            output_stream_append_text(stream, "\"} ");
+            output_stream_append_fixed(stream, values[i], 4);
+            output_stream_append(stream, "\n", 1);
+        }
+    }
+
+    if (frame->process_count > 0) {
+        output_stream_append_text(stream, "# HELP tieto_process_cpu_ratio CPU time of the busiest processes, 1 is one "
+                                          "fully busy CPU.\n"
+                                          "# TYPE tieto_process_cpu_ratio gauge\n");
+    }
+    for (size_t i = 0; i < frame->process_count; i++) {
+        const SampleFrameProcess *process = &frame->processes[i];
+        output_stream_append_text(stream, "tieto_process_cpu_ratio{pid=\"");
+        output_stream_append_unsigned(stream, (uint32_t) process->pid);
+        output_stream_append_text(stream, "\",command=\"");
+        output_stream_append_label_value(stream, process->command,
+                                         strnlen(process->command, PROCESS_SCANNER_COMMAND_LENGTH));
+        output_stream_append_text(stream, "\"} ");
+        output_stream_append_fixed(stream, process->utilization, 4);
+        output_stream_append(stream, "\n", 1);
+    }
+}
+
+static uint64_t output_stream_timestamp_ms(const OutputStream *const stream, const SampleFrame *const frame) {
+    int64_t timestamp_ns = (int64_t) frame->timestamp_ns + stream->realtime_offset_ns;
+    return timestamp_ns > 0 ? (uint64_t) timestamp_ns / 1000000 : 0;
+}
+
+static void output_stream_append(OutputStream *const stream, const char text[const], const size_t length) {
+    memcpy(stream->output + stream->output_length, text, length);
+    stream->output_length += length;
+}
+
+static void output_stream_append_text(OutputStream *const stream, const char text[const]) {
+    output_stream_append(stream, text, strlen(text));
+}
+
+static void output_stream_append_unsigned(OutputStream *const stream, uint64_t value) {
+    char digits[20];
+    size_t position = sizeof(digits);
+    do {
+        digits[--position] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    output_stream_append(stream, digits + position, sizeof(digits) - position);
+}
+
+//Value is in units of the last decimal, e.g. basis points with 2 decimals are percent, with 4 a ratio.
+static void output_stream_append_fixed(OutputStream *const stream, uint64_t value, const unsigned int decimals) {
+    char digits[24];
+    size_t position = sizeof(digits);
+    for (unsigned int i = 0; i < decimals; i++) {
+        digits[--position] = (char) ('0' + value % 10);
+        value /= 10;
+    }
+    digits[--position] = '.';
+    do {
+        digits[--position] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    output_stream_append(stream, digits + position, sizeof(digits) - position);
+}
+
+static void output_stream_append_json_string(OutputStream *const stream, const char text[const], const size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    output_stream_append(stream, "\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char character = (unsigned char) text[i];
+        if (character == '"' || character == '\\') {
+            char escaped[2] = {'\\', (char) character};
+            output_stream_append(stream, escaped, sizeof(escaped));
+        } else if (character < 0x20) {
+            char escaped[6] = {'\\', 'u', '0', '0', hex[character >> 4], hex[character & 0xF]};
+            output_stream_append(stream, escaped, sizeof(escaped));
+        } else {
+            output_stream_append(stream, (const char *) &character, 1);
+        }
+    }
+    output_stream_append(stream, "\"", 1);
+}
+
+static void output_stream_append_label_value(OutputStream *const stream, const char text[const], const size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"' || text[i] == '\\') {
+            char escaped[2] = {'\\', text[i]};
+            output_stream_append(stream, escaped, sizeof(escaped));
+        } else if (text[i] == '\n') {
+            output_stream_append(stream, "\\n", 2);
+        } else {
+            output_stream_append(stream, text + i, 1);
+        }
+    }
+}
+
+static bool output_stream_write_all(const int fd, const char data[const], const size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t bytes = write(fd, data + written, length - written);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += (size_t) bytes;
+    }
+    return true;
+}
@@ -1,68 +1,111 @@
 #include <stdio.h>
-#include <pthread.h>
+#include <string.h>
 #include "../include/Printer.h"
-#include "../include/LongDoubleArray.h"
+#include "../include/SampleFrame.h"
 #include "../include/Logger.h"
+#include "../include/Stage.h"
 
-static const time_t PRINTER_QUEUE_WAIT_TIMEOUT = 1;
+//Updates come after every broadcast wait and every batch, writing out a batch takes far less than a second.
+static const struct timespec PRINTER_WATCHDOG_BUDGET = {.tv_sec = 2, .tv_nsec = 0};
 
 struct Printer {
-    Queue *analyzer_printer_queue;
-    Watchdog *watchdog;
-    size_t watchdog_index;
-    pthread_t thread;
-    pthread_mutex_t mutex;
-    bool should_stop;
+    OutputSink sinks[PRINTER_MAX_SINKS];
+    size_t sink_count;
+    FrameBroadcast *broadcast;
+    size_t subscriber;
+    Stage *stage;
 };
 
-static void printer_request_stop_synchronized_void(void *printer);
+static void printer_destroy_sinks(const OutputSink sinks[], size_t sink_count);
 
-static bool printer_should_stop_synchronized(Printer *printer);
+static enum STAGE_STATUS printer_process(Stage *stage, void *context, void *items[], size_t count);
 
-static void *printer_thread(void *args);
+static void printer_close_subscriber(void *context);
 
-Printer *printer_create(Queue *const analyzer_printer_queue, Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_create: Entry.");
+//The printer owns sinks from here on, they are destroyed with the printer or right away if creation fails. It
+//subscribes to broadcast right away, so it gets every frame published after printer_create returned. Printers with
+//an EVERY_FRAME sink hold the producer back when they fall behind, the others skip the oldest frames.
+Printer *printer_create(FrameBroadcast *const broadcast, Watchdog *const watchdog, const OutputSink sinks[const],
+                        const size_t sink_count) {
+    LOGGER_DEBUG("printer_create: Entry.");
 
-    if (analyzer_printer_queue == NULL) {
+    if (sinks == NULL || sink_count == 0 || sink_count > PRINTER_MAX_SINKS) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received printer_create call with analyzer_printer_queue = NULL.");
+                   "Received printer_create call with sinks = NULL or an invalid sink_count.");
+        if (sinks != NULL) {
+            printer_destroy_sinks(sinks, sink_count);
+        }
+        return NULL;
+    }
+
+    if (broadcast == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received printer_create call with broadcast = NULL.");
+        printer_destroy_sinks(sinks, sink_count);
         return NULL;
     }
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
                    "Received printer_create call with watchdog = NULL.");
+        printer_destroy_sinks(sinks, sink_count);
         return NULL;
     }
 
     Printer *printer = malloc(sizeof(Printer));
     if (printer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in printer_create.");
+        printer_destroy_sinks(sinks, sink_count);
         return NULL;
     }
 
+    enum FRAME_BROADCAST_POLICY policy = FRAME_BROADCAST_POLICY_DROP_OLDEST;
+    for (size_t i = 0; i < sink_count; i++) {
+        if (sinks[i].delivery == OUTPUT_SINK_DELIVERY_EVERY_FRAME) {
+            policy = FRAME_BROADCAST_POLICY_BLOCK;
+        }
+    }
+
     *printer = (Printer) {
-            .analyzer_printer_queue = analyzer_printer_queue,
-            .watchdog = watchdog,
-            .watchdog_index = watchdog_register_watch(watchdog, &printer_request_stop_synchronized_void, printer),
-            .mutex = PTHREAD_MUTEX_INITIALIZER,
-            .should_stop = false
+            .sink_count = sink_count,
+            .broadcast = broadcast,
+            .subscriber = frame_broadcast_subscribe(broadcast, policy),
+            .stage = NULL
     };
+    memcpy(printer->sinks, sinks, sizeof(OutputSink) * sink_count);
 
-    if (pthread_create(&printer->thread, NULL, printer_thread, (void *) printer) != 0) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in printer_create.");
-        pthread_mutex_destroy(&printer->mutex);
+    if (printer->subscriber == FRAME_BROADCAST_INVALID_SUBSCRIBER) {
+        printer_destroy_sinks(printer->sinks, printer->sink_count);
         free(printer);
         return NULL;
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_create: Success.");
+    //The printer reads the broadcast on its own, the stage has neither an input queue nor outputs.
+    printer->stage = stage_create("printer",
+                                  (StageOperations) {
+                                          .process = &printer_process,
+                                          .discard = NULL,
+                                          .wake = &printer_close_subscriber,
+                                          .end = NULL
+                                  },
+                                  printer, NULL, NULL, 0, watchdog, PRINTER_WATCHDOG_BUDGET);
+    if (printer->stage != NULL && !stage_start(printer->stage)) {
+        stage_await_and_destroy(printer->stage);
+        printer->stage = NULL;
+    }
+    if (printer->stage == NULL) {
+        frame_broadcast_unsubscribe(broadcast, printer->subscriber);
+        printer_destroy_sinks(printer->sinks, printer->sink_count);
+        free(printer);
+        return NULL;
+    }
+
+    LOGGER_DEBUG("printer_create: Success.");
     return printer;
 }
 
 void printer_await_and_destroy(Printer *const printer) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_await_and_destroy: Entry.");
+    LOGGER_DEBUG("printer_await_and_destroy: Entry.");
 
     if (printer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -70,15 +113,16 @@ void printer_await_and_destroy(Printer *const printer) {
         return;
     }
 
-    pthread_join(printer->thread, NULL);
-    pthread_mutex_destroy(&printer->mutex);
+    stage_await_and_destroy(printer->stage);
+    frame_broadcast_unsubscribe(printer->broadcast, printer->subscriber);
+    printer_destroy_sinks(printer->sinks, printer->sink_count);
     free(printer);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_await_and_destroy: Success.");
+    LOGGER_DEBUG("printer_await_and_destroy: Success.");
 }
 
 void printer_request_stop_synchronized(Printer *const printer) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_request_stop_synchronized: Entry.");
+    LOGGER_DEBUG("printer_request_stop_synchronized: Entry.");
 
     if (printer == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -86,66 +130,61 @@ void printer_request_stop_synchronized(Printer *const printer) {
         return;
     }
 
-    pthread_mutex_lock(&printer->mutex);
-    printer->should_stop = true;
-    pthread_mutex_unlock(&printer->mutex);
-
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_request_stop_synchronized: Success.");
-}
+    stage_request_stop_synchronized(printer->stage);
 
-static void printer_request_stop_synchronized_void(void *const printer) {
-    printer_request_stop_synchronized((Printer *) printer);
+    LOGGER_DEBUG("printer_request_stop_synchronized: Success.");
 }
 
-static bool printer_should_stop_synchronized(Printer *const printer) {
-    if (printer == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received printer_should_stop_synchronized call with printer = NULL.");
-        return true;
+static void printer_destroy_sinks(const OutputSink sinks[const], const size_t sink_count) {
+    for (size_t i = 0; i < sink_count; i++) {
+        sinks[i].destroy(sinks[i].context);
     }
-
-    bool return_value;
-    pthread_mutex_lock(&printer->mutex);
-    return_value = printer->should_stop;
-    pthread_mutex_unlock(&printer->mutex);
-
-    return return_value;
 }
 
-static void *printer_thread(void *args) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_thread: Entry.");
-
-    Printer *printer = (Printer *) args;
-
-    while (!printer_should_stop_synchronized(printer)) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_thread: Iteration.");
-        watchdog_update(printer->watchdog, printer->watchdog_index);
-
-        queue_lock(printer->analyzer_printer_queue);
-        while (queue_is_empty(printer->analyzer_printer_queue)) {
-            queue_wait_to_extract_with_timeout(printer->analyzer_printer_queue, PRINTER_QUEUE_WAIT_TIMEOUT);
-            if (printer_should_stop_synchronized(printer)) {
-                queue_unlock(printer->analyzer_printer_queue);
-                logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_thread: Ending.");
-                return NULL;
-            }
+//Streams get every frame, sinks that only show the current state just the newest one. Buffered output goes out once
+//per batch. A closed broadcast is drained first when the Analyzer ended on its own, file sinks want every frame.
+static enum STAGE_STATUS printer_process(Stage *const stage, void *const context, void *items[const],
+                                         const size_t count) {
+    (void) items;
+    (void) count;
+    Printer *printer = (Printer *) context;
+
+    SampleFrame *frames[STAGE_BATCH_SIZE];
+    size_t frame_count;
+    while ((frame_count = frame_broadcast_acquire_batch(printer->broadcast, printer->subscriber, frames,
+                                                        STAGE_BATCH_SIZE)) == 0) {
+        bool available = frame_broadcast_wait_until_available(printer->broadcast, printer->subscriber,
+                                                              stage_get_wait_timeout(stage));
+        stage_heartbeat(stage);
+        if (stage_should_stop_synchronized(stage)) {
+            return STAGE_STATUS_STOPPED;
         }
-        LongDoubleArray *array = queue_extract(printer->analyzer_printer_queue);
-        queue_notify_insert(printer->analyzer_printer_queue);
-        queue_unlock(printer->analyzer_printer_queue);
-
-        printf("\x1b[2J\x1b[H");
-        if (array->num_elements > 0) {
-            printf("CPU:\t%.2Lf%%\n", array->buffer[0]);
+        if (!available) {
+            return STAGE_STATUS_FINISHED;
         }
-        for (size_t i = 1; i < array->num_elements; i++) {
-            printf("CPU%zu:\t%.2Lf%%\n", i - 1, array->buffer[i]);
+    }
+    LOGGER_DEBUG("printer_process: Took %zu frames.", frame_count);
+
+    for (size_t i = 0; i < frame_count; i++) {
+        for (size_t j = 0; j < printer->sink_count; j++) {
+            const OutputSink *sink = &printer->sinks[j];
+            if ((sink->delivery == OUTPUT_SINK_DELIVERY_EVERY_FRAME || i + 1 == frame_count) &&
+                !sink->write(sink->context, frames[i])) {
+                logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Could not output a frame in printer_process.");
+            }
         }
-        printf("\n");
-
-        long_double_array_destroy(array);
     }
+    frame_broadcast_release(printer->broadcast, printer->subscriber);
+    for (size_t j = 0; j < printer->sink_count; j++) {
+        if (!printer->sinks[j].flush(printer->sinks[j].context)) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Could not flush an output sink in printer_process.");
+        }
+    }
+    return STAGE_STATUS_CONTINUE;
+}
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "printer_thread: Ending.");
-    return NULL;
+//Also from the watchdog, the printer stops without draining the frames still broadcast.
+static void printer_close_subscriber(void *const context) {
+    Printer *printer = (Printer *) context;
+    frame_broadcast_close_subscriber(printer->broadcast, printer->subscriber);
 }
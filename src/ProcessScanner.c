@@ -0,0 +1,467 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "../include/ProcessScanner.h"
+#include "../include/StatParser.h"
+#include "../include/Logger.h"
+
+//Must stay a power of two, slots are picked with a mask.
+static const size_t PROCESS_SCANNER_INITIAL_CAPACITY = 1024;
+static const size_t PROCESS_SCANNER_DIRENT_BUFFER_SIZE = 32 * 1024;
+//Descriptors kept free for everything else the process opens, the rest of the soft limit may be cached.
+static const rlim_t PROCESS_SCANNER_RESERVED_FDS = 128;
+//Fields between the command and utime in /proc/[pid]/stat, state included.
+static const size_t PROCESS_SCANNER_FIELDS_BEFORE_UTIME = 11;
+//getdents64 calls per scan. Listing /proc costs about a third of reading the stat files, a host whose listing does
+//not fit is listed over several scans.
+static const size_t PROCESS_SCANNER_LISTING_CALLS = 2;
+
+#define PROCESS_SCANNER_STAT_BUFFER_SIZE 1024
+#define PROCESS_SCANNER_NO_ENTRY SIZE_MAX
+
+//Record layout of getdents64, glibc only exposes it with _GNU_SOURCE.
+typedef struct ProcessScannerDirent {
+    uint64_t inode;
+    int64_t offset;
+    unsigned short record_length;
+    unsigned char type;
+    char name[];
+} ProcessScannerDirent;
+
+//A pid of 0 marks an empty slot, the kernel never lists it.
+typedef struct ProcessEntry {
+    int32_t pid;
+    int fd;
+    uint64_t cycle;
+    uint64_t read_scan;
+    unsigned long long int ticks;
+    char command[PROCESS_SCANNER_COMMAND_LENGTH];
+} ProcessEntry;
+
+//Open addressing with linear probing keyed by pid. Every entry keeps its stat file open, so reading a known process
+//is a single pread. A scan reads every known process, one that wakes up shows on the next scan with all of its time.
+//It goes on with the /proc listing where the previous scan left it. A process that exits is dropped when its read
+//fails or when a listing cycle ends without it, a new one is found within a cycle.
+struct ProcessScanner {
+    int directory_fd;
+    ProcessEntry *entries;
+    size_t capacity;
+    size_t count;
+    uint64_t scan;
+    uint64_t cycle;
+    size_t cached_fd_count;
+    size_t cached_fd_limit;
+    ProcessSample *samples;
+    size_t sample_count;
+    size_t sample_capacity;
+    char *dirent_buffer;
+};
+
+static size_t process_scanner_hash(int32_t pid, size_t capacity);
+
+static bool process_scanner_rehash(ProcessScanner *scanner, size_t capacity);
+
+static size_t process_scanner_find_or_insert(ProcessScanner *scanner, int32_t pid, bool *inserted);
+
+static void process_scanner_remove(ProcessScanner *scanner, size_t index);
+
+static void process_scanner_close_entry(ProcessScanner *scanner, ProcessEntry *entry);
+
+static bool process_scanner_read_entry(ProcessScanner *scanner, ProcessEntry *entry);
+
+static bool process_scanner_parse_stat(const char input[], size_t length, unsigned long long int *ticks,
+                                       char command[]);
+
+static bool process_scanner_append_sample(ProcessScanner *scanner, const ProcessEntry *entry,
+                                          unsigned long long int ticks);
+
+static void process_scanner_list(ProcessScanner *scanner);
+
+static void process_scanner_end_cycle(ProcessScanner *scanner);
+
+static void process_scanner_visit(ProcessScanner *scanner, const char name[]);
+
+static void process_scanner_read_all(ProcessScanner *scanner);
+
+ProcessScanner *process_scanner_create(const char proc_path[const]) {
+    LOGGER_DEBUG("process_scanner_create: Entry.");
+
+    if (proc_path == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received process_scanner_create call with proc_path = NULL.");
+        return NULL;
+    }
+
+    ProcessScanner *scanner = malloc(sizeof(ProcessScanner));
+    if (scanner == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in process_scanner_create.");
+        return NULL;
+    }
+
+    *scanner = (ProcessScanner) {
+            .directory_fd = open(proc_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+            .entries = calloc(PROCESS_SCANNER_INITIAL_CAPACITY, sizeof(ProcessEntry)),
+            .capacity = PROCESS_SCANNER_INITIAL_CAPACITY,
+            .count = 0,
+            .scan = 0,
+            .cycle = 1,
+            .cached_fd_count = 0,
+            .cached_fd_limit = 0,
+            .samples = NULL,
+            .sample_count = 0,
+            .sample_capacity = 0,
+            .dirent_buffer = malloc(PROCESS_SCANNER_DIRENT_BUFFER_SIZE)
+    };
+
+    if (scanner->directory_fd < 0 || scanner->entries == NULL || scanner->dirent_buffer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not open the process directory in process_scanner_create.");
+        if (scanner->directory_fd >= 0) {
+            close(scanner->directory_fd);
+        }
+        free(scanner->entries);
+        free(scanner->dirent_buffer);
+        free(scanner);
+        return NULL;
+    }
+
+    //The soft limit is left to the caller, descriptors past it are opened for each read instead of cached.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur > PROCESS_SCANNER_RESERVED_FDS) {
+            scanner->cached_fd_limit = (size_t) (limit.rlim_cur - PROCESS_SCANNER_RESERVED_FDS);
+        } else if (limit.rlim_cur == RLIM_INFINITY) {
+            scanner->cached_fd_limit = SIZE_MAX;
+        }
+    }
+
+    LOGGER_DEBUG("process_scanner_create: Success.");
+    return scanner;
+}
+
+void process_scanner_destroy(ProcessScanner *const scanner) {
+    LOGGER_DEBUG("process_scanner_destroy: Entry.");
+
+    if (scanner == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received process_scanner_destroy call with scanner = NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < scanner->capacity; i++) {
+        if (scanner->entries[i].pid != 0) {
+            process_scanner_close_entry(scanner, &scanner->entries[i]);
+        }
+    }
+    close(scanner->directory_fd);
+    free(scanner->entries);
+    free(scanner->samples);
+    free(scanner->dirent_buffer);
+    free(scanner);
+
+    LOGGER_DEBUG("process_scanner_destroy: Success.");
+}
+
+//Returns the processes that used CPU time since the previous scan, valid until the next scan. A process seen for
+//the first time only gets its baseline, so the first scan returns nothing.
+const ProcessSample *process_scanner_scan(ProcessScanner *const scanner, size_t *const sample_count) {
+    if (scanner == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received process_scanner_scan call with scanner = NULL.");
+        return NULL;
+    }
+
+    if (sample_count == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received process_scanner_scan call with sample_count = NULL.");
+        return NULL;
+    }
+
+    scanner->scan++;
+    scanner->sample_count = 0;
+    process_scanner_list(scanner);
+    process_scanner_read_all(scanner);
+
+    *sample_count = scanner->sample_count;
+    return scanner->samples;
+}
+
+size_t process_scanner_get_process_count(const ProcessScanner *const scanner) {
+    if (scanner == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received process_scanner_get_process_count call with scanner = NULL.");
+        return 0;
+    }
+
+    return scanner->count;
+}
+
+static size_t process_scanner_hash(const int32_t pid, const size_t capacity) {
+    //Fibonacci hashing spreads the consecutive pids the kernel hands out.
+    return (size_t) (((uint64_t) (uint32_t) pid * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+static bool process_scanner_rehash(ProcessScanner *const scanner, const size_t capacity) {
+    ProcessEntry *entries = calloc(capacity, sizeof(ProcessEntry));
+    if (entries == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from calloc call in process_scanner_rehash.");
+        return false;
+    }
+
+    for (size_t i = 0; i < scanner->capacity; i++) {
+        if (scanner->entries[i].pid == 0) {
+            continue;
+        }
+        size_t index = process_scanner_hash(scanner->entries[i].pid, capacity);
+        while (entries[index].pid != 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        entries[index] = scanner->entries[i];
+    }
+
+    free(scanner->entries);
+    scanner->entries = entries;
+    scanner->capacity = capacity;
+    return true;
+}
+
+static size_t process_scanner_find_or_insert(ProcessScanner *const scanner, const int32_t pid, bool *const inserted) {
+    //Kept at most half full, probe sequences stay short.
+    if ((scanner->count + 1) * 2 > scanner->capacity && !process_scanner_rehash(scanner, scanner->capacity * 2)) {
+        return PROCESS_SCANNER_NO_ENTRY;
+    }
+
+    size_t index = process_scanner_hash(pid, scanner->capacity);
+    while (scanner->entries[index].pid != 0) {
+        if (scanner->entries[index].pid == pid) {
+            *inserted = false;
+            return index;
+        }
+        index = (index + 1) & (scanner->capacity - 1);
+    }
+
+    scanner->entries[index] = (ProcessEntry) {
+            .pid = pid,
+            .fd = -1,
+            .cycle = 0,
+            .read_scan = 0,
+            .ticks = 0
+    };
+    scanner->count++;
+    *inserted = true;
+    return index;
+}
+
+//Backward shift deletion, the table never holds tombstones.
+static void process_scanner_remove(ProcessScanner *const scanner, const size_t index) {
+    process_scanner_close_entry(scanner, &scanner->entries[index]);
+
+    const size_t mask = scanner->capacity - 1;
+    size_t hole = index;
+    size_t next = (hole + 1) & mask;
+    while (scanner->entries[next].pid != 0) {
+        size_t home = process_scanner_hash(scanner->entries[next].pid, scanner->capacity);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            scanner->entries[hole] = scanner->entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    scanner->entries[hole].pid = 0;
+    scanner->count--;
+}
+
+static void process_scanner_close_entry(ProcessScanner *const scanner, ProcessEntry *const entry) {
+    if (entry->fd >= 0) {
+        close(entry->fd);
+        entry->fd = -1;
+        scanner->cached_fd_count--;
+    }
+}
+
+//Reads the stat file of an entry. Past the descriptor budget the file is opened for this read only.
+static bool process_scanner_read_entry(ProcessScanner *const scanner, ProcessEntry *const entry) {
+    int fd = entry->fd;
+    if (fd < 0) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/stat", (int) entry->pid);
+        fd = openat(scanner->directory_fd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+    }
+
+    char buffer[PROCESS_SCANNER_STAT_BUFFER_SIZE];
+    ssize_t bytes;
+    do {
+        bytes = pread(fd, buffer, sizeof(buffer), 0);
+    } while (bytes < 0 && errno == EINTR);
+
+    bool success = bytes > 0 &&
+                   process_scanner_parse_stat(buffer, (size_t) bytes, &entry->ticks, entry->command);
+
+    if (fd != entry->fd) {
+        if (success && scanner->cached_fd_count < scanner->cached_fd_limit) {
+            entry->fd = fd;
+            scanner->cached_fd_count++;
+        } else {
+            close(fd);
+        }
+    }
+    return success;
+}
+
+static bool process_scanner_parse_stat(const char input[const], const size_t length, unsigned long long int *const ticks,
+                                       char command[const]) {
+    const char *const end = input + length;
+    const char *open = memchr(input, '(', length);
+    //The command may itself contain parentheses, it ends at the last one.
+    const char *close = end;
+    while (close > input && *(close - 1) != ')') {
+        close--;
+    }
+    if (open == NULL || close == input || close - 1 <= open) {
+        return false;
+    }
+
+    size_t command_length = (size_t) (close - 1 - (open + 1));
+    if (command_length >= PROCESS_SCANNER_COMMAND_LENGTH) {
+        command_length = PROCESS_SCANNER_COMMAND_LENGTH - 1;
+    }
+    memcpy(command, open + 1, command_length);
+    command[command_length] = '\0';
+
+    const char *cursor = close;
+    for (size_t field = 0; field < PROCESS_SCANNER_FIELDS_BEFORE_UTIME + 1; field++) {
+        cursor = memchr(cursor, ' ', (size_t) (end - cursor));
+        if (cursor == NULL) {
+            return false;
+        }
+        cursor++;
+    }
+
+    unsigned long long int user_time = stat_parser_parse_number(&cursor, end);
+    if (cursor >= end || *cursor != ' ') {
+        return false;
+    }
+    cursor++;
+    unsigned long long int system_time = stat_parser_parse_number(&cursor, end);
+
+    *ticks = user_time + system_time;
+    return true;
+}
+
+static bool process_scanner_append_sample(ProcessScanner *const scanner, const ProcessEntry *const entry,
+                                          const unsigned long long int ticks) {
+    if (scanner->sample_count == scanner->sample_capacity) {
+        size_t sample_capacity = scanner->sample_capacity > 0 ? scanner->sample_capacity * 2 : 256;
+        ProcessSample *samples = realloc(scanner->samples, sizeof(ProcessSample) * sample_capacity);
+        if (samples == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in process_scanner_append_sample.");
+            return false;
+        }
+        scanner->samples = samples;
+        scanner->sample_capacity = sample_capacity;
+    }
+
+    ProcessSample *sample = &scanner->samples[scanner->sample_count++];
+    *sample = (ProcessSample) {
+            .pid = entry->pid,
+            .ticks = ticks > UINT32_MAX ? UINT32_MAX : (uint32_t) ticks
+    };
+    memcpy(sample->command, entry->command, PROCESS_SCANNER_COMMAND_LENGTH);
+    return true;
+}
+
+//Goes on with the listing where the previous scan left it. Reaching its end closes a cycle.
+static void process_scanner_list(ProcessScanner *const scanner) {
+    for (size_t call = 0; call < PROCESS_SCANNER_LISTING_CALLS; call++) {
+        long bytes = syscall(SYS_getdents64, scanner->directory_fd, scanner->dirent_buffer,
+                             PROCESS_SCANNER_DIRENT_BUFFER_SIZE);
+        if (bytes <= 0) {
+            process_scanner_end_cycle(scanner);
+            return;
+        }
+
+        for (long position = 0; position < bytes;) {
+            const ProcessScannerDirent *dirent = (const ProcessScannerDirent *) (scanner->dirent_buffer + position);
+            process_scanner_visit(scanner, dirent->name);
+            position += dirent->record_length;
+        }
+    }
+}
+
+//Processes the cycle did not list are gone. Removal may shift a later entry into the current slot, so the slot is
+//checked again before moving on.
+static void process_scanner_end_cycle(ProcessScanner *const scanner) {
+    for (size_t i = 0; i < scanner->capacity;) {
+        if (scanner->entries[i].pid != 0 && scanner->entries[i].cycle != scanner->cycle) {
+            process_scanner_remove(scanner, i);
+        } else {
+            i++;
+        }
+    }
+    scanner->cycle++;
+    lseek(scanner->directory_fd, 0, SEEK_SET);
+}
+
+//A new pid only gets its baseline.
+static void process_scanner_visit(ProcessScanner *const scanner, const char name[const]) {
+    int32_t pid = 0;
+    for (const char *digit = name; *digit != '\0'; digit++) {
+        if ((unsigned char) (*digit - '0') >= 10 || pid > (INT32_MAX - 9) / 10) {
+            return;
+        }
+        pid = pid * 10 + (*digit - '0');
+    }
+    if (pid == 0) {
+        return;
+    }
+
+    bool inserted;
+    size_t index = process_scanner_find_or_insert(scanner, pid, &inserted);
+    if (index == PROCESS_SCANNER_NO_ENTRY) {
+        return;
+    }
+
+    ProcessEntry *entry = &scanner->entries[index];
+    entry->cycle = scanner->cycle;
+    if (!inserted) {
+        return;
+    }
+    entry->read_scan = scanner->scan;
+    if (!process_scanner_read_entry(scanner, entry)) {
+        process_scanner_remove(scanner, index);
+    }
+}
+
+//A read that fails means the process exited. If its pid was reused, the listing finds the new process and starts
+//over. Removal may shift a later entry into the current slot, so the slot is checked again, and an entry that
+//wrapped around to the end is not read twice.
+static void process_scanner_read_all(ProcessScanner *const scanner) {
+    for (size_t i = 0; i < scanner->capacity;) {
+        ProcessEntry *entry = &scanner->entries[i];
+        if (entry->pid == 0 || entry->read_scan == scanner->scan) {
+            i++;
+            continue;
+        }
+
+        unsigned long long int previous_ticks = entry->ticks;
+        entry->read_scan = scanner->scan;
+        if (!process_scanner_read_entry(scanner, entry)) {
+            process_scanner_remove(scanner, i);
+            continue;
+        }
+
+        if (entry->ticks > previous_ticks) {
+            process_scanner_append_sample(scanner, entry, entry->ticks - previous_ticks);
+        }
+        i++;
+    }
+}
@@ -1,11 +1,14 @@
 #include "../include/Queue.h"
+#include "../include/CacheLine.h"
 #include "../include/Logger.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <pthread.h>
-#include <sys/time.h>
 
 struct Queue {
+    enum QUEUE_MODE mode;
     size_t capacity;
     size_t size;
     size_t head;
@@ -13,31 +16,92 @@ struct Queue {
     pthread_mutex_t mutex;
     pthread_cond_t can_insert;
     pthread_cond_t can_extract;
-    void *buffer[];
+    //Once set, every wait returns immediately. Objects can still be moved with the non-blocking calls, so the
+    //owner is able to drain the queue after its threads are gone.
+    atomic_bool closed;
+    //Registered producers, the queue closes when the last of them leaves.
+    atomic_size_t producer_count;
+
+    //QUEUE_MODE_SPSC only. Producer and consumer indices live on separate cache lines so that steady state
+    //traffic never bounces a line between the two threads. Each side keeps a private copy of the other index.
+    alignas(CACHE_LINE_SIZE) atomic_size_t spsc_head;
+    size_t spsc_cached_tail;
+    alignas(CACHE_LINE_SIZE) atomic_size_t spsc_tail;
+    size_t spsc_cached_head;
+    alignas(CACHE_LINE_SIZE) atomic_bool spsc_producer_parked;
+    atomic_bool spsc_consumer_parked;
+
+    alignas(CACHE_LINE_SIZE) void *buffer[];
 };
 
+static struct timespec queue_deadline_after(struct timespec timeout);
+
+static bool queue_init_condition(pthread_cond_t *condition);
+
+static bool queue_spsc_try_push(Queue *queue, void *object);
+
+static void *queue_spsc_try_pop(Queue *queue);
+
+static size_t queue_spsc_insert_batch(Queue *queue, void *const objects[], size_t count);
+
+static size_t queue_spsc_extract_batch(Queue *queue, void *objects[], size_t max_count);
+
+static bool queue_spsc_wait_until_not_full(Queue *queue, struct timespec timeout);
+
+static bool queue_spsc_wait_until_not_empty(Queue *queue, struct timespec timeout);
+
 Queue *queue_create(const size_t capacity) {
+    return queue_create_with_mode(capacity, QUEUE_MODE_LOCKED);
+}
+
+Queue *queue_create_with_mode(const size_t capacity, const enum QUEUE_MODE mode) {
     if (capacity <= 0) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
                    "Received queue_create call with capacity <= 0.");
         return NULL;
     }
 
-    Queue *queue = malloc(sizeof(Queue) + sizeof(void *) * capacity);
+    if (mode != QUEUE_MODE_LOCKED && mode != QUEUE_MODE_SPSC) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_create call with unknown mode.");
+        return NULL;
+    }
+
+    size_t allocation_size = sizeof(Queue) + sizeof(void *) * capacity;
+    allocation_size = (allocation_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+    Queue *queue = aligned_alloc(CACHE_LINE_SIZE, allocation_size);
     if (queue == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in queue_create.");
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from aligned_alloc call in queue_create.");
         return NULL;
     }
 
     *queue = (Queue) {
+            .mode = mode,
             .capacity = capacity,
             .size = 0,
             .head = 0,
             .tail = 0,
             .mutex = PTHREAD_MUTEX_INITIALIZER,
-            .can_insert = PTHREAD_COND_INITIALIZER,
-            .can_extract = PTHREAD_COND_INITIALIZER
+            .spsc_cached_tail = 0,
+            .spsc_cached_head = 0
     };
+    atomic_init(&queue->closed, false);
+    atomic_init(&queue->producer_count, 0);
+    atomic_init(&queue->spsc_head, 0);
+    atomic_init(&queue->spsc_tail, 0);
+    atomic_init(&queue->spsc_producer_parked, false);
+    atomic_init(&queue->spsc_consumer_parked, false);
+
+    if (!queue_init_condition(&queue->can_insert)) {
+        free(queue);
+        return NULL;
+    }
+    if (!queue_init_condition(&queue->can_extract)) {
+        pthread_cond_destroy(&queue->can_insert);
+        free(queue);
+        return NULL;
+    }
 
     return queue;
 }
@@ -55,6 +119,65 @@ void queue_destroy(Queue *const queue) {
     free(queue);
 }
 
+//Wakes every thread blocked in a wait on the queue and makes all further waits return false immediately.
+void queue_close(Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_close call with queue = NULL.");
+        return;
+    }
+
+    atomic_store(&queue->closed, true);
+    pthread_mutex_lock(&queue->mutex);
+    pthread_cond_broadcast(&queue->can_insert);
+    pthread_cond_broadcast(&queue->can_extract);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+//For queues fed by several threads, each one registers and releases, consumers then drain and end once all producers
+//are done. Returns the number of producers including the new one.
+size_t queue_add_producer(Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_add_producer call with queue = NULL.");
+        return 0;
+    }
+
+    return atomic_fetch_add(&queue->producer_count, 1) + 1;
+}
+
+void queue_release_producer(Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_release_producer call with queue = NULL.");
+        return;
+    }
+
+    if (atomic_fetch_sub(&queue->producer_count, 1) == 1) {
+        queue_close(queue);
+    }
+}
+
+bool queue_is_closed(const Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_is_closed call with queue = NULL.");
+        return true;
+    }
+
+    return atomic_load(&queue->closed);
+}
+
+enum QUEUE_MODE queue_get_mode(const Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_get_mode call with queue = NULL.");
+        return QUEUE_MODE_LOCKED;
+    }
+
+    return queue->mode;
+}
+
 bool queue_is_empty(const Queue *const queue) {
     if (queue == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -62,6 +185,11 @@ bool queue_is_empty(const Queue *const queue) {
         return false;
     }
 
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return atomic_load_explicit(&queue->spsc_head, memory_order_acquire) ==
+               atomic_load_explicit(&queue->spsc_tail, memory_order_acquire);
+    }
+
     return queue->size == 0;
 }
 
@@ -72,6 +200,11 @@ bool queue_is_full(const Queue *const queue) {
         return false;
     }
 
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return atomic_load_explicit(&queue->spsc_head, memory_order_acquire) -
+               atomic_load_explicit(&queue->spsc_tail, memory_order_acquire) == queue->capacity;
+    }
+
     return queue->size == queue->capacity;
 }
 
@@ -88,6 +221,11 @@ void queue_insert(Queue *const queue, void *const object) {
         return;
     }
 
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        queue_spsc_try_push(queue, object);
+        return;
+    }
+
     queue->buffer[queue->head] = object;
     queue->head = (queue->head + 1) % queue->capacity;
     queue->size++;
@@ -106,6 +244,10 @@ void *queue_extract(Queue *const queue) {
         return NULL;
     }
 
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_try_pop(queue);
+    }
+
     void *object = queue->buffer[queue->tail];
     queue->tail = (queue->tail + 1) % queue->capacity;
     queue->size--;
@@ -113,6 +255,159 @@ void *queue_extract(Queue *const queue) {
     return object;
 }
 
+bool queue_try_push(Queue *const queue, void *const object) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_try_push call with queue = NULL.");
+        return false;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_try_push(queue, object);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->size == queue->capacity) {
+        pthread_mutex_unlock(&queue->mutex);
+        return false;
+    }
+    queue_insert(queue, object);
+    pthread_cond_signal(&queue->can_extract);
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+}
+
+void *queue_try_pop(Queue *const queue) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_try_pop call with queue = NULL.");
+        return NULL;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_try_pop(queue);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->size == 0) {
+        pthread_mutex_unlock(&queue->mutex);
+        return NULL;
+    }
+    void *object = queue_extract(queue);
+    pthread_cond_signal(&queue->can_insert);
+    pthread_mutex_unlock(&queue->mutex);
+    return object;
+}
+
+size_t queue_insert_batch(Queue *const queue, void *const objects[const], const size_t count) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_insert_batch call with queue = NULL.");
+        return 0;
+    }
+
+    if (objects == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_insert_batch call with objects = NULL.");
+        return 0;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_insert_batch(queue, objects, count);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    size_t inserted = 0;
+    while (inserted < count && queue->size < queue->capacity) {
+        queue_insert(queue, objects[inserted++]);
+    }
+    if (inserted > 0) {
+        pthread_cond_signal(&queue->can_extract);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return inserted;
+}
+
+size_t queue_extract_batch(Queue *const queue, void *objects[const], const size_t max_count) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_extract_batch call with queue = NULL.");
+        return 0;
+    }
+
+    if (objects == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_extract_batch call with objects = NULL.");
+        return 0;
+    }
+
+    if (max_count == 0) {
+        return 0;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_extract_batch(queue, objects, max_count);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    size_t extracted = 0;
+    while (extracted < max_count && queue->size > 0) {
+        objects[extracted++] = queue_extract(queue);
+    }
+    if (extracted > 0) {
+        pthread_cond_signal(&queue->can_insert);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return extracted;
+}
+
+//Returns false once the queue is closed, true otherwise. A true result does not guarantee room, the caller retries.
+bool queue_wait_until_not_full(Queue *const queue, const struct timespec timeout) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_wait_until_not_full call with queue = NULL.");
+        return false;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_wait_until_not_full(queue, timeout);
+    }
+
+    struct timespec deadline = queue_deadline_after(timeout);
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->size == queue->capacity && !atomic_load(&queue->closed)) {
+        pthread_cond_timedwait(&queue->can_insert, &queue->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return !atomic_load(&queue->closed);
+}
+
+//Returns false once the queue is closed, true otherwise. A true result does not guarantee an object, the caller
+//retries.
+bool queue_wait_until_not_empty(Queue *const queue, const struct timespec timeout) {
+    if (queue == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received queue_wait_until_not_empty call with queue = NULL.");
+        return false;
+    }
+
+    if (queue->mode == QUEUE_MODE_SPSC) {
+        return queue_spsc_wait_until_not_empty(queue, timeout);
+    }
+
+    struct timespec deadline = queue_deadline_after(timeout);
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->size == 0 && !atomic_load(&queue->closed)) {
+        pthread_cond_timedwait(&queue->can_extract, &queue->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return !atomic_load(&queue->closed);
+}
+
 void queue_lock(Queue *const queue) {
     if (queue == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -156,14 +451,7 @@ void queue_wait_to_insert_with_timeout(Queue *const queue, const time_t seconds)
         return;
     }
 
-    struct timeval tp;
-    struct timespec ts;
-
-    gettimeofday(&tp, NULL);
-    ts.tv_sec = tp.tv_sec;
-    ts.tv_nsec = tp.tv_usec * 1000;
-    ts.tv_sec += seconds;
-
+    struct timespec ts = queue_deadline_after((struct timespec) {.tv_sec = seconds, .tv_nsec = 0});
     pthread_cond_timedwait(&queue->can_insert, &queue->mutex, &ts);
 }
 
@@ -174,14 +462,7 @@ void queue_wait_to_extract_with_timeout(Queue *const queue, const time_t seconds
         return;
     }
 
-    struct timeval tp;
-    struct timespec ts;
-
-    gettimeofday(&tp, NULL);
-    ts.tv_sec = tp.tv_sec;
-    ts.tv_nsec = tp.tv_usec * 1000;
-    ts.tv_sec += seconds;
-
+    struct timespec ts = queue_deadline_after((struct timespec) {.tv_sec = seconds, .tv_nsec = 0});
     pthread_cond_timedwait(&queue->can_extract, &queue->mutex, &ts);
 }
 
@@ -203,3 +484,170 @@ void queue_notify_extract(Queue *const queue) {
     pthread_cond_signal(&queue->can_extract);
 }
 
+//Condition variables wait on CLOCK_MONOTONIC, so a stepped wall clock neither stretches nor cuts short a timeout.
+static struct timespec queue_deadline_after(const struct timespec timeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ts.tv_sec += timeout.tv_sec;
+    ts.tv_nsec += timeout.tv_nsec;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+static bool queue_init_condition(pthread_cond_t *const condition) {
+    pthread_condattr_t attributes;
+    if (pthread_condattr_init(&attributes) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_condattr_init in queue_create.");
+        return false;
+    }
+
+    bool success = pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) == 0 &&
+                   pthread_cond_init(condition, &attributes) == 0;
+    pthread_condattr_destroy(&attributes);
+    if (!success) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_cond_init in queue_create.");
+    }
+    return success;
+}
+
+//The parked flags pair with the index stores through seq_cst fences (Dekker style): a waiter publishes its flag
+//and then re-checks the ring, the other side publishes its index and then checks the flag. At least one of them
+//observes the other, so the mutex is only touched when a thread actually has to sleep.
+static bool queue_spsc_try_push(Queue *const queue, void *const object) {
+    size_t head = atomic_load_explicit(&queue->spsc_head, memory_order_relaxed);
+    if (head - queue->spsc_cached_tail == queue->capacity) {
+        queue->spsc_cached_tail = atomic_load_explicit(&queue->spsc_tail, memory_order_acquire);
+        if (head - queue->spsc_cached_tail == queue->capacity) {
+            return false;
+        }
+    }
+
+    queue->buffer[head % queue->capacity] = object;
+    atomic_store_explicit(&queue->spsc_head, head + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->spsc_consumer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->can_extract);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    return true;
+}
+
+static void *queue_spsc_try_pop(Queue *const queue) {
+    size_t tail = atomic_load_explicit(&queue->spsc_tail, memory_order_relaxed);
+    if (tail == queue->spsc_cached_head) {
+        queue->spsc_cached_head = atomic_load_explicit(&queue->spsc_head, memory_order_acquire);
+        if (tail == queue->spsc_cached_head) {
+            return NULL;
+        }
+    }
+
+    void *object = queue->buffer[tail % queue->capacity];
+    atomic_store_explicit(&queue->spsc_tail, tail + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->spsc_producer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->can_insert);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    return object;
+}
+
+static size_t queue_spsc_insert_batch(Queue *const queue, void *const objects[const], const size_t count) {
+    size_t head = atomic_load_explicit(&queue->spsc_head, memory_order_relaxed);
+    size_t free_slots = queue->capacity - (head - queue->spsc_cached_tail);
+    if (free_slots < count) {
+        queue->spsc_cached_tail = atomic_load_explicit(&queue->spsc_tail, memory_order_acquire);
+        free_slots = queue->capacity - (head - queue->spsc_cached_tail);
+    }
+
+    size_t inserted = count < free_slots ? count : free_slots;
+    if (inserted == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < inserted; i++) {
+        queue->buffer[(head + i) % queue->capacity] = objects[i];
+    }
+    atomic_store_explicit(&queue->spsc_head, head + inserted, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->spsc_consumer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->can_extract);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    return inserted;
+}
+
+static size_t queue_spsc_extract_batch(Queue *const queue, void *objects[const], const size_t max_count) {
+    size_t tail = atomic_load_explicit(&queue->spsc_tail, memory_order_relaxed);
+    size_t available = queue->spsc_cached_head - tail;
+    if (available < max_count) {
+        queue->spsc_cached_head = atomic_load_explicit(&queue->spsc_head, memory_order_acquire);
+        available = queue->spsc_cached_head - tail;
+    }
+
+    size_t extracted = max_count < available ? max_count : available;
+    if (extracted == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < extracted; i++) {
+        objects[i] = queue->buffer[(tail + i) % queue->capacity];
+    }
+    atomic_store_explicit(&queue->spsc_tail, tail + extracted, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->spsc_producer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->can_insert);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    return extracted;
+}
+
+static bool queue_spsc_wait_until_not_full(Queue *const queue, const struct timespec timeout) {
+    if (!queue_is_full(queue) || atomic_load(&queue->closed)) {
+        return !atomic_load(&queue->closed);
+    }
+
+    struct timespec deadline = queue_deadline_after(timeout);
+    atomic_store_explicit(&queue->spsc_producer_parked, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue_is_full(queue) && !atomic_load(&queue->closed)) {
+        pthread_cond_timedwait(&queue->can_insert, &queue->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    atomic_store_explicit(&queue->spsc_producer_parked, false, memory_order_relaxed);
+    return !atomic_load(&queue->closed);
+}
+
+static bool queue_spsc_wait_until_not_empty(Queue *const queue, const struct timespec timeout) {
+    if (!queue_is_empty(queue) || atomic_load(&queue->closed)) {
+        return !atomic_load(&queue->closed);
+    }
+
+    struct timespec deadline = queue_deadline_after(timeout);
+    atomic_store_explicit(&queue->spsc_consumer_parked, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue_is_empty(queue) && !atomic_load(&queue->closed)) {
+        pthread_cond_timedwait(&queue->can_extract, &queue->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    atomic_store_explicit(&queue->spsc_consumer_parked, false, memory_order_relaxed);
+    return !atomic_load(&queue->closed);
+}
@@ -1,73 +1,132 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <pthread.h>
 #include "../include/Reader.h"
 #include "../include/Logger.h"
+#include "../include/Scheduler.h"
+#include "../include/Stage.h"
 
-static const time_t READER_QUEUE_WAIT_TIMEOUT = 1;
-
-static const size_t READER_CHAR_BUFFER_SIZE = 4096;
-
-static struct timespec READER_UPDATE_INTERVAL = {.tv_sec = 1, .tv_nsec = 0};
+//On top of the update interval, covers one read with a process scan plus a queue wait.
+static const struct timespec READER_WATCHDOG_SLACK = {.tv_sec = 0, .tv_nsec = 500000000};
 
+//A source stage with the Analyzer's input as its only output.
 struct Reader {
-    Queue *reader_analyzer_queue;
-    Watchdog *watchdog;
-    size_t watchdog_index;
-    pthread_t thread;
-    pthread_mutex_t mutex;
-    bool should_stop;
+    BufferPool *buffer_pool;
+    ReaderSource source;
+    ProcessScanner *process_scanner;
+    Scheduler *scheduler;
+    Stage *stage;
 };
 
-static void reader_request_stop_synchronized_void(void *reader);
+static enum STAGE_STATUS reader_process(Stage *stage, void *context, void *items[], size_t count);
 
-static bool reader_should_stop_synchronized(Reader *reader);
+static void reader_wake(void *context);
 
-static void *reader_thread(void *args);
+static void reader_scan_processes(ProcessScanner *process_scanner, Buffer *buffer);
 
-Reader *reader_create(Queue *const reader_analyzer_queue, Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_create: Entry.");
+//Samples the stat file at path, e.g. /proc/stat, once per update_interval.
+Reader *reader_create(Queue *const reader_analyzer_queue, BufferPool *const buffer_pool, Watchdog *const watchdog,
+                      const char path[const], ProcessScanner *const process_scanner,
+                      const struct timespec update_interval) {
+    if (path == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received reader_create call with path = NULL.");
+        return NULL;
+    }
+
+    ReaderSource source;
+    if (!reader_source_create_file(path, &source)) {
+        return NULL;
+    }
+
+    return reader_create_with_source(reader_analyzer_queue, buffer_pool, watchdog, source, process_scanner,
+                                     update_interval);
+}
+
+//The reader owns source from here on, it is destroyed with the reader or right away if creation fails.
+//process_scanner is optional. When given, every sample also carries the processes that used CPU time since the
+//previous one. The scanner stays owned by the caller and is only touched by the reader thread.
+Reader *reader_create_with_source(Queue *const reader_analyzer_queue, BufferPool *const buffer_pool,
+                                  Watchdog *const watchdog, const ReaderSource source,
+                                  ProcessScanner *const process_scanner, const struct timespec update_interval) {
+    LOGGER_DEBUG("reader_create_with_source: Entry.");
 
     if (reader_analyzer_queue == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received reader_create call with reader_analyzer_queue = NULL.");
+                   "Received reader_create_with_source call with reader_analyzer_queue = NULL.");
+        source.destroy(source.context);
+        return NULL;
+    }
+
+    if (buffer_pool == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received reader_create_with_source call with buffer_pool = NULL.");
+        source.destroy(source.context);
         return NULL;
     }
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received printer_create call with watchdog = NULL.");
+                   "Received reader_create_with_source call with watchdog = NULL.");
+        source.destroy(source.context);
         return NULL;
     }
 
     Reader *reader = malloc(sizeof(Reader));
     if (reader == NULL) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in reader_create.");
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in reader_create_with_source.");
+        source.destroy(source.context);
+        return NULL;
+    }
+
+    Scheduler *scheduler = scheduler_create(update_interval);
+    if (scheduler == NULL) {
+        source.destroy(source.context);
+        free(reader);
         return NULL;
     }
 
     *reader = (Reader) {
-            .reader_analyzer_queue = reader_analyzer_queue,
-            .watchdog = watchdog,
-            .watchdog_index = watchdog_register_watch(watchdog, &reader_request_stop_synchronized_void, reader),
-            .mutex = PTHREAD_MUTEX_INITIALIZER,
-            .should_stop = false,
+            .buffer_pool = buffer_pool,
+            .source = source,
+            .process_scanner = process_scanner,
+            .scheduler = scheduler
     };
 
-    if (pthread_create(&reader->thread, NULL, reader_thread, (void *) reader) != 0) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in reader_create.");
-        pthread_mutex_destroy(&reader->mutex);
+    //A 10 ms sampler is missed after about half a second, not after the budget slower stages need.
+    struct timespec watchdog_budget = {
+            .tv_sec = update_interval.tv_sec + READER_WATCHDOG_SLACK.tv_sec,
+            .tv_nsec = update_interval.tv_nsec + READER_WATCHDOG_SLACK.tv_nsec
+    };
+    if (watchdog_budget.tv_nsec >= 1000000000L) {
+        watchdog_budget.tv_sec++;
+        watchdog_budget.tv_nsec -= 1000000000L;
+    }
+
+    StageOperations operations = {
+            .process = &reader_process,
+            .discard = NULL,
+            .wake = &reader_wake
+    };
+    Queue *outputs[] = {reader_analyzer_queue};
+    reader->stage = stage_create("reader", operations, reader, NULL, outputs, 1, watchdog, watchdog_budget);
+    if (reader->stage != NULL && !stage_start(reader->stage)) {
+        stage_await_and_destroy(reader->stage);
+        reader->stage = NULL;
+    }
+    if (reader->stage == NULL) {
+        scheduler_destroy(scheduler);
+        source.destroy(source.context);
         free(reader);
         return NULL;
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_create: Success.");
+    LOGGER_DEBUG("reader_create_with_source: Success.");
     return reader;
 }
 
 void reader_await_and_destroy(Reader *const reader) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_await_and_destroy: Entry.");
+    LOGGER_DEBUG("reader_await_and_destroy: Entry.");
 
     if (reader == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -75,15 +134,20 @@ void reader_await_and_destroy(Reader *const reader) {
         return;
     }
 
-    pthread_join(reader->thread, NULL);
-    pthread_mutex_destroy(&reader->mutex);
+    stage_await_and_destroy(reader->stage);
+
+    LOGGER_INFO("Reader missed deadlines: %llu.",
+                (unsigned long long) scheduler_get_missed_deadlines(reader->scheduler));
+
+    scheduler_destroy(reader->scheduler);
+    reader->source.destroy(reader->source.context);
     free(reader);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_await_and_destroy: Success.");
+    LOGGER_DEBUG("reader_await_and_destroy: Success.");
 }
 
 void reader_request_stop_synchronized(Reader *const reader) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_request_stop_synchronized: Entry.");
+    LOGGER_DEBUG("reader_request_stop_synchronized: Entry.");
 
     if (reader == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -91,96 +155,94 @@ void reader_request_stop_synchronized(Reader *const reader) {
         return;
     }
 
-    pthread_mutex_lock(&reader->mutex);
-    reader->should_stop = true;
-    pthread_mutex_unlock(&reader->mutex);
+    stage_request_stop_synchronized(reader->stage);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_request_stop_synchronized: Success.");
+    LOGGER_DEBUG("reader_request_stop_synchronized: Success.");
 }
 
-static void reader_request_stop_synchronized_void(void *const reader) {
-    reader_request_stop_synchronized((Reader *) reader);
+uint64_t reader_get_missed_deadlines(const Reader *const reader) {
+    if (reader == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received reader_get_missed_deadlines call with reader = NULL.");
+        return 0;
+    }
+
+    return scheduler_get_missed_deadlines(reader->scheduler);
 }
 
-static bool reader_should_stop_synchronized(Reader *const reader) {
+//True once the source ran out of snapshots. Everything read before is still queued for the Analyzer.
+bool reader_is_finished(const Reader *const reader) {
     if (reader == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received reader_should_stop_synchronized call with reader = NULL.");
-        return true;
+                   "Received reader_is_finished call with reader = NULL.");
+        return false;
     }
 
-    bool return_value;
-    pthread_mutex_lock(&reader->mutex);
-    return_value = reader->should_stop;
-    pthread_mutex_unlock(&reader->mutex);
-    return return_value;
+    return stage_is_finished(reader->stage);
 }
 
-static void *reader_thread(void *args) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_thread: Entry.");
-
-    Reader *reader = (Reader *) args;
+//The stage closes the queue, the scheduler and the pool are the waits of the Reader's own.
+static void reader_wake(void *const context) {
+    Reader *reader = (Reader *) context;
+    scheduler_cancel(reader->scheduler);
+    buffer_pool_close(reader->buffer_pool);
+}
 
-    FILE *proc_file = fopen("/proc/stat", "r");
-    if (proc_file == NULL) {
-        perror("fopen error");
-        return NULL;
+static void reader_scan_processes(ProcessScanner *const process_scanner, Buffer *const buffer) {
+    size_t sample_count;
+    const ProcessSample *samples = process_scanner_scan(process_scanner, &sample_count);
+    if (samples == NULL || sample_count == 0) {
+        return;
     }
 
-    if (setvbuf(proc_file, NULL, _IONBF, 0) != 0) {
-        perror("setvbuf error");
-        fclose(proc_file);
-        return NULL;
+    //A failed reservation only costs this tick's process list, the CPU sample is still sent.
+    size_t length = sizeof(ProcessSample) * sample_count;
+    if (buffer_reserve_records(buffer, length)) {
+        memcpy(buffer->records, samples, length);
+        buffer->records_length = length;
     }
+}
 
-    while (!reader_should_stop_synchronized(reader)) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_thread: Iteration.");
-        watchdog_update(reader->watchdog, reader->watchdog_index);
-
-        char *buffer = malloc(sizeof(char) * READER_CHAR_BUFFER_SIZE);
-        if (buffer == NULL) {
-            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in reader_thread.");
-            break;
-        }
-
-        size_t read = fread(buffer, sizeof(char), READER_CHAR_BUFFER_SIZE - 1, proc_file);
-        if (ferror(proc_file) != 0) {
-            free(buffer);
-            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "fread error in reader_thread.");
-            break;
-        }
-        buffer[read] = '\0';
-
-        if (read >= READER_CHAR_BUFFER_SIZE) {
-            logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "READER_CHAR_BUFFER_SIZE too small in reader_thread.");
-        }
-
-        queue_lock(reader->reader_analyzer_queue);
-        while (queue_is_full(reader->reader_analyzer_queue)) {
-            queue_wait_to_insert_with_timeout(reader->reader_analyzer_queue, READER_QUEUE_WAIT_TIMEOUT);
-            if (reader_should_stop_synchronized(reader)) {
-                queue_unlock(reader->reader_analyzer_queue);
-                free(buffer);
-                fclose(proc_file);
-                logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_thread: Ending.");
-                return NULL;
-            }
+//One sample per call. Returning FINISHED releases the queue, which lets the Analyzer drain what is queued and then
+//end instead of waiting for more.
+static enum STAGE_STATUS reader_process(Stage *const stage, void *const context, void *items[const],
+                                        const size_t count) {
+    (void) items;
+    (void) count;
+    Reader *reader = (Reader *) context;
+
+    //Buffers are handed back by the Analyzer. Only the Analyzer may release into the pool, so a buffer held here on
+    //an early exit is simply left for buffer_pool_destroy.
+    Buffer *buffer;
+    while ((buffer = buffer_pool_try_acquire(reader->buffer_pool)) == NULL) {
+        bool closed = !buffer_pool_wait_to_acquire(reader->buffer_pool, stage_get_wait_timeout(stage));
+        stage_heartbeat(stage);
+        if (closed || stage_should_stop_synchronized(stage)) {
+            return STAGE_STATUS_STOPPED;
         }
+    }
 
-        queue_insert(reader->reader_analyzer_queue, buffer);
-        queue_notify_extract(reader->reader_analyzer_queue);
-        queue_unlock(reader->reader_analyzer_queue);
-
-        rewind(proc_file);
-        if (ferror(proc_file) != 0) {
-            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "rewind error in reader_thread.");
-            break;
-        }
+    buffer->timestamp_ns = scheduler_monotonic_now_ns();
+    enum READER_SOURCE_STATUS status = reader->source.read(reader->source.context, buffer);
+    if (status == READER_SOURCE_STATUS_END) {
+        LOGGER_INFO("Reader source exhausted.");
+        return STAGE_STATUS_FINISHED;
+    }
+    if (status == READER_SOURCE_STATUS_ERROR) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Read error in reader_process.");
+        return STAGE_STATUS_STOPPED;
+    }
+    if (reader->process_scanner != NULL) {
+        reader_scan_processes(reader->process_scanner, buffer);
+    }
 
-        nanosleep(&READER_UPDATE_INTERVAL, NULL);
+    if (!stage_emit(stage, 0, buffer)) {
+        return STAGE_STATUS_STOPPED;
     }
-    fclose(proc_file);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "reader_thread: Ending.");
-    return NULL;
+    //Sleeps to an absolute deadline, the time spent reading and queueing does not shift the period.
+    if (reader->source.pacing == READER_SOURCE_PACING_REAL_TIME && !scheduler_wait_next(reader->scheduler)) {
+        return STAGE_STATUS_STOPPED;
+    }
+    return STAGE_STATUS_CONTINUE;
 }
@@ -0,0 +1,346 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/ReaderSource.h"
+#include "../include/Logger.h"
+
+static const size_t READER_SOURCE_BUFFER_GRANULARITY = 4096;
+static const char READER_SOURCE_SNAPSHOT_START[] = "cpu ";
+
+typedef struct ReaderFile {
+    int fd;
+    size_t expected_size;
+} ReaderFile;
+
+//Every snapshot is held in memory, so replay speed is bound by the pipeline and not by the disk. Snapshot i spans
+//offsets[i] to offsets[i + 1] of data.
+typedef struct ReaderReplay {
+    char *data;
+    size_t length;
+    bool mapped;
+    size_t *offsets;
+    size_t offset_capacity;
+    size_t snapshot_count;
+    size_t next;
+} ReaderReplay;
+
+static enum READER_SOURCE_STATUS reader_file_read(void *file, Buffer *buffer);
+
+static void reader_file_destroy(void *file);
+
+static enum READER_SOURCE_STATUS reader_replay_read(void *replay, Buffer *buffer);
+
+static void reader_replay_destroy(void *replay);
+
+static bool reader_replay_add_offset(ReaderReplay *replay, size_t offset);
+
+static bool reader_replay_load_directory(ReaderReplay *replay, const char path[]);
+
+static bool reader_replay_load_archive(ReaderReplay *replay, int fd, size_t size);
+
+//Reads a file that is rewritten in place, /proc/stat or a test double of it. The descriptor stays open across reads.
+bool reader_source_create_file(const char path[const], ReaderSource *const source) {
+    if (path == NULL || source == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received reader_source_create_file call with path = NULL or source = NULL.");
+        return false;
+    }
+
+    ReaderFile *file = malloc(sizeof(ReaderFile));
+    if (file == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in reader_source_create_file.");
+        return false;
+    }
+
+    *file = (ReaderFile) {
+            .fd = open(path, O_RDONLY | O_CLOEXEC),
+            .expected_size = 0
+    };
+    if (file->fd < 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not open the stat file in reader_source_create_file.");
+        free(file);
+        return false;
+    }
+
+    //Procfs reports a size of 0, regular files (e.g. captured snapshots) report the real one.
+    struct stat file_stat;
+    if (fstat(file->fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        file->expected_size = (size_t) file_stat.st_size;
+    }
+
+    *source = (ReaderSource) {
+            .read = &reader_file_read,
+            .destroy = &reader_file_destroy,
+            .context = file,
+            .pacing = READER_SOURCE_PACING_REAL_TIME
+    };
+    return true;
+}
+
+//Replays captured snapshots once, in order. path is either a directory with one snapshot per file, taken in name
+//order, or a single archive of concatenated snapshots, each starting at its aggregate "cpu " line.
+bool reader_source_create_replay(const char path[const], const enum READER_SOURCE_PACING pacing,
+                                 ReaderSource *const source) {
+    if (path == NULL || source == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received reader_source_create_replay call with path = NULL or source = NULL.");
+        return false;
+    }
+
+    ReaderReplay *replay = malloc(sizeof(ReaderReplay));
+    if (replay == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in reader_source_create_replay.");
+        return false;
+    }
+
+    *replay = (ReaderReplay) {
+            .data = NULL,
+            .length = 0,
+            .mapped = false,
+            .offsets = NULL,
+            .offset_capacity = 0,
+            .snapshot_count = 0,
+            .next = 0
+    };
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat path_stat;
+    if (fd < 0 || fstat(fd, &path_stat) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not open the replay path in reader_source_create_replay.");
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(replay);
+        return false;
+    }
+
+    bool loaded = S_ISDIR(path_stat.st_mode) ? reader_replay_load_directory(replay, path)
+                                             : reader_replay_load_archive(replay, fd, (size_t) path_stat.st_size);
+    close(fd);
+    if (!loaded || replay->snapshot_count == 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Found no snapshots to replay in reader_source_create_replay.");
+        reader_replay_destroy(replay);
+        return false;
+    }
+
+    LOGGER_INFO("Loaded %zu snapshots to replay.", replay->snapshot_count);
+
+    *source = (ReaderSource) {
+            .read = &reader_replay_read,
+            .destroy = &reader_replay_destroy,
+            .context = replay,
+            .pacing = pacing
+    };
+    return true;
+}
+
+static enum READER_SOURCE_STATUS reader_file_read(void *const context, Buffer *const buffer) {
+    ReaderFile *file = (ReaderFile *) context;
+
+    //Leave room for counters gaining digits between ticks, so the cached size is rarely exceeded.
+    size_t wanted = file->expected_size + file->expected_size / 8 + 1;
+    wanted = (wanted + READER_SOURCE_BUFFER_GRANULARITY - 1) / READER_SOURCE_BUFFER_GRANULARITY *
+             READER_SOURCE_BUFFER_GRANULARITY;
+    if (!buffer_reserve(buffer, wanted)) {
+        return READER_SOURCE_STATUS_ERROR;
+    }
+
+    while (true) {
+        buffer->length = 0;
+        while (buffer->length < buffer->capacity - 1) {
+            ssize_t bytes = pread(file->fd, buffer->data + buffer->length, buffer->capacity - 1 - buffer->length,
+                                  (off_t) buffer->length);
+            if (bytes < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return READER_SOURCE_STATUS_ERROR;
+            }
+            if (bytes == 0) {
+                break;
+            }
+            buffer->length += (size_t) bytes;
+        }
+
+        if (buffer->length < buffer->capacity - 1) {
+            break;
+        }
+
+        //The snapshot did not fit. Grow and read it again from the start, a partial snapshot is useless.
+        LOGGER_DEBUG("reader_file_read: Growing buffer.");
+        if (!buffer_reserve(buffer, buffer->capacity * 2)) {
+            return READER_SOURCE_STATUS_ERROR;
+        }
+    }
+
+    buffer->data[buffer->length] = '\0';
+    file->expected_size = buffer->length;
+    return READER_SOURCE_STATUS_OK;
+}
+
+static void reader_file_destroy(void *const context) {
+    ReaderFile *file = (ReaderFile *) context;
+    close(file->fd);
+    free(file);
+}
+
+static enum READER_SOURCE_STATUS reader_replay_read(void *const context, Buffer *const buffer) {
+    ReaderReplay *replay = (ReaderReplay *) context;
+    if (replay->next == replay->snapshot_count) {
+        return READER_SOURCE_STATUS_END;
+    }
+
+    size_t start = replay->offsets[replay->next];
+    size_t length = replay->offsets[replay->next + 1] - start;
+    if (!buffer_reserve(buffer, length + 1)) {
+        return READER_SOURCE_STATUS_ERROR;
+    }
+
+    memcpy(buffer->data, replay->data + start, length);
+    buffer->data[length] = '\0';
+    buffer->length = length;
+    replay->next++;
+    return READER_SOURCE_STATUS_OK;
+}
+
+static void reader_replay_destroy(void *const context) {
+    ReaderReplay *replay = (ReaderReplay *) context;
+    if (replay->mapped) {
+        munmap(replay->data, replay->length);
+    } else {
+        free(replay->data);
+    }
+    free(replay->offsets);
+    free(replay);
+}
+
+static bool reader_replay_add_offset(ReaderReplay *const replay, const size_t offset) {
+    if (replay->snapshot_count + 2 > replay->offset_capacity) {
+        size_t capacity = replay->offset_capacity > 0 ? replay->offset_capacity * 2 : 64;
+        size_t *offsets = realloc(replay->offsets, sizeof(size_t) * capacity);
+        if (offsets == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in reader_replay_add_offset.");
+            return false;
+        }
+        replay->offsets = offsets;
+        replay->offset_capacity = capacity;
+    }
+
+    //The closing offset of the last snapshot is kept one past the count.
+    replay->offsets[replay->snapshot_count++] = offset;
+    replay->offsets[replay->snapshot_count] = replay->length;
+    return true;
+}
+
+static int reader_replay_filter(const struct dirent *entry) {
+    return entry->d_name[0] != '.';
+}
+
+static bool reader_replay_load_directory(ReaderReplay *const replay, const char path[const]) {
+    struct dirent **entries;
+    int entry_count = scandir(path, &entries, &reader_replay_filter, &alphasort);
+    if (entry_count < 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from scandir in reader_replay_load_directory.");
+        return false;
+    }
+
+    int directory_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    size_t capacity = 0;
+    bool loaded = directory_fd >= 0;
+    for (int i = 0; i < entry_count; i++) {
+        if (!loaded) {
+            free(entries[i]);
+            continue;
+        }
+
+        int fd = openat(directory_fd, entries[i]->d_name, O_RDONLY | O_CLOEXEC);
+        free(entries[i]);
+        struct stat file_stat;
+        if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+
+        size_t size = (size_t) file_stat.st_size;
+        if (replay->length + size > capacity) {
+            size_t new_capacity = capacity > 0 ? capacity : 64 * 1024;
+            while (new_capacity < replay->length + size) {
+                new_capacity *= 2;
+            }
+            char *data = realloc(replay->data, new_capacity);
+            if (data == NULL) {
+                logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                           "Received NULL from realloc call in reader_replay_load_directory.");
+                close(fd);
+                loaded = false;
+                continue;
+            }
+            replay->data = data;
+            capacity = new_capacity;
+        }
+
+        size_t read_length = 0;
+        while (read_length < size) {
+            ssize_t bytes = read(fd, replay->data + replay->length + read_length, size - read_length);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                break;
+            }
+            read_length += (size_t) bytes;
+        }
+        close(fd);
+
+        size_t offset = replay->length;
+        replay->length += read_length;
+        if (read_length > 0 && !reader_replay_add_offset(replay, offset)) {
+            loaded = false;
+        }
+    }
+    free(entries);
+    if (directory_fd >= 0) {
+        close(directory_fd);
+    }
+    return loaded;
+}
+
+//Snapshots are split at every line that starts like the aggregate line, per CPU lines continue with a digit.
+static bool reader_replay_load_archive(ReaderReplay *const replay, const int fd, const size_t size) {
+    if (size == 0) {
+        return false;
+    }
+
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received MAP_FAILED from mmap call in reader_replay_load_archive.");
+        return false;
+    }
+    replay->data = data;
+    replay->length = size;
+    replay->mapped = true;
+
+    const size_t start_length = sizeof(READER_SOURCE_SNAPSHOT_START) - 1;
+    if (!reader_replay_add_offset(replay, 0)) {
+        return false;
+    }
+    const char *cursor = data;
+    const char *end = data + size;
+    while ((cursor = memchr(cursor, '\n', (size_t) (end - cursor))) != NULL) {
+        cursor++;
+        if ((size_t) (end - cursor) >= start_length &&
+            memcmp(cursor, READER_SOURCE_SNAPSHOT_START, start_length) == 0 &&
+            !reader_replay_add_offset(replay, (size_t) (cursor - data))) {
+            return false;
+        }
+    }
+    return true;
+}
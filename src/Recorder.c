@@ -0,0 +1,172 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../include/Recorder.h"
+#include "../include/CpuIndexMap.h"
+#include "../include/Logger.h"
+
+static const size_t RECORDER_INITIAL_FILE_SIZE = 1024 * 1024;
+//Growth doubles the file until the steps reach this size, then continues linearly.
+static const size_t RECORDER_MAXIMUM_GROWTH = 64 * 1024 * 1024;
+
+//Records are written straight into a shared mapping of the file. The header is updated after each record, so a
+//file left behind by a crash still holds every complete record. Space is allocated ahead with posix_fallocate,
+//a full disk fails the append instead of raising SIGBUS on a page of a sparse file.
+struct Recorder {
+    int fd;
+    char *mapping;
+    size_t mapping_size;
+    RecorderHeader *header;
+    size_t cpu_count;
+    size_t record_size;
+    bool dropped_rows_logged;
+};
+
+static bool recorder_grow(Recorder *recorder, size_t minimum_size);
+
+Recorder *recorder_create(const char path[const], const size_t cpu_count, const struct timespec interval) {
+    if (path == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received recorder_create call with path = NULL.");
+        return NULL;
+    }
+
+    if (cpu_count >= UINT32_MAX) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received recorder_create call with cpu_count >= UINT32_MAX.");
+        return NULL;
+    }
+
+    Recorder *recorder = malloc(sizeof(Recorder));
+    if (recorder == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in recorder_create.");
+        return NULL;
+    }
+
+    *recorder = (Recorder) {
+            .fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644),
+            .mapping = NULL,
+            .mapping_size = 0,
+            .header = NULL,
+            .cpu_count = cpu_count,
+            .record_size = sizeof(RecorderRecord) + sizeof(RecorderCounters) * (cpu_count + 1),
+            .dropped_rows_logged = false
+    };
+    if (recorder->fd < 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not open the record file in recorder_create.");
+        free(recorder);
+        return NULL;
+    }
+
+    if (!recorder_grow(recorder, RECORDER_INITIAL_FILE_SIZE)) {
+        close(recorder->fd);
+        free(recorder);
+        return NULL;
+    }
+
+    *recorder->header = (RecorderHeader) {
+            .version = RECORDER_VERSION,
+            .cpu_count = (uint32_t) cpu_count,
+            .column_count = STAT_PARSER_COLUMN_COUNT,
+            .reserved = 0,
+            .interval_ns = (uint64_t) interval.tv_sec * 1000000000ULL + (uint64_t) interval.tv_nsec,
+            .record_size = recorder->record_size,
+            .record_count = 0
+    };
+    memcpy(recorder->header->magic, RECORDER_MAGIC, sizeof(recorder->header->magic));
+    return recorder;
+}
+
+//Cuts the file to the records actually written.
+void recorder_destroy(Recorder *const recorder) {
+    if (recorder == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Received recorder_destroy call with recorder = NULL.");
+        return;
+    }
+
+    size_t used_size = sizeof(RecorderHeader) + recorder->header->record_count * recorder->record_size;
+    munmap(recorder->mapping, recorder->mapping_size);
+    if (ftruncate(recorder->fd, (off_t) used_size) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "Could not trim the record file in recorder_destroy.");
+    }
+    close(recorder->fd);
+    free(recorder);
+}
+
+//Rows are placed by CPU id. CPUs missing from the snapshot are stored as RECORDER_OFFLINE, CPU ids that do not fit
+//the cpu_count given on creation are dropped.
+bool recorder_append(Recorder *const recorder, const uint64_t timestamp_ns, const CpuData rows[const],
+                     const size_t row_count) {
+    if (recorder == NULL || rows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received recorder_append call with recorder = NULL or rows = NULL.");
+        return false;
+    }
+
+    size_t offset = sizeof(RecorderHeader) + recorder->header->record_count * recorder->record_size;
+    if (offset + recorder->record_size > recorder->mapping_size &&
+        !recorder_grow(recorder, offset + recorder->record_size)) {
+        return false;
+    }
+
+    RecorderRecord *record = (RecorderRecord *) (recorder->mapping + offset);
+    record->timestamp_ns = timestamp_ns;
+    for (size_t key = 0; key <= recorder->cpu_count; key++) {
+        for (size_t column = 0; column < STAT_PARSER_COLUMN_COUNT; column++) {
+            record->counters[key].columns[column] = RECORDER_OFFLINE;
+        }
+    }
+    for (size_t i = 0; i < row_count; i++) {
+        size_t key = cpu_index_map_key(rows[i].cpu_id);
+        if (key > recorder->cpu_count) {
+            if (!recorder->dropped_rows_logged) {
+                logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                           "Recorder dropped a CPU beyond the CPU count of the record file.");
+                recorder->dropped_rows_logged = true;
+            }
+            continue;
+        }
+        for (size_t column = 0; column < STAT_PARSER_COLUMN_COUNT; column++) {
+            record->counters[key].columns[column] = rows[i].columns[column];
+        }
+    }
+    recorder->header->record_count++;
+    return true;
+}
+
+uint64_t recorder_get_record_count(const Recorder *const recorder) {
+    if (recorder == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received recorder_get_record_count call with recorder = NULL.");
+        return 0;
+    }
+
+    return recorder->header->record_count;
+}
+
+static bool recorder_grow(Recorder *const recorder, const size_t minimum_size) {
+    size_t size = recorder->mapping_size > 0 ? recorder->mapping_size : minimum_size;
+    while (size < minimum_size || size == recorder->mapping_size) {
+        size += size < RECORDER_MAXIMUM_GROWTH ? size : RECORDER_MAXIMUM_GROWTH;
+    }
+
+    if (posix_fallocate(recorder->fd, 0, (off_t) size) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not extend the record file in recorder_grow.");
+        return false;
+    }
+
+    char *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, recorder->fd, 0);
+    if (mapping == MAP_FAILED) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received MAP_FAILED from mmap call in recorder_grow.");
+        return false;
+    }
+
+    if (recorder->mapping != NULL) {
+        munmap(recorder->mapping, recorder->mapping_size);
+    }
+    recorder->mapping = mapping;
+    recorder->mapping_size = size;
+    recorder->header = (RecorderHeader *) mapping;
+    return true;
+}
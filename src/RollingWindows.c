@@ -0,0 +1,487 @@
+#include <string.h>
+#include "../include/RollingWindows.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+//One bucket per percent, the last one only holds full load.
+#define ROLLING_WINDOWS_BUCKETS (SAMPLE_FRAME_FULL_LOAD / 100 + 1)
+//Must stay a power of two above the blocks of the longest span plus the open one, blocks are picked with a mask.
+#define ROLLING_WINDOWS_BLOCKS 64
+
+static const uint64_t ROLLING_WINDOWS_SPAN_NS[ROLLING_WINDOW_SPAN_COUNT] = {
+        10ULL * 1000000000ULL, 60ULL * 1000000000ULL, 300ULL * 1000000000ULL
+};
+static const uint64_t ROLLING_WINDOWS_BLOCK_NS = 5ULL * 1000000000ULL;
+//Rings and deques must stay powers of two, positions are mapped to slots with a mask.
+static const size_t ROLLING_WINDOWS_INITIAL_CAPACITY = 64;
+static const size_t ROLLING_WINDOWS_INITIAL_DEQUE_CAPACITY = 8;
+
+//Absolute sample positions, front is the oldest. Values along the deque are monotonic, so its front is the
+//minimum (or maximum) of the window and every position enters and leaves it once.
+typedef struct RollingDeque {
+    uint64_t *positions;
+    size_t capacity;
+    size_t front;
+    size_t back;
+} RollingDeque;
+
+typedef struct RollingTotals {
+    uint64_t sum;
+    uint32_t count;
+    uint32_t histogram[ROLLING_WINDOWS_BUCKETS];
+} RollingTotals;
+
+//What a series saw during one block. The count saturates, a block never holds that many samples at any interval
+//the Reader allows.
+typedef struct RollingBlock {
+    uint32_t sum;
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+    uint16_t histogram[ROLLING_WINDOWS_BUCKETS];
+} RollingBlock;
+
+typedef struct RollingSeries {
+    uint16_t *values;
+    RollingTotals totals[ROLLING_WINDOW_SPAN_COUNT];
+    RollingDeque min_deque;
+    RollingDeque max_deque;
+    RollingBlock *blocks;
+} RollingSeries;
+
+//The 10 second span is exact: samples of every series share one timestamp ring that holds just that span, and the
+//minimum and maximum come from monotonic deques. The longer spans are fed from 5 second blocks, each with the sum,
+//count, minimum, maximum and histogram of its samples, and drop a whole block at a time. They hold between their
+//span less one block and their span, and a series costs about 14 KB for its blocks plus 10 s of samples whatever the
+//interval, about 70 MB for 4096 CPUs sampled every 10 ms. Offline values are stored but counted by no statistic.
+struct RollingWindows {
+    uint64_t *timestamps;
+    size_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t block;
+    uint64_t block_tails[ROLLING_WINDOW_SPAN_COUNT];
+    RollingSeries *series;
+    size_t series_count;
+};
+
+static bool rolling_windows_reserve_series(RollingWindows *windows, size_t series_count);
+
+static bool rolling_windows_grow(RollingWindows *windows);
+
+static void rolling_windows_evict(RollingWindows *windows, uint64_t position);
+
+static void rolling_windows_open_block(RollingWindows *windows, uint64_t block);
+
+static void rolling_windows_evict_block(RollingWindows *windows, enum ROLLING_WINDOW_SPAN span, uint64_t block);
+
+static bool rolling_windows_reserve_deques(RollingSeries *series);
+
+static void rolling_windows_include(RollingWindows *windows, RollingSeries *series, uint64_t position,
+                                    uint16_t value);
+
+static uint16_t rolling_windows_percentile(const RollingTotals *totals, uint32_t percent, uint16_t min, uint16_t max);
+
+static bool rolling_deque_reserve(RollingDeque *deque);
+
+static void rolling_deque_push_back(RollingDeque *deque, uint64_t position);
+
+static void rolling_deque_destroy(RollingDeque *deque);
+
+RollingWindows *rolling_windows_create(void) {
+    RollingWindows *windows = malloc(sizeof(RollingWindows));
+    if (windows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in rolling_windows_create.");
+        return NULL;
+    }
+
+    *windows = (RollingWindows) {
+            .timestamps = malloc(sizeof(uint64_t) * ROLLING_WINDOWS_INITIAL_CAPACITY),
+            .capacity = ROLLING_WINDOWS_INITIAL_CAPACITY,
+            .head = 0,
+            .tail = 0,
+            .block = 0,
+            .series = NULL,
+            .series_count = 0
+    };
+    if (windows->timestamps == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in rolling_windows_create.");
+        free(windows);
+        return NULL;
+    }
+
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        windows->block_tails[span] = 0;
+    }
+    return windows;
+}
+
+void rolling_windows_destroy(RollingWindows *const windows) {
+    if (windows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_destroy call with windows = NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < windows->series_count; i++) {
+        free(windows->series[i].values);
+        free(windows->series[i].blocks);
+        rolling_deque_destroy(&windows->series[i].min_deque);
+        rolling_deque_destroy(&windows->series[i].max_deque);
+    }
+    free(windows->series);
+    free(windows->timestamps);
+    free(windows);
+}
+
+//Adds one value per series, indexed like SampleFrame utilization. Series beyond count get an offline value.
+//Timestamps must not go backwards. Amortized O(1) per value and span. Returns false if a value could not be
+//counted, it is stored as offline instead so that every span stays consistent.
+bool rolling_windows_add(RollingWindows *const windows, const uint64_t timestamp_ns, const uint16_t values[const],
+                         const size_t count) {
+    if (windows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_add call with windows = NULL.");
+        return false;
+    }
+
+    if (values == NULL && count > 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_add call with values = NULL.");
+        return false;
+    }
+
+    if (!rolling_windows_reserve_series(windows, count)) {
+        return false;
+    }
+
+    while (windows->tail < windows->head &&
+           windows->timestamps[windows->tail & (windows->capacity - 1)] +
+           ROLLING_WINDOWS_SPAN_NS[ROLLING_WINDOW_SPAN_10_SECONDS] <= timestamp_ns) {
+        rolling_windows_evict(windows, windows->tail);
+        windows->tail++;
+    }
+
+    uint64_t block = timestamp_ns / ROLLING_WINDOWS_BLOCK_NS;
+    if (windows->head == 0) {
+        windows->block = block;
+        for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+            windows->block_tails[span] = block;
+        }
+    } else if (block > windows->block) {
+        rolling_windows_open_block(windows, block);
+    }
+
+    if (windows->head - windows->tail == windows->capacity && !rolling_windows_grow(windows)) {
+        return false;
+    }
+
+    const uint64_t position = windows->head;
+    const size_t slot = position & (windows->capacity - 1);
+    windows->timestamps[slot] = timestamp_ns;
+    bool success = true;
+    for (size_t i = 0; i < windows->series_count; i++) {
+        RollingSeries *series = &windows->series[i];
+        uint16_t value = i < count ? values[i] : SAMPLE_FRAME_OFFLINE;
+        //Eviction assumes every span counted the value, so it is counted by all of them or by none.
+        if (value != SAMPLE_FRAME_OFFLINE && !rolling_windows_reserve_deques(series)) {
+            value = SAMPLE_FRAME_OFFLINE;
+            success = false;
+        }
+        series->values[slot] = value;
+        if (value != SAMPLE_FRAME_OFFLINE) {
+            rolling_windows_include(windows, series, position, value);
+        }
+    }
+    windows->head++;
+    return success;
+}
+
+//Fills stats from the maintained state. Only the percentile bucket scan and, for the spans fed from blocks, the
+//minimum and maximum over at most 61 blocks are computed here. A series without online samples in the window
+//reports a sample_count of 0.
+bool rolling_windows_get(const RollingWindows *const windows, const size_t series, const enum ROLLING_WINDOW_SPAN span,
+                         RollingWindowStats *const stats) {
+    if (windows == NULL || stats == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_get call with windows = NULL or stats = NULL.");
+        return false;
+    }
+
+    if (series >= windows->series_count || span >= ROLLING_WINDOW_SPAN_COUNT) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_get call with an invalid series or span.");
+        return false;
+    }
+
+    const RollingSeries *rolling_series = &windows->series[series];
+    const RollingTotals *totals = &rolling_series->totals[span];
+    *stats = (RollingWindowStats) {
+            .sample_count = totals->count
+    };
+    if (totals->count == 0) {
+        return true;
+    }
+
+    if (span == ROLLING_WINDOW_SPAN_10_SECONDS) {
+        const size_t mask = windows->capacity - 1;
+        const RollingDeque *min_deque = &rolling_series->min_deque;
+        const RollingDeque *max_deque = &rolling_series->max_deque;
+        stats->min = rolling_series->values[min_deque->positions[min_deque->front & (min_deque->capacity - 1)] & mask];
+        stats->max = rolling_series->values[max_deque->positions[max_deque->front & (max_deque->capacity - 1)] & mask];
+    } else {
+        stats->min = SAMPLE_FRAME_FULL_LOAD;
+        stats->max = 0;
+        for (uint64_t block = windows->block_tails[span]; block <= windows->block; block++) {
+            const RollingBlock *rolling_block = &rolling_series->blocks[block & (ROLLING_WINDOWS_BLOCKS - 1)];
+            if (rolling_block->count == 0) {
+                continue;
+            }
+            stats->min = rolling_block->min < stats->min ? rolling_block->min : stats->min;
+            stats->max = rolling_block->max > stats->max ? rolling_block->max : stats->max;
+        }
+    }
+    stats->mean = (uint16_t) ((totals->sum + totals->count / 2) / totals->count);
+    stats->p95 = rolling_windows_percentile(totals, 95, stats->min, stats->max);
+    stats->p99 = rolling_windows_percentile(totals, 99, stats->min, stats->max);
+    return true;
+}
+
+size_t rolling_windows_get_series_count(const RollingWindows *const windows) {
+    if (windows == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received rolling_windows_get_series_count call with windows = NULL.");
+        return 0;
+    }
+
+    return windows->series_count;
+}
+
+uint64_t rolling_windows_span_ns(const enum ROLLING_WINDOW_SPAN span) {
+    return span < ROLLING_WINDOW_SPAN_COUNT ? ROLLING_WINDOWS_SPAN_NS[span] : 0;
+}
+
+uint64_t rolling_windows_block_ns(void) {
+    return ROLLING_WINDOWS_BLOCK_NS;
+}
+
+//New series join with offline history and empty blocks, so evicting old positions and blocks never reads garbage.
+//Their blocks are allocated once, only the ring of the shortest span grows with the sampling rate.
+static bool rolling_windows_reserve_series(RollingWindows *const windows, const size_t series_count) {
+    if (series_count <= windows->series_count) {
+        return true;
+    }
+
+    RollingSeries *series = realloc(windows->series, sizeof(RollingSeries) * series_count);
+    if (series == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                   "Received NULL from realloc call in rolling_windows_reserve_series.");
+        return false;
+    }
+    windows->series = series;
+
+    for (size_t i = windows->series_count; i < series_count; i++) {
+        series[i] = (RollingSeries) {
+                .values = malloc(sizeof(uint16_t) * windows->capacity),
+                .blocks = calloc(ROLLING_WINDOWS_BLOCKS, sizeof(RollingBlock))
+        };
+        if (series[i].values == NULL || series[i].blocks == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from malloc call in rolling_windows_reserve_series.");
+            free(series[i].values);
+            free(series[i].blocks);
+            return false;
+        }
+        for (size_t slot = 0; slot < windows->capacity; slot++) {
+            series[i].values[slot] = SAMPLE_FRAME_OFFLINE;
+        }
+        windows->series_count = i + 1;
+    }
+    return true;
+}
+
+static bool rolling_windows_grow(RollingWindows *const windows) {
+    const size_t capacity = windows->capacity * 2;
+
+    uint64_t *timestamps = malloc(sizeof(uint64_t) * capacity);
+    if (timestamps == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in rolling_windows_grow.");
+        return false;
+    }
+    for (uint64_t position = windows->tail; position < windows->head; position++) {
+        timestamps[position & (capacity - 1)] = windows->timestamps[position & (windows->capacity - 1)];
+    }
+
+    for (size_t i = 0; i < windows->series_count; i++) {
+        uint16_t *values = malloc(sizeof(uint16_t) * capacity);
+        if (values == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in rolling_windows_grow.");
+            free(timestamps);
+            return false;
+        }
+        for (uint64_t position = windows->tail; position < windows->head; position++) {
+            values[position & (capacity - 1)] = windows->series[i].values[position & (windows->capacity - 1)];
+        }
+        free(windows->series[i].values);
+        windows->series[i].values = values;
+    }
+
+    free(windows->timestamps);
+    windows->timestamps = timestamps;
+    windows->capacity = capacity;
+    return true;
+}
+
+static void rolling_windows_evict(RollingWindows *const windows, const uint64_t position) {
+    const size_t slot = position & (windows->capacity - 1);
+    for (size_t i = 0; i < windows->series_count; i++) {
+        RollingSeries *series = &windows->series[i];
+        uint16_t value = series->values[slot];
+        if (value == SAMPLE_FRAME_OFFLINE) {
+            continue;
+        }
+
+        RollingTotals *totals = &series->totals[ROLLING_WINDOW_SPAN_10_SECONDS];
+        totals->sum -= value;
+        totals->count--;
+        totals->histogram[value / 100]--;
+
+        RollingDeque *deques[] = {&series->min_deque, &series->max_deque};
+        for (size_t d = 0; d < 2; d++) {
+            RollingDeque *deque = deques[d];
+            if (deque->front != deque->back && deque->positions[deque->front & (deque->capacity - 1)] == position) {
+                deque->front++;
+            }
+        }
+    }
+}
+
+//Every span fed from blocks first drops the blocks that fall out of it, while their slots still hold them, then
+//the slots of the new block and of any block skipped over a gap are emptied.
+static void rolling_windows_open_block(RollingWindows *const windows, const uint64_t block) {
+    for (size_t span = ROLLING_WINDOW_SPAN_10_SECONDS + 1; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        uint64_t span_blocks = ROLLING_WINDOWS_SPAN_NS[span] / ROLLING_WINDOWS_BLOCK_NS;
+        uint64_t oldest = block >= span_blocks ? block - span_blocks + 1 : 0;
+        while (windows->block_tails[span] < oldest && windows->block_tails[span] <= windows->block) {
+            rolling_windows_evict_block(windows, (enum ROLLING_WINDOW_SPAN) span, windows->block_tails[span]);
+            windows->block_tails[span]++;
+        }
+        if (windows->block_tails[span] < oldest) {
+            windows->block_tails[span] = oldest;
+        }
+    }
+
+    uint64_t first = block - windows->block > ROLLING_WINDOWS_BLOCKS ? block - ROLLING_WINDOWS_BLOCKS + 1 :
+                     windows->block + 1;
+    for (uint64_t emptied = first; emptied <= block; emptied++) {
+        for (size_t i = 0; i < windows->series_count; i++) {
+            memset(&windows->series[i].blocks[emptied & (ROLLING_WINDOWS_BLOCKS - 1)], 0, sizeof(RollingBlock));
+        }
+    }
+    windows->block = block;
+}
+
+static void rolling_windows_evict_block(RollingWindows *const windows, const enum ROLLING_WINDOW_SPAN span,
+                                        const uint64_t block) {
+    for (size_t i = 0; i < windows->series_count; i++) {
+        RollingSeries *series = &windows->series[i];
+        const RollingBlock *rolling_block = &series->blocks[block & (ROLLING_WINDOWS_BLOCKS - 1)];
+        if (rolling_block->count == 0) {
+            continue;
+        }
+
+        RollingTotals *totals = &series->totals[span];
+        totals->sum -= rolling_block->sum;
+        totals->count -= rolling_block->count;
+        for (size_t bucket = 0; bucket < ROLLING_WINDOWS_BUCKETS; bucket++) {
+            totals->histogram[bucket] -= rolling_block->histogram[bucket];
+        }
+    }
+}
+
+//Makes room for one more position in both deques of the series, so that including a value cannot fail halfway.
+static bool rolling_windows_reserve_deques(RollingSeries *const series) {
+    return rolling_deque_reserve(&series->min_deque) && rolling_deque_reserve(&series->max_deque);
+}
+
+//The deques must have room for the position, see rolling_windows_reserve_deques.
+static void rolling_windows_include(RollingWindows *const windows, RollingSeries *const series,
+                                    const uint64_t position, const uint16_t value) {
+    const size_t mask = windows->capacity - 1;
+    RollingBlock *block = &series->blocks[windows->block & (ROLLING_WINDOWS_BLOCKS - 1)];
+    bool block_full = block->count == UINT16_MAX;
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        if (span != ROLLING_WINDOW_SPAN_10_SECONDS && block_full) {
+            continue;
+        }
+        RollingTotals *totals = &series->totals[span];
+        totals->sum += value;
+        totals->count++;
+        totals->histogram[value / 100]++;
+    }
+
+    if (!block_full) {
+        block->min = block->count == 0 || value < block->min ? value : block->min;
+        block->max = block->count == 0 || value > block->max ? value : block->max;
+        block->sum += value;
+        block->count++;
+        block->histogram[value / 100]++;
+    }
+
+    RollingDeque *min_deque = &series->min_deque;
+    while (min_deque->front != min_deque->back &&
+           series->values[min_deque->positions[(min_deque->back - 1) & (min_deque->capacity - 1)] & mask] >= value) {
+        min_deque->back--;
+    }
+    rolling_deque_push_back(min_deque, position);
+
+    RollingDeque *max_deque = &series->max_deque;
+    while (max_deque->front != max_deque->back &&
+           series->values[max_deque->positions[(max_deque->back - 1) & (max_deque->capacity - 1)] & mask] <= value) {
+        max_deque->back--;
+    }
+    rolling_deque_push_back(max_deque, position);
+}
+
+static uint16_t rolling_windows_percentile(const RollingTotals *const totals, const uint32_t percent,
+                                           const uint16_t min, const uint16_t max) {
+    //Nearest rank: the smallest bucket that holds at least percent of the samples at or below it.
+    const uint64_t rank = ((uint64_t) totals->count * percent + 99) / 100;
+    uint64_t at_or_above = 0;
+    for (size_t bucket = ROLLING_WINDOWS_BUCKETS; bucket-- > 0;) {
+        at_or_above += totals->histogram[bucket];
+        if (totals->count - at_or_above < rank) {
+            //Bucket middle, kept inside the exact range of the window.
+            uint32_t value = (uint32_t) bucket * 100 + 50;
+            return (uint16_t) (value < min ? min : value > max ? max : value);
+        }
+    }
+    return min;
+}
+
+static bool rolling_deque_reserve(RollingDeque *const deque) {
+    if (deque->back - deque->front == deque->capacity) {
+        size_t capacity = deque->capacity > 0 ? deque->capacity * 2 : ROLLING_WINDOWS_INITIAL_DEQUE_CAPACITY;
+        uint64_t *positions = malloc(sizeof(uint64_t) * capacity);
+        if (positions == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in rolling_deque_reserve.");
+            return false;
+        }
+        for (size_t i = deque->front; i != deque->back; i++) {
+            positions[i & (capacity - 1)] = deque->positions[i & (deque->capacity - 1)];
+        }
+        free(deque->positions);
+        deque->positions = positions;
+        deque->capacity = capacity;
+    }
+    return true;
+}
+
+static void rolling_deque_push_back(RollingDeque *const deque, const uint64_t position) {
+    deque->positions[deque->back & (deque->capacity - 1)] = position;
+    deque->back++;
+}
+
+static void rolling_deque_destroy(RollingDeque *const deque) {
+    free(deque->positions);
+}
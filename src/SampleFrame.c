@@ -0,0 +1,42 @@
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+SampleFrame *sample_frame_create(const size_t cpu_count) {
+    if (cpu_count >= UINT32_MAX) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received sample_frame_create call with cpu_count >= UINT32_MAX.");
+        return NULL;
+    }
+
+    size_t allocation_size = sizeof(SampleFrame) + sizeof(uint16_t) * (cpu_count + 1);
+    allocation_size = (allocation_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+    SampleFrame *frame = aligned_alloc(CACHE_LINE_SIZE, allocation_size);
+    if (frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from aligned_alloc call in sample_frame_create.");
+        return NULL;
+    }
+
+    *frame = (SampleFrame) {
+            .timestamp_ns = 0,
+            .sequence = 0,
+            .cpu_count = (uint32_t) cpu_count,
+            .process_count = 0
+    };
+    return frame;
+}
+
+void sample_frame_destroy(SampleFrame *const frame) {
+    free(frame);
+}
+
+//Integer only, rounded to the nearest basis point. A torn snapshot can report more idle than total time, which
+//is clamped to an idle CPU instead of wrapping around.
+uint16_t sample_frame_basis_points(const unsigned long long int idle_time, const unsigned long long int total_time) {
+    if (idle_time >= total_time) {
+        return 0;
+    }
+
+    unsigned long long int busy_time = total_time - idle_time;
+    return (uint16_t) ((busy_time * SAMPLE_FRAME_FULL_LOAD + total_time / 2) / total_time);
+}
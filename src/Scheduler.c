@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "../include/Scheduler.h"
+#include "../include/Logger.h"
+
+static const uint64_t SCHEDULER_MINIMUM_INTERVAL_NS = 10000000ULL;
+static const uint64_t SCHEDULER_NS_PER_SECOND = 1000000000ULL;
+
+//Deadlines are absolute points on CLOCK_MONOTONIC spaced by the interval from the first one, so time spent working
+//between ticks never shifts the phase. The sleep is a timed wait on a condition bound to the same clock, which
+//scheduler_cancel can cut short.
+struct Scheduler {
+    uint64_t interval_ns;
+    uint64_t next_deadline_ns;
+    atomic_uint_fast64_t missed_deadlines;
+    pthread_mutex_t mutex;
+    pthread_cond_t cancelled_condition;
+    atomic_bool cancelled;
+};
+
+Scheduler *scheduler_create(const struct timespec interval) {
+    LOGGER_DEBUG("scheduler_create: Entry.");
+
+    if (interval.tv_sec < 0 || interval.tv_nsec < 0 || (uint64_t) interval.tv_nsec >= SCHEDULER_NS_PER_SECOND) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_create call with an invalid interval.");
+        return NULL;
+    }
+
+    uint64_t interval_ns = (uint64_t) interval.tv_sec * SCHEDULER_NS_PER_SECOND + (uint64_t) interval.tv_nsec;
+    if (interval_ns < SCHEDULER_MINIMUM_INTERVAL_NS) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_create call with interval below 10 ms.");
+        return NULL;
+    }
+
+    Scheduler *scheduler = malloc(sizeof(Scheduler));
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in scheduler_create.");
+        return NULL;
+    }
+
+    *scheduler = (Scheduler) {
+            .interval_ns = interval_ns,
+            .next_deadline_ns = scheduler_monotonic_now_ns(),
+            .mutex = PTHREAD_MUTEX_INITIALIZER
+    };
+    atomic_init(&scheduler->missed_deadlines, 0);
+    atomic_init(&scheduler->cancelled, false);
+
+    pthread_condattr_t attributes;
+    bool success = pthread_condattr_init(&attributes) == 0;
+    if (success) {
+        success = pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) == 0 &&
+                  pthread_cond_init(&scheduler->cancelled_condition, &attributes) == 0;
+        pthread_condattr_destroy(&attributes);
+    }
+    if (!success) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_cond_init in scheduler_create.");
+        free(scheduler);
+        return NULL;
+    }
+
+    LOGGER_DEBUG("scheduler_create: Success.");
+    return scheduler;
+}
+
+void scheduler_destroy(Scheduler *const scheduler) {
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_destroy call with scheduler = NULL.");
+        return;
+    }
+
+    pthread_cond_destroy(&scheduler->cancelled_condition);
+    pthread_mutex_destroy(&scheduler->mutex);
+    free(scheduler);
+}
+
+//Sleeps until the next deadline. Deadlines that already passed while the caller was busy are skipped and counted
+//as missed instead of being fired back to back. Returns false as soon as the scheduler is cancelled.
+bool scheduler_wait_next(Scheduler *const scheduler) {
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_wait_next call with scheduler = NULL.");
+        return false;
+    }
+
+    scheduler->next_deadline_ns += scheduler->interval_ns;
+
+    uint64_t now = scheduler_monotonic_now_ns();
+    if (now > scheduler->next_deadline_ns) {
+        uint64_t missed = (now - scheduler->next_deadline_ns) / scheduler->interval_ns + 1;
+        scheduler->next_deadline_ns += missed * scheduler->interval_ns;
+        atomic_fetch_add_explicit(&scheduler->missed_deadlines, missed, memory_order_relaxed);
+    }
+
+    struct timespec deadline = {
+            .tv_sec = (time_t) (scheduler->next_deadline_ns / SCHEDULER_NS_PER_SECOND),
+            .tv_nsec = (long) (scheduler->next_deadline_ns % SCHEDULER_NS_PER_SECOND)
+    };
+    pthread_mutex_lock(&scheduler->mutex);
+    while (!atomic_load(&scheduler->cancelled) &&
+           pthread_cond_timedwait(&scheduler->cancelled_condition, &scheduler->mutex, &deadline) != ETIMEDOUT) {
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return !atomic_load(&scheduler->cancelled);
+}
+
+//Deadline the last scheduler_wait_next call slept until.
+uint64_t scheduler_get_deadline(const Scheduler *const scheduler) {
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_get_deadline call with scheduler = NULL.");
+        return 0;
+    }
+
+    return scheduler->next_deadline_ns;
+}
+
+//Wakes a thread sleeping in scheduler_wait_next. Every later wait returns false immediately.
+void scheduler_cancel(Scheduler *const scheduler) {
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_cancel call with scheduler = NULL.");
+        return;
+    }
+
+    atomic_store(&scheduler->cancelled, true);
+    pthread_mutex_lock(&scheduler->mutex);
+    pthread_cond_broadcast(&scheduler->cancelled_condition);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+uint64_t scheduler_get_missed_deadlines(const Scheduler *const scheduler) {
+    if (scheduler == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received scheduler_get_missed_deadlines call with scheduler = NULL.");
+        return 0;
+    }
+
+    return atomic_load_explicit(&scheduler->missed_deadlines, memory_order_relaxed);
+}
+
+uint64_t scheduler_monotonic_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * SCHEDULER_NS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
@@ -0,0 +1,351 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/Stage.h"
+#include "../include/Logger.h"
+
+#define STAGE_NAME_LENGTH 32
+
+static const uint64_t STAGE_NS_PER_SECOND = 1000000000ULL;
+static const uint64_t STAGE_MINIMUM_WAIT_NS = 10000000ULL;
+static const uint64_t STAGE_MAXIMUM_WAIT_NS = 1000000000ULL;
+
+//The thread, stop flag, watchdog watch and queue waits every pipeline stage needs. Waits are a quarter of the watchdog
+//budget, each one followed by a heartbeat, so a stage that only waits on its neighbours never trips the watchdog. A
+//stalled neighbour trips its own watch instead.
+//
+//Every output registers the stage as a producer. When the stage ends, for whatever reason, it releases them, and
+//the last producer of a queue closes it. Stages register at creation and only run once started, so every producer of a
+//shared queue is counted before the first of them can end and close it. Consumers drain a closed input before they end, so an exhausted source
+//flushes the whole topology behind it. A stop request closes the input and the outputs right away instead, and a
+//stage that ends closes its input, so stopping any stage winds down its producers as well as its consumers.
+struct Stage {
+    char name[STAGE_NAME_LENGTH];
+    StageOperations operations;
+    void *context;
+    Queue *input;
+    Queue *outputs[STAGE_MAX_OUTPUTS];
+    size_t output_count;
+    Watchdog *watchdog;
+    size_t watchdog_index;
+    struct timespec wait_timeout;
+    pthread_t thread;
+    bool started;
+    atomic_bool should_stop;
+    atomic_bool finished;
+};
+
+static void stage_request_stop_synchronized_void(void *stage);
+
+static void stage_release_outputs(Stage *stage);
+
+static void *stage_thread(void *args);
+
+//context stays owned by the caller and must outlive the stage. input may be NULL for sources. A queue with several
+//producing stages must be QUEUE_MODE_LOCKED, a stage that would be the second producer of an SPSC queue is not created.
+//The stage is watched from here on but runs only after stage_start, create every stage of a topology first.
+Stage *stage_create(const char name[const], const StageOperations operations, void *const context,
+                    Queue *const input, Queue *const outputs[const], const size_t output_count,
+                    Watchdog *const watchdog, const struct timespec budget) {
+    LOGGER_DEBUG("stage_create: Entry.");
+
+    if (name == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_create call with name = NULL.");
+        return NULL;
+    }
+
+    if (operations.process == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_create call with operations.process = NULL.");
+        return NULL;
+    }
+
+    if (output_count > STAGE_MAX_OUTPUTS || (output_count > 0 && outputs == NULL)) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_create call with output_count > STAGE_MAX_OUTPUTS or outputs = NULL.");
+        return NULL;
+    }
+
+    if (watchdog == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_create call with watchdog = NULL.");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < output_count; i++) {
+        if (outputs[i] == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                       "Received stage_create call with an output = NULL.");
+            return NULL;
+        }
+    }
+
+    Stage *stage = malloc(sizeof(Stage));
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in stage_create.");
+        return NULL;
+    }
+
+    uint64_t wait_ns = ((uint64_t) budget.tv_sec * STAGE_NS_PER_SECOND + (uint64_t) budget.tv_nsec) / 4;
+    if (wait_ns < STAGE_MINIMUM_WAIT_NS) {
+        wait_ns = STAGE_MINIMUM_WAIT_NS;
+    } else if (wait_ns > STAGE_MAXIMUM_WAIT_NS) {
+        wait_ns = STAGE_MAXIMUM_WAIT_NS;
+    }
+
+    *stage = (Stage) {
+            .operations = operations,
+            .context = context,
+            .input = input,
+            .output_count = output_count,
+            .watchdog = watchdog,
+            .started = false,
+            .wait_timeout = {
+                    .tv_sec = (time_t) (wait_ns / STAGE_NS_PER_SECOND),
+                    .tv_nsec = (long) (wait_ns % STAGE_NS_PER_SECOND)
+            }
+    };
+    snprintf(stage->name, sizeof(stage->name), "%s", name);
+    if (output_count > 0) {
+        memcpy(stage->outputs, outputs, sizeof(Queue *) * output_count);
+    }
+    atomic_init(&stage->should_stop, false);
+    atomic_init(&stage->finished, false);
+
+    stage->watchdog_index = watchdog_register_watch(watchdog, &stage_request_stop_synchronized_void, stage, budget);
+    if (stage->watchdog_index == WATCHDOG_INVALID_INDEX) {
+        free(stage);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < output_count; i++) {
+        if (queue_add_producer(outputs[i]) > 1 && queue_get_mode(outputs[i]) == QUEUE_MODE_SPSC) {
+            LOGGER_ERROR("Stage %s shares an SPSC output with another producer.", stage->name);
+            for (size_t j = 0; j <= i; j++) {
+                queue_release_producer(outputs[j]);
+            }
+            watchdog_unregister_watch(watchdog, stage->watchdog_index);
+            free(stage);
+            return NULL;
+        }
+    }
+
+    LOGGER_DEBUG("stage_create: Success.");
+    return stage;
+}
+
+//A stage that could not start still has to go through stage_await_and_destroy, which then ends it as its thread would.
+bool stage_start(Stage *const stage) {
+    LOGGER_DEBUG("stage_start: Entry.");
+
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_start call with stage = NULL.");
+        return false;
+    }
+
+    if (stage->started) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_start call with a stage that already started.");
+        return false;
+    }
+
+    if (pthread_create(&stage->thread, NULL, stage_thread, (void *) stage) != 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in stage_start.");
+        return false;
+    }
+    stage->started = true;
+
+    LOGGER_DEBUG("stage_start: Success.");
+    return true;
+}
+
+void stage_await_and_destroy(Stage *const stage) {
+    LOGGER_DEBUG("stage_await_and_destroy: Entry.");
+
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_await_and_destroy call with stage = NULL.");
+        return;
+    }
+
+    if (stage->started) {
+        pthread_join(stage->thread, NULL);
+    } else {
+        if (stage->input != NULL) {
+            queue_close(stage->input);
+        }
+        stage_release_outputs(stage);
+    }
+    watchdog_unregister_watch(stage->watchdog, stage->watchdog_index);
+    free(stage);
+
+    LOGGER_DEBUG("stage_await_and_destroy: Success.");
+}
+
+//Closing wakes the thread wherever it blocks on a queue, it does not wait for a timeout to notice the flag.
+void stage_request_stop_synchronized(Stage *const stage) {
+    LOGGER_DEBUG("stage_request_stop_synchronized: Entry.");
+
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_request_stop_synchronized call with stage = NULL.");
+        return;
+    }
+
+    atomic_store(&stage->should_stop, true);
+    if (stage->input != NULL) {
+        queue_close(stage->input);
+    }
+    for (size_t i = 0; i < stage->output_count; i++) {
+        queue_close(stage->outputs[i]);
+    }
+    if (stage->operations.wake != NULL) {
+        stage->operations.wake(stage->context);
+    }
+
+    LOGGER_DEBUG("stage_request_stop_synchronized: Success.");
+}
+
+bool stage_should_stop_synchronized(const Stage *const stage) {
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_should_stop_synchronized call with stage = NULL.");
+        return true;
+    }
+
+    return atomic_load_explicit(&stage->should_stop, memory_order_acquire);
+}
+
+//True once process returned FINISHED or the input was closed and drained. Set before the outputs are released.
+bool stage_is_finished(const Stage *const stage) {
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_is_finished call with stage = NULL.");
+        return false;
+    }
+
+    return atomic_load_explicit(&stage->finished, memory_order_acquire);
+}
+
+//How long process should block at a time in waits of its own, followed by stage_heartbeat.
+struct timespec stage_get_wait_timeout(const Stage *const stage) {
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_get_wait_timeout call with stage = NULL.");
+        return (struct timespec) {.tv_sec = 0, .tv_nsec = (long) STAGE_MINIMUM_WAIT_NS};
+    }
+
+    return stage->wait_timeout;
+}
+
+void stage_heartbeat(Stage *const stage) {
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_heartbeat call with stage = NULL.");
+        return;
+    }
+
+    watchdog_update(stage->watchdog, stage->watchdog_index);
+}
+
+bool stage_emit(Stage *const stage, const size_t output, void *const item) {
+    void *items[] = {item};
+    return stage_emit_batch(stage, output, items, 1);
+}
+
+//Blocks while the output is full. Returns false when the stage is stopping or the output was closed, items not
+//handed on by then are given to discard.
+bool stage_emit_batch(Stage *const stage, const size_t output, void *items[const], const size_t count) {
+    if (stage == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_emit_batch call with stage = NULL.");
+        return false;
+    }
+
+    if (output >= stage->output_count) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stage_emit_batch call with output >= output_count.");
+        return false;
+    }
+
+    Queue *queue = stage->outputs[output];
+    size_t inserted = 0;
+    while ((inserted += queue_insert_batch(queue, &items[inserted], count - inserted)) < count) {
+        bool closed = !queue_wait_until_not_full(queue, stage->wait_timeout);
+        stage_heartbeat(stage);
+        if (closed || stage_should_stop_synchronized(stage)) {
+            if (stage->operations.discard != NULL) {
+                for (size_t i = inserted; i < count; i++) {
+                    stage->operations.discard(stage->context, output, items[i]);
+                }
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stage_request_stop_synchronized_void(void *const stage) {
+    stage_request_stop_synchronized((Stage *) stage);
+}
+
+static void stage_release_outputs(Stage *const stage) {
+    for (size_t i = 0; i < stage->output_count; i++) {
+        queue_release_producer(stage->outputs[i]);
+    }
+}
+
+static void *stage_thread(void *args) {
+    Stage *stage = (Stage *) args;
+    LOGGER_DEBUG("stage_thread: %s Entry.", stage->name);
+
+    void *items[STAGE_BATCH_SIZE];
+    while (!stage_should_stop_synchronized(stage)) {
+        LOGGER_DEBUG("stage_thread: %s Iteration.", stage->name);
+        stage_heartbeat(stage);
+
+        size_t count = 0;
+        if (stage->input != NULL) {
+            while ((count = queue_extract_batch(stage->input, items, STAGE_BATCH_SIZE)) == 0) {
+                bool closed = !queue_wait_until_not_empty(stage->input, stage->wait_timeout);
+                stage_heartbeat(stage);
+                if (closed && !queue_is_empty(stage->input) && !stage_should_stop_synchronized(stage)) {
+                    continue;
+                }
+                if (closed && !stage_should_stop_synchronized(stage)) {
+                    atomic_store_explicit(&stage->finished, true, memory_order_release);
+                }
+                if (closed || stage_should_stop_synchronized(stage)) {
+                    break;
+                }
+            }
+            if (count == 0) {
+                break;
+            }
+            LOGGER_DEBUG("stage_thread: %s took %zu items.", stage->name, count);
+        }
+
+        enum STAGE_STATUS status = stage->operations.process(stage, stage->context, items, count);
+        if (status == STAGE_STATUS_FINISHED) {
+            atomic_store_explicit(&stage->finished, true, memory_order_release);
+        }
+        if (status != STAGE_STATUS_CONTINUE) {
+            break;
+        }
+    }
+
+    //Nothing consumes the input anymore, producers blocked on it give up instead of waiting for their watchdog.
+    if (stage->input != NULL) {
+        queue_close(stage->input);
+    }
+    if (stage->operations.end != NULL) {
+        stage->operations.end(stage->context);
+    }
+    stage_release_outputs(stage);
+    LOGGER_DEBUG("stage_thread: %s Ending.", stage->name);
+    return NULL;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "../include/StatGenerator.h"
+#include "../include/Logger.h"
+
+enum STAT_GENERATOR_FIELD {
+    FIELD_USER = 0, FIELD_NICE, FIELD_SYSTEM, FIELD_IDLE, FIELD_IOWAIT, FIELD_IRQ, FIELD_SOFTIRQ, FIELD_STEAL,
+    FIELD_GUEST, FIELD_GUEST_NICE, FIELD_COUNT
+};
+
+typedef struct GeneratedCpu {
+    unsigned long long int fields[FIELD_COUNT];
+    unsigned int load_percent;
+} GeneratedCpu;
+
+struct StatGenerator {
+    size_t cpu_count;
+    unsigned long long int random_state;
+    unsigned long long int context_switches;
+    GeneratedCpu cpus[];
+};
+
+static unsigned int stat_generator_random(StatGenerator *generator, unsigned int bound);
+
+StatGenerator *stat_generator_create(const size_t cpu_count, const unsigned int seed) {
+    if (cpu_count <= 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stat_generator_create call with cpu_count <= 0.");
+        return NULL;
+    }
+
+    StatGenerator *generator = malloc(sizeof(StatGenerator) + sizeof(GeneratedCpu) * cpu_count);
+    if (generator == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in stat_generator_create.");
+        return NULL;
+    }
+
+    *generator = (StatGenerator) {
+            .cpu_count = cpu_count,
+            .random_state = seed * 6364136223846793005ULL + 1442695040888963407ULL,
+            .context_switches = 100000000ULL
+    };
+
+    //Start from counters of a machine that has been up for a while. Keeping every counter within the same decade
+    //keeps the rendered size stable across ticks, which lets tests rewrite a file in place.
+    for (size_t i = 0; i < cpu_count; i++) {
+        GeneratedCpu *cpu = &generator->cpus[i];
+        *cpu = (GeneratedCpu) {
+                .load_percent = stat_generator_random(generator, 101)
+        };
+        cpu->fields[FIELD_USER] = 100000000ULL + stat_generator_random(generator, 100000000);
+        cpu->fields[FIELD_NICE] = 1000000ULL + stat_generator_random(generator, 1000000);
+        cpu->fields[FIELD_SYSTEM] = 10000000ULL + stat_generator_random(generator, 10000000);
+        cpu->fields[FIELD_IDLE] = 1000000000ULL + stat_generator_random(generator, 1000000000);
+        cpu->fields[FIELD_IOWAIT] = 100000ULL + stat_generator_random(generator, 100000);
+        cpu->fields[FIELD_IRQ] = 10000ULL + stat_generator_random(generator, 10000);
+        cpu->fields[FIELD_SOFTIRQ] = 100000ULL + stat_generator_random(generator, 100000);
+    }
+
+    return generator;
+}
+
+void stat_generator_destroy(StatGenerator *const generator) {
+    if (generator == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stat_generator_destroy call with generator = NULL.");
+        return;
+    }
+
+    free(generator);
+}
+
+void stat_generator_advance(StatGenerator *const generator, const unsigned int ticks) {
+    if (generator == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stat_generator_advance call with generator = NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < generator->cpu_count; i++) {
+        GeneratedCpu *cpu = &generator->cpus[i];
+
+        //Load drifts slowly so the utilization evolves instead of jumping around.
+        unsigned int drift = stat_generator_random(generator, 11);
+        if (drift < 5 && cpu->load_percent >= 5 - drift) {
+            cpu->load_percent -= 5 - drift;
+        } else if (drift > 5 && cpu->load_percent + drift - 5 <= 100) {
+            cpu->load_percent += drift - 5;
+        }
+
+        unsigned int busy = ticks * cpu->load_percent / 100;
+        unsigned int system = busy / 4;
+        unsigned int irq = system > 0 ? stat_generator_random(generator, system / 8 + 1) : 0;
+        unsigned int idle = ticks - busy;
+        unsigned int iowait = idle > 0 ? stat_generator_random(generator, idle / 16 + 1) : 0;
+
+        cpu->fields[FIELD_USER] += busy - system;
+        cpu->fields[FIELD_SYSTEM] += system - irq;
+        cpu->fields[FIELD_SOFTIRQ] += irq;
+        cpu->fields[FIELD_IDLE] += idle - iowait;
+        cpu->fields[FIELD_IOWAIT] += iowait;
+    }
+
+    generator->context_switches += (unsigned long long int) ticks * generator->cpu_count * 10;
+}
+
+size_t stat_generator_render(const StatGenerator *const generator, char buffer[const], const size_t capacity) {
+    if (generator == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stat_generator_render call with generator = NULL.");
+        return 0;
+    }
+
+    if (buffer == NULL || capacity <= 0) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received stat_generator_render call without an output buffer.");
+        return 0;
+    }
+
+    unsigned long long int total[FIELD_COUNT] = {0};
+    for (size_t i = 0; i < generator->cpu_count; i++) {
+        for (size_t field = 0; field < FIELD_COUNT; field++) {
+            total[field] += generator->cpus[i].fields[field];
+        }
+    }
+
+    //Returns the length the full snapshot needs, like snprintf, so callers can grow and retry.
+    size_t length = 0;
+    int written = snprintf(buffer, capacity, "cpu  %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
+                           total[0], total[1], total[2], total[3], total[4], total[5], total[6], total[7], total[8],
+                           total[9]);
+    length += (size_t) written;
+
+    for (size_t i = 0; i < generator->cpu_count; i++) {
+        const unsigned long long int *fields = generator->cpus[i].fields;
+        written = snprintf(length < capacity ? buffer + length : NULL, length < capacity ? capacity - length : 0,
+                           "cpu%zu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n", i, fields[0], fields[1],
+                           fields[2], fields[3], fields[4], fields[5], fields[6], fields[7], fields[8], fields[9]);
+        length += (size_t) written;
+    }
+
+    written = snprintf(length < capacity ? buffer + length : NULL, length < capacity ? capacity - length : 0,
+                       "intr %llu 0 0 0 0\nctxt %llu\nbtime 1700000000\nprocesses %zu\nprocs_running %zu\n"
+                       "procs_blocked 0\nsoftirq %llu 0 0 0 0 0 0 0 0 0 0\n",
+                       generator->context_switches / 2, generator->context_switches, generator->cpu_count * 100,
+                       generator->cpu_count / 2 + 1, generator->context_switches / 4);
+    length += (size_t) written;
+
+    return length;
+}
+
+static unsigned int stat_generator_random(StatGenerator *const generator, const unsigned int bound) {
+    generator->random_state = generator->random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned int) ((generator->random_state >> 33) % bound);
+}
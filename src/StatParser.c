@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <string.h>
+#include "../include/StatParser.h"
+
+static const uint64_t STAT_PARSER_ASCII_ZEROS = 0x3030303030303030ULL;
+static const uint64_t STAT_PARSER_HIGH_BITS = 0x8080808080808080ULL;
+static const unsigned long long int STAT_PARSER_POWERS_OF_TEN[] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL
+};
+
+static unsigned long long int stat_parser_convert_eight_digits(uint64_t chunk);
+
+//Returns the number of rows found, which may exceed capacity. Rows past capacity are counted but not stored, so
+//callers can grow their array and parse again. Rows keep file order and carry the CPU id from their "cpuN" prefix,
+//the aggregate "cpu" line gets STAT_PARSER_AGGREGATE_ID. Offline CPUs have no line at all, so ids may have gaps.
+//The cpu lines lead /proc/stat, so parsing stops at the first other line and never touches "intr".
+size_t stat_parser_parse(const char input[const], const size_t length, CpuData rows[const], const size_t capacity) {
+    if (input == NULL) {
+        return 0;
+    }
+
+    const char *cursor = input;
+    const char *const end = input + length;
+    size_t row = 0;
+
+    while (end - cursor >= 3 && cursor[0] == 'c' && cursor[1] == 'p' && cursor[2] == 'u') {
+        cursor += 3;
+        size_t cpu_id = STAT_PARSER_AGGREGATE_ID;
+        if (cursor < end && (unsigned char) (*cursor - '0') < 10) {
+            cpu_id = 0;
+            while (cursor < end && (unsigned char) (*cursor - '0') < 10) {
+                cpu_id = cpu_id * 10 + (size_t) (*cursor - '0');
+                cursor++;
+            }
+        }
+
+        unsigned long long int fields[STAT_PARSER_COLUMN_COUNT] = {0};
+        for (size_t field = 0; field < STAT_PARSER_COLUMN_COUNT; field++) {
+            while (cursor < end && *cursor == ' ') {
+                cursor++;
+            }
+            if (cursor >= end || *cursor == '\n') {
+                break;
+            }
+            fields[field] = stat_parser_parse_number(&cursor, end);
+        }
+
+        if (row < capacity) {
+            //Guest time is already included in user and nice, so the sum of the first eight fields is the total.
+            unsigned long long int idle = fields[STAT_PARSER_COLUMN_IDLE] + fields[STAT_PARSER_COLUMN_IOWAIT];
+            rows[row] = (CpuData) {
+                    .cpu_id = cpu_id,
+                    .idle_time = idle,
+                    .total_time = fields[STAT_PARSER_COLUMN_USER] + fields[STAT_PARSER_COLUMN_NICE] +
+                                  fields[STAT_PARSER_COLUMN_SYSTEM] + idle + fields[STAT_PARSER_COLUMN_IRQ] +
+                                  fields[STAT_PARSER_COLUMN_SOFTIRQ] + fields[STAT_PARSER_COLUMN_STEAL]
+            };
+            memcpy(rows[row].columns, fields, sizeof(fields));
+        }
+        row++;
+
+        const char *line_end = memchr(cursor, '\n', (size_t) (end - cursor));
+        if (line_end == NULL) {
+            break;
+        }
+        cursor = line_end + 1;
+    }
+
+    return row;
+}
+
+//Consumes the digits at cursor. Eight digits at a time are validated and converted with SWAR arithmetic on a
+//single 64-bit word, the scalar tail only runs near the end of the input.
+unsigned long long int stat_parser_parse_number(const char **const cursor, const char *const end) {
+    const char *position = *cursor;
+    unsigned long long int value = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - position >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, position, sizeof(chunk));
+
+        uint64_t digits = chunk - STAT_PARSER_ASCII_ZEROS;
+        uint64_t non_digits = (digits | (digits + 0x7676767676767676ULL)) & STAT_PARSER_HIGH_BITS;
+        if (non_digits == 0) {
+            value = value * 100000000ULL + stat_parser_convert_eight_digits(chunk);
+            position += 8;
+            continue;
+        }
+
+        unsigned int count = (unsigned int) __builtin_ctzll(non_digits) / 8;
+        if (count > 0) {
+            //Shift the digits to the top of the word, the vacated low bytes act as leading zeros.
+            value = value * STAT_PARSER_POWERS_OF_TEN[count] +
+                    stat_parser_convert_eight_digits(chunk << (8 * (8 - count)));
+        }
+        *cursor = position + count;
+        return value;
+    }
+#endif
+
+    while (position < end && (unsigned char) (*position - '0') < 10) {
+        value = value * 10 + (unsigned long long int) (*position - '0');
+        position++;
+    }
+    *cursor = position;
+    return value;
+}
+
+static unsigned long long int stat_parser_convert_eight_digits(uint64_t chunk) {
+    chunk = (chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    chunk = (chunk & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return (chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+}
@@ -0,0 +1,466 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../include/TerminalRenderer.h"
+#include "../include/Logger.h"
+
+#define TERMINAL_RENDERER_MAX_LINES 24
+#define TERMINAL_RENDERER_LINE_LENGTH 96
+
+static const size_t TERMINAL_RENDERER_DEFAULT_COLUMNS = 80;
+//"100.00%" or "offline".
+static const size_t TERMINAL_RENDERER_VALUE_WIDTH = 7;
+static const size_t TERMINAL_RENDERER_CELL_GAP = 2;
+//"\x1b[<row>;<column>H" with two 20 digit numbers, and "\x1b[K".
+static const size_t TERMINAL_RENDERER_MOVE_LENGTH = 46;
+static const size_t TERMINAL_RENDERER_CLEAR_LINE_LENGTH = 3;
+static const uint32_t TERMINAL_RENDERER_NOT_SHOWN = UINT32_MAX;
+//Compact cells are one character each, grouped by this many with a space between groups.
+static const size_t TERMINAL_RENDERER_COMPACT_GROUP = 8;
+//Lines below the grid: a blank line, the header and one line per window span, then a blank line, the header and
+//the processes.
+static const size_t TERMINAL_RENDERER_WINDOW_LINES = 2 + ROLLING_WINDOW_SPAN_COUNT;
+static const size_t TERMINAL_RENDERER_PROCESS_LINES = 2 + SAMPLE_FRAME_TOP_PROCESSES;
+static const char *const TERMINAL_RENDERER_WINDOW_NAMES[ROLLING_WINDOW_SPAN_COUNT] = {"10s", "1m", "5m"};
+
+//Keeps a model of what the terminal shows and only sends what differs from it. The screen is the aggregate line,
+//a grid of CPU cells sized to the terminal, then free text lines for the windows and processes. Cell labels are
+//written once per layout, afterwards only changed values are rewritten in place. Everything of a frame goes out
+//in a single write from a buffer sized when the layout changes.
+//
+//The grid gets the rows the lines below leave free. When labelled cells do not fit them, every CPU becomes a single
+//character behind a label per row, and CPUs that still do not fit are counted on the last grid row.
+struct TerminalRenderer {
+    int fd;
+    char *output;
+    size_t output_capacity;
+    size_t output_length;
+    size_t terminal_rows;
+    size_t terminal_columns;
+    size_t cpu_count;
+    size_t label_width;
+    size_t cell_width;
+    bool compact;
+    bool process_lines;
+    size_t grid_columns;
+    size_t grid_rows;
+    size_t visible_cpu_count;
+    uint32_t *shown;
+    size_t shown_capacity;
+    char lines[TERMINAL_RENDERER_MAX_LINES][TERMINAL_RENDERER_LINE_LENGTH];
+    size_t line_count;
+    char shown_lines[TERMINAL_RENDERER_MAX_LINES][TERMINAL_RENDERER_LINE_LENGTH];
+    size_t shown_line_count;
+    bool screen_valid;
+    size_t cursor_row;
+    size_t cursor_column;
+    uint64_t bytes_written;
+};
+
+static bool terminal_renderer_layout(TerminalRenderer *renderer, size_t cpu_count, bool process_lines);
+
+static void terminal_renderer_draw_grid(TerminalRenderer *renderer, const SampleFrame *frame);
+
+static size_t terminal_renderer_value_column(const TerminalRenderer *renderer, size_t cpu);
+
+static char terminal_renderer_compact_value(uint32_t basis_points);
+
+static void terminal_renderer_build_lines(TerminalRenderer *renderer, const SampleFrame *frame);
+
+static void terminal_renderer_add_line(TerminalRenderer *renderer, const char format[], ...)
+__attribute__((format(printf, 2, 3)));
+
+static size_t terminal_renderer_line_row(const TerminalRenderer *renderer, size_t line);
+
+static void terminal_renderer_move(TerminalRenderer *renderer, size_t row, size_t column);
+
+static void terminal_renderer_append(TerminalRenderer *renderer, const char text[], size_t length);
+
+static void terminal_renderer_format_value(char text[], uint32_t basis_points, size_t width);
+
+static bool terminal_renderer_flush(TerminalRenderer *renderer);
+
+TerminalRenderer *terminal_renderer_create(const int fd) {
+    TerminalRenderer *renderer = malloc(sizeof(TerminalRenderer));
+    if (renderer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in terminal_renderer_create.");
+        return NULL;
+    }
+
+    *renderer = (TerminalRenderer) {
+            .fd = fd,
+            .output = NULL,
+            .output_capacity = 0,
+            .output_length = 0,
+            .cpu_count = 0,
+            .compact = false,
+            .process_lines = false,
+            .shown = NULL,
+            .shown_capacity = 0,
+            .line_count = 0,
+            .shown_line_count = 0,
+            .screen_valid = false,
+            .bytes_written = 0
+    };
+    return renderer;
+}
+
+//Leaves the cursor below the drawn content, so whatever runs next does not write over it.
+void terminal_renderer_destroy(TerminalRenderer *const renderer) {
+    if (renderer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received terminal_renderer_destroy call with renderer = NULL.");
+        return;
+    }
+
+    if (renderer->screen_valid) {
+        renderer->output_length = 0;
+        size_t row = terminal_renderer_line_row(renderer, renderer->shown_line_count);
+        terminal_renderer_move(renderer, row < renderer->terminal_rows ? row : renderer->terminal_rows, 1);
+        terminal_renderer_flush(renderer);
+    }
+    free(renderer->output);
+    free(renderer->shown);
+    free(renderer);
+}
+
+bool terminal_renderer_draw(TerminalRenderer *const renderer, const SampleFrame *const frame) {
+    if (renderer == NULL || frame == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received terminal_renderer_draw call with renderer = NULL or frame = NULL.");
+        return false;
+    }
+
+    //Once a frame had processes their lines keep their room, the layout does not flip with every frame.
+    if (!terminal_renderer_layout(renderer, frame->cpu_count, renderer->process_lines || frame->process_count > 0)) {
+        return false;
+    }
+
+    renderer->output_length = 0;
+    if (!renderer->screen_valid) {
+        terminal_renderer_draw_grid(renderer, frame);
+        renderer->screen_valid = true;
+    }
+
+    terminal_renderer_build_lines(renderer, frame);
+    for (size_t i = 0; i < renderer->line_count; i++) {
+        if (i < renderer->shown_line_count && strcmp(renderer->lines[i], renderer->shown_lines[i]) == 0) {
+            continue;
+        }
+        size_t row = terminal_renderer_line_row(renderer, i);
+        if (row <= renderer->terminal_rows) {
+            terminal_renderer_move(renderer, row, 1);
+            terminal_renderer_append(renderer, renderer->lines[i], strlen(renderer->lines[i]));
+            terminal_renderer_append(renderer, "\x1b[K", TERMINAL_RENDERER_CLEAR_LINE_LENGTH);
+            renderer->cursor_column -= TERMINAL_RENDERER_CLEAR_LINE_LENGTH;
+        }
+        memcpy(renderer->shown_lines[i], renderer->lines[i], TERMINAL_RENDERER_LINE_LENGTH);
+    }
+    for (size_t i = renderer->line_count; i < renderer->shown_line_count; i++) {
+        size_t row = terminal_renderer_line_row(renderer, i);
+        if (row <= renderer->terminal_rows) {
+            terminal_renderer_move(renderer, row, 1);
+            terminal_renderer_append(renderer, "\x1b[K", TERMINAL_RENDERER_CLEAR_LINE_LENGTH);
+            renderer->cursor_column -= TERMINAL_RENDERER_CLEAR_LINE_LENGTH;
+        }
+    }
+    renderer->shown_line_count = renderer->line_count;
+
+    char value[TERMINAL_RENDERER_VALUE_WIDTH + 1];
+    for (size_t cpu = 0; cpu < renderer->visible_cpu_count; cpu++) {
+        uint16_t basis_points = frame->utilization[cpu + 1];
+        size_t row = 2 + cpu / renderer->grid_columns;
+        if (renderer->shown[cpu] == basis_points || row > renderer->terminal_rows) {
+            continue;
+        }
+        terminal_renderer_move(renderer, row, terminal_renderer_value_column(renderer, cpu));
+        if (renderer->compact) {
+            value[0] = terminal_renderer_compact_value(basis_points);
+            terminal_renderer_append(renderer, value, 1);
+        } else {
+            terminal_renderer_format_value(value, basis_points, TERMINAL_RENDERER_VALUE_WIDTH);
+            terminal_renderer_append(renderer, value, TERMINAL_RENDERER_VALUE_WIDTH);
+        }
+        renderer->shown[cpu] = basis_points;
+    }
+
+    return terminal_renderer_flush(renderer);
+}
+
+uint64_t terminal_renderer_get_bytes_written(const TerminalRenderer *const renderer) {
+    if (renderer == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received terminal_renderer_get_bytes_written call with renderer = NULL.");
+        return 0;
+    }
+
+    return renderer->bytes_written;
+}
+
+//Outputs that are not terminals get the default width and no height limit.
+static bool terminal_renderer_layout(TerminalRenderer *const renderer, const size_t cpu_count,
+                                     const bool process_lines) {
+    size_t rows = SIZE_MAX;
+    size_t columns = TERMINAL_RENDERER_DEFAULT_COLUMNS;
+    struct winsize size;
+    if (ioctl(renderer->fd, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        rows = size.ws_row;
+        columns = size.ws_col;
+    }
+
+    //Without a height limit nothing needs room reserved, a frame with the first processes keeps the screen.
+    if (renderer->screen_valid && rows == renderer->terminal_rows && columns == renderer->terminal_columns &&
+        cpu_count == renderer->cpu_count && (process_lines == renderer->process_lines || rows == SIZE_MAX)) {
+        return true;
+    }
+
+    if (cpu_count > renderer->shown_capacity) {
+        uint32_t *shown = realloc(renderer->shown, sizeof(uint32_t) * cpu_count);
+        if (shown == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in terminal_renderer_layout.");
+            return false;
+        }
+        renderer->shown = shown;
+        renderer->shown_capacity = cpu_count;
+    }
+
+    size_t id_width = 1;
+    for (size_t id = cpu_count > 0 ? cpu_count - 1 : 0; id >= 10; id /= 10) {
+        id_width++;
+    }
+    renderer->label_width = 3 + id_width;
+    renderer->cell_width = renderer->label_width + 1 + TERMINAL_RENDERER_VALUE_WIDTH + TERMINAL_RENDERER_CELL_GAP;
+    renderer->compact = false;
+    renderer->grid_columns = columns / renderer->cell_width > 0 ? columns / renderer->cell_width : 1;
+    renderer->grid_rows = (cpu_count + renderer->grid_columns - 1) / renderer->grid_columns;
+    renderer->visible_cpu_count = cpu_count;
+
+    //The aggregate line and the lines below come first, the grid keeps at least one row.
+    size_t reserved_rows = 1 + TERMINAL_RENDERER_WINDOW_LINES + (process_lines ? TERMINAL_RENDERER_PROCESS_LINES : 0);
+    size_t grid_rows = rows > reserved_rows + 1 ? rows - reserved_rows : 1;
+    if (renderer->grid_rows > grid_rows) {
+        size_t width = columns > renderer->label_width + 1 ? columns - renderer->label_width - 1 : 1;
+        size_t groups = (width + 1) / (TERMINAL_RENDERER_COMPACT_GROUP + 1);
+        renderer->compact = true;
+        renderer->grid_columns = groups > 0 ? groups * TERMINAL_RENDERER_COMPACT_GROUP : width;
+        renderer->grid_rows = (cpu_count + renderer->grid_columns - 1) / renderer->grid_columns;
+        if (renderer->grid_rows > grid_rows) {
+            renderer->grid_rows = grid_rows;
+            renderer->visible_cpu_count = (grid_rows - 1) * renderer->grid_columns;
+        }
+    }
+
+    //A full redraw is the worst case: clear, every label and value with a move each, every line written and cleared.
+    size_t capacity = 7 + cpu_count * (2 * TERMINAL_RENDERER_MOVE_LENGTH + renderer->cell_width) +
+                      2 * TERMINAL_RENDERER_MAX_LINES *
+                      (TERMINAL_RENDERER_MOVE_LENGTH + TERMINAL_RENDERER_LINE_LENGTH + TERMINAL_RENDERER_CLEAR_LINE_LENGTH) +
+                      2 * TERMINAL_RENDERER_MOVE_LENGTH + TERMINAL_RENDERER_LINE_LENGTH;
+    if (capacity > renderer->output_capacity) {
+        char *output = realloc(renderer->output, capacity);
+        if (output == NULL) {
+            logger_log(logger_get_global(), LOGGER_LEVEL_ERROR,
+                       "Received NULL from realloc call in terminal_renderer_layout.");
+            return false;
+        }
+        renderer->output = output;
+        renderer->output_capacity = capacity;
+    }
+
+    renderer->terminal_rows = rows;
+    renderer->terminal_columns = columns;
+    renderer->cpu_count = cpu_count;
+    renderer->process_lines = process_lines;
+    renderer->screen_valid = false;
+    return true;
+}
+
+//Clears the screen and draws every cell. Rows go out as one run of cells, padded with the gaps instead of a cursor
+//move per cell.
+static void terminal_renderer_draw_grid(TerminalRenderer *const renderer, const SampleFrame *const frame) {
+    terminal_renderer_append(renderer, "\x1b[H\x1b[2J", 7);
+    renderer->cursor_row = 1;
+    renderer->cursor_column = 1;
+    renderer->shown_line_count = 0;
+
+    char cell[TERMINAL_RENDERER_LINE_LENGTH];
+    for (size_t cpu = 0; cpu < renderer->cpu_count; cpu++) {
+        size_t row = 2 + cpu / renderer->grid_columns;
+        size_t position = cpu % renderer->grid_columns;
+        renderer->shown[cpu] = TERMINAL_RENDERER_NOT_SHOWN;
+        if (cpu >= renderer->visible_cpu_count || row > renderer->terminal_rows) {
+            continue;
+        }
+
+        int length = 0;
+        if (!renderer->compact || position == 0) {
+            length = snprintf(cell, sizeof(cell), "CPU%-*zu ", (int) (renderer->label_width - 3), cpu);
+        }
+        if (renderer->compact) {
+            cell[length++] = terminal_renderer_compact_value(frame->utilization[cpu + 1]);
+            if ((position + 1) % TERMINAL_RENDERER_COMPACT_GROUP == 0 && position + 1 < renderer->grid_columns) {
+                cell[length++] = ' ';
+            }
+        } else {
+            terminal_renderer_format_value(cell + length, frame->utilization[cpu + 1], TERMINAL_RENDERER_VALUE_WIDTH);
+            length += (int) TERMINAL_RENDERER_VALUE_WIDTH;
+            if (position + 1 < renderer->grid_columns) {
+                memset(cell + length, ' ', TERMINAL_RENDERER_CELL_GAP);
+                length += (int) TERMINAL_RENDERER_CELL_GAP;
+            }
+        }
+        size_t label_length = !renderer->compact || position == 0 ? renderer->label_width + 1 : 0;
+        terminal_renderer_move(renderer, row, terminal_renderer_value_column(renderer, cpu) - label_length);
+        terminal_renderer_append(renderer, cell, (size_t) length);
+        renderer->shown[cpu] = frame->utilization[cpu + 1];
+    }
+
+    if (renderer->visible_cpu_count < renderer->cpu_count && 1 + renderer->grid_rows <= renderer->terminal_rows) {
+        int length = snprintf(cell, sizeof(cell), "+%zu CPUs not shown",
+                              renderer->cpu_count - renderer->visible_cpu_count);
+        terminal_renderer_move(renderer, 1 + renderer->grid_rows, 1);
+        terminal_renderer_append(renderer, cell, (size_t) length);
+    }
+}
+
+//Column the value of cpu starts at, labelled cells have their own label in front, compact rows one per row.
+static size_t terminal_renderer_value_column(const TerminalRenderer *const renderer, const size_t cpu) {
+    size_t position = cpu % renderer->grid_columns;
+    if (renderer->compact) {
+        return 1 + renderer->label_width + 1 + position + position / TERMINAL_RENDERER_COMPACT_GROUP;
+    }
+    return 1 + position * renderer->cell_width + renderer->label_width + 1;
+}
+
+//Tens of percent as a digit, '.' below ten percent, '#' for a fully loaded CPU and 'x' for an offline one.
+static char terminal_renderer_compact_value(const uint32_t basis_points) {
+    if (basis_points == SAMPLE_FRAME_OFFLINE) {
+        return 'x';
+    }
+    if (basis_points >= SAMPLE_FRAME_FULL_LOAD) {
+        return '#';
+    }
+    uint32_t tens = basis_points / (SAMPLE_FRAME_FULL_LOAD / 10);
+    return tens == 0 ? '.' : (char) ('0' + tens);
+}
+
+static void terminal_renderer_build_lines(TerminalRenderer *const renderer, const SampleFrame *const frame) {
+    char values[ROLLING_WINDOW_SPAN_COUNT + 2][TERMINAL_RENDERER_VALUE_WIDTH + 2];
+
+    renderer->line_count = 0;
+    terminal_renderer_format_value(values[0], frame->utilization[0], TERMINAL_RENDERER_VALUE_WIDTH);
+    terminal_renderer_add_line(renderer, "CPU: %s%s", values[0],
+                               renderer->compact ? "  (per CPU tens of %, . below 10%, # full, x offline)" : "");
+
+    terminal_renderer_add_line(renderer, "%s", "");
+    terminal_renderer_add_line(renderer, "%-6s %7s %7s %7s %7s %7s", "WINDOW", "MIN", "MEAN", "MAX", "P95", "P99");
+    for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+        const RollingWindowStats *stats = &frame->windows[span];
+        if (stats->sample_count == 0) {
+            continue;
+        }
+        char min[TERMINAL_RENDERER_VALUE_WIDTH + 1], mean[TERMINAL_RENDERER_VALUE_WIDTH + 1];
+        char max[TERMINAL_RENDERER_VALUE_WIDTH + 1], p95[TERMINAL_RENDERER_VALUE_WIDTH + 1];
+        char p99[TERMINAL_RENDERER_VALUE_WIDTH + 1];
+        terminal_renderer_format_value(min, stats->min, TERMINAL_RENDERER_VALUE_WIDTH);
+        terminal_renderer_format_value(mean, stats->mean, TERMINAL_RENDERER_VALUE_WIDTH);
+        terminal_renderer_format_value(max, stats->max, TERMINAL_RENDERER_VALUE_WIDTH);
+        terminal_renderer_format_value(p95, stats->p95, TERMINAL_RENDERER_VALUE_WIDTH);
+        terminal_renderer_format_value(p99, stats->p99, TERMINAL_RENDERER_VALUE_WIDTH);
+        terminal_renderer_add_line(renderer, "%-6s %s %s %s %s %s", TERMINAL_RENDERER_WINDOW_NAMES[span], min, mean,
+                                   max, p95, p99);
+    }
+
+    if (frame->process_count > 0) {
+        terminal_renderer_add_line(renderer, "%s", "");
+        terminal_renderer_add_line(renderer, "%-7s %8s  %s", "PID", "CPU%", "COMMAND");
+        for (size_t i = 0; i < frame->process_count; i++) {
+            const SampleFrameProcess *process = &frame->processes[i];
+            char utilization[TERMINAL_RENDERER_VALUE_WIDTH + 2];
+            terminal_renderer_format_value(utilization, process->utilization, TERMINAL_RENDERER_VALUE_WIDTH + 1);
+            terminal_renderer_add_line(renderer, "%-7d %s  %.*s", (int) process->pid, utilization,
+                                       PROCESS_SCANNER_COMMAND_LENGTH, process->command);
+        }
+    }
+}
+
+//Lines are cut to the terminal width, a wrapped line would shift every row below it.
+static void terminal_renderer_add_line(TerminalRenderer *const renderer, const char format[const], ...) {
+    if (renderer->line_count == TERMINAL_RENDERER_MAX_LINES) {
+        return;
+    }
+
+    char *line = renderer->lines[renderer->line_count++];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(line, TERMINAL_RENDERER_LINE_LENGTH, format, arguments);
+    va_end(arguments);
+    if (renderer->terminal_columns > 0 && renderer->terminal_columns - 1 < TERMINAL_RENDERER_LINE_LENGTH) {
+        line[renderer->terminal_columns - 1] = '\0';
+    }
+}
+
+//Line 0 is above the grid, the others follow below it.
+static size_t terminal_renderer_line_row(const TerminalRenderer *const renderer, const size_t line) {
+    return line == 0 ? 1 : renderer->grid_rows + 1 + line;
+}
+
+static void terminal_renderer_move(TerminalRenderer *const renderer, const size_t row, const size_t column) {
+    if (row == renderer->cursor_row && column == renderer->cursor_column) {
+        return;
+    }
+
+    int length = snprintf(renderer->output + renderer->output_length, TERMINAL_RENDERER_MOVE_LENGTH, "\x1b[%zu;%zuH",
+                          row, column);
+    renderer->output_length += (size_t) length;
+    renderer->cursor_row = row;
+    renderer->cursor_column = column;
+}
+
+static void terminal_renderer_append(TerminalRenderer *const renderer, const char text[const], const size_t length) {
+    memcpy(renderer->output + renderer->output_length, text, length);
+    renderer->output_length += length;
+    renderer->cursor_column += length;
+}
+
+//Right aligned percentage with two decimals, written by hand since it runs for every changed cell.
+static void terminal_renderer_format_value(char text[const], const uint32_t basis_points, const size_t width) {
+    memset(text, ' ', width);
+    text[width] = '\0';
+    if (basis_points == SAMPLE_FRAME_OFFLINE) {
+        memcpy(text + width - 7, "offline", 7);
+        return;
+    }
+
+    size_t position = width;
+    text[--position] = '%';
+    text[--position] = (char) ('0' + basis_points % 10);
+    text[--position] = (char) ('0' + basis_points / 10 % 10);
+    text[--position] = '.';
+    uint32_t whole = basis_points / 100;
+    do {
+        text[--position] = (char) ('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0 && position > 0);
+}
+
+static bool terminal_renderer_flush(TerminalRenderer *const renderer) {
+    size_t written = 0;
+    while (written < renderer->output_length) {
+        ssize_t bytes = write(renderer->fd, renderer->output + written, renderer->output_length - written);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            //The terminal no longer matches the model, start over with the next frame.
+            renderer->screen_valid = false;
+            return false;
+        }
+        written += (size_t) bytes;
+    }
+    renderer->bytes_written += written;
+    return true;
+}
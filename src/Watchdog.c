@@ -1,35 +1,104 @@
+#include <stdalign.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include "../include/CacheLine.h"
 #include "../include/Watchdog.h"
 #include "../include/Logger.h"
 
-static struct timespec WATCHDOG_UPDATE_INTERVAL = {.tv_sec = 2, .tv_nsec = 0};
-
+#define WATCHDOG_CHUNK_SIZE 64
+#define WATCHDOG_MAX_CHUNKS 64
+#define WATCHDOG_WHEEL_LEVELS 4
+#define WATCHDOG_WHEEL_BITS 6
+#define WATCHDOG_WHEEL_SLOTS (1u << WATCHDOG_WHEEL_BITS)
+
+static const uint64_t WATCHDOG_NS_PER_SECOND = 1000000000ULL;
+//Resolution of the deadlines, four levels of 64 slots cover budgets of up to about 46 hours.
+static const uint64_t WATCHDOG_TICK_NS = 10000000ULL;
+//How far ahead the thread sleeps when nothing is due, registering a watch wakes it early.
+static const uint64_t WATCHDOG_IDLE_TICKS = 100;
+//Half the wheel, so a deadline set while the thread catches up on past ticks still fits.
+static const uint64_t WATCHDOG_MAX_BUDGET_TICKS = 1ULL << (WATCHDOG_WHEEL_BITS * WATCHDOG_WHEEL_LEVELS - 1);
+static const size_t WATCHDOG_NO_INDEX = SIZE_MAX;
+
+//heartbeat is bumped by the watched thread only and sits alone on its cache line, updates take no lock and do not
+//bounce the line of another watch. The rest is only used under the Watchdog mutex: by the watchdog thread and by
+//register and unregister calls.
 typedef struct Watch {
-    void (*function)(void *);
+    alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t heartbeat;
+    alignas(CACHE_LINE_SIZE) void (*function)(void *);
 
     void *object;
-    bool status;
+    uint64_t budget_ticks;
+    uint_fast64_t seen_heartbeat;
+    uint64_t expires_tick;
+    //Neighbours in a wheel slot while registered, next_free links unused watches.
+    struct Watch *previous;
+    struct Watch *next;
+    size_t index;
+    size_t next_free;
+    unsigned int level;
+    unsigned int slot;
+    bool registered;
 } Watch;
 
+//Watches live in chunks that never move once allocated, so watchdog_update finds its heartbeat without a lock while
+//other threads register more. Unregistered indices are reused.
+//
+//Deadlines sit in a hierarchical timer wheel: level 0 has one slot per tick, each higher level one slot per full
+//turn of the level below. Entries move down a level when the wheel below wraps around to their slot. Per tick the
+//thread only looks at the watches due in it, so checking costs nothing for the ones that are not. A due watch whose
+//heartbeat moved gets a new deadline one budget ahead, one whose heartbeat did not trips the Watchdog.
 struct Watchdog {
-    size_t watches;
     size_t registered_count;
+    size_t slot_count;
+    size_t free_head;
     pthread_t thread;
     pthread_mutex_t mutex;
+    //Signalled on stop requests and new watches so that the thread does not finish its sleep first.
+    pthread_cond_t wake_condition;
     bool watching;
-    bool should_stop;
+    atomic_bool should_stop;
     bool triggered;
-    Watch watches_array[];
+    uint64_t start_ns;
+    //Ticks before it are processed.
+    uint64_t current_tick;
+    uint64_t occupied[WATCHDOG_WHEEL_LEVELS];
+    Watch *wheel[WATCHDOG_WHEEL_LEVELS][WATCHDOG_WHEEL_SLOTS];
+    _Atomic(Watch *) chunks[WATCHDOG_MAX_CHUNKS];
 };
 
 static bool watchdog_should_stop_synchronized(Watchdog *watchdog);
 
+static uint64_t watchdog_monotonic_now_ns(void);
+
+static uint64_t watchdog_now_tick(const Watchdog *watchdog);
+
+static Watch *watchdog_get_watch(Watchdog *watchdog, size_t index);
+
+static size_t watchdog_take_index(Watchdog *watchdog);
+
+static bool watchdog_add_chunk(Watchdog *watchdog);
+
+static void watchdog_free_chunks(Watchdog *watchdog);
+
+static void watchdog_wheel_insert(Watchdog *watchdog, Watch *watch, uint64_t expires_tick);
+
+static void watchdog_wheel_remove(Watchdog *watchdog, Watch *watch);
+
+static Watch *watchdog_wheel_take_slot(Watchdog *watchdog, unsigned int level, unsigned int slot);
+
+static bool watchdog_process_tick(Watchdog *watchdog, uint64_t now_tick);
+
+static uint64_t watchdog_next_tick(const Watchdog *watchdog);
+
 static void *watchdog_thread(void *args);
 
+//watches is how many watches to make room for up front, more can be registered later.
 Watchdog *watchdog_create(const size_t watches) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_create: Entry.");
+    LOGGER_DEBUG("watchdog_create: Entry.");
 
     if (watches <= 0) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -37,34 +106,72 @@ Watchdog *watchdog_create(const size_t watches) {
         return NULL;
     }
 
-    Watchdog *watchdog = malloc(sizeof(Watchdog) + sizeof(Watch) * watches);
+    if (watches > WATCHDOG_CHUNK_SIZE * WATCHDOG_MAX_CHUNKS) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received watchdog_create call with watches > WATCHDOG_CHUNK_SIZE * WATCHDOG_MAX_CHUNKS.");
+        return NULL;
+    }
+
+    Watchdog *watchdog = malloc(sizeof(Watchdog));
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in watchdog_create.");
         return NULL;
     }
 
     *watchdog = (Watchdog) {
-            .watches = watches,
             .registered_count = 0,
+            .slot_count = 0,
+            .free_head = WATCHDOG_NO_INDEX,
             .watching = false,
-            .should_stop = false,
             .triggered = false,
-            .mutex = PTHREAD_MUTEX_INITIALIZER
+            .mutex = PTHREAD_MUTEX_INITIALIZER,
+            .start_ns = watchdog_monotonic_now_ns(),
+            .current_tick = 0
     };
+    atomic_init(&watchdog->should_stop, false);
+    for (size_t i = 0; i < WATCHDOG_MAX_CHUNKS; i++) {
+        atomic_init(&watchdog->chunks[i], NULL);
+    }
+
+    bool success = true;
+    for (size_t i = 0; success && i < (watches + WATCHDOG_CHUNK_SIZE - 1) / WATCHDOG_CHUNK_SIZE; i++) {
+        success = watchdog_add_chunk(watchdog);
+    }
+    if (!success) {
+        watchdog_free_chunks(watchdog);
+        free(watchdog);
+        return NULL;
+    }
+
+    pthread_condattr_t attributes;
+    success = pthread_condattr_init(&attributes) == 0;
+    if (success) {
+        success = pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC) == 0 &&
+                  pthread_cond_init(&watchdog->wake_condition, &attributes) == 0;
+        pthread_condattr_destroy(&attributes);
+    }
+    if (!success) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_cond_init in watchdog_create.");
+        watchdog_free_chunks(watchdog);
+        free(watchdog);
+        return NULL;
+    }
 
     if (pthread_create(&watchdog->thread, NULL, watchdog_thread, (void *) watchdog) != 0) {
         logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received error from pthread_create in watchdog_create.");
+        pthread_cond_destroy(&watchdog->wake_condition);
         pthread_mutex_destroy(&watchdog->mutex);
+        watchdog_free_chunks(watchdog);
         free(watchdog);
         return NULL;
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_create: Success.");
+    LOGGER_DEBUG("watchdog_create: Success.");
     return watchdog;
 }
 
 void watchdog_await_and_destroy(Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_await_and_destroy: Entry.");
+    LOGGER_DEBUG("watchdog_await_and_destroy: Entry.");
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -73,14 +180,16 @@ void watchdog_await_and_destroy(Watchdog *const watchdog) {
     }
 
     pthread_join(watchdog->thread, NULL);
+    pthread_cond_destroy(&watchdog->wake_condition);
     pthread_mutex_destroy(&watchdog->mutex);
+    watchdog_free_chunks(watchdog);
     free(watchdog);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_await_and_destroy: Success.");
+    LOGGER_DEBUG("watchdog_await_and_destroy: Success.");
 }
 
 void watchdog_request_stop_synchronized(Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_request_stop_synchronized: Entry.");
+    LOGGER_DEBUG("watchdog_request_stop_synchronized: Entry.");
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -88,34 +197,92 @@ void watchdog_request_stop_synchronized(Watchdog *const watchdog) {
         return;
     }
 
+    atomic_store(&watchdog->should_stop, true);
     pthread_mutex_lock(&watchdog->mutex);
-    watchdog->should_stop = true;
+    pthread_cond_signal(&watchdog->wake_condition);
     pthread_mutex_unlock(&watchdog->mutex);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_request_stop_synchronized: Success.");
+    LOGGER_DEBUG("watchdog_request_stop_synchronized: Success.");
 }
 
-size_t watchdog_register_watch(Watchdog *const watchdog, void (*const function)(void *), void *const object) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_register_watch: Entry.");
+//function(object) is called when any watch trips, with the Watchdog locked, so it must not register or unregister.
+//budget is how long the watched thread may go without calling watchdog_update, it should cover its longest regular
+//wait plus the work done between updates. Returns the index to update with, or WATCHDOG_INVALID_INDEX.
+size_t watchdog_register_watch(Watchdog *const watchdog, void (*const function)(void *), void *const object,
+                               const struct timespec budget) {
+    LOGGER_DEBUG("watchdog_register_watch: Entry.");
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
                    "Received watchdog_register_watch call with watchdog = NULL.");
-        return 0;
+        return WATCHDOG_INVALID_INDEX;
+    }
+
+    if (function == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received watchdog_register_watch call with function = NULL.");
+        return WATCHDOG_INVALID_INDEX;
     }
 
-    size_t return_value;
     pthread_mutex_lock(&watchdog->mutex);
-    return_value = watchdog->registered_count++;
-    watchdog->watches_array[return_value] = (Watch) {
-            .status = true,
-            .function = function,
-            .object = object
-    };
+    size_t index = watchdog_take_index(watchdog);
+    if (index == WATCHDOG_NO_INDEX) {
+        pthread_mutex_unlock(&watchdog->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Could not make room for a watch in watchdog_register_watch.");
+        return WATCHDOG_INVALID_INDEX;
+    }
+
+    //A reused watch keeps counting from its old heartbeat, only a change matters.
+    Watch *watch = watchdog_get_watch(watchdog, index);
+    uint64_t budget_ns = (uint64_t) budget.tv_sec * WATCHDOG_NS_PER_SECOND + (uint64_t) budget.tv_nsec;
+    watch->function = function;
+    watch->object = object;
+    watch->budget_ticks = (budget_ns + WATCHDOG_TICK_NS - 1) / WATCHDOG_TICK_NS;
+    if (watch->budget_ticks == 0) {
+        watch->budget_ticks = 1;
+    } else if (watch->budget_ticks > WATCHDOG_MAX_BUDGET_TICKS) {
+        watch->budget_ticks = WATCHDOG_MAX_BUDGET_TICKS;
+    }
+    watch->index = index;
+    watch->seen_heartbeat = atomic_load_explicit(&watch->heartbeat, memory_order_relaxed);
+    watch->registered = true;
+    //One tick more since the current one has partly passed already.
+    watchdog_wheel_insert(watchdog, watch, watchdog_now_tick(watchdog) + watch->budget_ticks + 1);
+    watchdog->registered_count++;
+    pthread_cond_signal(&watchdog->wake_condition);
     pthread_mutex_unlock(&watchdog->mutex);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_register_watch: Success.");
-    return return_value;
+    LOGGER_DEBUG("watchdog_register_watch: Success.");
+    return index;
+}
+
+//The watched thread must no longer call watchdog_update with index, which may be handed out again.
+void watchdog_unregister_watch(Watchdog *const watchdog, const size_t index) {
+    LOGGER_DEBUG("watchdog_unregister_watch: Entry.");
+
+    if (watchdog == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received watchdog_unregister_watch call with watchdog = NULL.");
+        return;
+    }
+
+    pthread_mutex_lock(&watchdog->mutex);
+    Watch *watch = index < watchdog->slot_count ? watchdog_get_watch(watchdog, index) : NULL;
+    if (watch == NULL || !watch->registered) {
+        pthread_mutex_unlock(&watchdog->mutex);
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received watchdog_unregister_watch call with an index that is not registered.");
+        return;
+    }
+
+    watchdog_wheel_remove(watchdog, watch);
+    watch->registered = false;
+    watch->next_free = watchdog->free_head;
+    watchdog->free_head = index;
+    watchdog->registered_count--;
+    pthread_mutex_unlock(&watchdog->mutex);
+
+    LOGGER_DEBUG("watchdog_unregister_watch: Success.");
 }
 
 void watchdog_update(Watchdog *const watchdog, const size_t index) {
@@ -125,19 +292,22 @@ void watchdog_update(Watchdog *const watchdog, const size_t index) {
         return;
     }
 
-    if (index >= watchdog->watches) {
+    Watch *chunk = index < WATCHDOG_CHUNK_SIZE * WATCHDOG_MAX_CHUNKS
+                   ? atomic_load_explicit(&watchdog->chunks[index / WATCHDOG_CHUNK_SIZE], memory_order_acquire)
+                   : NULL;
+    if (chunk == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received watchdog_update call with watches index >= watches.");
+                   "Received watchdog_update call with watches index out of range.");
         return;
     }
 
-    pthread_mutex_lock(&watchdog->mutex);
-    watchdog->watches_array[index].status = true;
-    pthread_mutex_unlock(&watchdog->mutex);
+    //Only the watched thread writes its heartbeat, a plain load and store is enough.
+    atomic_uint_fast64_t *heartbeat = &chunk[index % WATCHDOG_CHUNK_SIZE].heartbeat;
+    atomic_store_explicit(heartbeat, atomic_load_explicit(heartbeat, memory_order_relaxed) + 1, memory_order_relaxed);
 }
 
 void watchdog_start_watching(Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_start_watching: Entry.");
+    LOGGER_DEBUG("watchdog_start_watching: Entry.");
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -149,11 +319,11 @@ void watchdog_start_watching(Watchdog *const watchdog) {
     watchdog->watching = true;
     pthread_mutex_unlock(&watchdog->mutex);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_start_watching: Success.");
+    LOGGER_DEBUG("watchdog_start_watching: Success.");
 }
 
 void watchdog_pause_watching(Watchdog *const watchdog) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_pause_watching: Entry.");
+    LOGGER_DEBUG("watchdog_pause_watching: Entry.");
 
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
@@ -165,7 +335,7 @@ void watchdog_pause_watching(Watchdog *const watchdog) {
     watchdog->watching = false;
     pthread_mutex_unlock(&watchdog->mutex);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_pause_watching: Success.");
+    LOGGER_DEBUG("watchdog_pause_watching: Success.");
 }
 
 bool watchdog_was_triggered(Watchdog *const watchdog) {
@@ -182,51 +352,252 @@ bool watchdog_was_triggered(Watchdog *const watchdog) {
     return return_value;
 }
 
-static bool watchdog_should_stop_synchronized(Watchdog *const watchdog) {
+size_t watchdog_get_registered_count(Watchdog *const watchdog) {
     if (watchdog == NULL) {
         logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
-                   "Received watchdog_should_stop_synchronized call with watchdog = NULL.");
-        return true;
+                   "Received watchdog_get_registered_count call with watchdog = NULL.");
+        return 0;
     }
 
-    bool return_value;
+    size_t return_value;
     pthread_mutex_lock(&watchdog->mutex);
-    return_value = watchdog->should_stop;
+    return_value = watchdog->registered_count;
     pthread_mutex_unlock(&watchdog->mutex);
     return return_value;
 }
 
+static bool watchdog_should_stop_synchronized(Watchdog *const watchdog) {
+    if (watchdog == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_WARN,
+                   "Received watchdog_should_stop_synchronized call with watchdog = NULL.");
+        return true;
+    }
+
+    return atomic_load_explicit(&watchdog->should_stop, memory_order_acquire);
+}
+
+static uint64_t watchdog_monotonic_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * WATCHDOG_NS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
+
+static uint64_t watchdog_now_tick(const Watchdog *const watchdog) {
+    return (watchdog_monotonic_now_ns() - watchdog->start_ns) / WATCHDOG_TICK_NS;
+}
+
+//Only for indices below slot_count, whose chunk exists.
+static Watch *watchdog_get_watch(Watchdog *const watchdog, const size_t index) {
+    Watch *chunk = atomic_load_explicit(&watchdog->chunks[index / WATCHDOG_CHUNK_SIZE], memory_order_relaxed);
+    return &chunk[index % WATCHDOG_CHUNK_SIZE];
+}
+
+//Only called with mutex held. Reuses an unregistered index first, indices are handed out in order otherwise.
+static size_t watchdog_take_index(Watchdog *const watchdog) {
+    size_t index = watchdog->free_head;
+    if (index != WATCHDOG_NO_INDEX) {
+        watchdog->free_head = watchdog_get_watch(watchdog, index)->next_free;
+        return index;
+    }
+
+    if (watchdog->slot_count == WATCHDOG_CHUNK_SIZE * WATCHDOG_MAX_CHUNKS) {
+        return WATCHDOG_NO_INDEX;
+    }
+    if (atomic_load_explicit(&watchdog->chunks[watchdog->slot_count / WATCHDOG_CHUNK_SIZE],
+                             memory_order_relaxed) == NULL && !watchdog_add_chunk(watchdog)) {
+        return WATCHDOG_NO_INDEX;
+    }
+    return watchdog->slot_count++;
+}
+
+//Only called with mutex held, or before the thread starts. Appends a chunk after the last one.
+static bool watchdog_add_chunk(Watchdog *const watchdog) {
+    size_t chunk_index = 0;
+    while (chunk_index < WATCHDOG_MAX_CHUNKS &&
+           atomic_load_explicit(&watchdog->chunks[chunk_index], memory_order_relaxed) != NULL) {
+        chunk_index++;
+    }
+    if (chunk_index == WATCHDOG_MAX_CHUNKS) {
+        return false;
+    }
+
+    Watch *chunk = aligned_alloc(CACHE_LINE_SIZE, sizeof(Watch) * WATCHDOG_CHUNK_SIZE);
+    if (chunk == NULL) {
+        logger_log(logger_get_global(), LOGGER_LEVEL_ERROR, "Received NULL from malloc call in watchdog_add_chunk.");
+        return false;
+    }
+    for (size_t i = 0; i < WATCHDOG_CHUNK_SIZE; i++) {
+        chunk[i] = (Watch) {
+                .function = NULL,
+                .object = NULL,
+                .registered = false
+        };
+        atomic_init(&chunk[i].heartbeat, 0);
+    }
+
+    //Release pairs with the acquire in watchdog_update, the chunk is initialised before it can be found.
+    atomic_store_explicit(&watchdog->chunks[chunk_index], chunk, memory_order_release);
+    return true;
+}
+
+static void watchdog_free_chunks(Watchdog *const watchdog) {
+    for (size_t i = 0; i < WATCHDOG_MAX_CHUNKS; i++) {
+        free(atomic_load_explicit(&watchdog->chunks[i], memory_order_relaxed));
+    }
+}
+
+//Only called with mutex held. The level is picked by how far away the deadline is, the slot by the deadline itself,
+//so an entry is due once the wheel at its level reaches its slot. Budgets are capped at half the wheel, which
+//keeps every deadline within one turn of the top level.
+static void watchdog_wheel_insert(Watchdog *const watchdog, Watch *const watch, uint64_t expires_tick) {
+    if (expires_tick < watchdog->current_tick) {
+        expires_tick = watchdog->current_tick;
+    }
+    uint64_t delta = expires_tick - watchdog->current_tick;
+
+    unsigned int level = 0;
+    while (level + 1 < WATCHDOG_WHEEL_LEVELS && delta >= (1ULL << (WATCHDOG_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    unsigned int slot = (unsigned int) (expires_tick >> (WATCHDOG_WHEEL_BITS * level)) & (WATCHDOG_WHEEL_SLOTS - 1);
+
+    watch->expires_tick = expires_tick;
+    watch->level = level;
+    watch->slot = slot;
+    watch->previous = NULL;
+    watch->next = watchdog->wheel[level][slot];
+    if (watch->next != NULL) {
+        watch->next->previous = watch;
+    }
+    watchdog->wheel[level][slot] = watch;
+    watchdog->occupied[level] |= 1ULL << slot;
+}
+
+//Only called with mutex held.
+static void watchdog_wheel_remove(Watchdog *const watchdog, Watch *const watch) {
+    if (watch->previous != NULL) {
+        watch->previous->next = watch->next;
+    } else {
+        watchdog->wheel[watch->level][watch->slot] = watch->next;
+    }
+    if (watch->next != NULL) {
+        watch->next->previous = watch->previous;
+    }
+    if (watchdog->wheel[watch->level][watch->slot] == NULL) {
+        watchdog->occupied[watch->level] &= ~(1ULL << watch->slot);
+    }
+}
+
+//Only called with mutex held. Empties the slot and returns its entries.
+static Watch *watchdog_wheel_take_slot(Watchdog *const watchdog, const unsigned int level, const unsigned int slot) {
+    Watch *list = watchdog->wheel[level][slot];
+    watchdog->wheel[level][slot] = NULL;
+    watchdog->occupied[level] &= ~(1ULL << slot);
+    return list;
+}
+
+//Only called with mutex held. Handles current_tick, first moving down the entries of every level that wraps around
+//with it. Returns true when a watch tripped.
+static bool watchdog_process_tick(Watchdog *const watchdog, const uint64_t now_tick) {
+    uint64_t tick = watchdog->current_tick;
+    for (unsigned int level = 1; level < WATCHDOG_WHEEL_LEVELS; level++) {
+        if ((tick & ((1ULL << (WATCHDOG_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        unsigned int slot = (unsigned int) (tick >> (WATCHDOG_WHEEL_BITS * level)) & (WATCHDOG_WHEEL_SLOTS - 1);
+        Watch *watch = watchdog_wheel_take_slot(watchdog, level, slot);
+        while (watch != NULL) {
+            Watch *next = watch->next;
+            watchdog_wheel_insert(watchdog, watch, watch->expires_tick);
+            watch = next;
+        }
+    }
+
+    //Deadlines are set from now, not from the tick being caught up on, so a late pass does not shorten budgets.
+    bool flag = false;
+    Watch *watch = watchdog_wheel_take_slot(watchdog, 0, (unsigned int) tick & (WATCHDOG_WHEEL_SLOTS - 1));
+    while (watch != NULL) {
+        Watch *next = watch->next;
+        uint_fast64_t heartbeat = atomic_load_explicit(&watch->heartbeat, memory_order_relaxed);
+        if (watchdog->watching && heartbeat == watch->seen_heartbeat) {
+            LOGGER_WARN("watchdog_thread: watch %zu missed its %llu ms budget.", watch->index,
+                        (unsigned long long int) (watch->budget_ticks * WATCHDOG_TICK_NS / 1000000));
+            flag = true;
+        }
+        watch->seen_heartbeat = heartbeat;
+        watchdog_wheel_insert(watchdog, watch, now_tick + watch->budget_ticks);
+        watch = next;
+    }
+
+    watchdog->current_tick++;
+    return flag;
+}
+
+//Only called with mutex held. The next tick with entries at level 0, or the next wrap around of level 0 when only
+//higher levels have entries.
+static uint64_t watchdog_next_tick(const Watchdog *const watchdog) {
+    uint64_t tick = watchdog->current_tick;
+    uint64_t next_tick = tick + WATCHDOG_IDLE_TICKS;
+
+    unsigned int index = (unsigned int) tick & (WATCHDOG_WHEEL_SLOTS - 1);
+    uint64_t occupied = watchdog->occupied[0];
+    if (occupied != 0) {
+        uint64_t rotated = index == 0 ? occupied : (occupied >> index) | (occupied << (WATCHDOG_WHEEL_SLOTS - index));
+        uint64_t due_tick = tick + (uint64_t) __builtin_ctzll(rotated);
+        if (due_tick < next_tick) {
+            next_tick = due_tick;
+        }
+    }
+
+    for (unsigned int level = 1; level < WATCHDOG_WHEEL_LEVELS; level++) {
+        if (watchdog->occupied[level] != 0) {
+            uint64_t wrap_tick = (tick | (WATCHDOG_WHEEL_SLOTS - 1)) + 1;
+            if (wrap_tick < next_tick) {
+                next_tick = wrap_tick;
+            }
+            break;
+        }
+    }
+    return next_tick;
+}
+
 static void *watchdog_thread(void *args) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_thread: Entry.");
+    LOGGER_DEBUG("watchdog_thread: Entry.");
     Watchdog *watchdog = (Watchdog *) args;
 
+    pthread_mutex_lock(&watchdog->mutex);
     while (!watchdog_should_stop_synchronized(watchdog)) {
-        logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_thread: Iteration.");
+        LOGGER_DEBUG("watchdog_thread: Iteration.");
+
         bool flag = false;
-        pthread_mutex_lock(&watchdog->mutex);
-        for (size_t i = 0; i < watchdog->watches; i++) {
-            if (watchdog->watching && !watchdog->watches_array[i].status) {
-                flag = true;
-            }
-            watchdog->watches_array[i].status = false;
+        uint64_t now_tick = watchdog_now_tick(watchdog);
+        while (!flag && watchdog->current_tick <= now_tick) {
+            flag = watchdog_process_tick(watchdog, now_tick);
         }
-        pthread_mutex_unlock(&watchdog->mutex);
 
         if (flag) {
             logger_log(logger_get_global(), LOGGER_LEVEL_WARN, "watchdog_thread: flagged. Stopping program.");
-            pthread_mutex_lock(&watchdog->mutex);
-            watchdog->should_stop = true;
+            atomic_store(&watchdog->should_stop, true);
             watchdog->triggered = true;
-            for (size_t i = 0; i < watchdog->watches; i++) {
-                watchdog->watches_array[i].function(watchdog->watches_array[i].object);
+            for (size_t i = 0; i < watchdog->slot_count; i++) {
+                Watch *watch = watchdog_get_watch(watchdog, i);
+                if (watch->registered) {
+                    watch->function(watch->object);
+                }
             }
-            pthread_mutex_unlock(&watchdog->mutex);
         } else {
-            nanosleep(&WATCHDOG_UPDATE_INTERVAL, NULL);
+            uint64_t deadline_ns = watchdog->start_ns + watchdog_next_tick(watchdog) * WATCHDOG_TICK_NS;
+            struct timespec deadline = {
+                    .tv_sec = (time_t) (deadline_ns / WATCHDOG_NS_PER_SECOND),
+                    .tv_nsec = (long) (deadline_ns % WATCHDOG_NS_PER_SECOND)
+            };
+            if (!atomic_load(&watchdog->should_stop)) {
+                pthread_cond_timedwait(&watchdog->wake_condition, &watchdog->mutex, &deadline);
+            }
         }
     }
+    pthread_mutex_unlock(&watchdog->mutex);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_DEBUG, "watchdog_thread: Ending.");
+    LOGGER_DEBUG("watchdog_thread: Ending.");
     return NULL;
 }
-
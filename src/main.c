@@ -1,104 +1,325 @@
 #include <unistd.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
 
 #include "../include/Reader.h"
+#include "../include/BufferPool.h"
 #include "../include/Analyzer.h"
+#include "../include/FrameBroadcast.h"
+#include "../include/FrameSnapshot.h"
+#include "../include/MetricsServer.h"
+#include "../include/OutputSink.h"
 #include "../include/Printer.h"
-#include "../include/LongDoubleArray.h"
+#include "../include/ProcessScanner.h"
+#include "../include/Recorder.h"
 #include "../include/Watchdog.h"
 #include "../include/Logger.h"
 
-static const size_t READER_ANALYZER_QUEUE_CAPACITY = 10;
-static const size_t ANALYZER_PRINTER_QUEUE_CAPACITY = 10;
+#define READER_ANALYZER_QUEUE_CAPACITY 10
 
-static bool running = false;
-static Watchdog *watchdog;
-static Reader *reader;
-static Analyzer *analyzer;
-static Printer *printer;
+static const size_t FRAME_BROADCAST_CAPACITY = 10;
+//One buffer per queue slot, one being filled by the Reader and one being parsed by the Analyzer.
+static const size_t READER_BUFFER_POOL_SIZE = READER_ANALYZER_QUEUE_CAPACITY + 2;
+static const size_t READER_BUFFER_CAPACITY = 4096;
+static const char READER_PROC_STAT_PATH[] = "/proc/stat";
+static const char READER_PROC_PATH[] = "/proc";
+static const long READER_DEFAULT_UPDATE_INTERVAL_MS = 1000;
+static const long READER_MINIMUM_UPDATE_INTERVAL_MS = 10;
 
-static void sighandler(int signo) {
-    if (signo == SIGTERM) {
-        if (running) {
-            logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "SIGTERM caught. Stopping.");
-            watchdog_pause_watching(watchdog);
+static const struct timespec WATCHDOG_STARTUP_DELAY = {.tv_sec = 3, .tv_nsec = 0};
+//A triggered watchdog stops the stages by itself, it is polled only so that the main thread moves on to joining.
+static const struct timespec WATCHDOG_POLL_INTERVAL = {.tv_sec = 1, .tv_nsec = 0};
 
-            reader_request_stop_synchronized(reader);
-            analyzer_request_stop_synchronized(analyzer);
-            printer_request_stop_synchronized(printer);
-            watchdog_request_stop_synchronized(watchdog);
-            running = false;
+//The process scanner caches one descriptor per process, a large host has far more than the usual soft limit of 1024.
+//It sizes its cache from whatever limit it finds.
+static void raise_open_file_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            LOGGER_WARN("Could not raise the open file limit, fewer process descriptors are cached.");
         }
     }
 }
 
-int main(void) {
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Process starting.");
-    //Flags for children
-    sigset_t set_blocked;
-    sigemptyset(&set_blocked);
-    sigaddset(&set_blocked, SIGTERM);
-    pthread_sigmask(SIG_BLOCK, &set_blocked, NULL);
-
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Creating queues.");
-    Queue *reader_analyzer_queue = queue_create(READER_ANALYZER_QUEUE_CAPACITY);
-    Queue *analyzer_printer_queue = queue_create(ANALYZER_PRINTER_QUEUE_CAPACITY);
-
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Creating threads.");
-    watchdog = watchdog_create(3);
-    reader = reader_create(reader_analyzer_queue, watchdog);
-    analyzer = analyzer_create(reader_analyzer_queue, analyzer_printer_queue, watchdog);
-    printer = printer_create(analyzer_printer_queue, watchdog);
-    running = true;
-
-    //Reset flags
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Setting signal handler.");
-    pthread_sigmask(SIG_UNBLOCK, &set_blocked, NULL);
-
-    //Install signal handler
-    struct sigaction act;
-    act.sa_handler = &sighandler;
-    sigfillset(&act.sa_mask);
-    act.sa_flags = SA_RESTART;
-    sigaction(SIGTERM, &act, NULL);
-
-    sleep(3);
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Enabling watchdog.");
-    watchdog_start_watching(watchdog);
-
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Main thread startup sequence finished. Awaiting for children.");
+static void print_usage(const char program[]) {
+    fprintf(stderr, "Usage: %s [-i interval_ms] [-p] [-r record_path] [-R replay_path [-f]] [-o sink]... [-m address]\n",
+            program);
+    fprintf(stderr, "  -i  Sampling interval in milliseconds, at least %ld (default %ld).\n",
+            READER_MINIMUM_UPDATE_INTERVAL_MS, READER_DEFAULT_UPDATE_INTERVAL_MS);
+    fprintf(stderr, "  -p  Track processes and show the busiest ones.\n");
+    fprintf(stderr, "  -r  Record the raw CPU counters to a binary file.\n");
+    fprintf(stderr, "  -R  Replay captured /proc/stat snapshots from a directory or an archive file.\n");
+    fprintf(stderr, "  -f  Replay as fast as possible instead of once per interval.\n");
+    fprintf(stderr, "  -o  Output to terminal, jsonl:path, csv:path or prometheus:path, a path of - is stdout.\n");
+    fprintf(stderr, "      Up to %d sinks run at once (default terminal).\n", PRINTER_MAX_SINKS);
+    fprintf(stderr, "  -m  Serve Prometheus metrics over HTTP on a localhost port or unix:path.\n");
+}
+
+static void destroy_sinks(const OutputSink sinks[], const size_t sink_count) {
+    for (size_t i = 0; i < sink_count; i++) {
+        sinks[i].destroy(sinks[i].context);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long update_interval_ms = READER_DEFAULT_UPDATE_INTERVAL_MS;
+    bool track_processes = false;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    enum READER_SOURCE_PACING replay_pacing = READER_SOURCE_PACING_REAL_TIME;
+    const char *sink_specs[PRINTER_MAX_SINKS];
+    size_t sink_count = 0;
+    const char *metrics_address = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "i:pr:R:fo:m:")) != -1) {
+        char *end;
+        switch (option) {
+            case 'i':
+                update_interval_ms = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || update_interval_ms < READER_MINIMUM_UPDATE_INTERVAL_MS) {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'p':
+                track_processes = true;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 'f':
+                replay_pacing = READER_SOURCE_PACING_NONE;
+                break;
+            case 'o':
+                if (sink_count == PRINTER_MAX_SINKS) {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                sink_specs[sink_count++] = optarg;
+                break;
+            case 'm':
+                metrics_address = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (sink_count == 0) {
+        sink_specs[sink_count++] = "terminal";
+    }
+    struct timespec update_interval = {
+            .tv_sec = update_interval_ms / 1000,
+            .tv_nsec = update_interval_ms % 1000 * 1000000
+    };
+
+    LOGGER_INFO("Process starting.");
+    //SIGTERM stays blocked in every thread and is taken synchronously by the main thread, so the stop requests run
+    //in a normal thread context instead of a signal handler.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    //Sinks are created before anything else, a mistyped path should fail before sampling starts.
+    OutputSink sinks[PRINTER_MAX_SINKS];
+    for (size_t i = 0; i < sink_count; i++) {
+        if (!output_sink_create_from_spec(sink_specs[i], &sinks[i])) {
+            fprintf(stderr, "Could not create the output %s.\n", sink_specs[i]);
+            destroy_sinks(sinks, i);
+            logger_destroy(logger_get_global());
+            return 1;
+        }
+    }
+
+    //CPUs that are offline now still get a column, so they are recorded once they come back.
+    Recorder *recorder = NULL;
+    if (record_path != NULL) {
+        LOGGER_INFO("Creating recorder.");
+        long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+        recorder = recorder_create(record_path, cpu_count > 0 ? (size_t) cpu_count : 1, update_interval);
+        if (recorder == NULL) {
+            fprintf(stderr, "Could not create the record file %s.\n", record_path);
+            destroy_sinks(sinks, sink_count);
+            logger_destroy(logger_get_global());
+            return 1;
+        }
+    }
+
+    ReaderSource source;
+    if (replay_path != NULL) {
+        LOGGER_INFO("Creating replay source.");
+        if (!reader_source_create_replay(replay_path, replay_pacing, &source)) {
+            fprintf(stderr, "Could not load snapshots to replay from %s.\n", replay_path);
+            destroy_sinks(sinks, sink_count);
+            if (recorder != NULL) {
+                recorder_destroy(recorder);
+            }
+            logger_destroy(logger_get_global());
+            return 1;
+        }
+    } else if (!reader_source_create_file(READER_PROC_STAT_PATH, &source)) {
+        fprintf(stderr, "Could not open %s.\n", READER_PROC_STAT_PATH);
+        destroy_sinks(sinks, sink_count);
+        if (recorder != NULL) {
+            recorder_destroy(recorder);
+        }
+        logger_destroy(logger_get_global());
+        return 1;
+    }
+
+    //The server binds before any stage runs, so a taken port fails the start instead of going unnoticed.
+    Watchdog *watchdog = watchdog_create(2 + sink_count + (metrics_address != NULL ? 1 : 0));
+    FrameSnapshot *snapshot = NULL;
+    MetricsServer *metrics_server = NULL;
+    if (metrics_address != NULL) {
+        LOGGER_INFO("Creating metrics server.");
+        long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+        snapshot = frame_snapshot_create(cpu_count > 0 ? (size_t) cpu_count : 1);
+        metrics_server = snapshot != NULL ? metrics_server_create(metrics_address, snapshot, watchdog) : NULL;
+        if (metrics_server == NULL) {
+            fprintf(stderr, "Could not serve metrics on %s.\n", metrics_address);
+            if (snapshot != NULL) {
+                frame_snapshot_destroy(snapshot);
+            }
+            watchdog_request_stop_synchronized(watchdog);
+            watchdog_await_and_destroy(watchdog);
+            source.destroy(source.context);
+            destroy_sinks(sinks, sink_count);
+            if (recorder != NULL) {
+                recorder_destroy(recorder);
+            }
+            logger_destroy(logger_get_global());
+            return 1;
+        }
+    }
+
+    LOGGER_INFO("Creating queues.");
+    Queue *reader_analyzer_queue = queue_create_with_mode(READER_ANALYZER_QUEUE_CAPACITY, QUEUE_MODE_SPSC);
+
+    LOGGER_INFO("Creating frame broadcast.");
+    FrameBroadcast *broadcast = frame_broadcast_create(FRAME_BROADCAST_CAPACITY);
+
+    LOGGER_INFO("Creating buffer pool.");
+    BufferPool *reader_buffer_pool = buffer_pool_create(READER_BUFFER_POOL_SIZE, READER_BUFFER_CAPACITY);
+
+    ProcessScanner *process_scanner = NULL;
+    if (track_processes) {
+        LOGGER_INFO("Creating process scanner.");
+        raise_open_file_limit();
+        process_scanner = process_scanner_create(READER_PROC_PATH);
+    }
+
+    //Every sink gets its own Printer subscribed to the same frames, so a slow file does not hold back the terminal.
+    //They subscribe before the Analyzer starts and see its first frame.
+    LOGGER_INFO("Creating threads.");
+    Printer *printers[PRINTER_MAX_SINKS];
+    for (size_t i = 0; i < sink_count; i++) {
+        printers[i] = printer_create(broadcast, watchdog, &sinks[i], 1);
+    }
+    Reader *reader = reader_create_with_source(reader_analyzer_queue, reader_buffer_pool, watchdog, source,
+                                               process_scanner, update_interval);
+    Analyzer *analyzer = analyzer_create(reader_analyzer_queue, broadcast, watchdog, recorder, snapshot);
+
+    bool stop_signalled = sigtimedwait(&stop_signals, NULL, &WATCHDOG_STARTUP_DELAY) == SIGTERM;
+    if (!stop_signalled) {
+        LOGGER_INFO("Enabling watchdog.");
+        watchdog_start_watching(watchdog);
+
+        LOGGER_INFO("Main thread startup sequence finished. Awaiting SIGTERM.");
+        while (!stop_signalled && !watchdog_was_triggered(watchdog) && !reader_is_finished(reader)) {
+            stop_signalled = sigtimedwait(&stop_signals, NULL, &WATCHDOG_POLL_INTERVAL) == SIGTERM;
+        }
+    }
+
+    if (stop_signalled) {
+        LOGGER_INFO("SIGTERM caught. Stopping.");
+        watchdog_pause_watching(watchdog);
+
+        reader_request_stop_synchronized(reader);
+        analyzer_request_stop_synchronized(analyzer);
+        for (size_t i = 0; i < sink_count; i++) {
+            printer_request_stop_synchronized(printers[i]);
+        }
+        if (metrics_server != NULL) {
+            metrics_server_request_stop_synchronized(metrics_server);
+        }
+        watchdog_request_stop_synchronized(watchdog);
+    } else if (reader_is_finished(reader)) {
+        //The stages end on their own once the queued snapshots are drained, only the watchdog and the metrics
+        //server have to go.
+        LOGGER_INFO("Replay finished. Draining.");
+        watchdog_pause_watching(watchdog);
+        if (metrics_server != NULL) {
+            metrics_server_request_stop_synchronized(metrics_server);
+        }
+        watchdog_request_stop_synchronized(watchdog);
+    }
+
+    LOGGER_INFO("Awaiting for children.");
     reader_await_and_destroy(reader);
     analyzer_await_and_destroy(analyzer);
-    printer_await_and_destroy(printer);
+    for (size_t i = 0; i < sink_count; i++) {
+        printer_await_and_destroy(printers[i]);
+    }
+    if (metrics_server != NULL) {
+        LOGGER_INFO("Destroying metrics server. Scrapes served: %llu.",
+                    (unsigned long long int) metrics_server_get_scrape_count(metrics_server));
+        metrics_server_await_and_destroy(metrics_server);
+        FrameSnapshotStats snapshot_stats;
+        frame_snapshot_get_stats(snapshot, &snapshot_stats);
+        LOGGER_INFO("Destroying frame snapshot. Frames published: %llu, reads: %llu, read retries: %llu.",
+                    (unsigned long long int) snapshot_stats.version, (unsigned long long int) snapshot_stats.reads,
+                    (unsigned long long int) snapshot_stats.retries);
+        frame_snapshot_destroy(snapshot);
+    }
 
     bool watchdog_triggered = watchdog_was_triggered(watchdog);
     if (watchdog_triggered) {
         printf("Watchdog triggered. Shutting down.\n");
-        logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Watchdog status: TRIGGERED.");
+        LOGGER_INFO("Watchdog status: TRIGGERED.");
     } else {
-        logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Watchdog status: CLEAN.");
+        LOGGER_INFO("Watchdog status: CLEAN.");
     }
 
     watchdog_await_and_destroy(watchdog);
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Children joined.");
+    LOGGER_INFO("Children joined.");
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Cleaning queues.");
-    while (!queue_is_empty(reader_analyzer_queue)) {
-        void *object = queue_extract(reader_analyzer_queue);
-        free(object);
+    if (process_scanner != NULL) {
+        process_scanner_destroy(process_scanner);
+    }
+
+    if (recorder != NULL) {
+        LOGGER_INFO("Destroying recorder. Records written: %llu.",
+                    (unsigned long long int) recorder_get_record_count(recorder));
+        recorder_destroy(recorder);
     }
 
-    while (!queue_is_empty(analyzer_printer_queue)) {
-        LongDoubleArray *object = queue_extract(analyzer_printer_queue);
-        long_double_array_destroy(object);
+    LOGGER_INFO("Cleaning queues.");
+    while (!queue_is_empty(reader_analyzer_queue)) {
+        Buffer *object = queue_extract(reader_analyzer_queue);
+        buffer_pool_release(object);
     }
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Destroying queues.");
+    LOGGER_INFO("Destroying queues.");
     queue_destroy(reader_analyzer_queue);
-    queue_destroy(analyzer_printer_queue);
 
-    logger_log(logger_get_global(), LOGGER_LEVEL_INFO, "Destroying logger.");
+    LOGGER_INFO("Destroying frame broadcast.");
+    frame_broadcast_destroy(broadcast);
+
+    LOGGER_INFO("Destroying buffer pool. Buffer allocations: %zu.",
+                buffer_pool_get_allocation_count(reader_buffer_pool));
+    buffer_pool_destroy(reader_buffer_pool);
+
+    LOGGER_INFO("Destroying logger. Messages dropped: %llu.",
+                (unsigned long long int) logger_get_dropped_count(logger_get_global()));
     logger_destroy(logger_get_global());
 
     if (watchdog_triggered) {
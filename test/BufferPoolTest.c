@@ -0,0 +1,47 @@
+#include <assert.h>
+#include "../include/BufferPool.h"
+#include "../include/Logger.h"
+
+int main(void) {
+    BufferPool *pool = buffer_pool_create(3, 64);
+    assert(pool != NULL);
+    assert(buffer_pool_get_allocation_count(pool) == 3);
+
+    Buffer *a = buffer_pool_try_acquire(pool);
+    Buffer *b = buffer_pool_try_acquire(pool);
+    Buffer *c = buffer_pool_try_acquire(pool);
+    assert(a != NULL && b != NULL && c != NULL);
+    assert(a != b && b != c && a != c);
+    assert(a->capacity == 64 && a->length == 0 && a->pool == pool);
+    assert(buffer_pool_try_acquire(pool) == NULL);
+
+    b->length = 10;
+    buffer_pool_release(b);
+    Buffer *d = buffer_pool_try_acquire(pool);
+    assert(d == b);
+    assert(d->length == 0);
+
+    //Steady state recycling never allocates.
+    buffer_pool_release(a);
+    buffer_pool_release(c);
+    buffer_pool_release(d);
+    for (size_t i = 0; i < 1000; i++) {
+        Buffer *buffer = buffer_pool_try_acquire(pool);
+        assert(buffer != NULL);
+        buffer_pool_release(buffer);
+    }
+    assert(buffer_pool_get_allocation_count(pool) == 3);
+
+    Buffer *grown = buffer_pool_try_acquire(pool);
+    assert(buffer_reserve(grown, 32));
+    assert(grown->capacity == 64);
+    assert(buffer_pool_get_allocation_count(pool) == 3);
+    assert(buffer_reserve(grown, 4096));
+    assert(grown->capacity == 4096 && grown->pool == pool);
+    assert(buffer_pool_get_allocation_count(pool) == 4);
+    buffer_pool_release(grown);
+
+    buffer_pool_destroy(pool);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <assert.h>
+#include "../include/CpuIndexMap.h"
+#include "../include/Logger.h"
+
+static CpuData row(const size_t cpu_id) {
+    return (CpuData) {.cpu_id = cpu_id, .total_time = 0, .idle_time = 0};
+}
+
+int main(void) {
+    CpuIndexMap *map = cpu_index_map_create();
+    assert(map != NULL);
+
+    CpuData all[] = {row(STAT_PARSER_AGGREGATE_ID), row(0), row(1), row(2), row(3)};
+    const size_t *slots = cpu_index_map_update(map, all, 5);
+    assert(slots != NULL);
+    assert(cpu_index_map_get_slot_count(map) == 5);
+    assert(cpu_index_map_get_key_count(map) == 5);
+    size_t generation = cpu_index_map_get_generation(map);
+    for (size_t i = 0; i < 5; i++) {
+        assert(cpu_index_map_is_online(map, slots[i]));
+        assert(cpu_index_map_get_slot_key(map, slots[i]) == cpu_index_map_key(all[i].cpu_id));
+    }
+    assert(cpu_index_map_key(STAT_PARSER_AGGREGATE_ID) == 0);
+    size_t slot_of_cpu2 = slots[3];
+    size_t slot_of_cpu3 = slots[4];
+
+    //Same layout, nothing is rebuilt.
+    assert(cpu_index_map_update(map, all, 5) == slots);
+    assert(cpu_index_map_get_generation(map) == generation);
+
+    //cpu1 goes offline, later cores keep their slots.
+    CpuData parked[] = {row(STAT_PARSER_AGGREGATE_ID), row(0), row(2), row(3)};
+    slots = cpu_index_map_update(map, parked, 4);
+    assert(cpu_index_map_get_generation(map) == generation + 1);
+    assert(slots[2] == slot_of_cpu2 && slots[3] == slot_of_cpu3);
+    assert(cpu_index_map_get_slot_count(map) == 5);
+    size_t offline = 0;
+    for (size_t slot = 0; slot < cpu_index_map_get_slot_count(map); slot++) {
+        if (!cpu_index_map_is_online(map, slot)) {
+            assert(cpu_index_map_get_slot_key(map, slot) == cpu_index_map_key(1));
+            offline++;
+        }
+    }
+    assert(offline == 1);
+
+    //cpu1 returns and a new sparse core appears.
+    CpuData grown[] = {row(STAT_PARSER_AGGREGATE_ID), row(0), row(1), row(2), row(3), row(100)};
+    slots = cpu_index_map_update(map, grown, 6);
+    assert(cpu_index_map_get_generation(map) == generation + 2);
+    assert(cpu_index_map_get_slot_count(map) == 6);
+    assert(cpu_index_map_get_key_count(map) == 102);
+    for (size_t i = 0; i < 6; i++) {
+        assert(cpu_index_map_is_online(map, slots[i]));
+    }
+
+    //Garbage ids are ignored instead of sizing the key table.
+    CpuData corrupted[] = {row(STAT_PARSER_AGGREGATE_ID), row(1000000000)};
+    slots = cpu_index_map_update(map, corrupted, 2);
+    assert(slots[1] == CPU_INDEX_MAP_NO_SLOT);
+
+    cpu_index_map_destroy(map);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "../include/FrameBroadcast.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+static const size_t CAPACITY = 4;
+static const size_t CPU_COUNT = 2;
+static const uint64_t THREADED_FRAME_COUNT = 20000;
+static const struct timespec WAIT_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0};
+static const struct timespec SHORT_TIMEOUT = {.tv_sec = 0, .tv_nsec = 1000000};
+
+typedef struct Consumer {
+    FrameBroadcast *broadcast;
+    size_t subscriber;
+    bool slow;
+    uint64_t received;
+    uint64_t last_sequence;
+} Consumer;
+
+static SampleFrame *create_frame(const uint64_t sequence) {
+    SampleFrame *frame = sample_frame_create(CPU_COUNT);
+    assert(frame != NULL);
+    frame->sequence = sequence;
+    return frame;
+}
+
+//Takes frames until the broadcast is closed and drained. Sequences only grow, BLOCK subscribers see every one.
+static void *consumer_thread(void *args) {
+    Consumer *consumer = (Consumer *) args;
+    SampleFrame *frames[3];
+    while (true) {
+        size_t count = frame_broadcast_acquire_batch(consumer->broadcast, consumer->subscriber, frames, 3);
+        if (count == 0) {
+            if (!frame_broadcast_wait_until_available(consumer->broadcast, consumer->subscriber, WAIT_TIMEOUT)) {
+                break;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            assert(frames[i]->sequence > consumer->last_sequence);
+            consumer->last_sequence = frames[i]->sequence;
+            consumer->received++;
+        }
+        if (consumer->slow) {
+            nanosleep(&SHORT_TIMEOUT, NULL);
+        }
+        frame_broadcast_release(consumer->broadcast, consumer->subscriber);
+    }
+    return NULL;
+}
+
+static void publish(FrameBroadcast *const broadcast, const uint64_t sequence) {
+    SampleFrame *frame = create_frame(sequence);
+    while (!frame_broadcast_try_publish(broadcast, frame)) {
+        assert(frame_broadcast_wait_until_publishable(broadcast, WAIT_TIMEOUT));
+    }
+}
+
+int main(void)
+{
+    assert(frame_broadcast_create(0) == NULL);
+
+    FrameBroadcast *broadcast = frame_broadcast_create(CAPACITY);
+    assert(broadcast != NULL);
+    assert(frame_broadcast_subscribe(broadcast, (enum FRAME_BROADCAST_POLICY) 7) == FRAME_BROADCAST_INVALID_SUBSCRIBER);
+
+    //Without subscribers frames are destroyed right away and never fill the ring.
+    for (uint64_t sequence = 1; sequence <= CAPACITY * 2; sequence++) {
+        assert(frame_broadcast_try_publish(broadcast, create_frame(sequence)));
+    }
+
+    size_t first = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK);
+    size_t second = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK);
+    size_t latest = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_DROP_OLDEST);
+    assert(first != FRAME_BROADCAST_INVALID_SUBSCRIBER && second != FRAME_BROADCAST_INVALID_SUBSCRIBER &&
+           latest != FRAME_BROADCAST_INVALID_SUBSCRIBER);
+    assert(frame_broadcast_get_subscriber_count(broadcast) == 3);
+
+    //Subscribers only see frames published after they subscribed.
+    SampleFrame *frames[8];
+    assert(frame_broadcast_acquire_batch(broadcast, first, frames, 8) == 0);
+
+    for (uint64_t sequence = 1; sequence <= CAPACITY; sequence++) {
+        assert(frame_broadcast_try_publish(broadcast, create_frame(sequence)));
+    }
+    SampleFrame *pending = create_frame(CAPACITY + 1);
+    assert(!frame_broadcast_try_publish(broadcast, pending));
+
+    //Every subscriber reads the very same frames, nothing is copied.
+    SampleFrame *second_frames[8];
+    assert(frame_broadcast_acquire_batch(broadcast, first, frames, 8) == CAPACITY);
+    assert(frame_broadcast_acquire_batch(broadcast, second, second_frames, 2) == 2);
+    for (size_t i = 0; i < CAPACITY; i++) {
+        assert(frames[i]->sequence == i + 1);
+    }
+    assert(second_frames[0] == frames[0] && second_frames[1] == frames[1]);
+    frame_broadcast_release(broadcast, first);
+
+    //The second subscriber still holds the oldest frame, it blocks the producer until released.
+    assert(!frame_broadcast_try_publish(broadcast, pending));
+    frame_broadcast_release(broadcast, second);
+
+    //The DROP_OLDEST subscriber never took the oldest frame, it is skipped instead of waited for.
+    assert(frame_broadcast_try_publish(broadcast, pending));
+    assert(frame_broadcast_get_dropped_count(broadcast, latest) == 1);
+    assert(frame_broadcast_get_dropped_count(broadcast, first) == 0);
+    assert(frame_broadcast_acquire_batch(broadcast, latest, frames, 8) == CAPACITY);
+    assert(frames[0]->sequence == 2 && frames[CAPACITY - 1]->sequence == CAPACITY + 1);
+    frame_broadcast_release(broadcast, latest);
+
+    //A closed subscriber takes nothing more, its waits fail and it no longer counts for new frames.
+    frame_broadcast_close_subscriber(broadcast, latest);
+    assert(!frame_broadcast_wait_until_available(broadcast, latest, WAIT_TIMEOUT));
+    assert(frame_broadcast_try_publish(broadcast, create_frame(CAPACITY + 2)));
+    assert(frame_broadcast_acquire_batch(broadcast, first, frames, 8) == 2);
+    frame_broadcast_release(broadcast, first);
+    frame_broadcast_unsubscribe(broadcast, latest);
+    assert(frame_broadcast_get_subscriber_count(broadcast) == 2);
+
+    //Unsubscribing gives back held and untaken frames alike.
+    assert(frame_broadcast_acquire_batch(broadcast, second, frames, 1) == 1);
+    frame_broadcast_unsubscribe(broadcast, second);
+    assert(frame_broadcast_try_publish(broadcast, create_frame(CAPACITY + 3)));
+    assert(frame_broadcast_acquire_batch(broadcast, second, frames, 8) == 0);
+
+    //A closed broadcast is still drained by its subscribers before their waits fail.
+    frame_broadcast_close(broadcast);
+    assert(frame_broadcast_is_closed(broadcast));
+    SampleFrame *rejected = create_frame(CAPACITY + 4);
+    assert(!frame_broadcast_try_publish(broadcast, rejected));
+    sample_frame_destroy(rejected);
+    assert(!frame_broadcast_wait_until_publishable(broadcast, WAIT_TIMEOUT));
+    assert(frame_broadcast_wait_until_available(broadcast, first, WAIT_TIMEOUT));
+    assert(frame_broadcast_acquire_batch(broadcast, first, frames, 8) == 1);
+    assert(frames[0]->sequence == CAPACITY + 3);
+    frame_broadcast_release(broadcast, first);
+    assert(!frame_broadcast_wait_until_available(broadcast, first, WAIT_TIMEOUT));
+    frame_broadcast_unsubscribe(broadcast, first);
+    assert(frame_broadcast_get_subscriber_count(broadcast) == 0);
+    frame_broadcast_destroy(broadcast);
+
+    //Subscriber slots run out.
+    broadcast = frame_broadcast_create(CAPACITY);
+    for (size_t i = 0; i < FRAME_BROADCAST_MAX_SUBSCRIBERS; i++) {
+        assert(frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK) == i);
+    }
+    assert(frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK) == FRAME_BROADCAST_INVALID_SUBSCRIBER);
+    frame_broadcast_unsubscribe(broadcast, 3);
+    assert(frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_DROP_OLDEST) == 3);
+    //Frames nobody took yet go with the broadcast.
+    assert(frame_broadcast_try_publish(broadcast, create_frame(1)));
+    assert(frame_broadcast_try_publish(broadcast, create_frame(2)));
+    frame_broadcast_destroy(broadcast);
+
+    //Two BLOCK subscribers get every frame in order, a slow DROP_OLDEST one gets the rest of what it did not skip.
+    broadcast = frame_broadcast_create(CAPACITY);
+    Consumer consumers[3];
+    for (size_t i = 0; i < 3; i++) {
+        consumers[i] = (Consumer) {
+                .broadcast = broadcast,
+                .subscriber = frame_broadcast_subscribe(broadcast, i < 2 ? FRAME_BROADCAST_POLICY_BLOCK :
+                                                                   FRAME_BROADCAST_POLICY_DROP_OLDEST),
+                .slow = i == 2,
+                .received = 0,
+                .last_sequence = 0
+        };
+    }
+    pthread_t threads[3];
+    for (size_t i = 0; i < 3; i++) {
+        assert(pthread_create(&threads[i], NULL, consumer_thread, &consumers[i]) == 0);
+    }
+    for (uint64_t sequence = 1; sequence <= THREADED_FRAME_COUNT; sequence++) {
+        publish(broadcast, sequence);
+    }
+    frame_broadcast_close(broadcast);
+    for (size_t i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(consumers[0].received == THREADED_FRAME_COUNT && consumers[1].received == THREADED_FRAME_COUNT);
+    assert(consumers[0].last_sequence == THREADED_FRAME_COUNT);
+    uint64_t dropped = frame_broadcast_get_dropped_count(broadcast, consumers[2].subscriber);
+    assert(dropped > 0);
+    assert(consumers[2].received + dropped == THREADED_FRAME_COUNT);
+    for (size_t i = 0; i < 3; i++) {
+        frame_broadcast_unsubscribe(broadcast, consumers[i].subscriber);
+    }
+    frame_broadcast_destroy(broadcast);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
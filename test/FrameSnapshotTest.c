@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/FrameSnapshot.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+#define CPU_CAPACITY 64
+#define PUBLISH_COUNT 200000
+#define READER_COUNT 3
+
+static FrameSnapshot *snapshot;
+static atomic_bool writer_done;
+
+//Every value of a published frame is derived from its sequence, a torn copy mixes two of them.
+static void fill_frame(SampleFrame *const frame, const uint64_t sequence) {
+    frame->sequence = sequence;
+    frame->timestamp_ns = sequence * 3;
+    frame->cpu_count = sequence % 2 == 0 ? CPU_CAPACITY : CPU_CAPACITY / 4;
+    for (size_t i = 0; i <= frame->cpu_count; i++) {
+        frame->utilization[i] = (uint16_t) (sequence % SAMPLE_FRAME_FULL_LOAD);
+    }
+}
+
+static void *writer_thread(void *args) {
+    (void) args;
+    SampleFrame *frame = sample_frame_create(CPU_CAPACITY);
+    assert(frame != NULL);
+    for (uint64_t sequence = 1; sequence <= PUBLISH_COUNT; sequence++) {
+        fill_frame(frame, sequence);
+        frame_snapshot_publish(snapshot, frame);
+    }
+    sample_frame_destroy(frame);
+    atomic_store(&writer_done, true);
+    return NULL;
+}
+
+static void *reader_thread(void *args) {
+    size_t *reads = (size_t *) args;
+    SampleFrame *copy = sample_frame_create(frame_snapshot_get_cpu_capacity(snapshot));
+    assert(copy != NULL);
+    uint64_t previous_sequence = 0;
+    uint64_t version;
+    while (!atomic_load(&writer_done)) {
+        if (!frame_snapshot_read_versioned(snapshot, copy, &version)) {
+            continue;
+        }
+        //Two frames were published before the writer started.
+        assert(version == copy->sequence + 2);
+        assert(copy->sequence >= previous_sequence);
+        assert(copy->timestamp_ns == copy->sequence * 3);
+        assert(copy->cpu_count == (copy->sequence % 2 == 0 ? CPU_CAPACITY : CPU_CAPACITY / 4));
+        for (size_t i = 0; i <= copy->cpu_count; i++) {
+            assert(copy->utilization[i] == copy->sequence % SAMPLE_FRAME_FULL_LOAD);
+        }
+        previous_sequence = copy->sequence;
+        (*reads)++;
+    }
+    sample_frame_destroy(copy);
+    return NULL;
+}
+
+int main(void) {
+    snapshot = frame_snapshot_create(CPU_CAPACITY);
+    assert(snapshot != NULL);
+    assert(frame_snapshot_get_cpu_capacity(snapshot) == CPU_CAPACITY);
+
+    //Nothing published yet.
+    SampleFrame *copy = sample_frame_create(CPU_CAPACITY);
+    assert(copy != NULL);
+    assert(!frame_snapshot_read(snapshot, copy));
+    assert(frame_snapshot_get_version(snapshot) == 0);
+
+    //CPUs beyond the capacity are cut off.
+    SampleFrame *large = sample_frame_create(CPU_CAPACITY * 2);
+    assert(large != NULL);
+    for (size_t i = 0; i <= CPU_CAPACITY * 2; i++) {
+        large->utilization[i] = (uint16_t) i;
+    }
+    large->sequence = 7;
+    large->timestamp_ns = 7 * 3;
+    frame_snapshot_publish(snapshot, large);
+    assert(frame_snapshot_read(snapshot, copy));
+    assert(copy->sequence == 7 && copy->cpu_count == CPU_CAPACITY);
+    assert(copy->utilization[CPU_CAPACITY] == CPU_CAPACITY);
+    sample_frame_destroy(large);
+
+    //Pollers see the version stay put while nothing is published.
+    uint64_t version = 0;
+    assert(frame_snapshot_read_versioned(snapshot, copy, &version));
+    assert(version == 1 && frame_snapshot_get_version(snapshot) == version);
+    FrameSnapshotStats stats;
+    frame_snapshot_get_stats(snapshot, &stats);
+    assert(stats.version == 1 && stats.reads == 2 && stats.retries == 0);
+
+    //Concurrent readers only ever see whole frames.
+    fill_frame(copy, 0);
+    frame_snapshot_publish(snapshot, copy);
+    atomic_init(&writer_done, false);
+    pthread_t writer;
+    pthread_t readers[READER_COUNT];
+    size_t reads[READER_COUNT] = {0};
+    for (size_t i = 0; i < READER_COUNT; i++) {
+        assert(pthread_create(&readers[i], NULL, reader_thread, &reads[i]) == 0);
+    }
+    assert(pthread_create(&writer, NULL, writer_thread, NULL) == 0);
+    pthread_join(writer, NULL);
+    size_t total_reads = 0;
+    for (size_t i = 0; i < READER_COUNT; i++) {
+        pthread_join(readers[i], NULL);
+        total_reads += reads[i];
+    }
+
+    assert(frame_snapshot_read_versioned(snapshot, copy, &version));
+    assert(copy->sequence == PUBLISH_COUNT && version == PUBLISH_COUNT + 2);
+    frame_snapshot_get_stats(snapshot, &stats);
+    assert(stats.version == PUBLISH_COUNT + 2);
+    assert(stats.reads == total_reads + 3);
+    printf("%d frames published, %zu consistent reads, %llu retries.\n", PUBLISH_COUNT, total_reads,
+           (unsigned long long) stats.retries);
+
+    sample_frame_destroy(copy);
+    frame_snapshot_destroy(snapshot);
+    logger_destroy(logger_get_global());
+    return 0;
+}
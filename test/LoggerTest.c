@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/Logger.h"
+
+//Builds this file as if configured with TIETO_LOG_LEVEL=INFO, the macros read it where they are used.
+#undef LOGGER_COMPILE_LEVEL
+#define LOGGER_COMPILE_LEVEL 1
+
+#define THREAD_COUNT 4
+#define MESSAGES_PER_THREAD 20000
+
+static char sync_path[] = "/tmp/TietoLoggerTestSyncXXXXXX";
+static char async_path[] = "/tmp/TietoLoggerTestAsyncXXXXXX";
+static Logger *async_logger;
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+static char *read_file(const char path[]) {
+    FILE *file = fopen(path, "r");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *content = malloc((size_t) size + 1);
+    assert(content != NULL);
+    assert(fread(content, 1, (size_t) size, file) == (size_t) size);
+    content[size] = '\0';
+    fclose(file);
+    return content;
+}
+
+static void *producer_thread(void *args) {
+    size_t thread = (size_t) args;
+    for (size_t i = 0; i < MESSAGES_PER_THREAD; i++) {
+        logger_logf(async_logger, LOGGER_LEVEL_DEBUG, "thread %zu message %zu", thread, i);
+    }
+    return NULL;
+}
+
+int main(void) {
+    int sync_fd = mkstemp(sync_path);
+    int async_fd = mkstemp(async_path);
+    assert(sync_fd >= 0 && async_fd >= 0);
+    close(sync_fd);
+    close(async_fd);
+
+    //SYNC: the line is on disk when logger_log returns.
+    Logger *sync_logger = logger_create(sync_path);
+    assert(sync_logger != NULL);
+    logger_log(sync_logger, LOGGER_LEVEL_INFO, "synchronous line");
+    char *content = read_file(sync_path);
+    assert(strstr(content, "[INFO] [") != NULL && strstr(content, "] synchronous line\n") != NULL);
+    free(content);
+
+    //Each line carries microseconds since the logger was created, later lines never go back.
+    logger_log(sync_logger, LOGGER_LEVEL_INFO, "second line");
+    content = read_file(sync_path);
+    unsigned long long int offset_seconds[2];
+    unsigned int offset_microseconds[2];
+    const char *line = content;
+    for (size_t i = 0; i < 2; i++) {
+        const char *offset = strstr(strstr(line, "] [") + 3, "] [");
+        assert(offset != NULL &&
+               sscanf(offset, "] [%llu.%6u] ", &offset_seconds[i], &offset_microseconds[i]) == 2);
+        line = strchr(offset, '\n') + 1;
+    }
+    assert(offset_seconds[0] < offset_seconds[1] ||
+           (offset_seconds[0] == offset_seconds[1] && offset_microseconds[0] <= offset_microseconds[1]));
+    assert(strstr(content, "] second line\n") != NULL);
+    free(content);
+
+    //Formatted lines longer than a record are cut.
+    char long_text[400];
+    memset(long_text, 'x', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    logger_logf(sync_logger, LOGGER_LEVEL_WARN, "depth %zu of %d", (size_t) 12, 64);
+    logger_logf(sync_logger, LOGGER_LEVEL_INFO, "%s", long_text);
+    content = read_file(sync_path);
+    assert(strstr(content, "[WARN] [") != NULL && strstr(content, "] depth 12 of 64\n") != NULL);
+    const char *long_line = strstr(content, "] xxx");
+    assert(long_line != NULL && strlen(long_line) < sizeof(long_text) && long_line[strlen(long_line) - 1] == '\n');
+    free(content);
+    assert(logger_get_dropped_count(sync_logger) == 0);
+    logger_destroy(sync_logger);
+
+    //Below the build time level the whole call is gone, arguments are not even evaluated.
+    int evaluations = 0;
+    LOGGER_DEBUG("evaluated %d", ++evaluations);
+    assert(evaluations == 0);
+    LOGGER_INFO("evaluated %d", ++evaluations);
+    assert(evaluations == 1);
+
+    //ASYNC: producers never block, whatever did not fit the ring is counted.
+    async_logger = logger_create_with_mode(async_path, LOGGER_MODE_ASYNC);
+    assert(async_logger != NULL);
+    pthread_t threads[THREAD_COUNT];
+    double start = monotonic_seconds();
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        assert(pthread_create(&threads[i], NULL, producer_thread, (void *) i) == 0);
+    }
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = monotonic_seconds() - start;
+
+    //An ERROR is written right away, after everything queued before it.
+    logger_log(async_logger, LOGGER_LEVEL_ERROR, "error line");
+    content = read_file(async_path);
+    const char *error_line = strstr(content, "[ERROR] [");
+    assert(error_line != NULL && strstr(error_line, "] error line\n") != NULL);
+    assert(strstr(error_line, "thread ") == NULL);
+    free(content);
+
+    uint64_t dropped = logger_get_dropped_count(async_logger);
+    logger_log(async_logger, LOGGER_LEVEL_INFO, "last line");
+    logger_destroy(async_logger);
+
+    //Every message is either in the file, in the order its thread logged it, or counted as dropped.
+    content = read_file(async_path);
+    size_t logged = 0;
+    long next[THREAD_COUNT] = {0};
+    for (char *line = strtok(content, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        size_t thread, index;
+        const char *text = strstr(line, "] thread ");
+        if (text != NULL && sscanf(text, "] thread %zu message %zu", &thread, &index) == 2) {
+            assert(thread < THREAD_COUNT && (long) index >= next[thread]);
+            next[thread] = (long) index + 1;
+            logged++;
+        }
+    }
+    assert(logged + dropped == THREAD_COUNT * MESSAGES_PER_THREAD);
+    free(content);
+    content = read_file(async_path);
+    assert(strstr(content, "] last line\n") != NULL);
+    if (dropped > 0) {
+        assert(strstr(content, "[WARN] [") != NULL && strstr(content, " dropped ") != NULL);
+    }
+    free(content);
+
+    printf("%d messages in %.3fs (%.0f ns per call), %llu dropped.\n", THREAD_COUNT * MESSAGES_PER_THREAD, seconds,
+           seconds * 1e9 / (THREAD_COUNT * MESSAGES_PER_THREAD), (unsigned long long int) dropped);
+
+    unlink(sync_path);
+    unlink(async_path);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../include/MetricsServer.h"
+#include "../include/FrameSnapshot.h"
+#include "../include/SampleFrame.h"
+#include "../include/Watchdog.h"
+#include "../include/Logger.h"
+
+#define CPU_COUNT 4
+#define TRICKLE_BYTES 50
+
+static const struct timespec TRICKLE_PAUSE = {.tv_sec = 0, .tv_nsec = 100000000};
+
+static char socket_path[64];
+
+static int connect_client(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strcpy(address.sun_path, socket_path);
+    assert(connect(fd, (const struct sockaddr *) &address, sizeof(address)) == 0);
+    return fd;
+}
+
+//Sends request over a new connection and returns everything the server wrote until it closed the connection.
+static char *exchange(const char request[]) {
+    int fd = connect_client();
+    assert(write(fd, request, strlen(request)) == (ssize_t) strlen(request));
+
+    size_t capacity = 64 * 1024, length = 0;
+    char *response = malloc(capacity);
+    assert(response != NULL);
+    ssize_t bytes;
+    while ((bytes = read(fd, response + length, capacity - 1 - length)) > 0) {
+        length += (size_t) bytes;
+    }
+    response[length] = '\0';
+    close(fd);
+    return response;
+}
+
+int main(void) {
+    snprintf(socket_path, sizeof(socket_path), "/tmp/TietoMetricsServerTest%d.sock", (int) getpid());
+    char address[80];
+    snprintf(address, sizeof(address), "unix:%s", socket_path);
+
+    FrameSnapshot *snapshot = frame_snapshot_create(CPU_COUNT);
+    Watchdog *watchdog = watchdog_create(1);
+    assert(snapshot != NULL && watchdog != NULL);
+    watchdog_start_watching(watchdog);
+
+    assert(metrics_server_create("not a port", snapshot, watchdog) == NULL);
+    assert(metrics_server_create("0", snapshot, watchdog) == NULL);
+    MetricsServer *server = metrics_server_create(address, snapshot, watchdog);
+    assert(server != NULL);
+
+    //Nothing published yet.
+    char *response = exchange("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 503 ", 13) == 0);
+    free(response);
+
+    SampleFrame *frame = sample_frame_create(CPU_COUNT);
+    assert(frame != NULL);
+    frame->sequence = 1;
+    frame->utilization[0] = 2500;
+    frame->utilization[1] = SAMPLE_FRAME_FULL_LOAD;
+    frame->utilization[2] = 0;
+    frame->utilization[3] = SAMPLE_FRAME_OFFLINE;
+    frame->utilization[4] = 42;
+    frame_snapshot_publish(snapshot, frame);
+
+    response = exchange("GET /metrics HTTP/1.1\r\nHost: localhost\r\nAccept: */*\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    assert(strstr(response, "Content-Type: text/plain; version=0.0.4") != NULL);
+    assert(strstr(response, "Connection: close\r\n") != NULL);
+    const char *body = strstr(response, "\r\n\r\n");
+    assert(body != NULL);
+    body += 4;
+    unsigned long content_length = strtoul(strstr(response, "Content-Length: ") + 16, NULL, 10);
+    assert(content_length == strlen(body));
+    assert(strstr(body, "tieto_cpu_utilization_ratio{cpu=\"all\"} 0.2500\n") != NULL);
+    assert(strstr(body, "tieto_cpu_utilization_ratio{cpu=\"0\"} 1.0000\n") != NULL);
+    assert(strstr(body, "tieto_cpu_utilization_ratio{cpu=\"3\"} 0.0042\n") != NULL);
+    assert(strstr(body, "cpu=\"2\"") == NULL);
+    free(response);
+
+    //A newer frame shows up in the next scrape.
+    frame->utilization[0] = 5000;
+    frame_snapshot_publish(snapshot, frame);
+    response = exchange("GET /metrics?name=x HTTP/1.0\r\n\r\n");
+    assert(strstr(response, "tieto_cpu_utilization_ratio{cpu=\"all\"} 0.5000\n") != NULL);
+    free(response);
+
+    response = exchange("HEAD /metrics HTTP/1.1\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    assert(strstr(response, "tieto_") == NULL);
+    free(response);
+
+    response = exchange("GET / HTTP/1.1\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 404 ", 13) == 0);
+    free(response);
+
+    response = exchange("POST /metrics HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 405 ", 13) == 0);
+    assert(strstr(response, "Allow: GET, HEAD\r\n") != NULL);
+    free(response);
+
+    assert(metrics_server_get_scrape_count(server) == 3);
+
+    //A client sending one byte at a time never stalls a single read, yet it is dropped once its deadline passed,
+    //long before it would finish, and the server thread keeps its watchdog fed meanwhile.
+    int slow = connect_client();
+    const char slow_request[] = "GET /metrics HTTP/1.1\r\n";
+    assert(write(slow, slow_request, strlen(slow_request)) == (ssize_t) strlen(slow_request));
+    size_t trickled = 0;
+    while (trickled < TRICKLE_BYTES) {
+        nanosleep(&TRICKLE_PAUSE, NULL);
+        struct pollfd descriptor = {.fd = slow, .events = POLLIN};
+        if (poll(&descriptor, 1, 0) > 0 || send(slow, "X", 1, MSG_NOSIGNAL) != 1) {
+            break;
+        }
+        trickled++;
+    }
+    char unused;
+    assert(trickled < TRICKLE_BYTES);
+    assert(read(slow, &unused, 1) <= 0);
+    close(slow);
+    assert(!watchdog_was_triggered(watchdog));
+
+    response = exchange("GET /metrics HTTP/1.1\r\n\r\n");
+    assert(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    free(response);
+
+    metrics_server_request_stop_synchronized(server);
+    metrics_server_await_and_destroy(server);
+    struct stat path_stat;
+    assert(stat(socket_path, &path_stat) != 0);
+
+    watchdog_request_stop_synchronized(watchdog);
+    watchdog_await_and_destroy(watchdog);
+    sample_frame_destroy(frame);
+    frame_snapshot_destroy(snapshot);
+    logger_destroy(logger_get_global());
+    return 0;
+}
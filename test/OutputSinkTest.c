@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/OutputSink.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+#define CPU_COUNT 4
+#define FRAME_COUNT 1000
+
+static char directory[] = "/tmp/TietoOutputSinkTestXXXXXX";
+
+static char *read_file(const char path[], size_t *const length) {
+    FILE *file = fopen(path, "rb");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    assert(size >= 0);
+    rewind(file);
+    char *content = malloc((size_t) size + 1);
+    assert(content != NULL);
+    assert(fread(content, 1, (size_t) size, file) == (size_t) size);
+    content[size] = '\0';
+    fclose(file);
+    *length = (size_t) size;
+    return content;
+}
+
+static size_t count_lines(const char content[]) {
+    size_t lines = 0;
+    for (const char *position = content; (position = strchr(position, '\n')) != NULL; position++) {
+        lines++;
+    }
+    return lines;
+}
+
+static void fill_frame(SampleFrame *const frame, const uint64_t sequence) {
+    frame->sequence = sequence;
+    frame->utilization[0] = 1234;
+    frame->utilization[1] = SAMPLE_FRAME_FULL_LOAD;
+    frame->utilization[2] = 5;
+    frame->utilization[3] = SAMPLE_FRAME_OFFLINE;
+    frame->utilization[4] = (uint16_t) (sequence % 10000);
+    frame->process_count = 1;
+    frame->processes[0] = (SampleFrameProcess) {.pid = 42, .utilization = 15000};
+    memcpy(frame->processes[0].command, "a\"b\\c\n", 7);
+    frame->windows[ROLLING_WINDOW_SPAN_10_SECONDS] = (RollingWindowStats) {
+            .sample_count = 3, .min = 0, .max = 10000, .mean = 5000, .p95 = 9900, .p99 = 9999
+    };
+}
+
+int main(void) {
+    assert(mkdtemp(directory) != NULL);
+    char json_path[64], csv_path[64], prometheus_path[64], temporary_path[64];
+    snprintf(json_path, sizeof(json_path), "%s/frames.jsonl", directory);
+    snprintf(csv_path, sizeof(csv_path), "%s/frames.csv", directory);
+    snprintf(prometheus_path, sizeof(prometheus_path), "%s/tieto.prom", directory);
+    snprintf(temporary_path, sizeof(temporary_path), "%s/tieto.prom.tmp", directory);
+
+    OutputSink sinks[3];
+    char spec[96];
+    snprintf(spec, sizeof(spec), "jsonl:%s", json_path);
+    assert(output_sink_create_from_spec(spec, &sinks[0]));
+    assert(sinks[0].delivery == OUTPUT_SINK_DELIVERY_EVERY_FRAME);
+    snprintf(spec, sizeof(spec), "csv:%s", csv_path);
+    assert(output_sink_create_from_spec(spec, &sinks[1]));
+    assert(sinks[1].delivery == OUTPUT_SINK_DELIVERY_EVERY_FRAME);
+    snprintf(spec, sizeof(spec), "prometheus:%s", prometheus_path);
+    assert(output_sink_create_from_spec(spec, &sinks[2]));
+    assert(sinks[2].delivery == OUTPUT_SINK_DELIVERY_LATEST_FRAME);
+
+    OutputSink unused;
+    assert(!output_sink_create_from_spec("xml:-", &unused));
+    assert(!output_sink_create_from_spec("csv:", &unused));
+    assert(!output_sink_create_from_spec("jsonl", &unused));
+
+    SampleFrame *frame = sample_frame_create(CPU_COUNT);
+    assert(frame != NULL);
+
+    //Nothing reaches the files before a flush, small frames are batched.
+    fill_frame(frame, 0);
+    for (size_t i = 0; i < 3; i++) {
+        assert(sinks[i].write(sinks[i].context, frame));
+    }
+    size_t length;
+    char *content = read_file(json_path, &length);
+    assert(length == 0);
+    free(content);
+    struct stat file_stat;
+    assert(stat(prometheus_path, &file_stat) != 0);
+
+    for (size_t i = 0; i < 3; i++) {
+        assert(sinks[i].flush(sinks[i].context));
+    }
+
+    content = read_file(json_path, &length);
+    assert(count_lines(content) == 1);
+    assert(strncmp(content, "{\"timestamp_ms\":", 16) == 0);
+    assert(strstr(content, ",\"sequence\":0,\"total\":12.34,\"cpus\":[100.00,0.05,null,0.00],\"windows\":{\"10s\":"
+                           "{\"samples\":3,\"min\":0.00,\"mean\":50.00,\"max\":100.00,\"p95\":99.00,\"p99\":99.99}},"
+                           "\"processes\":[{\"pid\":42,\"cpu\":150.00,\"command\":\"a\\\"b\\\\c\\u000a\"}]}\n") != NULL);
+    free(content);
+
+    content = read_file(csv_path, &length);
+    assert(strncmp(content, "timestamp_ms,sequence,total,cpu0,cpu1,cpu2,cpu3\n", 48) == 0);
+    assert(strstr(content, ",0,12.34,100.00,0.05,,0.00\n") != NULL);
+    free(content);
+
+    //The exposition is renamed into place, the temporary file does not stay behind.
+    content = read_file(prometheus_path, &length);
+    assert(stat(temporary_path, &file_stat) != 0);
+    assert(strstr(content, "# TYPE tieto_cpu_utilization_ratio gauge\n") != NULL);
+    assert(strstr(content, "tieto_cpu_utilization_ratio{cpu=\"all\"} 0.1234\n") != NULL);
+    assert(strstr(content, "tieto_cpu_utilization_ratio{cpu=\"0\"} 1.0000\n") != NULL);
+    assert(strstr(content, "tieto_cpu_utilization_ratio{cpu=\"1\"} 0.0005\n") != NULL);
+    assert(strstr(content, "cpu=\"2\"") == NULL);
+    assert(strstr(content, "tieto_cpu_utilization_window_ratio{window=\"10s\",statistic=\"p99\"} 0.9999\n") != NULL);
+    assert(strstr(content, "window=\"1m\"") == NULL);
+    assert(strstr(content, "tieto_process_cpu_ratio{pid=\"42\",command=\"a\\\"b\\\\c\\n\"} 1.5000\n") != NULL);
+    free(content);
+
+    //Many frames: every one reaches the streams, the exposition only holds the newest.
+    for (uint64_t sequence = 1; sequence <= FRAME_COUNT; sequence++) {
+        fill_frame(frame, sequence);
+        for (size_t i = 0; i < 3; i++) {
+            assert(sinks[i].write(sinks[i].context, frame));
+        }
+    }
+
+    //A changed CPU count repeats the CSV header.
+    SampleFrame *smaller = sample_frame_create(2);
+    assert(smaller != NULL);
+    smaller->sequence = FRAME_COUNT + 1;
+    smaller->utilization[0] = 1;
+    smaller->utilization[1] = 2;
+    smaller->utilization[2] = 3;
+    assert(sinks[1].write(sinks[1].context, smaller));
+
+    for (size_t i = 0; i < 3; i++) {
+        sinks[i].destroy(sinks[i].context);
+    }
+
+    content = read_file(json_path, &length);
+    assert(count_lines(content) == FRAME_COUNT + 1);
+    assert(strstr(content, "\"sequence\":1000,") != NULL);
+    free(content);
+
+    content = read_file(csv_path, &length);
+    assert(count_lines(content) == FRAME_COUNT + 4);
+    assert(strstr(content, "timestamp_ms,sequence,total,cpu0,cpu1\n") != NULL);
+    assert(strstr(content, ",1001,0.01,0.02,0.03\n") != NULL);
+    free(content);
+
+    content = read_file(prometheus_path, &length);
+    assert(strstr(content, "tieto_cpu_utilization_ratio{cpu=\"3\"} 0.1000\n") != NULL);
+    free(content);
+
+    remove(json_path);
+    remove(csv_path);
+    remove(prometheus_path);
+    rmdir(directory);
+    sample_frame_destroy(smaller);
+    sample_frame_destroy(frame);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/Analyzer.h"
+#include "../include/BufferPool.h"
+#include "../include/FrameBroadcast.h"
+#include "../include/FrameSnapshot.h"
+#include "../include/Logger.h"
+#include "../include/Queue.h"
+#include "../include/Reader.h"
+#include "../include/ReaderSource.h"
+#include "../include/SampleFrame.h"
+#include "../include/StatGenerator.h"
+#include "../include/Watchdog.h"
+
+#define QUEUE_CAPACITY 10
+
+static const size_t CPU_COUNT = 4096;
+static const size_t BUFFER_POOL_SIZE = QUEUE_CAPACITY + 2;
+//Deliberately far below the snapshot size, the Reader has to grow its buffers.
+static const size_t BUFFER_CAPACITY = 4096;
+static const struct timespec WAIT_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0};
+static const struct timespec WRITER_INTERVAL = {.tv_sec = 0, .tv_nsec = 20000000};
+static const size_t REPLAY_CPU_COUNT = 64;
+static const size_t REPLAY_SNAPSHOT_COUNT = 2000;
+static const size_t REPEAT_SNAPSHOT_COUNT = 2;
+
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool writer_should_stop = false;
+
+typedef struct Writer {
+    StatGenerator *generator;
+    char *content;
+    size_t capacity;
+    size_t file_size;
+    int fd;
+} Writer;
+
+//Every write is padded with blank lines to the size of the first one. A write that grew the file would raise its
+//size page by page, and a Reader hitting the end of file halfway through would lose the last CPUs.
+static void writer_write(Writer *writer) {
+    size_t length = stat_generator_render(writer->generator, writer->content, writer->capacity);
+    if (writer->file_size == 0) {
+        writer->file_size = length + length / 16;
+    }
+    assert(length <= writer->file_size && writer->file_size < writer->capacity);
+    memset(writer->content + length, '\n', writer->file_size - length);
+    assert(pwrite(writer->fd, writer->content, writer->file_size, 0) == (ssize_t) writer->file_size);
+}
+
+//Rewrites the synthetic stat file in place, the Reader keeps its descriptor open across ticks.
+static void *writer_thread(void *args) {
+    Writer *writer = (Writer *) args;
+    while (true) {
+        pthread_mutex_lock(&writer_mutex);
+        bool stop = writer_should_stop;
+        pthread_mutex_unlock(&writer_mutex);
+        if (stop) {
+            break;
+        }
+
+        stat_generator_advance(writer->generator, 2);
+        writer_write(writer);
+        nanosleep(&WRITER_INTERVAL, NULL);
+    }
+    return NULL;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+static void run_pipeline(const char path[], const struct timespec interval, const double seconds,
+                         const size_t minimum_frames) {
+    Queue *reader_analyzer_queue = queue_create_with_mode(QUEUE_CAPACITY, QUEUE_MODE_SPSC);
+    FrameBroadcast *broadcast = frame_broadcast_create(QUEUE_CAPACITY);
+    BufferPool *pool = buffer_pool_create(BUFFER_POOL_SIZE, BUFFER_CAPACITY);
+    Watchdog *watchdog = watchdog_create(2);
+    FrameSnapshot *snapshot = frame_snapshot_create(CPU_COUNT);
+    assert(reader_analyzer_queue != NULL && broadcast != NULL && pool != NULL && watchdog != NULL);
+    assert(snapshot != NULL);
+
+    size_t subscriber = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK);
+    assert(subscriber != FRAME_BROADCAST_INVALID_SUBSCRIBER);
+
+    Reader *reader = reader_create(reader_analyzer_queue, pool, watchdog, path, NULL, interval);
+    Analyzer *analyzer = analyzer_create(reader_analyzer_queue, broadcast, watchdog, NULL, snapshot);
+    assert(reader != NULL && analyzer != NULL);
+    watchdog_start_watching(watchdog);
+
+    size_t frames = 0;
+    uint64_t previous_timestamp_ns = 0;
+    uint64_t last_sequence = 0;
+    double end = monotonic_seconds() + seconds;
+    while (monotonic_seconds() < end) {
+        SampleFrame *frame;
+        if (frame_broadcast_acquire_batch(broadcast, subscriber, &frame, 1) == 0) {
+            frame_broadcast_wait_until_available(broadcast, subscriber, WAIT_TIMEOUT);
+            continue;
+        }
+
+        //Aggregate line plus every core, nothing truncated.
+        assert(frame->cpu_count == CPU_COUNT);
+        for (size_t i = 0; i <= frame->cpu_count; i++) {
+            assert(frame->utilization[i] <= SAMPLE_FRAME_FULL_LOAD);
+        }
+        //Stamped by the Reader when the sample was taken.
+        assert(frame->timestamp_ns > previous_timestamp_ns);
+        previous_timestamp_ns = frame->timestamp_ns;
+        last_sequence = frame->sequence;
+        frame_broadcast_release(broadcast, subscriber);
+        frames++;
+    }
+
+    double stop_start = monotonic_seconds();
+    watchdog_pause_watching(watchdog);
+    reader_request_stop_synchronized(reader);
+    analyzer_request_stop_synchronized(analyzer);
+    watchdog_request_stop_synchronized(watchdog);
+    uint64_t missed_deadlines = reader_get_missed_deadlines(reader);
+    reader_await_and_destroy(reader);
+    analyzer_await_and_destroy(analyzer);
+    assert(!watchdog_was_triggered(watchdog));
+    watchdog_await_and_destroy(watchdog);
+    //Blocked stages are woken by the stop requests instead of noticing them after their timeouts.
+    double stop_seconds = monotonic_seconds() - stop_start;
+
+    printf("Interval %ld.%09lds: %zu frames in %.1fs, %zu buffer allocations, %llu missed deadlines, "
+           "stopped in %.3fs.\n", (long) interval.tv_sec, interval.tv_nsec, frames, seconds,
+           buffer_pool_get_allocation_count(pool), (unsigned long long) missed_deadlines, stop_seconds);
+    assert(stop_seconds < 0.5);
+    assert(frames >= minimum_frames);
+    //The snapshot holds a frame at least as new as the last one taken from the broadcast.
+    SampleFrame *latest = sample_frame_create(CPU_COUNT);
+    assert(latest != NULL && frame_snapshot_read(snapshot, latest));
+    assert(latest->sequence >= last_sequence && latest->cpu_count == CPU_COUNT);
+    sample_frame_destroy(latest);
+    frame_snapshot_destroy(snapshot);
+    //Every pooled buffer grows at most a couple of times, then the cached size is reused.
+    assert(buffer_pool_get_allocation_count(pool) <= BUFFER_POOL_SIZE * 4);
+
+    while (!queue_is_empty(reader_analyzer_queue)) {
+        buffer_pool_release(queue_extract(reader_analyzer_queue));
+    }
+    buffer_pool_destroy(pool);
+    queue_destroy(reader_analyzer_queue);
+    frame_broadcast_unsubscribe(broadcast, subscriber);
+    frame_broadcast_destroy(broadcast);
+}
+
+//Replays an archive as fast as possible. Every snapshot but the first one must come out as a frame, then the
+//stages end by themselves. The last repeated_frames frames come from unchanged counters and repeat the one before.
+static void run_replay(const char path[], const size_t expected_frames, const size_t repeated_frames) {
+    Queue *reader_analyzer_queue = queue_create_with_mode(QUEUE_CAPACITY, QUEUE_MODE_SPSC);
+    FrameBroadcast *broadcast = frame_broadcast_create(QUEUE_CAPACITY);
+    BufferPool *pool = buffer_pool_create(BUFFER_POOL_SIZE, BUFFER_CAPACITY);
+    Watchdog *watchdog = watchdog_create(2);
+    assert(reader_analyzer_queue != NULL && broadcast != NULL && pool != NULL && watchdog != NULL);
+
+    ReaderSource source;
+    assert(reader_source_create_replay(path, READER_SOURCE_PACING_NONE, &source));
+    size_t subscriber = frame_broadcast_subscribe(broadcast, FRAME_BROADCAST_POLICY_BLOCK);
+    assert(subscriber != FRAME_BROADCAST_INVALID_SUBSCRIBER);
+    double start = monotonic_seconds();
+    Reader *reader = reader_create_with_source(reader_analyzer_queue, pool, watchdog, source, NULL,
+                                               (struct timespec) {.tv_sec = 1, .tv_nsec = 0});
+    Analyzer *analyzer = analyzer_create(reader_analyzer_queue, broadcast, watchdog, NULL, NULL);
+    assert(reader != NULL && analyzer != NULL);
+
+    size_t frames = 0;
+    uint64_t previous_sequence = 0;
+    uint16_t previous_utilization[REPLAY_CPU_COUNT + 1];
+    while (true) {
+        SampleFrame *frame;
+        if (frame_broadcast_acquire_batch(broadcast, subscriber, &frame, 1) == 0) {
+            if (!frame_broadcast_wait_until_available(broadcast, subscriber, WAIT_TIMEOUT)) {
+                break;
+            }
+            continue;
+        }
+
+        assert(frame->cpu_count == REPLAY_CPU_COUNT);
+        assert(frames == 0 || frame->sequence == previous_sequence + 1);
+        if (frames >= expected_frames - repeated_frames) {
+            assert(frames > 0);
+            assert(memcmp(frame->utilization, previous_utilization, sizeof(previous_utilization)) == 0);
+        }
+        memcpy(previous_utilization, frame->utilization, sizeof(previous_utilization));
+        previous_sequence = frame->sequence;
+        frame_broadcast_release(broadcast, subscriber);
+        frames++;
+    }
+    double seconds = monotonic_seconds() - start;
+
+    assert(reader_is_finished(reader));
+    reader_await_and_destroy(reader);
+    analyzer_await_and_destroy(analyzer);
+    watchdog_request_stop_synchronized(watchdog);
+    watchdog_await_and_destroy(watchdog);
+
+    printf("Replayed %zu frames in %.3fs, %.0f frames/s.\n", frames, seconds, (double) frames / seconds);
+    assert(frames == expected_frames);
+
+    buffer_pool_destroy(pool);
+    queue_destroy(reader_analyzer_queue);
+    frame_broadcast_unsubscribe(broadcast, subscriber);
+    frame_broadcast_destroy(broadcast);
+}
+
+//The last snapshot is written repeated_count more times, like samples taken faster than the kernel tick.
+static void write_archive(const char path[], const size_t snapshot_count, const size_t repeated_count) {
+    StatGenerator *generator = stat_generator_create(REPLAY_CPU_COUNT, 7);
+    size_t capacity = 64 * 1024;
+    char *content = malloc(capacity);
+    FILE *file = fopen(path, "w");
+    assert(generator != NULL && content != NULL && file != NULL);
+    for (size_t i = 0; i < snapshot_count + repeated_count; i++) {
+        if (i < snapshot_count) {
+            stat_generator_advance(generator, 2);
+        }
+        size_t length = stat_generator_render(generator, content, capacity);
+        assert(length < capacity);
+        assert(fwrite(content, 1, length, file) == length);
+    }
+    fclose(file);
+    free(content);
+    stat_generator_destroy(generator);
+}
+
+int main(void) {
+    char path[] = "/tmp/TietoPipelineTestXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+
+    Writer writer = {
+            .generator = stat_generator_create(CPU_COUNT, 42),
+            .capacity = 1024 * 1024,
+            .file_size = 0,
+            .fd = fd
+    };
+    writer.content = malloc(writer.capacity);
+    assert(writer.generator != NULL && writer.content != NULL);
+    writer_write(&writer);
+
+    pthread_t writer_handle;
+    assert(pthread_create(&writer_handle, NULL, writer_thread, &writer) == 0);
+
+    //The first sample only primes the previous counters, hence one frame less than ticks.
+    run_pipeline(path, (struct timespec) {.tv_sec = 1, .tv_nsec = 0}, 5.5, 4);
+    run_pipeline(path, (struct timespec) {.tv_sec = 0, .tv_nsec = 100000000}, 3.5, 25);
+    //Faster than the writer: a sample that saw no new ticks repeats the last frame, none is dropped.
+    run_pipeline(path, (struct timespec) {.tv_sec = 0, .tv_nsec = 10000000}, 2.0, 50);
+
+    pthread_mutex_lock(&writer_mutex);
+    writer_should_stop = true;
+    pthread_mutex_unlock(&writer_mutex);
+    pthread_join(writer_handle, NULL);
+
+    stat_generator_destroy(writer.generator);
+    free(writer.content);
+    close(fd);
+    unlink(path);
+
+    char archive_path[] = "/tmp/TietoPipelineReplayXXXXXX";
+    fd = mkstemp(archive_path);
+    assert(fd >= 0);
+    close(fd);
+    write_archive(archive_path, REPLAY_SNAPSHOT_COUNT, 0);
+    run_replay(archive_path, REPLAY_SNAPSHOT_COUNT - 1, 0);
+    //Two snapshots identical to the last diffed one, both still come out as frames repeating it.
+    write_archive(archive_path, 2, REPEAT_SNAPSHOT_COUNT);
+    run_replay(archive_path, 1 + REPEAT_SNAPSHOT_COUNT, REPEAT_SNAPSHOT_COUNT);
+    unlink(archive_path);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/ProcessScanner.h"
+#include "../include/Logger.h"
+
+static char root[] = "/tmp/TietoProcessScannerTestXXXXXX";
+
+static void write_stat(const int pid, const char command[], const unsigned long long int user_time,
+                       const unsigned long long int system_time) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d", root, pid);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+
+    FILE *file = fopen(path, "w");
+    assert(file != NULL);
+    fprintf(file, "%d (%s) S 1 %d %d 0 -1 4194560 100 0 0 0 %llu %llu 0 0 20 0 1 0 100 1000 10\n", pid, command, pid,
+            pid, user_time, system_time);
+    fclose(file);
+}
+
+static void remove_process(const int pid) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%d", root, pid);
+    rmdir(path);
+}
+
+static const ProcessSample *find_sample(const ProcessSample samples[], const size_t count, const int pid) {
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].pid == pid) {
+            return &samples[i];
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    assert(mkdtemp(root) != NULL);
+
+    write_stat(100, "init", 10, 5);
+    write_stat(200, "worker (x) y", 1000, 200);
+    write_stat(300, "idle", 7, 7);
+    //Not a pid, must be skipped.
+    char path[128];
+    snprintf(path, sizeof(path), "%s/self", root);
+    mkdir(path, 0700);
+
+    ProcessScanner *scanner = process_scanner_create(root);
+    assert(scanner != NULL);
+
+    //The first scan only takes the baselines.
+    size_t count;
+    process_scanner_scan(scanner, &count);
+    assert(count == 0);
+    assert(process_scanner_get_process_count(scanner) == 3);
+
+    //Counters are read through the cached descriptors, rewriting in place is seen.
+    write_stat(100, "init", 12, 6);
+    write_stat(200, "worker (x) y", 1100, 250);
+    const ProcessSample *samples = process_scanner_scan(scanner, &count);
+    assert(count == 2);
+    assert(find_sample(samples, count, 100)->ticks == 3);
+    assert(find_sample(samples, count, 200)->ticks == 150);
+    //Parentheses inside the command do not confuse the field offsets.
+    assert(strcmp(find_sample(samples, count, 200)->command, "worker (x) y") == 0);
+    assert(find_sample(samples, count, 300) == NULL);
+
+    //Exited processes are dropped, new ones start with a baseline.
+    remove_process(100);
+    write_stat(400, "a_very_long_command_name", 50, 50);
+    samples = process_scanner_scan(scanner, &count);
+    assert(count == 0);
+    assert(process_scanner_get_process_count(scanner) == 3);
+
+    write_stat(400, "a_very_long_command_name", 60, 50);
+    samples = process_scanner_scan(scanner, &count);
+    assert(count == 1);
+    assert(samples[0].pid == 400 && samples[0].ticks == 10);
+    //Long commands are cut to fit.
+    assert(strlen(samples[0].command) == PROCESS_SCANNER_COMMAND_LENGTH - 1);
+
+    //A process idle for many scans shows up on the very next scan once it runs, with all of the time it used.
+    for (size_t i = 0; i < 20; i++) {
+        process_scanner_scan(scanner, &count);
+        assert(count == 0);
+    }
+    write_stat(300, "idle", 39, 7);
+    samples = process_scanner_scan(scanner, &count);
+    assert(count == 1 && find_sample(samples, count, 300)->ticks == 32);
+    write_stat(300, "idle", 40, 7);
+    samples = process_scanner_scan(scanner, &count);
+    assert(count == 1 && find_sample(samples, count, 300)->ticks == 1);
+
+    //Enough processes to force the table to grow and entries to move on removal. The listing no longer fits a
+    //single scan and every scan lists a part of it.
+    for (int pid = 1000; pid < 4000; pid++) {
+        write_stat(pid, "bulk", 1, 1);
+    }
+    for (size_t i = 0; i < 2; i++) {
+        process_scanner_scan(scanner, &count);
+    }
+    assert(process_scanner_get_process_count(scanner) == 3 + 3000);
+    for (int pid = 1000; pid < 4000; pid += 2) {
+        remove_process(pid);
+    }
+    for (int pid = 1001; pid < 4000; pid += 2) {
+        write_stat(pid, "bulk", 2, 1);
+    }
+    //Each remaining process reports its tick on the next scan, and only there.
+    static unsigned int reported[4000];
+    for (size_t i = 0; i < 2; i++) {
+        samples = process_scanner_scan(scanner, &count);
+        assert(count == (i == 0 ? 1500 : 0));
+        for (size_t j = 0; j < count; j++) {
+            assert(samples[j].pid >= 1000 && samples[j].pid % 2 == 1 && samples[j].ticks == 1);
+            reported[samples[j].pid]++;
+        }
+    }
+    assert(process_scanner_get_process_count(scanner) == 3 + 1500);
+    for (int pid = 1001; pid < 4000; pid += 2) {
+        assert(reported[pid] == 1);
+    }
+
+    process_scanner_destroy(scanner);
+    for (int pid = 1001; pid < 4000; pid += 2) {
+        remove_process(pid);
+    }
+    remove_process(200);
+    remove_process(300);
+    remove_process(400);
+    rmdir(path);
+    rmdir(root);
+
+    //The live process table, timed for reference.
+    scanner = process_scanner_create("/proc");
+    assert(scanner != NULL);
+    process_scanner_scan(scanner, &count);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    process_scanner_scan(scanner, &count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Scanned %zu processes in %.3f ms.\n", process_scanner_get_process_count(scanner),
+           (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6);
+    assert(process_scanner_get_process_count(scanner) > 0);
+    process_scanner_destroy(scanner);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
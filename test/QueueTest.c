@@ -1,7 +1,61 @@
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 #include "../include/Queue.h"
 #include "../include/Logger.h"
 
+static const size_t SPSC_TRANSFER_COUNT = 200000;
+static const struct timespec WAIT_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0};
+static const struct timespec LONG_WAIT_TIMEOUT = {.tv_sec = 30, .tv_nsec = 0};
+
+static void *close_later(void *args) {
+    nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 50000000}, NULL);
+    queue_close((Queue *) args);
+    return NULL;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+//A waiter blocked on an empty or a full queue returns false right after the queue is closed.
+static void check_close_wakes_waiters(const enum QUEUE_MODE mode) {
+    int value = 0;
+    Queue *queue = queue_create_with_mode(1, mode);
+    pthread_t closer;
+    assert(pthread_create(&closer, NULL, close_later, queue) == 0);
+    double start = monotonic_seconds();
+    assert(!queue_wait_until_not_empty(queue, LONG_WAIT_TIMEOUT));
+    assert(monotonic_seconds() - start < 5.0);
+    pthread_join(closer, NULL);
+    assert(queue_is_closed(queue));
+    queue_destroy(queue);
+
+    queue = queue_create_with_mode(1, mode);
+    assert(queue_try_push(queue, &value));
+    assert(pthread_create(&closer, NULL, close_later, queue) == 0);
+    start = monotonic_seconds();
+    assert(!queue_wait_until_not_full(queue, LONG_WAIT_TIMEOUT));
+    assert(monotonic_seconds() - start < 5.0);
+    pthread_join(closer, NULL);
+    //Leftovers can still be drained.
+    assert(queue_try_pop(queue) == &value);
+    queue_destroy(queue);
+}
+
+static void *spsc_producer(void *args) {
+    Queue *queue = (Queue *) args;
+    for (size_t i = 1; i <= SPSC_TRANSFER_COUNT; i++) {
+        while (!queue_try_push(queue, (void *) (uintptr_t) i)) {
+            queue_wait_until_not_full(queue, WAIT_TIMEOUT);
+        }
+    }
+    return NULL;
+}
+
 int main(void)
 {
     int array[] = {0, 1, 2, 3, 4};
@@ -44,7 +98,84 @@ int main(void)
     assert(queue_is_empty(queue));
     assert(!queue_is_full(queue));
 
+    assert(queue_try_push(queue, &array[0]));
+    assert(queue_try_pop(queue) == &array[0]);
+    assert(queue_try_pop(queue) == NULL);
+
+    void *batch[8];
+    void *const inputs[] = {&array[0], &array[1], &array[2], &array[3], &array[4], &full_size_val};
+    assert(queue_insert_batch(queue, inputs, 6) == 5);
+    assert(queue_is_full(queue));
+    assert(queue_extract_batch(queue, batch, 2) == 2);
+    assert(batch[0] == &array[0] && batch[1] == &array[1]);
+    assert(queue_extract_batch(queue, batch, 8) == 3);
+    assert(batch[0] == &array[2] && batch[2] == &array[4]);
+    assert(queue_extract_batch(queue, batch, 8) == 0);
+
     queue_destroy(queue);
+
+    //SPSC mode, single thread.
+    queue = queue_create_with_mode(5, QUEUE_MODE_SPSC);
+    assert(queue_get_mode(queue) == QUEUE_MODE_SPSC);
+    assert(queue_is_empty(queue));
+    assert(!queue_is_full(queue));
+    assert(queue_try_pop(queue) == NULL);
+
+    for (size_t i = 0; i < array_size; i++) {
+        assert(queue_try_push(queue, &array[i]));
+    }
+    assert(queue_is_full(queue));
+    assert(!queue_try_push(queue, &full_size_val));
+
+    for (size_t i = 0; i < array_size; i++) {
+        assert(queue_try_pop(queue) == &array[i]);
+    }
+    assert(queue_try_pop(queue) == NULL);
+    assert(queue_is_empty(queue));
+
+    //Indices keep running past the capacity.
+    for (size_t round = 0; round < 17; round++) {
+        queue_insert(queue, &array[round % array_size]);
+        assert(queue_extract(queue) == &array[round % array_size]);
+    }
+
+    assert(queue_insert_batch(queue, inputs, 6) == 5);
+    assert(queue_insert_batch(queue, inputs, 6) == 0);
+    assert(queue_extract_batch(queue, batch, 3) == 3);
+    assert(batch[0] == &array[0] && batch[2] == &array[2]);
+    assert(queue_insert_batch(queue, &inputs[5], 1) == 1);
+    assert(queue_extract_batch(queue, batch, 8) == 3);
+    assert(batch[0] == &array[3] && batch[1] == &array[4] && batch[2] == &full_size_val);
+    queue_destroy(queue);
+
+    //SPSC mode, one producer and one consumer thread.
+    queue = queue_create_with_mode(8, QUEUE_MODE_SPSC);
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, spsc_producer, queue) == 0);
+    for (size_t expected = 1; expected <= SPSC_TRANSFER_COUNT; expected++) {
+        void *object;
+        while ((object = queue_try_pop(queue)) == NULL) {
+            queue_wait_until_not_empty(queue, WAIT_TIMEOUT);
+        }
+        assert((uintptr_t) object == expected);
+    }
+    pthread_join(producer, NULL);
+    assert(queue_is_empty(queue));
+    queue_destroy(queue);
+
+    check_close_wakes_waiters(QUEUE_MODE_LOCKED);
+    check_close_wakes_waiters(QUEUE_MODE_SPSC);
+
+    //The last of several producers closes the queue.
+    queue = queue_create(4);
+    assert(queue_add_producer(queue) == 1);
+    assert(queue_add_producer(queue) == 2);
+    queue_release_producer(queue);
+    assert(!queue_is_closed(queue));
+    queue_release_producer(queue);
+    assert(queue_is_closed(queue));
+    queue_destroy(queue);
+
     logger_destroy(logger_get_global());
     return 0;
 }
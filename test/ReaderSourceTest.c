@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/ReaderSource.h"
+#include "../include/BufferPool.h"
+#include "../include/Logger.h"
+
+static const char *const SNAPSHOTS[] = {
+        "cpu  10 0 10 80 0 0 0 0 0 0\ncpu0 10 0 10 80 0 0 0 0 0 0\nintr 1\n",
+        "cpu  20 0 20 160 0 0 0 0 0 0\ncpu0 20 0 20 160 0 0 0 0 0 0\nintr 2\n",
+        "cpu  30 0 30 240 0 0 0 0 0 0\ncpu0 30 0 30 240 0 0 0 0 0 0\nintr 3\n"
+};
+static const size_t SNAPSHOT_COUNT = sizeof(SNAPSHOTS) / sizeof(SNAPSHOTS[0]);
+
+static void write_file(const char path[], const char content[]) {
+    FILE *file = fopen(path, "w");
+    assert(file != NULL);
+    fputs(content, file);
+    fclose(file);
+}
+
+//Every snapshot comes back whole and in order, then the source reports its end.
+static void check_replay(const ReaderSource *source, Buffer *buffer) {
+    for (size_t i = 0; i < SNAPSHOT_COUNT; i++) {
+        assert(source->read(source->context, buffer) == READER_SOURCE_STATUS_OK);
+        assert(buffer->length == strlen(SNAPSHOTS[i]));
+        assert(strcmp(buffer->data, SNAPSHOTS[i]) == 0);
+    }
+    assert(source->read(source->context, buffer) == READER_SOURCE_STATUS_END);
+    assert(source->read(source->context, buffer) == READER_SOURCE_STATUS_END);
+    source->destroy(source->context);
+}
+
+int main(void) {
+    //Smaller than a snapshot, the sources have to grow it.
+    BufferPool *pool = buffer_pool_create(1, 16);
+    assert(pool != NULL);
+    Buffer *buffer = buffer_pool_try_acquire(pool);
+    assert(buffer != NULL);
+
+    char directory[] = "/tmp/TietoReaderSourceTestXXXXXX";
+    assert(mkdtemp(directory) != NULL);
+    char path[128];
+
+    //Written out of order, replayed in name order. Hidden files are skipped.
+    for (size_t i = SNAPSHOT_COUNT; i-- > 0;) {
+        snprintf(path, sizeof(path), "%s/snapshot-%03zu", directory, i);
+        write_file(path, SNAPSHOTS[i]);
+    }
+    snprintf(path, sizeof(path), "%s/.hidden", directory);
+    write_file(path, "garbage");
+
+    ReaderSource source;
+    assert(reader_source_create_replay(directory, READER_SOURCE_PACING_NONE, &source));
+    assert(source.pacing == READER_SOURCE_PACING_NONE);
+    check_replay(&source, buffer);
+
+    //The same snapshots concatenated into one archive.
+    char archive[128];
+    snprintf(archive, sizeof(archive), "%s.archive", directory);
+    FILE *file = fopen(archive, "w");
+    assert(file != NULL);
+    for (size_t i = 0; i < SNAPSHOT_COUNT; i++) {
+        fputs(SNAPSHOTS[i], file);
+    }
+    fclose(file);
+    assert(reader_source_create_replay(archive, READER_SOURCE_PACING_REAL_TIME, &source));
+    assert(source.pacing == READER_SOURCE_PACING_REAL_TIME);
+    check_replay(&source, buffer);
+
+    //A plain file source rereads the same file and never ends.
+    assert(reader_source_create_file(archive, &source));
+    for (size_t i = 0; i < 3; i++) {
+        assert(source.read(source.context, buffer) == READER_SOURCE_STATUS_OK);
+        assert(strncmp(buffer->data, SNAPSHOTS[0], strlen(SNAPSHOTS[0])) == 0);
+    }
+    source.destroy(source.context);
+
+    //Nothing to replay is an error at creation, not at the first read.
+    write_file(archive, "");
+    assert(!reader_source_create_replay(archive, READER_SOURCE_PACING_NONE, &source));
+    assert(!reader_source_create_replay("/nonexistent/TietoReaderSourceTest", READER_SOURCE_PACING_NONE, &source));
+    assert(!reader_source_create_file("/nonexistent/TietoReaderSourceTest", &source));
+
+    unlink(archive);
+    for (size_t i = 0; i < SNAPSHOT_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/snapshot-%03zu", directory, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/.hidden", directory);
+    unlink(path);
+    rmdir(directory);
+
+    buffer_pool_release(buffer);
+    buffer_pool_destroy(pool);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/Recorder.h"
+#include "../include/Logger.h"
+
+#define CPU_COUNT 4
+//Enough records to outgrow the initial file size several times.
+#define RECORD_COUNT 20000
+
+static const struct timespec INTERVAL = {.tv_sec = 0, .tv_nsec = 100000000};
+
+//Column n holds base + n, so every column of every row is told apart.
+static CpuData make_row(const size_t cpu_id, const uint64_t base) {
+    CpuData row = {.cpu_id = cpu_id, .total_time = 0, .idle_time = 0};
+    for (size_t column = 0; column < STAT_PARSER_COLUMN_COUNT; column++) {
+        row.columns[column] = base + column;
+    }
+    return row;
+}
+
+static void assert_counters(const RecorderCounters *counters, const uint64_t base) {
+    for (size_t column = 0; column < STAT_PARSER_COLUMN_COUNT; column++) {
+        assert(counters->columns[column] == (base == RECORDER_OFFLINE ? RECORDER_OFFLINE : base + column));
+    }
+}
+
+int main(void) {
+    char path[] = "/tmp/TietoRecorderTestXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    Recorder *recorder = recorder_create(path, CPU_COUNT, INTERVAL);
+    assert(recorder != NULL);
+
+    CpuData rows[CPU_COUNT + 2];
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < RECORD_COUNT; i++) {
+        rows[0] = make_row(STAT_PARSER_AGGREGATE_ID, i * 100);
+        //CPU 2 is missing from every other snapshot, CPU 7 does not fit the file and is dropped.
+        size_t row_count = 1;
+        for (size_t cpu = 0; cpu < CPU_COUNT; cpu++) {
+            if (cpu == 2 && i % 2 == 1) {
+                continue;
+            }
+            rows[row_count++] = make_row(cpu, i * 100 + (cpu + 1) * 10);
+        }
+        rows[row_count++] = make_row(7, 1);
+        assert(recorder_append(recorder, 1000 + i, rows, row_count));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Recorded %d snapshots in %.3f ms.\n", RECORD_COUNT,
+           (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6);
+    assert(recorder_get_record_count(recorder) == RECORD_COUNT);
+    recorder_destroy(recorder);
+
+    //The file is trimmed to the header and the records.
+    size_t record_size = sizeof(RecorderRecord) + sizeof(RecorderCounters) * (CPU_COUNT + 1);
+    struct stat file_stat;
+    assert(stat(path, &file_stat) == 0);
+    assert((size_t) file_stat.st_size == sizeof(RecorderHeader) + record_size * RECORD_COUNT);
+
+    FILE *file = fopen(path, "rb");
+    assert(file != NULL);
+    RecorderHeader header;
+    assert(fread(&header, sizeof(header), 1, file) == 1);
+    assert(memcmp(header.magic, RECORDER_MAGIC, sizeof(header.magic)) == 0);
+    assert(header.version == RECORDER_VERSION);
+    assert(header.cpu_count == CPU_COUNT);
+    assert(header.column_count == STAT_PARSER_COLUMN_COUNT);
+    assert(header.interval_ns == 100000000);
+    assert(header.record_size == record_size);
+    assert(header.record_count == RECORD_COUNT);
+
+    RecorderRecord *record = malloc(record_size);
+    assert(record != NULL);
+    for (size_t i = 0; i < RECORD_COUNT; i++) {
+        assert(fread(record, record_size, 1, file) == 1);
+        assert(record->timestamp_ns == 1000 + i);
+        assert_counters(&record->counters[0], i * 100);
+        for (size_t cpu = 0; cpu < CPU_COUNT; cpu++) {
+            assert_counters(&record->counters[cpu + 1],
+                            cpu == 2 && i % 2 == 1 ? RECORDER_OFFLINE : i * 100 + (cpu + 1) * 10);
+        }
+    }
+    free(record);
+    fclose(file);
+    unlink(path);
+
+    //A path that cannot be created is reported, not crashed on.
+    assert(recorder_create("/nonexistent/TietoRecorderTest", CPU_COUNT, INTERVAL) == NULL);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
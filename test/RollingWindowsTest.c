@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../include/RollingWindows.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+#define SAMPLE_COUNT 4000
+#define SERIES_COUNT 3
+
+static const uint64_t INTERVAL_NS = 100000000ULL;
+
+static uint16_t history[SAMPLE_COUNT][SERIES_COUNT];
+static uint64_t timestamps[SAMPLE_COUNT];
+
+static int compare_values(const void *left, const void *right) {
+    return (int) *(const uint16_t *) left - (int) *(const uint16_t *) right;
+}
+
+//The 10 second window is exact, the longer ones keep whole blocks, the newest of them still filling.
+static bool in_window(const size_t sample, const size_t newest, const enum ROLLING_WINDOW_SPAN span) {
+    if (span == ROLLING_WINDOW_SPAN_10_SECONDS) {
+        return timestamps[sample] + rolling_windows_span_ns(span) > timestamps[newest];
+    }
+    const uint64_t block_ns = rolling_windows_block_ns();
+    return timestamps[sample] / block_ns + rolling_windows_span_ns(span) / block_ns > timestamps[newest] / block_ns;
+}
+
+//Recomputes the window from scratch and compares the exact statistics.
+static void check_against_history(const RollingWindows *windows, const size_t newest, const size_t series,
+                                  const enum ROLLING_WINDOW_SPAN span) {
+    static uint16_t values[SAMPLE_COUNT];
+    size_t count = 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i <= newest; i++) {
+        if (in_window(i, newest, span) && history[i][series] != SAMPLE_FRAME_OFFLINE) {
+            values[count++] = history[i][series];
+            sum += history[i][series];
+        }
+    }
+
+    RollingWindowStats stats;
+    assert(rolling_windows_get(windows, series, span, &stats));
+    assert(stats.sample_count == count);
+    if (count == 0) {
+        return;
+    }
+
+    qsort(values, count, sizeof(uint16_t), compare_values);
+    assert(stats.min == values[0]);
+    assert(stats.max == values[count - 1]);
+    assert(stats.mean == (sum + count / 2) / count);
+    //Percentiles are only as exact as their 1% bucket.
+    uint16_t p95 = values[(count * 95 + 99) / 100 - 1];
+    uint16_t p99 = values[(count * 99 + 99) / 100 - 1];
+    assert(stats.p95 / 100 == p95 / 100 && stats.p95 >= stats.min && stats.p95 <= stats.max);
+    assert(stats.p99 / 100 == p99 / 100 && stats.p99 >= stats.min && stats.p99 <= stats.max);
+}
+
+int main(void) {
+    RollingWindows *windows = rolling_windows_create();
+    assert(windows != NULL);
+    assert(rolling_windows_get_series_count(windows) == 0);
+
+    srand(7);
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        timestamps[i] = (i + 1) * INTERVAL_NS;
+        //A trend with noise, so the deques see both rising and falling runs.
+        history[i][0] = (uint16_t) ((i * 7 % SAMPLE_FRAME_FULL_LOAD + (size_t) rand() % 1500) % (SAMPLE_FRAME_FULL_LOAD + 1));
+        history[i][1] = (uint16_t) ((size_t) rand() % (SAMPLE_FRAME_FULL_LOAD + 1));
+        //The last series goes offline for a while and only joins after the first samples.
+        history[i][2] = i < 50 || (i >= 1000 && i < 1200) ? SAMPLE_FRAME_OFFLINE : history[i][1] / 2;
+
+        assert(rolling_windows_add(windows, timestamps[i], history[i], i < 50 ? 2 : SERIES_COUNT));
+        if (i % 97 == 0 || i == SAMPLE_COUNT - 1) {
+            for (size_t series = 0; series < rolling_windows_get_series_count(windows); series++) {
+                for (size_t span = 0; span < ROLLING_WINDOW_SPAN_COUNT; span++) {
+                    check_against_history(windows, i, series, (enum ROLLING_WINDOW_SPAN) span);
+                }
+            }
+        }
+    }
+    assert(rolling_windows_get_series_count(windows) == SERIES_COUNT);
+
+    //The 10 second window holds 100 samples at this interval, the 5 minute one 59 full blocks of 50 and the newest.
+    RollingWindowStats stats;
+    assert(rolling_windows_get(windows, 1, ROLLING_WINDOW_SPAN_10_SECONDS, &stats) && stats.sample_count == 100);
+    assert(rolling_windows_get(windows, 1, ROLLING_WINDOW_SPAN_5_MINUTES, &stats) && stats.sample_count == 2951);
+    assert(!rolling_windows_get(windows, SERIES_COUNT, ROLLING_WINDOW_SPAN_10_SECONDS, &stats));
+
+    //A long gap empties every window.
+    uint16_t values[SERIES_COUNT] = {SAMPLE_FRAME_OFFLINE, 100, SAMPLE_FRAME_OFFLINE};
+    assert(rolling_windows_add(windows, timestamps[SAMPLE_COUNT - 1] + 3600ULL * 1000000000ULL, values, SERIES_COUNT));
+    assert(rolling_windows_get(windows, 0, ROLLING_WINDOW_SPAN_5_MINUTES, &stats) && stats.sample_count == 0);
+    assert(rolling_windows_get(windows, 1, ROLLING_WINDOW_SPAN_5_MINUTES, &stats) && stats.sample_count == 1);
+    assert(stats.min == 100 && stats.max == 100 && stats.mean == 100 && stats.p95 == 100 && stats.p99 == 100);
+
+    //Cost of an update at the 10 ms interval with a wide machine, for reference.
+    rolling_windows_destroy(windows);
+    windows = rolling_windows_create();
+    assert(windows != NULL);
+    static uint16_t wide[257];
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < 40000; i++) {
+        for (size_t series = 0; series < 257; series++) {
+            wide[series] = (uint16_t) ((i * 31 + series * 17) % (SAMPLE_FRAME_FULL_LOAD + 1));
+        }
+        assert(rolling_windows_add(windows, (i + 1) * 10000000ULL, wide, 257));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Added 40000 frames of 257 series in %.3f ms.\n",
+           (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6);
+    rolling_windows_destroy(windows);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include "../include/Scheduler.h"
+#include "../include/Logger.h"
+
+static const uint64_t INTERVAL_NS = 10000000ULL;
+
+static void *cancel_later(void *args) {
+    nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 50000000}, NULL);
+    scheduler_cancel((Scheduler *) args);
+    return NULL;
+}
+
+int main(void) {
+    assert(scheduler_create((struct timespec) {.tv_sec = 0, .tv_nsec = 9999999}) == NULL);
+
+    Scheduler *scheduler = scheduler_create((struct timespec) {.tv_sec = 0, .tv_nsec = (long) INTERVAL_NS});
+    assert(scheduler != NULL);
+
+    //Work inside a tick does not shift the following deadlines. A loaded runner may still miss a tick now and then,
+    //which is skipped and counted, so every deadline stays on the grid of the first one.
+    assert(scheduler_wait_next(scheduler));
+    uint64_t first = scheduler_get_deadline(scheduler);
+    for (size_t i = 0; i < 20; i++) {
+        nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 3000000}, NULL);
+        assert(scheduler_wait_next(scheduler));
+        uint64_t deadline = scheduler_get_deadline(scheduler);
+        assert(deadline == first + (i + 1 + scheduler_get_missed_deadlines(scheduler)) * INTERVAL_NS);
+        assert(scheduler_monotonic_now_ns() >= deadline);
+    }
+
+    //A stall of several intervals is skipped in one go and keeps the phase.
+    uint64_t missed = scheduler_get_missed_deadlines(scheduler);
+    nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 45000000}, NULL);
+    assert(scheduler_wait_next(scheduler));
+    assert(scheduler_get_missed_deadlines(scheduler) - missed >= 4);
+    assert((scheduler_get_deadline(scheduler) - first) % INTERVAL_NS == 0);
+    scheduler_destroy(scheduler);
+
+    //Cancelling cuts a long sleep short.
+    scheduler = scheduler_create((struct timespec) {.tv_sec = 10, .tv_nsec = 0});
+    assert(scheduler != NULL);
+    pthread_t canceller;
+    assert(pthread_create(&canceller, NULL, cancel_later, scheduler) == 0);
+    uint64_t start = scheduler_monotonic_now_ns();
+    assert(!scheduler_wait_next(scheduler));
+    assert(scheduler_monotonic_now_ns() - start < 1000000000ULL);
+    pthread_join(canceller, NULL);
+    assert(!scheduler_wait_next(scheduler));
+    scheduler_destroy(scheduler);
+    logger_destroy(logger_get_global());
+    return 0;
+}
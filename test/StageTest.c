@@ -0,0 +1,279 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "../include/Stage.h"
+#include "../include/Queue.h"
+#include "../include/Watchdog.h"
+#include "../include/Logger.h"
+
+static const uintptr_t ITEMS_PER_SOURCE = 20000;
+static const struct timespec BUDGET = {.tv_sec = 2, .tv_nsec = 0};
+
+//Emits next, next + 2, ... up to last, one item per call. last = 0 never runs out.
+typedef struct Source {
+    uintptr_t next;
+    uintptr_t last;
+} Source;
+
+//Counts what reached it, items of a sink come from a single source and must stay in order.
+typedef struct Sink {
+    uintptr_t sum;
+    size_t count;
+    uintptr_t previous;
+} Sink;
+
+static atomic_size_t discard_count;
+
+static void sleep_ms(long milliseconds) {
+    struct timespec duration = {.tv_sec = milliseconds / 1000, .tv_nsec = milliseconds % 1000 * 1000000};
+    nanosleep(&duration, NULL);
+}
+
+static enum STAGE_STATUS source_process(Stage *stage, void *context, void *items[], size_t count) {
+    (void) items;
+    assert(count == 0);
+    Source *source = (Source *) context;
+
+    if (source->last != 0 && source->next > source->last) {
+        return STAGE_STATUS_FINISHED;
+    }
+    if (!stage_emit(stage, 0, (void *) source->next)) {
+        return STAGE_STATUS_STOPPED;
+    }
+    source->next += 2;
+    return STAGE_STATUS_CONTINUE;
+}
+
+//Even items go to output 0, odd ones to output 1.
+static enum STAGE_STATUS router_process(Stage *stage, void *context, void *items[], size_t count) {
+    (void) context;
+    assert(count > 0 && count <= STAGE_BATCH_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!stage_emit(stage, (uintptr_t) items[i] % 2, items[i])) {
+            return STAGE_STATUS_STOPPED;
+        }
+    }
+    return STAGE_STATUS_CONTINUE;
+}
+
+static void router_discard(void *context, size_t output, void *item) {
+    (void) context;
+    assert((uintptr_t) item % 2 == output);
+    atomic_fetch_add(&discard_count, 1);
+}
+
+static enum STAGE_STATUS sink_process(Stage *stage, void *context, void *items[], size_t count) {
+    (void) stage;
+    Sink *sink = (Sink *) context;
+
+    for (size_t i = 0; i < count; i++) {
+        uintptr_t item = (uintptr_t) items[i];
+        assert(item > sink->previous);
+        sink->previous = item;
+        sink->sum += item;
+        sink->count++;
+    }
+    return STAGE_STATUS_CONTINUE;
+}
+
+static enum STAGE_STATUS stall_process(Stage *stage, void *context, void *items[], size_t count) {
+    (void) context;
+    (void) items;
+    (void) count;
+    sleep_ms(1000);
+    return stage_should_stop_synchronized(stage) ? STAGE_STATUS_STOPPED : STAGE_STATUS_CONTINUE;
+}
+
+static Stage *create_source(const char name[], Source *source, Queue *output, Watchdog *watchdog) {
+    Queue *outputs[] = {output};
+    return stage_create(name, (StageOperations) {.process = &source_process, .discard = NULL, .wake = NULL},
+                        source, NULL, outputs, 1, watchdog, BUDGET);
+}
+
+static Stage *create_router(Queue *input, Queue *even, Queue *odd, Watchdog *watchdog) {
+    Queue *outputs[] = {even, odd};
+    return stage_create("router",
+                        (StageOperations) {.process = &router_process, .discard = &router_discard, .wake = NULL}, NULL,
+                        input, outputs, 2, watchdog, BUDGET);
+}
+
+static Stage *create_sink(const char name[], Sink *sink, Queue *input, Watchdog *watchdog) {
+    return stage_create(name, (StageOperations) {.process = &sink_process, .discard = NULL, .wake = NULL},
+                        sink, input, NULL, 0, watchdog, BUDGET);
+}
+
+static void start_all(Stage *const stages[], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        assert(stage_start(stages[i]));
+    }
+}
+
+static void drain(Queue *queue) {
+    while (queue_try_pop(queue) != NULL) {
+    }
+}
+
+int main(void)
+{
+    Watchdog *watchdog = watchdog_create(8);
+    assert(watchdog != NULL);
+    watchdog_start_watching(watchdog);
+    atomic_init(&discard_count, 0);
+
+    //Invalid arguments.
+    Queue *queue = queue_create(4);
+    Queue *outputs[STAGE_MAX_OUTPUTS + 1] = {queue};
+    assert(stage_create(NULL, (StageOperations) {.process = &sink_process}, NULL, queue, NULL, 0, watchdog, BUDGET) ==
+           NULL);
+    assert(stage_create("a", (StageOperations) {.process = NULL}, NULL, queue, NULL, 0, watchdog, BUDGET) == NULL);
+    assert(stage_create("a", (StageOperations) {.process = &sink_process}, NULL, queue, NULL, 0, NULL, BUDGET) == NULL);
+    assert(stage_create("a", (StageOperations) {.process = &sink_process}, NULL, queue, outputs, 2, watchdog, BUDGET) ==
+           NULL);
+    assert(stage_create("a", (StageOperations) {.process = &sink_process}, NULL, queue, outputs, STAGE_MAX_OUTPUTS + 1,
+                        watchdog, BUDGET) == NULL);
+    assert(watchdog_get_registered_count(watchdog) == 0);
+    queue_destroy(queue);
+
+    //A second producer on an SPSC queue is rejected and leaves the first one's registration alone.
+    queue = queue_create_with_mode(4, QUEUE_MODE_SPSC);
+    Source rejected_source = {.next = 1, .last = 0};
+    queue_add_producer(queue);
+    assert(create_source("rejected source", &rejected_source, queue, watchdog) == NULL);
+    assert(watchdog_get_registered_count(watchdog) == 0);
+    assert(!queue_is_closed(queue));
+    queue_release_producer(queue);
+    assert(queue_is_closed(queue));
+    queue_destroy(queue);
+
+    //A source that runs out right away does not close the queue it shares with a source that starts later, both
+    //registered as producers when they were created. A created stage only runs once started.
+    Queue *fan_in = queue_create_with_mode(64, QUEUE_MODE_LOCKED);
+    Source empty_source = {.next = 3, .last = 1};
+    Source late_source = {.next = 1, .last = 99};
+    Sink fan_in_sink = {0};
+    Stage *empty_source_stage = create_source("empty source", &empty_source, fan_in, watchdog);
+    Stage *late_source_stage = create_source("late source", &late_source, fan_in, watchdog);
+    Stage *fan_in_sink_stage = create_sink("fan in sink", &fan_in_sink, fan_in, watchdog);
+    assert(empty_source_stage != NULL && late_source_stage != NULL && fan_in_sink_stage != NULL);
+    assert(!stage_is_finished(empty_source_stage) && queue_is_empty(fan_in));
+    assert(stage_start(empty_source_stage));
+    assert(!stage_start(empty_source_stage));
+    while (!stage_is_finished(empty_source_stage)) {
+        sleep_ms(1);
+    }
+    stage_await_and_destroy(empty_source_stage);
+    assert(!queue_is_closed(fan_in));
+    start_all((Stage *[]) {late_source_stage, fan_in_sink_stage}, 2);
+    stage_await_and_destroy(late_source_stage);
+    stage_await_and_destroy(fan_in_sink_stage);
+    assert(fan_in_sink.count == 50 && fan_in_sink.sum == 50 * 50);
+    assert(queue_is_closed(fan_in));
+    queue_destroy(fan_in);
+
+    //A stage that is never started ends on destroy like one whose thread ran, its outputs are released.
+    fan_in = queue_create_with_mode(4, QUEUE_MODE_SPSC);
+    Stage *unstarted = create_source("unstarted source", &late_source, fan_in, watchdog);
+    assert(unstarted != NULL && !queue_is_closed(fan_in));
+    stage_await_and_destroy(unstarted);
+    assert(queue_is_closed(fan_in) && queue_is_empty(fan_in));
+    assert(watchdog_get_registered_count(watchdog) == 0);
+    queue_destroy(fan_in);
+
+    //Two sources fan in to the router through one locked queue, the router fans out to two sinks. Once both sources
+    //ran out the last producer closes the shared queue and the whole topology drains and finishes.
+    Queue *shared = queue_create_with_mode(64, QUEUE_MODE_LOCKED);
+    Queue *even = queue_create_with_mode(16, QUEUE_MODE_SPSC);
+    Queue *odd = queue_create_with_mode(16, QUEUE_MODE_SPSC);
+    Source odd_source = {.next = 1, .last = 2 * ITEMS_PER_SOURCE - 1};
+    Source even_source = {.next = 2, .last = 2 * ITEMS_PER_SOURCE};
+    Sink even_sink = {0};
+    Sink odd_sink = {0};
+
+    Stage *even_sink_stage = create_sink("even sink", &even_sink, even, watchdog);
+    Stage *odd_sink_stage = create_sink("odd sink", &odd_sink, odd, watchdog);
+    Stage *router = create_router(shared, even, odd, watchdog);
+    Stage *odd_source_stage = create_source("odd source", &odd_source, shared, watchdog);
+    Stage *even_source_stage = create_source("even source", &even_source, shared, watchdog);
+    assert(even_sink_stage != NULL && odd_sink_stage != NULL && router != NULL && odd_source_stage != NULL &&
+           even_source_stage != NULL);
+    start_all((Stage *[]) {even_sink_stage, odd_sink_stage, router, odd_source_stage, even_source_stage}, 5);
+    assert(watchdog_get_registered_count(watchdog) == 5);
+
+    while (!stage_is_finished(even_sink_stage) || !stage_is_finished(odd_sink_stage)) {
+        sleep_ms(10);
+    }
+    assert(stage_is_finished(odd_source_stage) && stage_is_finished(even_source_stage) && stage_is_finished(router));
+    stage_await_and_destroy(odd_source_stage);
+    stage_await_and_destroy(even_source_stage);
+    stage_await_and_destroy(router);
+    stage_await_and_destroy(even_sink_stage);
+    stage_await_and_destroy(odd_sink_stage);
+    assert(watchdog_get_registered_count(watchdog) == 0);
+
+    assert(even_sink.count == ITEMS_PER_SOURCE && odd_sink.count == ITEMS_PER_SOURCE);
+    assert(even_sink.sum == ITEMS_PER_SOURCE * (ITEMS_PER_SOURCE + 1));
+    assert(odd_sink.sum == ITEMS_PER_SOURCE * ITEMS_PER_SOURCE);
+    assert(atomic_load(&discard_count) == 0);
+    assert(queue_is_closed(shared) && queue_is_closed(even) && queue_is_closed(odd));
+    queue_destroy(shared);
+    queue_destroy(even);
+    queue_destroy(odd);
+
+    //Endless sources. Stopping one sink ends the router, whose closed input ends both sources, and closes the other
+    //sink's queue.
+    shared = queue_create_with_mode(64, QUEUE_MODE_LOCKED);
+    even = queue_create_with_mode(16, QUEUE_MODE_SPSC);
+    odd = queue_create_with_mode(16, QUEUE_MODE_SPSC);
+    odd_source = (Source) {.next = 1, .last = 0};
+    even_source = (Source) {.next = 2, .last = 0};
+    even_sink = (Sink) {0};
+    odd_sink = (Sink) {0};
+
+    even_sink_stage = create_sink("even sink", &even_sink, even, watchdog);
+    odd_sink_stage = create_sink("odd sink", &odd_sink, odd, watchdog);
+    router = create_router(shared, even, odd, watchdog);
+    odd_source_stage = create_source("odd source", &odd_source, shared, watchdog);
+    even_source_stage = create_source("even source", &even_source, shared, watchdog);
+    assert(even_sink_stage != NULL && odd_sink_stage != NULL && router != NULL && odd_source_stage != NULL &&
+           even_source_stage != NULL);
+    start_all((Stage *[]) {even_sink_stage, odd_sink_stage, router, odd_source_stage, even_source_stage}, 5);
+
+    sleep_ms(200);
+    stage_request_stop_synchronized(even_sink_stage);
+    assert(stage_should_stop_synchronized(even_sink_stage));
+    stage_await_and_destroy(odd_source_stage);
+    stage_await_and_destroy(even_source_stage);
+    stage_await_and_destroy(router);
+    stage_await_and_destroy(even_sink_stage);
+    stage_await_and_destroy(odd_sink_stage);
+    assert(watchdog_get_registered_count(watchdog) == 0);
+    assert(!watchdog_was_triggered(watchdog));
+    assert(even_sink.count > 0 && odd_sink.count > 0);
+    drain(shared);
+    drain(even);
+    drain(odd);
+    queue_destroy(shared);
+    queue_destroy(even);
+    queue_destroy(odd);
+
+    //A stage stuck in process misses its budget and is stopped by the watchdog like any other.
+    queue = queue_create(4);
+    queue_insert(queue, (void *) (uintptr_t) 1);
+    Stage *stalled = stage_create("stalled", (StageOperations) {.process = &stall_process}, NULL, queue, NULL, 0,
+                                  watchdog, (struct timespec) {.tv_sec = 0, .tv_nsec = 300000000});
+    assert(stalled != NULL && stage_start(stalled));
+    assert(stage_get_wait_timeout(stalled).tv_nsec == 75000000);
+    stage_await_and_destroy(stalled);
+    assert(watchdog_was_triggered(watchdog));
+    assert(!stage_is_finished(NULL));
+    queue_destroy(queue);
+
+    watchdog_await_and_destroy(watchdog);
+
+    logger_destroy(logger_get_global());
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "../include/StatParser.h"
+#include "../include/StatGenerator.h"
+#include "../include/Logger.h"
+
+static void assert_number(const char input[], const unsigned long long int expected, const size_t digits) {
+    const char *cursor = input;
+    assert(stat_parser_parse_number(&cursor, input + strlen(input)) == expected);
+    assert(cursor == input + digits);
+}
+
+int main(void) {
+    //Every length around the eight digit chunk boundary, with and without trailing bytes in the same word.
+    assert_number("0", 0, 1);
+    assert_number("7 ", 7, 1);
+    assert_number("1234567", 1234567, 7);
+    assert_number("12345678", 12345678, 8);
+    assert_number("12345678 1", 12345678, 8);
+    assert_number("123456789", 123456789, 9);
+    assert_number("1234567890123456 99", 1234567890123456ULL, 16);
+    assert_number("18446744073709551615\n", 18446744073709551615ULL, 20);
+    assert_number("000042xyzxyzxyz", 42, 6);
+    assert_number("x1", 0, 0);
+
+    const char input[] = "cpu  10 1 5 100 4 1 1 2 3 0\n"
+                         "cpu0 6 1 3 50 2 1 0 1 3 0\n"
+                         "cpu1 4 0 2 50 2 0 1 1 0 0\n"
+                         "intr 123 cpu 1 2 3\n"
+                         "ctxt 1\n";
+    CpuData rows[4];
+    assert(stat_parser_parse(input, strlen(input), rows, 4) == 3);
+    assert(rows[0].cpu_id == STAT_PARSER_AGGREGATE_ID);
+    assert(rows[1].cpu_id == 0 && rows[2].cpu_id == 1);
+    assert(rows[0].idle_time == 104 && rows[0].total_time == 124);
+    assert(rows[1].idle_time == 52 && rows[1].total_time == 64);
+    assert(rows[2].idle_time == 52 && rows[2].total_time == 60);
+    //Every raw column is kept, guest time included.
+    const unsigned long long int columns[STAT_PARSER_COLUMN_COUNT] = {6, 1, 3, 50, 2, 1, 0, 1, 3, 0};
+    assert(memcmp(rows[1].columns, columns, sizeof(columns)) == 0);
+
+    //Rows beyond capacity are counted, not stored.
+    CpuData single[1];
+    assert(stat_parser_parse(input, strlen(input), single, 1) == 3);
+    assert(single[0].total_time == 124);
+
+    //Offline cores leave gaps in the ids.
+    const char hotplug_input[] = "cpu  1 1 1 1\ncpu0 1 1 1 1\ncpu17 2 2 2 2\ncpu123 3 3 3 3\nintr 0\n";
+    assert(stat_parser_parse(hotplug_input, strlen(hotplug_input), rows, 4) == 4);
+    assert(rows[1].cpu_id == 0 && rows[2].cpu_id == 17 && rows[3].cpu_id == 123);
+    assert(rows[3].total_time == 12);
+
+    //Older kernels report fewer columns.
+    const char short_input[] = "cpu 1 2 3 4\ncpu0 1 2 3 4";
+    assert(stat_parser_parse(short_input, strlen(short_input), rows, 4) == 2);
+    assert(rows[1].idle_time == 4 && rows[1].total_time == 10);
+    assert(rows[1].columns[STAT_PARSER_COLUMN_IDLE] == 4 && rows[1].columns[STAT_PARSER_COLUMN_IOWAIT] == 0 &&
+           rows[1].columns[STAT_PARSER_COLUMN_GUEST_NICE] == 0);
+
+    //Matches the previous sscanf based implementation on a large synthetic snapshot.
+    StatGenerator *generator = stat_generator_create(512, 7);
+    stat_generator_advance(generator, 100);
+    char probe[1];
+    size_t capacity = stat_generator_render(generator, probe, sizeof(probe)) + 1;
+    char *snapshot = malloc(capacity);
+    assert(snapshot != NULL);
+    size_t length = stat_generator_render(generator, snapshot, capacity);
+    CpuData *parsed = malloc(sizeof(CpuData) * 513);
+    assert(stat_parser_parse(snapshot, length, parsed, 513) == 513);
+
+    char *line = strtok(snapshot, "\n");
+    for (size_t i = 0; i < 513; i++) {
+        unsigned long long int user, nice, system, idle, io_wait, irq, soft_irq, steal, guest, guest_nice;
+        assert(sscanf(line, "%*s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle,
+                      &io_wait, &irq, &soft_irq, &steal, &guest, &guest_nice) == 10);
+        assert(parsed[i].idle_time == idle + io_wait);
+        assert(parsed[i].total_time == user + nice + system + idle + io_wait + irq + soft_irq + steal);
+        line = strtok(NULL, "\n");
+    }
+
+    free(parsed);
+    free(snapshot);
+    stat_generator_destroy(generator);
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../include/TerminalRenderer.h"
+#include "../include/SampleFrame.h"
+#include "../include/Logger.h"
+
+#define CPU_COUNT 384
+#define LARGE_CPU_COUNT 4096
+#define TERMINAL_ROWS 24
+
+static char output_path[] = "/tmp/TietoTerminalRendererTestXXXXXX";
+
+//Everything the renderer wrote since the last call.
+static size_t read_output(const int fd, char content[], const size_t capacity, off_t *const offset) {
+    ssize_t length = pread(fd, content, capacity - 1, *offset);
+    assert(length >= 0);
+    content[length] = '\0';
+    *offset += length;
+    return (size_t) length;
+}
+
+//Everything the renderer wrote to the terminal since the last call, read off the pty master.
+static size_t read_terminal(const int master, char content[], const size_t capacity) {
+    size_t length = 0;
+    ssize_t bytes;
+    while (length + 1 < capacity && (bytes = read(master, content + length, capacity - 1 - length)) > 0) {
+        length += (size_t) bytes;
+    }
+    content[length] = '\0';
+    return length;
+}
+
+//No cursor move may leave the terminal, whatever is drawn below it is lost.
+static void assert_within_rows(const char content[]) {
+    for (const char *move = strstr(content, "\x1b["); move != NULL; move = strstr(move + 1, "\x1b[")) {
+        char *end;
+        unsigned long row = strtoul(move + 2, &end, 10);
+        assert(*end != ';' || (row >= 1 && row <= TERMINAL_ROWS));
+    }
+}
+
+static void fill_frame(SampleFrame *frame) {
+    for (size_t i = 0; i <= frame->cpu_count; i++) {
+        frame->utilization[i] = (uint16_t) (i * 25 % (SAMPLE_FRAME_FULL_LOAD + 1));
+    }
+    frame->utilization[1] = SAMPLE_FRAME_FULL_LOAD;
+    frame->utilization[2] = SAMPLE_FRAME_OFFLINE;
+    frame->windows[ROLLING_WINDOW_SPAN_10_SECONDS] = (RollingWindowStats) {
+            .sample_count = 10, .min = 100, .max = 9000, .mean = 4500, .p95 = 8800, .p99 = 8950
+    };
+    frame->process_count = 1;
+    frame->processes[0] = (SampleFrameProcess) {.pid = 4242, .utilization = 15000};
+    strcpy(frame->processes[0].command, "stress");
+}
+
+//Many CPUs in an 80x24 terminal: labelled cells would take 77 rows, compact rows fit every CPU above the windows and
+//processes. Far more CPUs than fit are counted instead.
+static void test_small_terminal(char content[], const size_t capacity) {
+    //The pty ioctls directly, posix_openpt and friends are hidden without _XOPEN_SOURCE.
+    int master = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+    unsigned int pty_number;
+    int unlock = 0;
+    assert(master >= 0 && ioctl(master, TIOCGPTN, &pty_number) == 0 && ioctl(master, TIOCSPTLCK, &unlock) == 0);
+    char pty_path[32];
+    snprintf(pty_path, sizeof(pty_path), "/dev/pts/%u", pty_number);
+    int terminal = open(pty_path, O_RDWR | O_NOCTTY);
+    assert(terminal >= 0);
+    struct termios attributes;
+    assert(tcgetattr(terminal, &attributes) == 0);
+    cfmakeraw(&attributes);
+    assert(tcsetattr(terminal, TCSANOW, &attributes) == 0);
+    struct winsize size = {.ws_row = TERMINAL_ROWS, .ws_col = 80};
+    assert(ioctl(terminal, TIOCSWINSZ, &size) == 0);
+    assert(fcntl(master, F_SETFL, O_NONBLOCK) == 0);
+
+    TerminalRenderer *renderer = terminal_renderer_create(terminal);
+    SampleFrame *frame = sample_frame_create(CPU_COUNT);
+    assert(renderer != NULL && frame != NULL);
+    fill_frame(frame);
+
+    assert(terminal_renderer_draw(renderer, frame));
+    read_terminal(master, content, capacity);
+    assert_within_rows(content);
+    assert(strstr(content, "CPU0   #x") != NULL);
+    assert(strstr(content, "CPU320 ") != NULL);
+    assert(strstr(content, "not shown") == NULL);
+    assert(strstr(content, "WINDOW") != NULL && strstr(content, "stress") != NULL);
+
+    //A changed CPU is a single character.
+    frame->utilization[101] = 5000;
+    assert(terminal_renderer_draw(renderer, frame));
+    size_t changed_length = read_terminal(master, content, capacity);
+    assert(changed_length < 16 && content[changed_length - 1] == '5');
+
+    SampleFrame *large = sample_frame_create(LARGE_CPU_COUNT);
+    assert(large != NULL);
+    fill_frame(large);
+    assert(terminal_renderer_draw(renderer, large));
+    read_terminal(master, content, capacity);
+    assert_within_rows(content);
+    assert(strstr(content, "CPU256  ") != NULL && strstr(content, "CPU320 ") == NULL);
+    assert(strstr(content, "+3776 CPUs not shown") != NULL);
+    assert(strstr(content, "stress") != NULL);
+
+    sample_frame_destroy(large);
+    sample_frame_destroy(frame);
+    terminal_renderer_destroy(renderer);
+    close(terminal);
+    close(master);
+}
+
+int main(void) {
+    int fd = mkstemp(output_path);
+    assert(fd >= 0);
+    size_t capacity = 1024 * 1024;
+    char *content = malloc(capacity);
+    assert(content != NULL);
+    off_t offset = 0;
+
+    TerminalRenderer *renderer = terminal_renderer_create(fd);
+    assert(renderer != NULL);
+
+    SampleFrame *frame = sample_frame_create(CPU_COUNT);
+    assert(frame != NULL);
+    for (size_t i = 0; i <= CPU_COUNT; i++) {
+        frame->utilization[i] = (uint16_t) (i * 25);
+    }
+    frame->utilization[CPU_COUNT] = SAMPLE_FRAME_OFFLINE;
+    frame->utilization[1] = SAMPLE_FRAME_FULL_LOAD;
+
+    //The first frame clears the screen and draws every cell.
+    assert(terminal_renderer_draw(renderer, frame));
+    size_t full_length = read_output(fd, content, capacity, &offset);
+    assert(strncmp(content, "\x1b[H\x1b[2J", 7) == 0);
+    assert(strstr(content, "CPU: ") != NULL);
+    assert(strstr(content, "CPU0  ") != NULL);
+    assert(strstr(content, "CPU383") != NULL);
+    assert(strstr(content, "100.00%") != NULL);
+    assert(strstr(content, "offline") != NULL);
+    assert(strstr(content, "  9.50%") != NULL);
+    assert(terminal_renderer_get_bytes_written(renderer) == full_length);
+
+    //Nothing changed, nothing is written.
+    assert(terminal_renderer_draw(renderer, frame));
+    assert(read_output(fd, content, capacity, &offset) == 0);
+
+    //One core changes: one cursor move and one value, no clear.
+    frame->utilization[101] = 1234;
+    assert(terminal_renderer_draw(renderer, frame));
+    size_t changed_length = read_output(fd, content, capacity, &offset);
+    assert(strstr(content, "\x1b[2J") == NULL);
+    assert(strstr(content, " 12.34%") != NULL);
+    assert(changed_length < 32);
+
+    //A quarter of the cores change: still far below a full redraw.
+    for (size_t i = 1; i <= CPU_COUNT; i += 4) {
+        frame->utilization[i] = (uint16_t) (frame->utilization[i] + 1);
+    }
+    assert(terminal_renderer_draw(renderer, frame));
+    changed_length = read_output(fd, content, capacity, &offset);
+    printf("Full frame: %zu bytes, quarter of %d cores changed: %zu bytes.\n", full_length, CPU_COUNT,
+           changed_length);
+    assert(changed_length * 3 < full_length);
+
+    //Windows and processes are rewritten line by line, the grid stays.
+    frame->windows[ROLLING_WINDOW_SPAN_10_SECONDS] = (RollingWindowStats) {
+            .sample_count = 10, .min = 100, .max = 9000, .mean = 4500, .p95 = 8800, .p99 = 8950
+    };
+    frame->process_count = 1;
+    frame->processes[0] = (SampleFrameProcess) {.pid = 4242, .utilization = 15000};
+    strcpy(frame->processes[0].command, "stress");
+    assert(terminal_renderer_draw(renderer, frame));
+    read_output(fd, content, capacity, &offset);
+    assert(strstr(content, "WINDOW") == NULL);
+    assert(strstr(content, "10s      1.00%  45.00%  90.00%  88.00%  89.50%") != NULL);
+    assert(strstr(content, "4242     150.00%  stress") != NULL);
+
+    //Lines that disappear are cleared.
+    frame->process_count = 0;
+    assert(terminal_renderer_draw(renderer, frame));
+    read_output(fd, content, capacity, &offset);
+    assert(strstr(content, "\x1b[K") != NULL);
+    assert(strstr(content, "stress") == NULL);
+
+    //A different CPU count changes the layout, the screen is drawn anew.
+    SampleFrame *smaller = sample_frame_create(4);
+    assert(smaller != NULL);
+    for (size_t i = 0; i <= 4; i++) {
+        smaller->utilization[i] = 0;
+    }
+    assert(terminal_renderer_draw(renderer, smaller));
+    read_output(fd, content, capacity, &offset);
+    assert(strncmp(content, "\x1b[H\x1b[2J", 7) == 0);
+    assert(strstr(content, "CPU3") != NULL && strstr(content, "CPU4") == NULL);
+
+    sample_frame_destroy(smaller);
+    sample_frame_destroy(frame);
+    terminal_renderer_destroy(renderer);
+    close(fd);
+    unlink(output_path);
+
+    test_small_terminal(content, capacity);
+    free(content);
+
+    logger_destroy(logger_get_global());
+    return 0;
+}
@@ -1,7 +1,7 @@
-#include <unistd.h>
 #include <assert.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <time.h>
 #include "../include/Watchdog.h"
 #include "../include/Logger.h"
 
@@ -10,6 +10,7 @@ static int objectA = 2;
 static int objectB = 8;
 static bool flagA = false;
 static bool flagB = false;
+static int stop_count = 0;
 
 static void stopA(void *object) {
     assert(&objectA == object);
@@ -27,32 +28,36 @@ static void stopB(void *object) {
     pthread_mutex_unlock(&mutex);
 }
 
+static void count_stop(void *object) {
+    (void) object;
+
+    pthread_mutex_lock(&mutex);
+    stop_count++;
+    pthread_mutex_unlock(&mutex);
+}
+
+static void sleep_ms(long milliseconds) {
+    struct timespec duration = {.tv_sec = milliseconds / 1000, .tv_nsec = milliseconds % 1000 * 1000000};
+    nanosleep(&duration, NULL);
+}
+
 int main(void) {
+    //A is a fast stage with a tight budget, B a slow one with a loose budget.
     Watchdog *watchdog = watchdog_create(2);
-    size_t a = watchdog_register_watch(watchdog, &stopA, &objectA);
-    size_t b = watchdog_register_watch(watchdog, &stopB, &objectB);
+    struct timespec budget_a = {.tv_sec = 0, .tv_nsec = 300000000};
+    struct timespec budget_b = {.tv_sec = 3, .tv_nsec = 0};
+    size_t a = watchdog_register_watch(watchdog, &stopA, &objectA, budget_a);
+    size_t b = watchdog_register_watch(watchdog, &stopB, &objectB, budget_b);
+    assert(a == 0 && b == 1);
     watchdog_update(watchdog, a);
     watchdog_update(watchdog, b);
     watchdog_start_watching(watchdog);
 
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
+    //B staying silent for 1.5 s is within its budget.
+    for (int i = 0; i < 15; i++) {
+        sleep_ms(100);
+        watchdog_update(watchdog, a);
+    }
 
     pthread_mutex_lock(&mutex);
     assert(!flagA && !flagB);
@@ -60,11 +65,12 @@ int main(void) {
 
     assert(!watchdog_was_triggered(watchdog));
 
-    sleep(1);
-    watchdog_update(watchdog, a);
-    watchdog_update(watchdog, b);
+    //A going silent trips well before B's budget would.
+    for (int i = 0; i < 8; i++) {
+        sleep_ms(100);
+        watchdog_update(watchdog, b);
+    }
 
-    sleep(4);
     pthread_mutex_lock(&mutex);
     assert(flagA && flagB);
     pthread_mutex_unlock(&mutex);
@@ -73,6 +79,57 @@ int main(void) {
     assert(watchdog_was_triggered(watchdog));
     watchdog_await_and_destroy(watchdog);
 
+    //Workers come and go at runtime. Budgets from 100 ms to 1.5 s put deadlines on two levels of the wheel.
+    enum {DYNAMIC_WATCHES = 300, REUSED_WATCHES = 10};
+    bool live[DYNAMIC_WATCHES];
+    watchdog = watchdog_create(1);
+    for (size_t i = 0; i < DYNAMIC_WATCHES; i++) {
+        struct timespec budget = {.tv_sec = 0, .tv_nsec = 100000000L + (long) (i % 8) * 200000000L};
+        if (budget.tv_nsec >= 1000000000L) {
+            budget.tv_sec++;
+            budget.tv_nsec -= 1000000000L;
+        }
+        assert(watchdog_register_watch(watchdog, &count_stop, NULL, budget) == i);
+        live[i] = true;
+    }
+    assert(watchdog_get_registered_count(watchdog) == DYNAMIC_WATCHES);
+    watchdog_start_watching(watchdog);
+
+    for (int round = 0; round < 40; round++) {
+        sleep_ms(50);
+        for (size_t i = 0; i < DYNAMIC_WATCHES; i++) {
+            if (live[i]) {
+                watchdog_update(watchdog, i);
+            }
+        }
+        if (round == 20) {
+            for (size_t i = 0; i < DYNAMIC_WATCHES; i += 2) {
+                watchdog_unregister_watch(watchdog, i);
+                live[i] = false;
+            }
+            assert(watchdog_get_registered_count(watchdog) == DYNAMIC_WATCHES / 2);
+            //Freed indices are handed out again before new ones.
+            for (size_t i = 0; i < REUSED_WATCHES; i++) {
+                size_t index = watchdog_register_watch(watchdog, &count_stop, NULL,
+                                                       (struct timespec) {.tv_sec = 0, .tv_nsec = 200000000L});
+                assert(index < DYNAMIC_WATCHES && index % 2 == 0 && !live[index]);
+                live[index] = true;
+            }
+        }
+    }
+    assert(!watchdog_was_triggered(watchdog));
+    assert(watchdog_get_registered_count(watchdog) == DYNAMIC_WATCHES / 2 + REUSED_WATCHES);
+
+    //Only the watches still registered are stopped.
+    sleep_ms(2000);
+    assert(watchdog_was_triggered(watchdog));
+    pthread_mutex_lock(&mutex);
+    assert(stop_count == DYNAMIC_WATCHES / 2 + REUSED_WATCHES);
+    pthread_mutex_unlock(&mutex);
+    watchdog_unregister_watch(watchdog, 1);
+    assert(watchdog_get_registered_count(watchdog) == DYNAMIC_WATCHES / 2 + REUSED_WATCHES - 1);
+    watchdog_await_and_destroy(watchdog);
+
     pthread_mutex_destroy(&mutex);
 
     logger_destroy(logger_get_global());